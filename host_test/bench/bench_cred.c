@@ -0,0 +1,92 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * Credential store cost at one capacity, CONFIG_LOCK_CRED_MAX_USERS, which
+ * CMake sets per build of this program (10, 1000 and 10000).  The store is
+ * filled to capacity, then verify() is timed for PINs that match a user
+ * and PINs that match none, and the static RAM the index holds is
+ * reported.  Every PIN is re-checked, so the run is also a test.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "host_app.h"
+#include "cred_store.h"
+
+#define BENCH_LOOKUPS           5000
+#define BENCH_PIN_LEN           8
+
+static void
+bench_pin(uint32_t n, char pin[BENCH_PIN_LEN + 1])
+{
+    /* Above every 6-digit default */
+    snprintf(pin, BENCH_PIN_LEN + 1, "%08u", (unsigned)(10000000 + n));
+}
+
+int
+main(void)
+{
+    static int64_t hit_us[BENCH_LOOKUPS];
+    static int64_t miss_us[BENCH_LOOKUPS];
+    uint16_t users = CONFIG_LOCK_CRED_MAX_USERS;
+    uint16_t added = 0;
+    char pin[BENCH_PIN_LEN + 1];
+    uint16_t user;
+    int64_t t0;
+    int64_t add_us;
+
+    HOST_CHECK(cred_store_init() == ESP_OK);
+    /* The default PIN takes one slot */
+    t0 = esp_timer_get_time();
+    while (cred_store_count() < users)
+    {
+        bench_pin(added++, pin);
+        HOST_CHECK(cred_store_add(pin, BENCH_PIN_LEN, CRED_DOORS_ALL, &user) == ESP_OK);
+    }
+    add_us = esp_timer_get_time() - t0;
+    bench_pin(added, pin);
+    HOST_CHECK(cred_store_add(pin, BENCH_PIN_LEN, CRED_DOORS_ALL, &user) != ESP_OK);
+
+    for (int i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        uint32_t n = (uint32_t)i * 7919 % added;
+
+        bench_pin(n, pin);
+        t0 = esp_timer_get_time();
+        HOST_CHECK(cred_store_verify(pin, BENCH_PIN_LEN, &user, NULL) == ESP_OK);
+        hit_us[i] = esp_timer_get_time() - t0;
+
+        bench_pin(added + i, pin);
+        t0 = esp_timer_get_time();
+        HOST_CHECK(cred_store_verify(pin, BENCH_PIN_LEN, &user, NULL) == ESP_ERR_NOT_FOUND);
+        miss_us[i] = esp_timer_get_time() - t0;
+    }
+
+    /* Revoking one user leaves every other one in place */
+    bench_pin(0, pin);
+    HOST_CHECK(cred_store_verify(pin, BENCH_PIN_LEN, &user, NULL) == ESP_OK);
+    HOST_CHECK(cred_store_revoke(user) == ESP_OK);
+    HOST_CHECK(cred_store_verify(pin, BENCH_PIN_LEN, &user, NULL) == ESP_ERR_NOT_FOUND);
+    for (uint32_t n = 1; n < added; n++)
+    {
+        bench_pin(n, pin);
+        HOST_CHECK(cred_store_verify(pin, BENCH_PIN_LEN, &user, NULL) == ESP_OK);
+    }
+
+    printf("users %u: RAM %zu B (%.1f B/user), add %.1f us/user\n",
+           users, cred_store_ram(), (double)cred_store_ram() / users,
+           (double)add_us / added);
+    printf("verify hit  p50 %4lld us  p99 %4lld us\n",
+           (long long)host_percentile(hit_us, BENCH_LOOKUPS, 50),
+           (long long)host_percentile(hit_us, BENCH_LOOKUPS, 99));
+    printf("verify miss p50 %4lld us  p99 %4lld us\n",
+           (long long)host_percentile(miss_us, BENCH_LOOKUPS, 50),
+           (long long)host_percentile(miss_us, BENCH_LOOKUPS, 99));
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * Per-door latency with 1 .. CONFIG_LOCK_DOOR_COUNT doors unlocked at
+ * once.  Three centrals in binary mode each unlock their share of the
+ * doors in the same instant; for every door the time from its UNLOCK write
+ * to the start of its servo fade and to the door being held open is
+ * recorded.  Neither may grow with the number of doors moving.
+ *
+ * Usage: bench_doors [rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host_ble.h"
+#include "host_hal.h"
+#include "host_app.h"
+#include "actuator.h"
+#include "frame_parser.h"
+#include "lock_proto.h"
+
+#define BENCH_SPP_UUID          0xABF1
+#define BENCH_LINKS             CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#define BENCH_ROUNDS_MAX        50
+/* Host scheduling noise allowed on top of a lone door's figures; far
+ * less than the servo move that waiting on another door would add */
+#define BENCH_SLACK_US          5000
+#define BENCH_OPEN_SLACK_US     (CONFIG_LOCK_SERVO_TRAVEL_MS * 1000 / 4)
+
+typedef struct
+{
+    pthread_t thread;
+    uint16_t conn;
+    uint8_t doors;              /* Mask this central unlocks in a round */
+    uint8_t seq;
+} bench_link_t;
+
+static bench_link_t links[BENCH_LINKS];
+static uint16_t spp;
+static int64_t write_at[ACTUATOR_DOORS];
+
+static void
+send_frame(bench_link_t *l, uint8_t op, const uint8_t *tlv, uint8_t tlv_len)
+{
+    uint8_t frame[3 + LOCK_PROTO_HDR_LEN + 32];
+    uint8_t reply[64];
+    lock_msg_t msg;
+    uint8_t res;
+    int n;
+
+    frame[0] = FRAME_BIN_MAGIC;
+    frame[1] = LOCK_PROTO_HDR_LEN + tlv_len;
+    frame[2] = 0;
+    frame[3] = op;
+    frame[4] = ++l->seq;
+    memcpy(&frame[5], tlv, tlv_len);
+    HOST_CHECK(host_ble_write(l->conn, spp, frame, 5 + tlv_len) == 0);
+    n = host_ble_notify_wait(l->conn, spp, reply, sizeof reply, 1000, NULL);
+    HOST_CHECK(n > 3 && reply[0] == FRAME_BIN_MAGIC);
+    HOST_CHECK(lock_proto_decode(&reply[3], n - 3, &msg) == ESP_OK);
+    HOST_CHECK(msg.op == (op | LOCK_OP_REPLY) && msg.seq == l->seq);
+    HOST_CHECK(lock_proto_get_u8(&msg, LOCK_TLV_RESULT, &res) && res == LOCK_RES_OK);
+}
+
+static void *
+link_run(void *arg)
+{
+    bench_link_t *l = arg;
+    const char *pin = CONFIG_LOCK_DEFAULT_PIN;
+    uint8_t pin_len = strlen(pin);
+
+    for (uint8_t door = 0; door < ACTUATOR_DOORS; door++)
+    {
+        uint8_t tlv[4 + 16] = { LOCK_TLV_DOOR, 1, door, LOCK_TLV_CODE, pin_len };
+
+        if (!(l->doors & 1u << door))
+        {
+            continue;
+        }
+        memcpy(&tlv[5], pin, pin_len);
+        write_at[door] = esp_timer_get_time();
+        send_frame(l, LOCK_OP_UNLOCK, tlv, 5 + pin_len);
+    }
+    return NULL;
+}
+
+static void
+wait_all(actuator_state_t state, uint8_t doors, int64_t *at)
+{
+    int64_t deadline = esp_timer_get_time() + 5000000;
+    uint8_t left = doors;
+
+    while (left != 0)
+    {
+        HOST_CHECK(esp_timer_get_time() < deadline);
+        for (uint8_t door = 0; door < ACTUATOR_DOORS; door++)
+        {
+            if ((left & 1u << door) && actuator_get_state(door) == state)
+            {
+                left &= ~(1u << door);
+                if (at != NULL)
+                {
+                    at[door] = esp_timer_get_time();
+                }
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    static int64_t fade_us[ACTUATOR_DOORS][BENCH_ROUNDS_MAX * ACTUATOR_DOORS];
+    static int64_t open_us[ACTUATOR_DOORS][BENCH_ROUNDS_MAX * ACTUATOR_DOORS];
+    int rounds = argc > 1 ? atoi(argv[1]) : 5;
+    uint8_t buf[256];
+    ble_addr_t peer;
+
+    HOST_CHECK(rounds > 0 && rounds <= BENCH_ROUNDS_MAX);
+    host_app_start();
+    spp = host_ble_val_handle(BENCH_SPP_UUID);
+    HOST_CHECK(spp != 0);
+    for (int i = 0; i < BENCH_LINKS; i++)
+    {
+        host_app_peer(1 + i, &peer);
+        HOST_CHECK(host_ble_connect(&peer, 3000, &links[i].conn) == 0);
+        HOST_CHECK(host_ble_subscribe(links[i].conn, spp, true) == 0);
+        send_frame(&links[i], LOCK_OP_HELLO, NULL, 0);
+        /* No banner follows a HELLO */
+        HOST_CHECK(host_ble_notify_wait(links[i].conn, spp, buf, sizeof buf, 200, NULL) < 0);
+    }
+
+    printf("doors  write-to-fade p50/max us   write-to-open p50/max ms\n");
+    for (int k = 1; k <= ACTUATOR_DOORS; k++)
+    {
+        uint8_t doors = (1u << k) - 1;
+        int n = 0;
+
+        for (int r = 0; r < rounds; r++)
+        {
+            uint32_t fades[ACTUATOR_DOORS];
+            int64_t open_at[ACTUATOR_DOORS];
+            int used = 0;
+
+            wait_all(ACTUATOR_STATE_IDLE, ACTUATOR_DOORS_ALL, NULL);
+            /* Keeps each central under its rate limit */
+            vTaskDelay(pdMS_TO_TICKS(1000 / CONFIG_LOCK_RATE_PER_S));
+            for (int i = 0; i < BENCH_LINKS; i++)
+            {
+                links[i].doors = 0;
+            }
+            for (uint8_t door = 0; door < k; door++)
+            {
+                links[door % BENCH_LINKS].doors |= 1u << door;
+                fades[door] = host_ledc_fades(door);
+            }
+            for (int i = 0; i < BENCH_LINKS && links[i].doors != 0; i++)
+            {
+                HOST_CHECK(pthread_create(&links[i].thread, NULL, link_run, &links[i]) == 0);
+                used++;
+            }
+            for (int i = 0; i < used; i++)
+            {
+                pthread_join(links[i].thread, NULL);
+            }
+            wait_all(ACTUATOR_STATE_HOLDING, doors, open_at);
+            for (uint8_t door = 0; door < k; door++)
+            {
+                int64_t at;
+
+                HOST_CHECK(host_ledc_wait(door, fades[door], 0, &at));
+                fade_us[k - 1][n] = at - write_at[door];
+                open_us[k - 1][n] = open_at[door] - write_at[door];
+                n++;
+                HOST_CHECK(actuator_request(door, ACTUATOR_CMD_LOCK) == ESP_OK);
+            }
+        }
+        printf("%5d  %13lld/%-6lld            %9lld/%-4lld\n", k,
+               (long long)host_percentile(fade_us[k - 1], n, 50),
+               (long long)host_percentile(fade_us[k - 1], n, 100),
+               (long long)host_percentile(open_us[k - 1], n, 50) / 1000,
+               (long long)host_percentile(open_us[k - 1], n, 100) / 1000);
+        /* A door never waits for another one's move */
+        HOST_CHECK(host_percentile(fade_us[k - 1], n, 50) <
+                   host_percentile(fade_us[0], rounds, 50) + BENCH_SLACK_US);
+        HOST_CHECK(host_percentile(open_us[k - 1], n, 50) <
+                   host_percentile(open_us[0], rounds, 50) + BENCH_SLACK_US);
+        HOST_CHECK(host_percentile(open_us[k - 1], n, 100) <
+                   host_percentile(open_us[0], rounds, 100) + BENCH_OPEN_SLACK_US);
+    }
+    printf("PASS\n");
+    return 0;
+}
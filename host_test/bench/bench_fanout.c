@@ -0,0 +1,140 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * Cost of one UART broadcast by number of subscribers.  Phones join one at
+ * a time up to CONFIG_BT_NIMBLE_MAX_CONNECTIONS; at every step the same
+ * burst of bridged lines is fed to the UART and read back by each phone.
+ * The fan-out's own counters, bucketed by subscribers at submit, give the
+ * notifications sent, the mbuf copies and the CPU time per chunk, and so
+ * the msys bytes each chunk ties up.  Every phone must get every byte.
+ *
+ * Usage: bench_fanout [bytes]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host_ble.h"
+#include "host_hal.h"
+#include "host_app.h"
+#include "fanout.h"
+#include "mem_acct.h"
+
+#define BENCH_SPP_UUID          0xABF1
+#define BENCH_BYTES             2048
+#define BENCH_BYTES_MAX         4096
+#define BENCH_SUBS              CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#define BENCH_WAIT_MS           5000
+#define BENCH_POOLS             8
+
+static uint16_t spp;
+
+/* Reads len bridged bytes from conn and checks them against sent */
+static void
+drain(uint16_t conn, const uint8_t *sent, size_t len)
+{
+    static uint8_t got[BENCH_BYTES_MAX];
+    size_t have = 0;
+
+    while (have < len)
+    {
+        int n = host_ble_notify_wait(conn, spp, &got[have], len - have, BENCH_WAIT_MS, NULL);
+
+        HOST_CHECK(n > 0);
+        have += n;
+    }
+    HOST_CHECK(memcmp(got, sent, len) == 0);
+}
+
+static uint16_t
+join(uint32_t n)
+{
+    ble_addr_t peer;
+    uint16_t conn;
+    uint8_t buf[512];
+
+    host_app_peer(n, &peer);
+    HOST_CHECK(host_ble_connect(&peer, BENCH_WAIT_MS, &conn) == 0);
+    HOST_CHECK(host_ble_exchange_mtu(conn, 247) == 0);
+    HOST_CHECK(host_ble_subscribe(conn, spp, true) == 0);
+    /* The banner, so only bridged data is left to read */
+    HOST_CHECK(host_ble_notify_wait(conn, spp, buf, sizeof buf, BENCH_WAIT_MS, NULL) > 0);
+    return conn;
+}
+
+int
+main(int argc, char **argv)
+{
+    static uint8_t sent[BENCH_BYTES_MAX];
+    size_t bytes = argc > 1 ? strtoul(argv[1], NULL, 0) : BENCH_BYTES;
+    uint16_t conns[BENCH_SUBS];
+    mem_pool_info_t pools[BENCH_POOLS];
+    fanout_stats_t before;
+    fanout_stats_t after;
+    int npools;
+
+    HOST_CHECK(bytes > 0 && bytes <= BENCH_BYTES_MAX);
+    host_app_start();
+    spp = host_ble_val_handle(BENCH_SPP_UUID);
+    HOST_CHECK(spp != 0);
+
+    printf("subs  chunks  sends/chunk  copies/chunk  B held/chunk  cpu us/chunk  held max\n");
+    for (int k = 1; k <= BENCH_SUBS; k++)
+    {
+        fanout_cost_t *c;
+        uint32_t chunks;
+        uint32_t sends;
+        uint32_t copies;
+        uint32_t cpu_us;
+        double chunk_bytes;
+
+        conns[k - 1] = join(k);
+        for (size_t i = 0; i < bytes; i++)
+        {
+            sent[i] = i % 64 == 63 ? '\n' : 'a' + (k + i) % 26;
+        }
+
+        fanout_get_stats(&before);
+        HOST_CHECK(host_uart_inject(sent, bytes));
+        for (int i = 0; i < k; i++)
+        {
+            drain(conns[i], sent, bytes);
+        }
+        fanout_get_stats(&after);
+
+        c = &after.by_subs[k - 1];
+        chunks = c->chunks - before.by_subs[k - 1].chunks;
+        sends = c->sends - before.by_subs[k - 1].sends;
+        copies = c->copies - before.by_subs[k - 1].copies;
+        cpu_us = c->cpu_us - before.by_subs[k - 1].cpu_us;
+        HOST_CHECK(chunks > 0);
+        chunk_bytes = (double)bytes / chunks;
+        /* The source, plus one copy for each send that was not handed it */
+        printf("%4d  %6u  %11.2f  %12.2f  %12.0f  %12.1f  %8u\n", k, (unsigned)chunks,
+               (double)sends / chunks, (double)copies / chunks,
+               chunk_bytes * (1.0 + (double)copies / chunks),
+               (double)cpu_us / chunks, (unsigned)after.held_max);
+
+        HOST_CHECK(sends == chunks * k);
+        HOST_CHECK(copies <= chunks * k);
+        HOST_CHECK(after.slow_skips == before.slow_skips);
+    }
+
+    npools = mem_acct_pools(pools, BENCH_POOLS);
+    for (int i = 0; i < npools; i++)
+    {
+        printf("pool %-15s %3u x %4uB, peak %3u used\n", pools[i].name, pools[i].blocks,
+               pools[i].block_size, pools[i].blocks - pools[i].min_free);
+    }
+    for (int i = 0; i < BENCH_SUBS; i++)
+    {
+        HOST_CHECK(host_ble_disconnect(conns[i], BLE_ERR_REM_USER_CONN_TERM) == 0);
+    }
+    printf("PASS\n");
+    return 0;
+}
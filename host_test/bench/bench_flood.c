@@ -0,0 +1,172 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * A legitimate central unlocks with the PIN at a steady pace, first alone
+ * and then while two hostile centrals write wrong PINs every 2 ms, several
+ * times what a link can carry.  Reports the legitimate write-to-notify
+ * latency in both phases, the host task's CPU share during the flood and
+ * the limiter's counters.  The flood must stay within its token budget and
+ * must not move the legitimate latency.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host_ble.h"
+#include "host_app.h"
+#include "rate_limit.h"
+
+#define BENCH_SPP_UUID          0xABF1
+#define BENCH_SAMPLES           8
+/* Slower than the limiter refills, so the legitimate peer never waits */
+#define BENCH_PACE_MS           (1000 / CONFIG_LOCK_RATE_PER_S + 100)
+#define BENCH_ATTACKERS         2
+#define BENCH_FLOOD_GAP_US      2000
+
+static uint16_t spp;
+static volatile bool flooding;
+
+typedef struct
+{
+    pthread_t thread;
+    uint16_t conn;
+    uint32_t writes;
+    uint32_t refused;
+} attacker_t;
+
+static void *
+attacker_run(void *arg)
+{
+    attacker_t *a = arg;
+    while (flooding)
+    {
+        if (host_ble_write(a->conn, spp, "000000", 6) != 0)
+        {
+            a->refused++;
+        }
+        a->writes++;
+        /* Nobody reads the replies */
+        host_ble_notify_flush(a->conn);
+        usleep(BENCH_FLOOD_GAP_US);
+    }
+    return NULL;
+}
+
+/* BENCH_SAMPLES PIN writes from conn, each latency into out */
+static void
+legit_samples(uint16_t conn, int64_t *out)
+{
+    uint8_t buf[256];
+
+    for (int i = 0; i < BENCH_SAMPLES; i++)
+    {
+        int64_t t0;
+        int64_t at;
+
+        vTaskDelay(pdMS_TO_TICKS(BENCH_PACE_MS));
+        host_ble_notify_flush(conn);
+        t0 = esp_timer_get_time();
+        HOST_CHECK(host_ble_write(conn, spp, CONFIG_LOCK_DEFAULT_PIN,
+                                  strlen(CONFIG_LOCK_DEFAULT_PIN)) == 0);
+        HOST_CHECK(host_ble_notify_wait(conn, spp, buf, sizeof buf, 1000, &at) > 0);
+        out[i] = at - t0;
+    }
+}
+
+int
+main(void)
+{
+    int64_t base_us[BENCH_SAMPLES];
+    int64_t flood_us[BENCH_SAMPLES];
+    attacker_t attackers[BENCH_ATTACKERS];
+    rate_limit_stats_t st;
+    uint32_t writes = 0;
+    uint32_t refused = 0;
+    int64_t cpu0;
+    int64_t t0;
+    int64_t cpu_us;
+    int64_t wall_us;
+    int64_t base_p99;
+    int64_t flood_p99;
+    uint16_t conn;
+    ble_addr_t peer;
+    uint8_t buf[256];
+
+    host_app_start();
+    spp = host_ble_val_handle(BENCH_SPP_UUID);
+    HOST_CHECK(spp != 0);
+
+    host_app_peer(1, &peer);
+    HOST_CHECK(host_ble_connect(&peer, 2000, &conn) == 0);
+    HOST_CHECK(host_ble_subscribe(conn, spp, true) == 0);
+    HOST_CHECK(host_ble_notify_wait(conn, spp, buf, sizeof buf, 2000, NULL) > 0);
+    legit_samples(conn, base_us);
+
+    for (int i = 0; i < BENCH_ATTACKERS; i++)
+    {
+        host_app_peer(100 + i, &peer);
+        memset(&attackers[i], 0, sizeof attackers[i]);
+        HOST_CHECK(host_ble_connect(&peer, 3000, &attackers[i].conn) == 0);
+        HOST_CHECK(host_ble_subscribe(attackers[i].conn, spp, true) == 0);
+    }
+    rate_limit_get_stats(&st);
+    flooding = true;
+    cpu0 = host_ble_host_cpu_us();
+    t0 = esp_timer_get_time();
+    for (int i = 0; i < BENCH_ATTACKERS; i++)
+    {
+        HOST_CHECK(pthread_create(&attackers[i].thread, NULL, attacker_run, &attackers[i]) == 0);
+    }
+    legit_samples(conn, flood_us);
+    flooding = false;
+    for (int i = 0; i < BENCH_ATTACKERS; i++)
+    {
+        pthread_join(attackers[i].thread, NULL);
+        writes += attackers[i].writes;
+        refused += attackers[i].refused;
+    }
+    wall_us = esp_timer_get_time() - t0;
+    cpu_us = host_ble_host_cpu_us() - cpu0;
+    {
+        rate_limit_stats_t end;
+
+        rate_limit_get_stats(&end);
+        st.admitted = end.admitted - st.admitted;
+        st.rejected_rate = end.rejected_rate - st.rejected_rate;
+        st.rejected_lockout = end.rejected_lockout - st.rejected_lockout;
+        st.lockouts = end.lockouts - st.lockouts;
+    }
+
+    base_p99 = host_percentile(base_us, BENCH_SAMPLES, 99);
+    flood_p99 = host_percentile(flood_us, BENCH_SAMPLES, 99);
+    printf("legit write-to-notify  alone p50 %5lld us p99 %5lld us, "
+           "flood p50 %5lld us p99 %5lld us\n",
+           (long long)host_percentile(base_us, BENCH_SAMPLES, 50), (long long)base_p99,
+           (long long)host_percentile(flood_us, BENCH_SAMPLES, 50), (long long)flood_p99);
+    printf("flood: %u writes in %lld ms (%u/s), %u refused; host CPU %lld ms (%.1f%%), "
+           "%.1f us/write\n", (unsigned)writes, (long long)wall_us / 1000,
+           (unsigned)(writes * 1000000ull / wall_us), (unsigned)refused,
+           (long long)cpu_us / 1000, 100.0 * cpu_us / wall_us, (double)cpu_us / writes);
+    printf("limiter: admitted %u, over rate %u, locked out %u, lockouts %u\n",
+           (unsigned)st.admitted, (unsigned)st.rejected_rate,
+           (unsigned)st.rejected_lockout, (unsigned)st.lockouts);
+
+    /* Every attacker write past its bucket was refused before parsing */
+    HOST_CHECK(st.admitted <= BENCH_SAMPLES + BENCH_ATTACKERS *
+               (CONFIG_LOCK_RATE_BURST + CONFIG_LOCK_RATE_PER_S * (wall_us / 1000000 + 1)));
+    HOST_CHECK(writes - refused <= st.admitted);
+    HOST_CHECK(st.lockouts >= BENCH_ATTACKERS);
+    /* The legitimate peer is neither refused nor slowed */
+    HOST_CHECK(flood_p99 < base_p99 + 5000);
+    HOST_CHECK(100 * cpu_us < 50 * wall_us);
+    printf("PASS\n");
+    return 0;
+}
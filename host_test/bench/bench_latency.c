@@ -0,0 +1,147 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * Scripted sessions against the whole lock: connect, raise the MTU,
+ * subscribe, wait for the banner, write the PIN and disconnect once the
+ * door has cycled.  Reports write-to-notify (the PIN write to the reply
+ * reaching the phone) and write-to-actuate (to the first servo fade on
+ * door 0), p50 and p99 over the sessions.
+ *
+ * The fake controller moves data only at connection events, so both are
+ * measured twice: with the connection policy's fast interval, and with the
+ * phone refusing every parameter update, which leaves the link at the
+ * phone's 30 ms default as if there were no policy.
+ *
+ * Usage: bench_latency [sessions per run]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host/ble_hs.h"
+#include "host_ble.h"
+#include "host_hal.h"
+#include "host_app.h"
+#include "actuator.h"
+
+#define BENCH_SESSIONS          50
+#define BENCH_SPP_UUID          0xABF1
+#define BENCH_PIN               CONFIG_LOCK_DEFAULT_PIN
+/* What the policy asks for first, in 1.25 ms units */
+#define BENCH_FAST_ITVL         (CONFIG_LOCK_POLICY_FAST_ITVL_MS * 4 / 5)
+
+static uint16_t spp;
+
+/* Waits for the link to reach the fast interval */
+static bool
+fast_link(uint16_t conn)
+{
+    struct ble_gap_conn_desc desc;
+
+    for (int i = 0; i < 200; i++)
+    {
+        HOST_CHECK(ble_gap_conn_find(conn, &desc) == 0);
+        if (desc.conn_itvl == BENCH_FAST_ITVL)
+        {
+            return true;
+        }
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    return false;
+}
+
+static void
+run(int sessions, bool policy, int64_t *notify_us, int64_t *actuate_us)
+{
+    host_ble_timing_t timing;
+    uint8_t buf[256];
+
+    host_ble_get_timing(&timing);
+    /* Unacceptable connection parameters */
+    timing.update_status = policy ? 0 : 0x3B;
+    host_ble_set_timing(&timing);
+
+    for (int i = 0; i < sessions; i++)
+    {
+        struct ble_gap_conn_desc desc;
+        ble_addr_t peer;
+        uint16_t conn;
+        uint32_t fades = host_ledc_fades(0);
+        int64_t t0;
+        int64_t at;
+
+        host_app_peer(i, &peer);
+        HOST_CHECK(host_ble_connect(&peer, 5000, &conn) == 0);
+        HOST_CHECK(host_ble_exchange_mtu(conn, 247) == 0);
+        HOST_CHECK(host_ble_subscribe(conn, spp, true) == 0);
+        HOST_CHECK(host_ble_notify_wait(conn, spp, buf, sizeof buf, 2000, NULL) > 0);
+        if (policy)
+        {
+            HOST_CHECK(fast_link(conn));
+        }
+        else
+        {
+            HOST_CHECK(ble_gap_conn_find(conn, &desc) == 0);
+            HOST_CHECK(desc.conn_itvl != BENCH_FAST_ITVL);
+        }
+
+        t0 = esp_timer_get_time();
+        HOST_CHECK(host_ble_write(conn, spp, BENCH_PIN, strlen(BENCH_PIN)) == 0);
+        HOST_CHECK(host_ble_notify_wait(conn, spp, buf, sizeof buf, 2000, &at) > 0);
+        notify_us[i] = at - t0;
+        HOST_CHECK(host_ledc_wait(0, fades, 2000, &at));
+        actuate_us[i] = at - t0;
+
+        /* Let the door finish its cycle before the next session */
+        while (actuator_get_state(0) != ACTUATOR_STATE_IDLE)
+        {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        HOST_CHECK(host_ble_disconnect(conn, BLE_ERR_REM_USER_CONN_TERM) == 0);
+        HOST_CHECK(host_ble_wait_adv(2000));
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    int sessions = argc > 1 ? atoi(argv[1]) : BENCH_SESSIONS;
+    int64_t *notify_us[2];
+    int64_t *actuate_us[2];
+
+    HOST_CHECK(sessions > 0);
+    for (int p = 0; p < 2; p++)
+    {
+        notify_us[p] = calloc(sessions, sizeof *notify_us[p]);
+        actuate_us[p] = calloc(sessions, sizeof *actuate_us[p]);
+        HOST_CHECK(notify_us[p] != NULL && actuate_us[p] != NULL);
+    }
+    host_app_start();
+    spp = host_ble_val_handle(BENCH_SPP_UUID);
+    HOST_CHECK(spp != 0);
+
+    run(sessions, false, notify_us[0], actuate_us[0]);
+    run(sessions, true, notify_us[1], actuate_us[1]);
+
+    printf("sessions %d per run; fast interval %d ms, the phone's default 30 ms\n",
+           sessions, CONFIG_LOCK_POLICY_FAST_ITVL_MS);
+    printf("conn policy   write-to-notify p50/p99 us   write-to-actuate p50/p99 us\n");
+    for (int p = 0; p < 2; p++)
+    {
+        printf("%-11s %17lld/%-10lld %15lld/%lld\n", p ? "on" : "off",
+               (long long)host_percentile(notify_us[p], sessions, 50),
+               (long long)host_percentile(notify_us[p], sessions, 99),
+               (long long)host_percentile(actuate_us[p], sessions, 50),
+               (long long)host_percentile(actuate_us[p], sessions, 99));
+    }
+    /* Half the interval, half the wait for an event each way */
+    HOST_CHECK(host_percentile(notify_us[1], sessions, 50) <
+               host_percentile(notify_us[0], sessions, 50));
+    return 0;
+}
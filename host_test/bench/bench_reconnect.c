@@ -0,0 +1,221 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * Connect-to-unlock for a new phone and for a returning bond.
+ *
+ * A new phone connects, exchanges the MTU, subscribes, waits for the
+ * banner and sends the PIN.  A bonded phone that opened the door with the
+ * PIN before comes back: the lock starts encryption and the MTU exchange
+ * itself, sends the short prompt once the link is encrypted, and the phone
+ * answers with the resume command.  Controller delays are the fake's: 60
+ * ms to encrypt, 30 ms for an MTU exchange.
+ *
+ * Both make the same ATT exchanges after connecting, but a new phone has
+ * to discover the lock's services first, while a bond reuses the table it
+ * cached.  The fake link carries the exchanges it sees at connection
+ * events but has no discovery, so that part is charged at
+ * BENCH_DISCOVERY_REQS requests of one connection interval each and shown
+ * apart from what was measured.  Neither path counts a person typing.
+ *
+ * Reported per path: link up to the granted reply, the lock's own bond
+ * statistics, which must agree, and the advertising each phone found.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host_ble.h"
+#include "host_app.h"
+#include "bond_cache.h"
+
+#define BENCH_SPP_UUID          0xABF1
+/* Any characteristic that needs an encrypted link */
+#define BENCH_ENC_UUID          0xABF9
+#define BENCH_ROUNDS            10
+/* Slower than the PIN limiter refills */
+#define BENCH_PACE_MS           (1000 / CONFIG_LOCK_RATE_PER_S + 100)
+#define BENCH_RESUME_CMD        "开门"
+#define BENCH_BOND_PEER         50
+#define BENCH_NEW_PEER          100
+/* Primary service by UUID, its characteristics, the CCCD: the fewest a
+ * phone without a cached table needs, at the 30 ms interval the link
+ * starts at */
+#define BENCH_DISCOVERY_REQS    3
+#define BENCH_EVENT_MS          30
+/* The resumed path may cost encryption, the events carrying the prompt,
+ * the command and the reply, and nothing much more */
+#define BENCH_ENC_MS            60
+#define BENCH_RESUME_EVENTS     3
+#define BENCH_RESUME_SLACK_MS   20
+
+static uint16_t spp;
+static uint16_t enc_chr;
+
+/* Waits until the lock advertises, and returns half its interval in ms:
+ * the mean wait of a phone scanning continuously */
+static double
+adv_wait_ms(bool *accept_list)
+{
+    host_ble_adv_t adv;
+
+    for (int i = 0; i < 1000; i++)
+    {
+        host_ble_get_adv(&adv);
+        if (adv.active)
+        {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    HOST_CHECK(adv.active);
+    *accept_list = adv.filter_policy != 0;
+    return adv.itvl_max * 0.625 / 2;
+}
+
+/* Banner, then the unlock line; returns link up to the granted reply */
+static int64_t
+dialogue(uint16_t conn, int64_t t0, const char *line, const char *banner_has)
+{
+    char buf[256];
+    int64_t at;
+    int len;
+
+    HOST_CHECK(host_ble_subscribe(conn, spp, true) == 0);
+    len = host_ble_notify_wait(conn, spp, buf, sizeof buf - 1, 2000, NULL);
+    HOST_CHECK(len > 0);
+    buf[len] = '\0';
+    HOST_CHECK(strstr(buf, banner_has) != NULL);
+    HOST_CHECK(host_ble_write(conn, spp, line, strlen(line)) == 0);
+    len = host_ble_notify_wait(conn, spp, buf, sizeof buf - 1, 2000, &at);
+    HOST_CHECK(len > 0);
+    return at - t0;
+}
+
+/* A bond that opened the door with the PIN, so it has a session to resume */
+static void
+bond_phone(void)
+{
+    ble_addr_t peer;
+    uint8_t st[16];
+    uint16_t len;
+    uint16_t conn;
+    int rc = BLE_ATT_ERR_INSUFFICIENT_ENC;
+
+    host_app_peer(BENCH_BOND_PEER, &peer);
+    HOST_CHECK(host_ble_connect(&peer, 2000, &conn) == 0);
+    HOST_CHECK(host_ble_exchange_mtu(conn, 247) == 0);
+    HOST_CHECK(host_ble_pair(conn, true) == 0);
+    for (int i = 0; i < 200 && rc == BLE_ATT_ERR_INSUFFICIENT_ENC; i++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(5));
+        rc = host_ble_read(conn, enc_chr, st, sizeof st, &len);
+    }
+    HOST_CHECK(rc == 0);
+    dialogue(conn, 0, CONFIG_LOCK_DEFAULT_PIN, ">");
+    HOST_CHECK(host_ble_disconnect(conn, BLE_ERR_REM_USER_CONN_TERM) == 0);
+}
+
+static void
+report(const char *name, int64_t *us, const bond_stats_t *before, const bond_stats_t *after,
+       bond_path_t path, double adv_ms, int accept)
+{
+    uint32_t n = after->unlocks[path] - before->unlocks[path];
+    uint32_t total = after->total_ms[path] - before->total_ms[path];
+    int64_t sum = 0;
+
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+    {
+        sum += us[i];
+    }
+    printf("%-8s link up to unlock: mean %.1f ms, p50 %.1f ms, max %.1f ms; "
+           "lock's stats: %u unlocks, mean %.1f ms; advertising found: "
+           "%.0f ms mean wait%s\n", name, sum / 1000.0 / BENCH_ROUNDS,
+           host_percentile(us, BENCH_ROUNDS, 50) / 1000.0,
+           host_percentile(us, BENCH_ROUNDS, 100) / 1000.0,
+           (unsigned)n, n ? (double)total / n : 0.0, adv_ms / BENCH_ROUNDS,
+           accept == BENCH_ROUNDS ? ", accept list" : accept ? ", partly accept list" : "");
+    HOST_CHECK(n == BENCH_ROUNDS);
+    /* The lock's whole-millisecond times agree with what the phone saw,
+     * which hears the reply at the next connection event */
+    HOST_CHECK(total <= sum / 1000 + BENCH_ROUNDS &&
+               total + (2 + BENCH_EVENT_MS) * BENCH_ROUNDS >= sum / 1000);
+}
+
+int
+main(void)
+{
+    int64_t new_us[BENCH_ROUNDS];
+    int64_t bond_us[BENCH_ROUNDS];
+    double new_adv_ms = 0;
+    double bond_adv_ms = 0;
+    int new_accept = 0;
+    int bond_accept = 0;
+    double new_p50;
+    double bond_p50;
+    bond_stats_t before;
+    bond_stats_t mid;
+    bond_stats_t after;
+    ble_addr_t peer;
+    uint16_t conn;
+    bool accept;
+
+    host_app_start();
+    spp = host_ble_val_handle(BENCH_SPP_UUID);
+    enc_chr = host_ble_val_handle(BENCH_ENC_UUID);
+    HOST_CHECK(spp != 0 && enc_chr != 0);
+
+    bond_cache_get_stats(&before);
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+    {
+        int64_t t0;
+
+        vTaskDelay(pdMS_TO_TICKS(BENCH_PACE_MS));
+        new_adv_ms += adv_wait_ms(&accept);
+        new_accept += accept;
+        host_app_peer(BENCH_NEW_PEER + i, &peer);
+        t0 = esp_timer_get_time();
+        HOST_CHECK(host_ble_connect(&peer, 2000, &conn) == 0);
+        HOST_CHECK(host_ble_exchange_mtu(conn, 247) == 0);
+        new_us[i] = dialogue(conn, t0, CONFIG_LOCK_DEFAULT_PIN, ">");
+        HOST_CHECK(host_ble_disconnect(conn, BLE_ERR_REM_USER_CONN_TERM) == 0);
+    }
+    bond_cache_get_stats(&mid);
+
+    bond_phone();
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+    {
+        int64_t t0;
+
+        vTaskDelay(pdMS_TO_TICKS(BENCH_PACE_MS));
+        bond_adv_ms += adv_wait_ms(&accept);
+        bond_accept += accept;
+        host_app_peer(BENCH_BOND_PEER, &peer);
+        t0 = esp_timer_get_time();
+        HOST_CHECK(host_ble_connect(&peer, 2000, &conn) == 0);
+        /* The lock asks for encryption and the old MTU on its own */
+        bond_us[i] = dialogue(conn, t0, BENCH_RESUME_CMD, BENCH_RESUME_CMD);
+        HOST_CHECK(host_ble_disconnect(conn, BLE_ERR_REM_USER_CONN_TERM) == 0);
+    }
+    bond_cache_get_stats(&after);
+
+    report("new", new_us, &before, &mid, BOND_PATH_NEW, new_adv_ms, new_accept);
+    report("resumed", bond_us, &mid, &after, BOND_PATH_RESUMED, bond_adv_ms, bond_accept);
+    new_p50 = host_percentile(new_us, BENCH_ROUNDS, 50) / 1000.0;
+    bond_p50 = host_percentile(bond_us, BENCH_ROUNDS, 50) / 1000.0;
+    printf("p50 with service discovery charged to the new phone: new %.1f ms, "
+           "resumed %.1f ms\n", new_p50 + BENCH_DISCOVERY_REQS * BENCH_EVENT_MS, bond_p50);
+    HOST_CHECK(after.resumed - mid.resumed == BENCH_ROUNDS);
+    HOST_CHECK(after.early_enc - mid.early_enc == BENCH_ROUNDS);
+    HOST_CHECK(bond_accept == BENCH_ROUNDS && new_accept == 0);
+    HOST_CHECK(bond_p50 < BENCH_ENC_MS + BENCH_RESUME_EVENTS * BENCH_EVENT_MS +
+               BENCH_RESUME_SLACK_MS);
+    HOST_CHECK(bond_p50 < new_p50 + BENCH_DISCOVERY_REQS * BENCH_EVENT_MS);
+    printf("PASS\n");
+    return 0;
+}
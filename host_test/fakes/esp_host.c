@@ -0,0 +1,491 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "esp_rom_crc.h"
+#include "esp_heap_caps.h"
+#include "esp_pm.h"
+#include "esp_peripheral.h"
+#include "modlog/modlog.h"
+#include "host_os.h"
+
+/* What the heap figures are reported against, near an ESP32 with NimBLE up */
+#define HOST_HEAP_SIZE          (300 * 1024)
+
+/* Cycle counter rate: the CPU at full speed */
+#define HOST_CPU_MHZ            240
+
+static struct timespec host_epoch;
+
+int host_log_level = MODLOG_LEVEL_WARN;
+
+__attribute__((constructor)) static void
+host_clock_init(void)
+{
+    const char *lvl = getenv("LOCK_HOST_LOG");
+    static const char *const names[] = { "debug", "info", "warn", "error", "critical" };
+
+    clock_gettime(CLOCK_MONOTONIC, &host_epoch);
+    for (int i = 0; lvl != NULL && i < 5; i++)
+    {
+        if (strcasecmp(lvl, names[i]) == 0)
+        {
+            host_log_level = i;
+        }
+    }
+}
+
+void
+host_log(int level, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+void
+host_cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+void
+host_abs_time(int64_t t_us, struct timespec *ts)
+{
+    int64_t ns = host_epoch.tv_nsec + (t_us % 1000000) * 1000;
+
+    ts->tv_sec = host_epoch.tv_sec + t_us / 1000000 + ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
+}
+
+void
+host_sleep_until_us(int64_t t_us)
+{
+    struct timespec ts;
+
+    host_abs_time(t_us, &ts);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+    {
+    }
+}
+
+bool
+host_cond_wait_until(pthread_cond_t *cond, pthread_mutex_t *mutex, int64_t t_us)
+{
+    struct timespec ts;
+
+    if (t_us < 0)
+    {
+        pthread_cond_wait(cond, mutex);
+        return true;
+    }
+    host_abs_time(t_us, &ts);
+    return pthread_cond_timedwait(cond, mutex, &ts) == 0;
+}
+
+int64_t
+esp_timer_get_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)(ts.tv_sec - host_epoch.tv_sec) * 1000000 +
+           (ts.tv_nsec - host_epoch.tv_nsec) / 1000;
+}
+
+/*
+ * esp_timer: one thread per dispatch method, each running its due
+ * callbacks one at a time in deadline order.  The ISR thread is marked as
+ * interrupt context.
+ */
+struct esp_timer
+{
+    esp_timer_cb_t cb;
+    void *arg;
+    esp_timer_dispatch_t dispatch;
+    int64_t due_us;
+    uint64_t period_us;
+    bool active;
+    struct esp_timer *next;
+};
+
+static struct
+{
+    pthread_cond_t cond;
+    struct esp_timer *timers;
+} timer_svc[2];
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t timer_once = PTHREAD_ONCE_INIT;
+
+static void
+timer_task(void *arg)
+{
+    esp_timer_dispatch_t dispatch = (esp_timer_dispatch_t)(uintptr_t)arg;
+
+    host_set_isr_context(dispatch == ESP_TIMER_ISR);
+    pthread_mutex_lock(&timer_lock);
+    for (;;)
+    {
+        struct esp_timer *due = NULL;
+
+        for (struct esp_timer *t = timer_svc[dispatch].timers; t != NULL; t = t->next)
+        {
+            if (t->active && (due == NULL || t->due_us < due->due_us))
+            {
+                due = t;
+            }
+        }
+        if (due == NULL)
+        {
+            host_cond_wait_until(&timer_svc[dispatch].cond, &timer_lock, -1);
+            continue;
+        }
+        if (due->due_us > esp_timer_get_time())
+        {
+            host_cond_wait_until(&timer_svc[dispatch].cond, &timer_lock, due->due_us);
+            continue;
+        }
+        if (due->period_us != 0)
+        {
+            due->due_us += due->period_us;
+        }
+        else
+        {
+            due->active = false;
+        }
+        pthread_mutex_unlock(&timer_lock);
+        due->cb(due->arg);
+        pthread_mutex_lock(&timer_lock);
+    }
+}
+
+static void
+timer_start_tasks(void)
+{
+    host_cond_init(&timer_svc[ESP_TIMER_TASK].cond);
+    host_cond_init(&timer_svc[ESP_TIMER_ISR].cond);
+    xTaskCreate(timer_task, "esp_timer", CONFIG_ESP_TIMER_TASK_STACK_SIZE,
+                (void *)(uintptr_t)ESP_TIMER_TASK, 22, NULL);
+    xTaskCreate(timer_task, "isr", 0, (void *)(uintptr_t)ESP_TIMER_ISR, 24, NULL);
+}
+
+esp_err_t
+esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out)
+{
+    struct esp_timer *t;
+
+    if (args == NULL || args->callback == NULL || out == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_once(&timer_once, timer_start_tasks);
+    t = calloc(1, sizeof *t);
+    if (t == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    t->cb = args->callback;
+    t->arg = args->arg;
+    t->dispatch = args->dispatch_method == ESP_TIMER_ISR ? ESP_TIMER_ISR : ESP_TIMER_TASK;
+    pthread_mutex_lock(&timer_lock);
+    t->next = timer_svc[t->dispatch].timers;
+    timer_svc[t->dispatch].timers = t;
+    pthread_mutex_unlock(&timer_lock);
+    *out = t;
+    return ESP_OK;
+}
+
+static esp_err_t
+timer_start(esp_timer_handle_t t, uint64_t timeout_us, uint64_t period_us)
+{
+    esp_err_t ret = ESP_OK;
+
+    pthread_mutex_lock(&timer_lock);
+    if (t->active)
+    {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    else
+    {
+        t->due_us = esp_timer_get_time() + timeout_us;
+        t->period_us = period_us;
+        t->active = true;
+        pthread_cond_signal(&timer_svc[t->dispatch].cond);
+    }
+    pthread_mutex_unlock(&timer_lock);
+    return ret;
+}
+
+esp_err_t
+esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t
+esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    return timer_start(timer, period_us, period_us);
+}
+
+esp_err_t
+esp_timer_stop(esp_timer_handle_t t)
+{
+    esp_err_t ret = ESP_OK;
+
+    pthread_mutex_lock(&timer_lock);
+    if (!t->active)
+    {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    t->active = false;
+    pthread_mutex_unlock(&timer_lock);
+    return ret;
+}
+
+esp_err_t
+esp_timer_delete(esp_timer_handle_t t)
+{
+    struct esp_timer **link;
+
+    pthread_mutex_lock(&timer_lock);
+    if (t->active)
+    {
+        pthread_mutex_unlock(&timer_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (link = &timer_svc[t->dispatch].timers; *link != t; link = &(*link)->next)
+    {
+    }
+    *link = t->next;
+    pthread_mutex_unlock(&timer_lock);
+    free(t);
+    return ESP_OK;
+}
+
+bool
+esp_timer_is_active(esp_timer_handle_t t)
+{
+    bool active;
+
+    pthread_mutex_lock(&timer_lock);
+    active = t->active;
+    pthread_mutex_unlock(&timer_lock);
+    return active;
+}
+
+esp_cpu_cycle_count_t
+esp_cpu_get_cycle_count(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (esp_cpu_cycle_count_t)(((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec) *
+                                   HOST_CPU_MHZ / 1000);
+}
+
+int
+esp_cpu_get_core_id(void)
+{
+    return 0;
+}
+
+uint32_t
+esp_rom_get_cpu_ticks_per_us(void)
+{
+    return HOST_CPU_MHZ;
+}
+
+uint32_t
+esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len-- > 0)
+    {
+        crc ^= *buf++;
+        for (int k = 0; k < 8; k++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static size_t heap_min_free = HOST_HEAP_SIZE;
+static esp_alloc_failed_hook_t heap_failed_hook;
+
+size_t
+heap_caps_get_free_size(uint32_t caps)
+{
+    struct mallinfo2 mi = mallinfo2();
+    size_t used = mi.uordblks + mi.hblkhd;
+    size_t free_size = used < HOST_HEAP_SIZE ? HOST_HEAP_SIZE - used : 0;
+
+    if (free_size < heap_min_free)
+    {
+        heap_min_free = free_size;
+    }
+    return free_size;
+}
+
+size_t
+heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    heap_caps_get_free_size(caps);
+    return heap_min_free;
+}
+
+size_t
+heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return heap_caps_get_free_size(caps);
+}
+
+esp_err_t
+heap_caps_register_failed_alloc_callback(esp_alloc_failed_hook_t callback)
+{
+    heap_failed_hook = callback;
+    return ESP_OK;
+}
+
+struct esp_pm_lock
+{
+    esp_pm_lock_type_t type;
+    const char *name;
+    int count;
+    struct esp_pm_lock *next;
+};
+
+static struct esp_pm_lock *pm_locks;
+static pthread_mutex_t pm_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+esp_err_t
+esp_pm_configure(const void *config)
+{
+    return config != NULL ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t
+esp_pm_lock_create(esp_pm_lock_type_t type, int arg, const char *name,
+                   esp_pm_lock_handle_t *out_handle)
+{
+    struct esp_pm_lock *lock = calloc(1, sizeof *lock);
+
+    if (lock == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    lock->type = type;
+    lock->name = name;
+    pthread_mutex_lock(&pm_mutex);
+    lock->next = pm_locks;
+    pm_locks = lock;
+    pthread_mutex_unlock(&pm_mutex);
+    *out_handle = lock;
+    return ESP_OK;
+}
+
+esp_err_t
+esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+    pthread_mutex_lock(&pm_mutex);
+    handle->count++;
+    pthread_mutex_unlock(&pm_mutex);
+    return ESP_OK;
+}
+
+esp_err_t
+esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+    esp_err_t ret = ESP_OK;
+
+    pthread_mutex_lock(&pm_mutex);
+    if (handle->count == 0)
+    {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    else
+    {
+        handle->count--;
+    }
+    pthread_mutex_unlock(&pm_mutex);
+    return ret;
+}
+
+esp_err_t
+esp_pm_dump_locks(FILE *stream)
+{
+    pthread_mutex_lock(&pm_mutex);
+    for (struct esp_pm_lock *l = pm_locks; l != NULL; l = l->next)
+    {
+        fprintf(stream, "%-16s %d\n", l->name != NULL ? l->name : "?", l->count);
+    }
+    pthread_mutex_unlock(&pm_mutex);
+    return ESP_OK;
+}
+
+const char *
+esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE:
+        return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC:
+        return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_NVS_NOT_FOUND:
+        return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_OTA_VALIDATE_FAILED:
+        return "ESP_ERR_OTA_VALIDATE_FAILED";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+void
+print_addr(const void *addr)
+{
+    const uint8_t *u8p = addr;
+
+    MODLOG_DFLT(INFO, "%02x:%02x:%02x:%02x:%02x:%02x",
+                u8p[5], u8p[4], u8p[3], u8p[2], u8p[1], u8p[0]);
+}
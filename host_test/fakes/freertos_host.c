@@ -0,0 +1,433 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "host_os.h"
+
+/*
+ * FreeRTOS on POSIX threads.  Every task is a detached thread; the thread
+ * that calls into the API without being created by xTaskCreate() (the
+ * test's main thread) gets a task record the first time it needs one.
+ */
+#define HOST_TASKS_MAX          32
+
+struct host_task
+{
+    pthread_t thread;
+    char name[configMAX_TASK_NAME_LEN];
+    TaskFunction_t fn;
+    void *arg;
+    uint32_t stack;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;
+};
+
+struct host_queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t *items;
+};
+
+static struct host_task *host_tasks[HOST_TASKS_MAX];
+static int host_task_count;
+static pthread_mutex_t host_tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct host_task *host_current;
+static __thread bool host_isr;
+
+void
+host_set_isr_context(bool isr)
+{
+    host_isr = isr;
+}
+
+BaseType_t
+xPortInIsrContext(void)
+{
+    return host_isr;
+}
+
+void
+vPortEnterCritical(portMUX_TYPE *mux)
+{
+    pthread_mutex_lock(&mux->mutex);
+}
+
+void
+vPortExitCritical(portMUX_TYPE *mux)
+{
+    pthread_mutex_unlock(&mux->mutex);
+}
+
+/* Deadline on the esp_timer clock for a wait of ticks; -1 for forever */
+static int64_t
+host_ticks_deadline(TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        return -1;
+    }
+    return esp_timer_get_time() + (int64_t)pdTICKS_TO_MS(ticks) * 1000;
+}
+
+static struct host_task *
+host_task_new(const char *name, uint32_t stack)
+{
+    struct host_task *task = calloc(1, sizeof *task);
+
+    if (task == NULL)
+    {
+        return NULL;
+    }
+    snprintf(task->name, sizeof task->name, "%s", name);
+    task->stack = stack;
+    pthread_mutex_init(&task->lock, NULL);
+    host_cond_init(&task->cond);
+
+    pthread_mutex_lock(&host_tasks_lock);
+    if (host_task_count < HOST_TASKS_MAX)
+    {
+        host_tasks[host_task_count++] = task;
+    }
+    pthread_mutex_unlock(&host_tasks_lock);
+    return task;
+}
+
+static void *
+host_task_entry(void *arg)
+{
+    struct host_task *task = arg;
+
+    host_current = task;
+    task->fn(task->arg);
+    return NULL;
+}
+
+BaseType_t
+xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                        void *arg, UBaseType_t prio, TaskHandle_t *out, BaseType_t core)
+{
+    struct host_task *task = host_task_new(name, stack_depth);
+    pthread_attr_t attr;
+    int rc;
+
+    if (task == NULL)
+    {
+        return pdFAIL;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    if (out != NULL)
+    {
+        *out = task;
+    }
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    rc = pthread_create(&task->thread, &attr, host_task_entry, task);
+    pthread_attr_destroy(&attr);
+    return rc == 0 ? pdPASS : pdFAIL;
+}
+
+BaseType_t
+xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+            void *arg, UBaseType_t prio, TaskHandle_t *out)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack_depth, arg, prio, out, tskNO_AFFINITY);
+}
+
+void
+vTaskDelete(TaskHandle_t task)
+{
+    /* Only a task ending itself is supported; its record stays for lookups */
+    if (task == NULL || task == host_current)
+    {
+        pthread_exit(NULL);
+    }
+}
+
+void
+vTaskDelay(TickType_t ticks)
+{
+    host_sleep_until_us(esp_timer_get_time() + (int64_t)pdTICKS_TO_MS(ticks) * 1000);
+}
+
+void
+vTaskDelayUntil(TickType_t *prev_wake, TickType_t increment)
+{
+    *prev_wake += increment;
+    host_sleep_until_us((int64_t)pdTICKS_TO_MS(*prev_wake) * 1000);
+}
+
+TickType_t
+xTaskGetTickCount(void)
+{
+    return pdMS_TO_TICKS(esp_timer_get_time() / 1000);
+}
+
+TaskHandle_t
+xTaskGetCurrentTaskHandle(void)
+{
+    if (host_current == NULL)
+    {
+        host_current = host_task_new("main", 0);
+        host_current->thread = pthread_self();
+    }
+    return host_current;
+}
+
+TaskHandle_t
+xTaskGetHandle(const char *name)
+{
+    TaskHandle_t found = NULL;
+
+    pthread_mutex_lock(&host_tasks_lock);
+    for (int i = 0; i < host_task_count && found == NULL; i++)
+    {
+        if (strcmp(host_tasks[i]->name, name) == 0)
+        {
+            found = host_tasks[i];
+        }
+    }
+    pthread_mutex_unlock(&host_tasks_lock);
+    return found;
+}
+
+const char *
+pcTaskGetName(TaskHandle_t task)
+{
+    return (task != NULL ? task : xTaskGetCurrentTaskHandle())->name;
+}
+
+UBaseType_t
+uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    return (task != NULL ? task : xTaskGetCurrentTaskHandle())->stack;
+}
+
+BaseType_t
+xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+void
+vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+    xTaskNotifyGive(task);
+    if (woken != NULL)
+    {
+        *woken = pdTRUE;
+    }
+}
+
+uint32_t
+ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    struct host_task *task = xTaskGetCurrentTaskHandle();
+    int64_t deadline = host_ticks_deadline(ticks);
+    uint32_t value;
+
+    pthread_mutex_lock(&task->lock);
+    while (task->notify == 0 && ticks != 0)
+    {
+        if (!host_cond_wait_until(&task->cond, &task->lock, deadline))
+        {
+            break;
+        }
+    }
+    value = task->notify;
+    if (value != 0)
+    {
+        task->notify = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+QueueHandle_t
+xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue *q = calloc(1, sizeof *q);
+
+    if (q == NULL)
+    {
+        return NULL;
+    }
+    q->items = calloc(length, item_size ? item_size : 1);
+    if (q->items == NULL)
+    {
+        free(q);
+        return NULL;
+    }
+    q->length = length;
+    q->item_size = item_size;
+    pthread_mutex_init(&q->lock, NULL);
+    host_cond_init(&q->not_empty);
+    host_cond_init(&q->not_full);
+    return q;
+}
+
+void
+vQueueDelete(QueueHandle_t q)
+{
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    free(q->items);
+    free(q);
+}
+
+static BaseType_t
+host_queue_send(QueueHandle_t q, const void *item, TickType_t ticks, bool front)
+{
+    int64_t deadline = host_ticks_deadline(ticks);
+    UBaseType_t slot;
+
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->length)
+    {
+        if (ticks == 0 || !host_cond_wait_until(&q->not_full, &q->lock, deadline))
+        {
+            pthread_mutex_unlock(&q->lock);
+            return pdFAIL;
+        }
+    }
+    if (front)
+    {
+        q->head = (q->head + q->length - 1) % q->length;
+        slot = q->head;
+    }
+    else
+    {
+        slot = (q->head + q->count) % q->length;
+    }
+    if (q->item_size != 0 && item != NULL)
+    {
+        memcpy(q->items + slot * q->item_size, item, q->item_size);
+    }
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+BaseType_t
+xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks)
+{
+    return host_queue_send(q, item, ticks, false);
+}
+
+BaseType_t
+xQueueSendToFront(QueueHandle_t q, const void *item, TickType_t ticks)
+{
+    return host_queue_send(q, item, ticks, true);
+}
+
+BaseType_t
+xQueueSendFromISR(QueueHandle_t q, const void *item, BaseType_t *woken)
+{
+    BaseType_t ok = host_queue_send(q, item, 0, false);
+
+    if (ok == pdPASS && woken != NULL)
+    {
+        *woken = pdTRUE;
+    }
+    return ok;
+}
+
+BaseType_t
+xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks)
+{
+    int64_t deadline = host_ticks_deadline(ticks);
+
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0)
+    {
+        if (ticks == 0 || !host_cond_wait_until(&q->not_empty, &q->lock, deadline))
+        {
+            pthread_mutex_unlock(&q->lock);
+            return pdFAIL;
+        }
+    }
+    if (q->item_size != 0)
+    {
+        memcpy(item, q->items + q->head * q->item_size, q->item_size);
+    }
+    q->head = (q->head + 1) % q->length;
+    q->count--;
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+BaseType_t
+xQueueReset(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->count = 0;
+    q->head = 0;
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+UBaseType_t
+uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    UBaseType_t n;
+
+    pthread_mutex_lock(&q->lock);
+    n = q->count;
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+SemaphoreHandle_t
+xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t sem = xQueueCreate(1, 0);
+
+    if (sem != NULL)
+    {
+        xSemaphoreGive(sem);
+    }
+    return sem;
+}
+
+SemaphoreHandle_t
+xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t
+xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    SemaphoreHandle_t sem = xQueueCreate(max, 0);
+
+    while (sem != NULL && initial-- > 0)
+    {
+        xSemaphoreGive(sem);
+    }
+    return sem;
+}
@@ -0,0 +1,58 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "host_ble.h"
+#include "host_app.h"
+
+void app_main(void);
+
+void
+host_app_start(void)
+{
+    app_main();
+    if (!host_ble_wait_adv(5000))
+    {
+        fprintf(stderr, "host: the lock never started advertising\n");
+        exit(1);
+    }
+}
+
+void
+host_app_peer(uint32_t n, ble_addr_t *out)
+{
+    out->type = BLE_ADDR_PUBLIC;
+    out->val[0] = n;
+    out->val[1] = n >> 8;
+    out->val[2] = n >> 16;
+    out->val[3] = 0x5a;
+    out->val[4] = 0xa5;
+    out->val[5] = 0x10;
+}
+
+static int
+cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+int64_t
+host_percentile(int64_t *samples, size_t n, int p)
+{
+    size_t i;
+
+    if (n == 0)
+    {
+        return 0;
+    }
+    qsort(samples, n, sizeof samples[0], cmp_i64);
+    i = (n * p + 99) / 100;
+    return samples[i > 0 ? i - 1 : 0];
+}
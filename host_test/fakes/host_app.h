@@ -0,0 +1,37 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+/*
+ * Boots the whole lock in the host process and gives the test programs the
+ * few helpers they share.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "nimble/ble.h"
+
+/* Runs app_main() once and waits until the lock advertises; aborts if it
+ * does not within a few seconds */
+void host_app_start(void);
+
+/* A distinct public address for the n-th scripted central */
+void host_app_peer(uint32_t n, ble_addr_t *out);
+
+/* The p-th percentile (0..100) of n samples; sorts them */
+int64_t host_percentile(int64_t *samples, size_t n, int p);
+
+/* Fails the program, naming the check, if cond is false */
+#define HOST_CHECK(cond) do {                                               \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                    \
+                    __FILE__, __LINE__, #cond);                             \
+            exit(1);                                                        \
+        }                                                                   \
+    } while (0)
@@ -0,0 +1,103 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+/*
+ * The central's side of the fake NimBLE host in nimble_host.c.  A test
+ * thread plays one or more centrals: every call below is carried out on
+ * the host task, as the matching HCI or ATT traffic would be, and returns
+ * once the lock's callbacks have run.  Notifications the lock sends are
+ * queued per connection with the time they were handed to the host.
+ *
+ * Return values are NimBLE codes: 0, BLE_HS_E* or, from a write or read,
+ * the ATT error the access callback returned.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include "host/ble_hs.h"
+
+/* Controller and peer delays, in milliseconds */
+typedef struct
+{
+    uint32_t enc_ms;            /* Encryption start to ENC_CHANGE */
+    uint32_t update_ms;         /* Parameter update request to CONN_UPDATE */
+    uint32_t mtu_ms;            /* MTU exchange to the MTU event */
+    uint32_t terminate_ms;      /* ble_gap_terminate() to DISCONNECT */
+    uint8_t update_status;      /* HCI status the central answers updates with */
+    bool tx_held;               /* A notification's mbufs are held until its event */
+} host_ble_timing_t;
+
+void host_ble_get_timing(host_ble_timing_t *out);
+void host_ble_set_timing(const host_ble_timing_t *timing);
+
+/* Waits until the host has synced and the lock called ble_gap_adv_start() */
+bool host_ble_wait_adv(uint32_t timeout_ms);
+
+/* What the lock last asked the controller to advertise */
+typedef struct
+{
+    bool active;
+    uint16_t itvl_min;
+    uint16_t itvl_max;
+    uint8_t filter_policy;
+    int32_t duration_ms;
+    uint32_t starts;            /* ble_gap_adv_start() calls that succeeded */
+    uint8_t accept_list_len;
+    uint8_t rsp[BLE_HS_ADV_MAX_SZ];
+    uint8_t rsp_len;
+} host_ble_adv_t;
+
+void host_ble_get_adv(host_ble_adv_t *out);
+
+/**
+ * Connects a central at peer to the advertising lock, waiting up to
+ * timeout_ms for connectable advertising that lets it in.
+ *
+ * @return 0 with *conn_handle set; BLE_HS_ETIMEOUT if the lock never
+ *         advertised to the peer; BLE_HS_ENOMEM with every link in use.
+ */
+int host_ble_connect(const ble_addr_t *peer, uint32_t timeout_ms, uint16_t *conn_handle);
+
+/* The central ends the link with HCI reason, e.g. BLE_ERR_REM_USER_CONN_TERM */
+int host_ble_disconnect(uint16_t conn_handle, uint8_t reason);
+
+/* Writes the client characteristic configuration of a characteristic */
+int host_ble_subscribe(uint16_t conn_handle, uint16_t val_handle, bool notify);
+
+/* A write request; longer than MTU - 3 it arrives as a prepared write */
+int host_ble_write(uint16_t conn_handle, uint16_t val_handle, const void *data, uint16_t len);
+
+int host_ble_read(uint16_t conn_handle, uint16_t val_handle, void *buf, uint16_t max,
+                  uint16_t *len);
+
+/* A central-initiated MTU exchange offering mtu */
+int host_ble_exchange_mtu(uint16_t conn_handle, uint16_t mtu);
+
+/* Pairs, storing the keys if bond; a peer the lock already holds keys for
+ * goes through BLE_GAP_EVENT_REPEAT_PAIRING first */
+int host_ble_pair(uint16_t conn_handle, bool bond);
+
+/* Starts encryption with stored keys, as a returning bond does */
+int host_ble_encrypt(uint16_t conn_handle);
+
+/* Value handle of a characteristic by its 16-bit UUID; 0 if none */
+uint16_t host_ble_val_handle(uint16_t uuid16);
+
+/**
+ * Takes the oldest notification on val_handle (0 for any), waiting up to
+ * timeout_ms.  *at_us, if not NULL, is the esp_timer time it was sent.
+ *
+ * @return its length, or -1 on timeout.
+ */
+int host_ble_notify_wait(uint16_t conn_handle, uint16_t val_handle, void *buf, uint16_t max,
+                         uint32_t timeout_ms, int64_t *at_us);
+
+/* Drops every notification queued for a connection */
+void host_ble_notify_flush(uint16_t conn_handle);
+
+/* CPU time the host task has used, in microseconds */
+int64_t host_ble_host_cpu_us(void);
@@ -0,0 +1,45 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+/*
+ * What a test can see of and do to the hardware behind lock_hal_host.c.
+ * Servo outputs record every fade, the bridge UART takes injected bytes
+ * and captures what the lock writes, and partitions are files laid out by
+ * partitions.csv.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Fades started on a door since boot */
+uint32_t host_ledc_fades(uint8_t door);
+
+/**
+ * Waits until more than after fades have started on door.
+ *
+ * @return true with *at_us, if not NULL, the esp_timer time the fade
+ *         numbered after + 1 started; false on timeout.
+ */
+bool host_ledc_wait(uint8_t door, uint32_t after, uint32_t timeout_ms, int64_t *at_us);
+
+/* The duty the output is at, and whether it is driven at all */
+uint32_t host_ledc_duty(uint8_t door);
+bool host_ledc_powered(uint8_t door);
+
+/* Bytes arriving on the bridge UART; false if the RX buffer overflowed */
+bool host_uart_inject(const void *data, size_t len);
+
+/* Takes up to max bytes the lock wrote to the bridge UART */
+size_t host_uart_take(void *buf, size_t max);
+
+/* Times partition erases and writes like SPI flash does: about 45 ms a
+ * sector and 0.7 ms a 256-byte page.  Off by default. */
+void host_flash_timing(bool on);
+
+/* lock_hal_restart() calls; the process itself carries on */
+uint32_t host_hal_restarts(void);
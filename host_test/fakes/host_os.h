@@ -0,0 +1,32 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+/*
+ * Plumbing shared by the fakes: one monotonic clock for the tick count,
+ * esp_timer and the BLE controller, and condition variables that wait on
+ * it.  Not part of any ESP-IDF API.
+ */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Marks the calling thread as interrupt context for xPortInIsrContext() */
+void host_set_isr_context(bool isr);
+
+/* A condition variable that times its waits on CLOCK_MONOTONIC */
+void host_cond_init(pthread_cond_t *cond);
+
+/* The CLOCK_MONOTONIC time at t_us on the esp_timer clock */
+void host_abs_time(int64_t t_us, struct timespec *ts);
+
+/* Sleeps until t_us on the esp_timer clock */
+void host_sleep_until_us(int64_t t_us);
+
+/* Waits on cond until t_us; false on timeout.  t_us < 0 waits forever. */
+bool host_cond_wait_until(pthread_cond_t *cond, pthread_mutex_t *mutex, int64_t t_us);
@@ -0,0 +1,896 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/random.h>
+#include "esp_timer.h"
+#include "driver/uart.h"
+#include "host/ble_hs.h"
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "lock_diag.h"
+#include "mem_acct.h"
+#include "host_os.h"
+#include "host_hal.h"
+
+/*
+ * lock_hal.h for the host build.  The notify path is the one in
+ * lock_hal_esp.c, over the fake NimBLE host; the servo outputs finish
+ * their fades from an ISR-dispatched esp_timer, so fade callbacks run in
+ * interrupt context as they do from the LEDC interrupt.
+ */
+#define HOST_UART_RX_SIZE       4096
+#define HOST_UART_TX_SIZE       8192
+#define HOST_UART_QUEUE_LEN     10
+#define HOST_PARTS_MAX          16
+#define HOST_FLASH_ERASE_US     45000
+#define HOST_FLASH_PAGE_US      700
+#define HOST_FLASH_PAGE         256
+#define HOST_IMAGE_MAGIC        0xE9
+
+static int64_t wall_base;
+
+int64_t
+lock_hal_now_us(void)
+{
+    return esp_timer_get_time();
+}
+
+int64_t
+lock_hal_wall_time(void)
+{
+    return wall_base + esp_timer_get_time() / 1000000;
+}
+
+void
+lock_hal_set_wall_time(int64_t unix_s)
+{
+    wall_base = unix_s - esp_timer_get_time() / 1000000;
+}
+
+const char *
+lock_hal_fw_version(void)
+{
+    return "host";
+}
+
+esp_err_t
+lock_hal_nvs_init(void)
+{
+    return ESP_OK;
+}
+
+int
+lock_hal_notify(uint16_t conn_handle, uint16_t attr_handle,
+                const void *data, uint16_t len)
+{
+    struct os_mbuf *txom;
+
+    txom = ble_hs_mbuf_from_flat(data, len);
+    if (txom == NULL)
+    {
+        MEM_COUNT(MEM_CNT_MSYS_FAIL);
+        return BLE_HS_ENOMEM;
+    }
+    return lock_hal_notify_mbuf(conn_handle, attr_handle, txom);
+}
+
+int
+lock_hal_notify_mbuf(uint16_t conn_handle, uint16_t attr_handle,
+                     struct os_mbuf *om)
+{
+    int rc;
+
+    /* BLE_GAP_EVENT_NOTIFY_TX can fire before the call returns */
+    DIAG_CALL(lock_diag_notify_submit(conn_handle));
+    /* Consumes om on both success and failure */
+    rc = ble_gatts_notify_custom(conn_handle, attr_handle, om);
+    if (rc == BLE_HS_ENOMEM)
+    {
+        MEM_COUNT(MEM_CNT_NOTIFY_ENOMEM);
+    }
+    return rc;
+}
+
+/* ---- Servo outputs ---- */
+
+static struct
+{
+    lock_hal_fade_cb_t cb;
+    void *arg;
+    esp_timer_handle_t timer;
+    uint32_t duty;
+    uint32_t target;
+    bool on;
+    uint32_t fades;
+    int64_t fade_at[8];             /* Start times of the last fades */
+} servo_out[CONFIG_LOCK_DOOR_COUNT];
+static pthread_mutex_t servo_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t servo_cond;
+static pthread_once_t servo_once = PTHREAD_ONCE_INIT;
+#if CONFIG_LOCK_PM
+static uint32_t servo_powered;              /* Doors with the output on */
+static portMUX_TYPE servo_power_lock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+static void
+servo_cond_init(void)
+{
+    host_cond_init(&servo_cond);
+}
+
+/* The fade engine reached the target; runs in interrupt context */
+static void
+servo_fade_end(void *arg)
+{
+    uintptr_t door = (uintptr_t)arg;
+
+    pthread_mutex_lock(&servo_lock);
+    servo_out[door].duty = servo_out[door].target;
+    pthread_mutex_unlock(&servo_lock);
+    if (servo_out[door].cb != NULL)
+    {
+        servo_out[door].cb(servo_out[door].arg);
+    }
+}
+
+void
+lock_hal_servo_init(uint8_t door, lock_hal_fade_cb_t fade_done, void *arg)
+{
+    esp_timer_create_args_t args = {
+        .callback = servo_fade_end,
+        .arg = (void *)(uintptr_t)door,
+        .dispatch_method = ESP_TIMER_ISR,
+        .name = "ledc_fade",
+    };
+
+    pthread_once(&servo_once, servo_cond_init);
+    assert(door < CONFIG_LOCK_DOOR_COUNT);
+    if (servo_out[door].timer == NULL)
+    {
+        ESP_ERROR_CHECK(esp_timer_create(&args, &servo_out[door].timer));
+    }
+    servo_out[door].cb = fade_done;
+    servo_out[door].arg = arg;
+    servo_out[door].duty = 0;
+    servo_out[door].on = true;
+}
+
+void
+lock_hal_servo_set_duty(uint8_t door, uint32_t duty)
+{
+    pthread_mutex_lock(&servo_lock);
+    servo_out[door].duty = servo_out[door].target = duty;
+    servo_out[door].on = true;
+    pthread_mutex_unlock(&servo_lock);
+}
+
+void
+lock_hal_servo_fade(uint8_t door, uint32_t duty, uint32_t ms)
+{
+    pthread_mutex_lock(&servo_lock);
+    servo_out[door].target = duty;
+    servo_out[door].on = true;
+    servo_out[door].fade_at[servo_out[door].fades++ % 8] = esp_timer_get_time();
+    pthread_cond_broadcast(&servo_cond);
+    pthread_mutex_unlock(&servo_lock);
+
+    /* A new fade replaces the one running, as on the LEDC */
+    esp_timer_stop(servo_out[door].timer);
+    ESP_ERROR_CHECK(esp_timer_start_once(servo_out[door].timer, (uint64_t)ms * 1000));
+}
+
+void
+lock_hal_servo_power(uint8_t door, bool on)
+{
+#if CONFIG_LOCK_PM
+    if (!on)
+    {
+        pthread_mutex_lock(&servo_lock);
+        servo_out[door].on = false;
+        pthread_mutex_unlock(&servo_lock);
+    }
+    /* The supply is shared; it stays on while any door is powered */
+    portENTER_CRITICAL(&servo_power_lock);
+    servo_powered = on ? servo_powered | 1u << door : servo_powered & ~(1u << door);
+    portEXIT_CRITICAL(&servo_power_lock);
+#endif
+}
+
+uint32_t
+host_ledc_fades(uint8_t door)
+{
+    uint32_t n;
+
+    pthread_mutex_lock(&servo_lock);
+    n = servo_out[door].fades;
+    pthread_mutex_unlock(&servo_lock);
+    return n;
+}
+
+bool
+host_ledc_wait(uint8_t door, uint32_t after, uint32_t timeout_ms, int64_t *at_us)
+{
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    bool ok = true;
+
+    pthread_once(&servo_once, servo_cond_init);
+    pthread_mutex_lock(&servo_lock);
+    while (servo_out[door].fades <= after && ok)
+    {
+        ok = host_cond_wait_until(&servo_cond, &servo_lock, deadline);
+    }
+    ok = servo_out[door].fades > after;
+    if (ok && at_us != NULL)
+    {
+        *at_us = servo_out[door].fade_at[after % 8];
+    }
+    pthread_mutex_unlock(&servo_lock);
+    return ok;
+}
+
+uint32_t
+host_ledc_duty(uint8_t door)
+{
+    uint32_t duty;
+
+    pthread_mutex_lock(&servo_lock);
+    duty = servo_out[door].duty;
+    pthread_mutex_unlock(&servo_lock);
+    return duty;
+}
+
+bool
+host_ledc_powered(uint8_t door)
+{
+    bool on;
+
+    pthread_mutex_lock(&servo_lock);
+    on = servo_out[door].on;
+    pthread_mutex_unlock(&servo_lock);
+    return on;
+}
+
+/* ---- Bridge UART ---- */
+
+static struct
+{
+    QueueHandle_t events;
+    uint8_t rx[HOST_UART_RX_SIZE];
+    size_t rx_head;
+    size_t rx_len;
+    uint8_t tx[HOST_UART_TX_SIZE];
+    size_t tx_head;
+    size_t tx_len;
+} uart;
+static pthread_mutex_t uart_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t uart_cond;
+
+esp_err_t
+lock_hal_uart_init(QueueHandle_t *event_queue)
+{
+    if (uart.events != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uart.events = xQueueCreate(HOST_UART_QUEUE_LEN, sizeof(uart_event_t));
+    if (uart.events == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    host_cond_init(&uart_cond);
+    *event_queue = uart.events;
+    return ESP_OK;
+}
+
+/* Posts an event as the UART interrupt would; dropped if the queue is full */
+static void
+uart_post(uart_event_type_t type, size_t size)
+{
+    uart_event_t event = {
+        .type = type,
+        .size = size,
+    };
+
+    xQueueSend(uart.events, &event, 0);
+}
+
+bool
+host_uart_inject(const void *data, size_t len)
+{
+    const uint8_t *src = data;
+    size_t room;
+    size_t n;
+
+    if (uart.events == NULL)
+    {
+        return false;
+    }
+    pthread_mutex_lock(&uart_lock);
+    room = HOST_UART_RX_SIZE - uart.rx_len;
+    n = len < room ? len : room;
+    for (size_t i = 0; i < n; i++)
+    {
+        uart.rx[(uart.rx_head + uart.rx_len++) % HOST_UART_RX_SIZE] = src[i];
+    }
+    pthread_cond_broadcast(&uart_cond);
+    pthread_mutex_unlock(&uart_lock);
+
+    if (n > 0)
+    {
+        uart_post(UART_DATA, n);
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        if (src[i] == '\n')
+        {
+            uart_post(UART_PATTERN_DET, 0);
+        }
+    }
+    if (n < len)
+    {
+        uart_post(UART_BUFFER_FULL, 0);
+    }
+    return n == len;
+}
+
+int
+lock_hal_uart_read(void *buf, uint32_t len, TickType_t ticks_to_wait)
+{
+    int64_t deadline = ticks_to_wait == portMAX_DELAY ? -1 :
+                       esp_timer_get_time() + (int64_t)pdTICKS_TO_MS(ticks_to_wait) * 1000;
+    uint8_t *dst = buf;
+    uint32_t n = 0;
+
+    pthread_mutex_lock(&uart_lock);
+    while (uart.rx_len == 0 && ticks_to_wait > 0 &&
+           host_cond_wait_until(&uart_cond, &uart_lock, deadline))
+    {
+    }
+    while (n < len && uart.rx_len > 0)
+    {
+        dst[n++] = uart.rx[uart.rx_head];
+        uart.rx_head = (uart.rx_head + 1) % HOST_UART_RX_SIZE;
+        uart.rx_len--;
+    }
+    pthread_mutex_unlock(&uart_lock);
+    return n;
+}
+
+int
+lock_hal_uart_write(const void *buf, size_t len)
+{
+    const uint8_t *src = buf;
+
+    pthread_mutex_lock(&uart_lock);
+    for (size_t i = 0; i < len; i++)
+    {
+        /* The oldest output goes if nobody takes it */
+        if (uart.tx_len == HOST_UART_TX_SIZE)
+        {
+            uart.tx_head = (uart.tx_head + 1) % HOST_UART_TX_SIZE;
+            uart.tx_len--;
+        }
+        uart.tx[(uart.tx_head + uart.tx_len++) % HOST_UART_TX_SIZE] = src[i];
+    }
+    pthread_mutex_unlock(&uart_lock);
+    return len;
+}
+
+size_t
+host_uart_take(void *buf, size_t max)
+{
+    uint8_t *dst = buf;
+    size_t n = 0;
+
+    pthread_mutex_lock(&uart_lock);
+    while (n < max && uart.tx_len > 0)
+    {
+        dst[n++] = uart.tx[uart.tx_head];
+        uart.tx_head = (uart.tx_head + 1) % HOST_UART_TX_SIZE;
+        uart.tx_len--;
+    }
+    pthread_mutex_unlock(&uart_lock);
+    return n;
+}
+
+size_t
+lock_hal_uart_buffered(void)
+{
+    size_t len;
+
+    pthread_mutex_lock(&uart_lock);
+    len = uart.rx_len;
+    pthread_mutex_unlock(&uart_lock);
+    return len;
+}
+
+void
+lock_hal_uart_flush(void)
+{
+    pthread_mutex_lock(&uart_lock);
+    uart.rx_head = uart.rx_len = 0;
+    pthread_mutex_unlock(&uart_lock);
+}
+
+void
+lock_hal_uart_pattern_flush(void)
+{
+    /* Line ends are not recorded apart from the events */
+}
+
+/* ---- Partitions ---- */
+
+typedef struct
+{
+    char label[17];
+    bool data;
+    size_t size;
+    int fd;
+} host_part_t;
+
+static host_part_t host_parts[HOST_PARTS_MAX];
+static int host_part_count;
+static bool flash_timed;
+static pthread_mutex_t part_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t
+parse_size(const char *s)
+{
+    char *end;
+    size_t v = strtoul(s, &end, 0);
+
+    if (*end == 'K' || *end == 'k')
+    {
+        v *= 1024;
+    }
+    else if (*end == 'M' || *end == 'm')
+    {
+        v *= 1024 * 1024;
+    }
+    return v;
+}
+
+/* Copies one comma-separated field, trimmed; returns what follows it */
+static char *
+csv_field(char *p, char *out, size_t max)
+{
+    char *comma = strchr(p, ',');
+    char *end = comma != NULL ? comma : p + strlen(p);
+    size_t n;
+
+    while (p < end && isspace((unsigned char)*p))
+    {
+        p++;
+    }
+    while (end > p && isspace((unsigned char)end[-1]))
+    {
+        end--;
+    }
+    n = (size_t)(end - p) < max - 1 ? (size_t)(end - p) : max - 1;
+    memcpy(out, p, n);
+    out[n] = '\0';
+    return comma != NULL ? comma + 1 : p + strlen(p);
+}
+
+/* part_lock held */
+static void
+parts_load(void)
+{
+    FILE *f;
+    char line[160];
+
+    if (host_part_count > 0)
+    {
+        return;
+    }
+    f = fopen(HOST_PARTITIONS_CSV, "r");
+    if (f == NULL)
+    {
+        MODLOG_DFLT(ERROR, "host: no partition table at %s\n", HOST_PARTITIONS_CSV);
+        return;
+    }
+    while (fgets(line, sizeof line, f) != NULL && host_part_count < HOST_PARTS_MAX)
+    {
+        host_part_t *p = &host_parts[host_part_count];
+        char type[16];
+        char field[16];
+        char *s = line;
+
+        if (line[0] == '#' || strchr(line, ',') == NULL)
+        {
+            continue;
+        }
+        s = csv_field(s, p->label, sizeof p->label);
+        s = csv_field(s, type, sizeof type);
+        s = csv_field(s, field, sizeof field);        /* Subtype */
+        s = csv_field(s, field, sizeof field);        /* Offset */
+        csv_field(s, field, sizeof field);
+        p->data = strcmp(type, "data") == 0;
+        p->size = parse_size(field);
+        p->fd = -1;
+        host_part_count++;
+    }
+    fclose(f);
+}
+
+/* Opens the backing file, creating it erased; part_lock held */
+static bool
+part_open(host_part_t *p)
+{
+    const char *dir = getenv("LOCK_HOST_FLASH_DIR");
+    char path[256];
+    off_t len;
+
+    if (p->fd >= 0)
+    {
+        return true;
+    }
+    snprintf(path, sizeof path, "%s/%s.bin", dir != NULL ? dir : ".", p->label);
+    p->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (p->fd < 0)
+    {
+        return false;
+    }
+    len = lseek(p->fd, 0, SEEK_END);
+    if ((size_t)len < p->size)
+    {
+        size_t left = p->size - len;
+        uint8_t ff[LOCK_HAL_SECTOR_SIZE];
+
+        memset(ff, 0xff, sizeof ff);
+        while (left > 0)
+        {
+            size_t n = left < sizeof ff ? left : sizeof ff;
+
+            if (write(p->fd, ff, n) != (ssize_t)n)
+            {
+                close(p->fd);
+                p->fd = -1;
+                return false;
+            }
+            left -= n;
+        }
+    }
+    return true;
+}
+
+static host_part_t *
+part_by_label(const char *label)
+{
+    host_part_t *found = NULL;
+
+    pthread_mutex_lock(&part_lock);
+    parts_load();
+    for (int i = 0; i < host_part_count && found == NULL; i++)
+    {
+        if (strcmp(host_parts[i].label, label) == 0 && part_open(&host_parts[i]))
+        {
+            found = &host_parts[i];
+        }
+    }
+    pthread_mutex_unlock(&part_lock);
+    return found;
+}
+
+static void
+flash_delay(int64_t us)
+{
+    if (flash_timed)
+    {
+        host_sleep_until_us(esp_timer_get_time() + us);
+    }
+}
+
+void
+host_flash_timing(bool on)
+{
+    flash_timed = on;
+}
+
+esp_err_t
+lock_hal_part_find(const char *label, lock_hal_part_t *part, size_t *size)
+{
+    host_part_t *p = part_by_label(label);
+
+    if (p == NULL || !p->data)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *part = p;
+    *size = p->size;
+    return ESP_OK;
+}
+
+esp_err_t
+lock_hal_part_read(lock_hal_part_t part, size_t off, void *buf, size_t len)
+{
+    const host_part_t *p = part;
+
+    if (off > p->size || len > p->size - off)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return pread(p->fd, buf, len, off) == (ssize_t)len ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t
+lock_hal_part_write(lock_hal_part_t part, size_t off, const void *buf, size_t len)
+{
+    const host_part_t *p = part;
+    const uint8_t *src = buf;
+    uint8_t cur[HOST_FLASH_PAGE];
+
+    if (off > p->size || len > p->size - off)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    /* Programming only clears bits */
+    while (len > 0)
+    {
+        size_t n = len < sizeof cur ? len : sizeof cur;
+
+        if (pread(p->fd, cur, n, off) != (ssize_t)n)
+        {
+            return ESP_FAIL;
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            cur[i] &= src[i];
+        }
+        if (pwrite(p->fd, cur, n, off) != (ssize_t)n)
+        {
+            return ESP_FAIL;
+        }
+        flash_delay(HOST_FLASH_PAGE_US * ((n + HOST_FLASH_PAGE - 1) / HOST_FLASH_PAGE));
+        src += n;
+        off += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+esp_err_t
+lock_hal_part_erase(lock_hal_part_t part, size_t off, size_t len)
+{
+    const host_part_t *p = part;
+    uint8_t ff[LOCK_HAL_SECTOR_SIZE];
+
+    if (off % LOCK_HAL_SECTOR_SIZE != 0 || len % LOCK_HAL_SECTOR_SIZE != 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (off > p->size || len > p->size - off)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memset(ff, 0xff, sizeof ff);
+    for (; len > 0; off += sizeof ff, len -= sizeof ff)
+    {
+        if (pwrite(p->fd, ff, sizeof ff, off) != (ssize_t)sizeof ff)
+        {
+            return ESP_FAIL;
+        }
+        flash_delay(HOST_FLASH_ERASE_US);
+    }
+    return ESP_OK;
+}
+
+/* ---- NVS ---- */
+
+typedef struct host_blob
+{
+    char ns[16];
+    char key[16];
+    size_t len;
+    struct host_blob *next;
+    uint8_t data[];
+} host_blob_t;
+
+static host_blob_t *nvs_blobs;
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* nvs_lock held; the link to the blob, or to the NULL that ends the list */
+static host_blob_t **
+nvs_find(const char *ns, const char *key)
+{
+    host_blob_t **link = &nvs_blobs;
+
+    while (*link != NULL && (strcmp((*link)->ns, ns) != 0 || strcmp((*link)->key, key) != 0))
+    {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+esp_err_t
+lock_hal_nvs_get(const char *ns, const char *key, void *buf, size_t *len)
+{
+    host_blob_t *b;
+    esp_err_t ret = ESP_OK;
+
+    pthread_mutex_lock(&nvs_lock);
+    b = *nvs_find(ns, key);
+    if (b == NULL)
+    {
+        ret = ESP_ERR_NVS_NOT_FOUND;
+    }
+    else if (buf == NULL)
+    {
+        *len = b->len;
+    }
+    else if (*len < b->len)
+    {
+        *len = b->len;
+        ret = ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    else
+    {
+        memcpy(buf, b->data, b->len);
+        *len = b->len;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ret;
+}
+
+esp_err_t
+lock_hal_nvs_set(const char *ns, const char *key, const void *buf, size_t len)
+{
+    host_blob_t **link;
+    host_blob_t *b = malloc(sizeof *b + len);
+
+    if (b == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    snprintf(b->ns, sizeof b->ns, "%s", ns);
+    snprintf(b->key, sizeof b->key, "%s", key);
+    b->len = len;
+    memcpy(b->data, buf, len);
+
+    pthread_mutex_lock(&nvs_lock);
+    link = nvs_find(ns, key);
+    b->next = *link != NULL ? (*link)->next : NULL;
+    free(*link);
+    *link = b;
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t
+lock_hal_nvs_erase(const char *ns, const char *key)
+{
+    host_blob_t **link;
+    host_blob_t *b;
+
+    pthread_mutex_lock(&nvs_lock);
+    link = nvs_find(ns, key);
+    b = *link;
+    if (b != NULL)
+    {
+        *link = b->next;
+        free(b);
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return b != NULL ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+void
+lock_hal_random(void *buf, size_t len)
+{
+    uint8_t *p = buf;
+
+    while (len > 0)
+    {
+        ssize_t n = getrandom(p, len, 0);
+
+        if (n > 0)
+        {
+            p += n;
+            len -= n;
+        }
+    }
+}
+
+/* ---- Firmware update ---- */
+
+static struct
+{
+    host_part_t *part;
+    size_t written;
+    uint32_t restarts;
+} ota;
+
+esp_err_t
+lock_hal_ota_begin(uint32_t size)
+{
+    ota.part = part_by_label("ota_0");
+    ota.written = 0;
+    if (ota.part == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (size > ota.part->size)
+    {
+        ota.part = NULL;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t
+lock_hal_ota_write(const void *buf, size_t len)
+{
+    size_t erased = (ota.written + LOCK_HAL_SECTOR_SIZE - 1) & ~(size_t)(LOCK_HAL_SECTOR_SIZE - 1);
+    size_t end = ota.written + len;
+    esp_err_t ret;
+
+    if (ota.part == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (end > ota.part->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    /* Sequential writes: each sector is erased as the data reaches it */
+    while (erased < end)
+    {
+        ret = lock_hal_part_erase(ota.part, erased, LOCK_HAL_SECTOR_SIZE);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+        erased += LOCK_HAL_SECTOR_SIZE;
+    }
+    ret = lock_hal_part_write(ota.part, ota.written, buf, len);
+    if (ret == ESP_OK)
+    {
+        ota.written = end;
+    }
+    return ret;
+}
+
+esp_err_t
+lock_hal_ota_end(void)
+{
+    uint8_t magic = 0;
+
+    if (ota.part == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (ota.written > 0)
+    {
+        lock_hal_part_read(ota.part, 0, &magic, 1);
+    }
+    ota.part = NULL;
+    return magic == HOST_IMAGE_MAGIC ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+}
+
+void
+lock_hal_ota_abort(void)
+{
+    ota.part = NULL;
+}
+
+void
+lock_hal_restart(void)
+{
+    MODLOG_DFLT(WARN, "host: restart requested\n");
+    __atomic_fetch_add(&ota.restarts, 1, __ATOMIC_RELAXED);
+}
+
+uint32_t
+host_hal_restarts(void)
+{
+    return __atomic_load_n(&ota.restarts, __ATOMIC_RELAXED);
+}
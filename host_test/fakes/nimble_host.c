@@ -0,0 +1,2121 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "host/ble_hs.h"
+#include "host/util/util.h"
+#include "nimble/nimble_port.h"
+#include "nimble/nimble_port_freertos.h"
+#include "services/gap/ble_svc_gap.h"
+#include "services/gatt/ble_svc_gatt.h"
+#include "modlog/modlog.h"
+#include "host_os.h"
+#include "host_ble.h"
+
+/*
+ * An in-process NimBLE host and controller.  The default event queue is
+ * run by the host task as in the NimBLE port, GATT access callbacks and
+ * GAP events are delivered there, and the controller's delayed answers
+ * (encryption, parameter updates, MTU exchanges, advertising timeouts) are
+ * timed by a "btController" thread that posts them to the host.  Data
+ * moves through mbufs from the msys pools sized by sdkconfig.h, so pool
+ * exhaustion fails where it would on the target.
+ *
+ * Data goes over the air only at connection events, one every connection
+ * interval from the last parameter change.  A write reaches the lock at
+ * the next event the lock listens at, which with slave latency may be
+ * that many events on; a notification reaches the script at the next
+ * event.  So the intervals the connection policy asks for show up in what
+ * a script measures.  With tx_held set, a notification's mbufs stay taken
+ * until its event, as NimBLE holds queued ACL data, so a lock that sends
+ * faster than the link carries runs the pools dry.
+ */
+#define HOST_MAX_CONNS          CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#define HOST_MAX_ATTRS          16
+#define HOST_MAX_SVC_DEFS       4
+#define HOST_NOTIFY_DEPTH       64
+#define HOST_NOTIFY_MAX         (CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU - 3)
+#define HOST_STORE_MAX          CONFIG_BT_NIMBLE_MAX_BONDS
+
+/* Header and leading space the host reserves in the first buffer of a
+ * packet: os_mbuf, pkthdr, then HCI ACL, L2CAP and ATT headers */
+#define HOST_MBUF_HDR           16
+#define HOST_MBUF_PKTHDR        8
+#define HOST_MBUF_LEADING       12
+
+/* Default connection: 30 ms interval, 4 s supervision timeout */
+#define HOST_CONN_ITVL          24
+#define HOST_CONN_TIMEOUT       400
+#define HOST_PEER_MTU           247
+/* Writes a phone fits in one connection event when it has them queued,
+ * and the most time between two for the second to count as queued */
+#define HOST_EVENT_PDUS         6
+#define HOST_EVENT_GAP_US       2000
+
+_Static_assert(CONFIG_BT_NIMBLE_MSYS_1_BLOCK_COUNT + CONFIG_BT_NIMBLE_MSYS_2_BLOCK_COUNT <
+               HOST_NOTIFY_DEPTH, "a connection's TX queue must outlast the pools");
+
+/* ---- mbufs ---- */
+
+struct os_mempool
+{
+    const char *name;
+    int block_size;
+    int blocks;
+    int nfree;
+    int min_free;
+};
+
+struct os_mbuf_pool
+{
+    struct os_mempool mp;
+    struct os_mbuf *free;
+};
+
+static struct os_mbuf_pool msys_pools[2] = {
+    { { "msys_1", CONFIG_BT_NIMBLE_MSYS_1_BLOCK_SIZE, CONFIG_BT_NIMBLE_MSYS_1_BLOCK_COUNT } },
+    { { "msys_2", CONFIG_BT_NIMBLE_MSYS_2_BLOCK_SIZE, CONFIG_BT_NIMBLE_MSYS_2_BLOCK_COUNT } },
+};
+static pthread_mutex_t mbuf_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void conn_tx_reap(void);
+
+static void
+msys_init(void)
+{
+    for (int p = 0; p < 2; p++)
+    {
+        struct os_mbuf_pool *pool = &msys_pools[p];
+        int room = pool->mp.block_size - HOST_MBUF_HDR;
+
+        pool->free = NULL;
+        for (int i = 0; i < pool->mp.blocks; i++)
+        {
+            struct os_mbuf *om = calloc(1, sizeof *om + room);
+
+            om->om_omp = pool;
+            SLIST_NEXT(om, om_next) = pool->free;
+            pool->free = om;
+        }
+        pool->mp.nfree = pool->mp.min_free = pool->mp.blocks;
+    }
+}
+
+/* One block, with the header room of a packet start if pkthdr; mbuf_lock held */
+static struct os_mbuf *
+mbuf_get(struct os_mbuf_pool *pool, bool pkthdr)
+{
+    struct os_mbuf *om = pool->free;
+    int lead = pkthdr ? HOST_MBUF_PKTHDR + HOST_MBUF_LEADING : 0;
+
+    if (om == NULL)
+    {
+        return NULL;
+    }
+    pool->free = SLIST_NEXT(om, om_next);
+    if (--pool->mp.nfree < pool->mp.min_free)
+    {
+        pool->mp.min_free = pool->mp.nfree;
+    }
+    SLIST_NEXT(om, om_next) = NULL;
+    om->om_size = pool->mp.block_size - HOST_MBUF_HDR - lead;
+    om->om_data = om->om_databuf;
+    om->om_len = 0;
+    om->om_pktlen = 0;
+    om->om_flags = 0;
+    om->om_pkthdr_len = pkthdr ? HOST_MBUF_PKTHDR : 0;
+    return om;
+}
+
+struct os_mbuf *
+os_msys_get_pkthdr(uint16_t dsize, uint16_t user_hdr_len)
+{
+    struct os_mbuf_pool *pool = &msys_pools[1];
+    struct os_mbuf *om;
+
+    conn_tx_reap();
+    /* The smallest pool that fits, and only that one, as os_msys does */
+    if (dsize + HOST_MBUF_PKTHDR + user_hdr_len <= msys_pools[0].mp.block_size - HOST_MBUF_HDR)
+    {
+        pool = &msys_pools[0];
+    }
+    pthread_mutex_lock(&mbuf_lock);
+    om = mbuf_get(pool, true);
+    pthread_mutex_unlock(&mbuf_lock);
+    return om;
+}
+
+int
+os_mbuf_append(struct os_mbuf *om, const void *data, uint16_t len)
+{
+    struct os_mbuf *head = om;
+    const uint8_t *src = data;
+    int rc = 0;
+
+    pthread_mutex_lock(&mbuf_lock);
+    while (SLIST_NEXT(om, om_next) != NULL)
+    {
+        om = SLIST_NEXT(om, om_next);
+    }
+    while (len > 0)
+    {
+        uint16_t room = om->om_size - om->om_len;
+        uint16_t n = room < len ? room : len;
+
+        memcpy(om->om_data + om->om_len, src, n);
+        om->om_len += n;
+        head->om_pktlen += n;
+        src += n;
+        len -= n;
+        if (len == 0)
+        {
+            break;
+        }
+        SLIST_NEXT(om, om_next) = mbuf_get(om->om_omp, false);
+        if (SLIST_NEXT(om, om_next) == NULL)
+        {
+            rc = OS_ENOMEM;
+            break;
+        }
+        om = SLIST_NEXT(om, om_next);
+    }
+    pthread_mutex_unlock(&mbuf_lock);
+    return rc;
+}
+
+int
+os_mbuf_free_chain(struct os_mbuf *om)
+{
+    pthread_mutex_lock(&mbuf_lock);
+    while (om != NULL)
+    {
+        struct os_mbuf *next = SLIST_NEXT(om, om_next);
+        struct os_mbuf_pool *pool = om->om_omp;
+
+        SLIST_NEXT(om, om_next) = pool->free;
+        pool->free = om;
+        pool->mp.nfree++;
+        om = next;
+    }
+    pthread_mutex_unlock(&mbuf_lock);
+    return 0;
+}
+
+struct os_mbuf *
+os_mbuf_dup(struct os_mbuf *om)
+{
+    struct os_mbuf *copy;
+
+    conn_tx_reap();
+    pthread_mutex_lock(&mbuf_lock);
+    copy = mbuf_get(om->om_omp, true);
+    pthread_mutex_unlock(&mbuf_lock);
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+    for (struct os_mbuf *m = om; m != NULL; m = SLIST_NEXT(m, om_next))
+    {
+        if (os_mbuf_append(copy, m->om_data, m->om_len) != 0)
+        {
+            os_mbuf_free_chain(copy);
+            return NULL;
+        }
+    }
+    return copy;
+}
+
+int
+os_mbuf_copydata(const struct os_mbuf *om, int off, int len, void *dst)
+{
+    uint8_t *out = dst;
+
+    for (; om != NULL && len > 0; om = SLIST_NEXT(om, om_next))
+    {
+        if (off >= om->om_len)
+        {
+            off -= om->om_len;
+            continue;
+        }
+        int n = om->om_len - off < len ? om->om_len - off : len;
+
+        memcpy(out, om->om_data + off, n);
+        out += n;
+        len -= n;
+        off = 0;
+    }
+    return len > 0 ? -1 : 0;
+}
+
+int
+os_msys_count(void)
+{
+    return msys_pools[0].mp.blocks + msys_pools[1].mp.blocks;
+}
+
+int
+os_msys_num_free(void)
+{
+    int n;
+
+    conn_tx_reap();
+    pthread_mutex_lock(&mbuf_lock);
+    n = msys_pools[0].mp.nfree + msys_pools[1].mp.nfree;
+    pthread_mutex_unlock(&mbuf_lock);
+    return n;
+}
+
+struct os_mempool *
+os_mempool_info_get_next(struct os_mempool *mp, struct os_mempool_info *omi)
+{
+    int i = mp == NULL ? 0 : (int)((struct os_mbuf_pool *)mp - msys_pools) + 1;
+
+    if (i >= 2)
+    {
+        return NULL;
+    }
+    conn_tx_reap();
+    pthread_mutex_lock(&mbuf_lock);
+    omi->omi_block_size = msys_pools[i].mp.block_size;
+    omi->omi_num_blocks = msys_pools[i].mp.blocks;
+    omi->omi_num_free = msys_pools[i].mp.nfree;
+    omi->omi_min_free = msys_pools[i].mp.min_free;
+    pthread_mutex_unlock(&mbuf_lock);
+    snprintf(omi->omi_name, sizeof omi->omi_name, "%s", msys_pools[i].mp.name);
+    return &msys_pools[i].mp;
+}
+
+struct os_mbuf *
+ble_hs_mbuf_from_flat(const void *buf, uint16_t len)
+{
+    struct os_mbuf *om = os_msys_get_pkthdr(0, 0);
+
+    if (om != NULL && os_mbuf_append(om, buf, len) != 0)
+    {
+        os_mbuf_free_chain(om);
+        return NULL;
+    }
+    return om;
+}
+
+int
+ble_hs_mbuf_to_flat(const struct os_mbuf *om, void *flat, uint16_t max_len,
+                    uint16_t *out_copy_len)
+{
+    uint16_t n = OS_MBUF_PKTLEN(om) < max_len ? OS_MBUF_PKTLEN(om) : max_len;
+
+    os_mbuf_copydata(om, 0, n, flat);
+    if (out_copy_len != NULL)
+    {
+        *out_copy_len = n;
+    }
+    return n < OS_MBUF_PKTLEN(om) ? BLE_HS_EMSGSIZE : 0;
+}
+
+/* ---- UUIDs ---- */
+
+int
+ble_uuid_cmp(const ble_uuid_t *uuid1, const ble_uuid_t *uuid2)
+{
+    if (uuid1->type != uuid2->type)
+    {
+        return uuid1->type - uuid2->type;
+    }
+    if (uuid1->type == BLE_UUID_TYPE_16)
+    {
+        return (int)ble_uuid_u16(uuid1) - (int)ble_uuid_u16(uuid2);
+    }
+    return memcmp(((const ble_uuid128_t *)uuid1)->value,
+                  ((const ble_uuid128_t *)uuid2)->value, 16);
+}
+
+uint16_t
+ble_uuid_u16(const ble_uuid_t *uuid)
+{
+    return uuid->type == BLE_UUID_TYPE_16 ? ((const ble_uuid16_t *)uuid)->value : 0;
+}
+
+char *
+ble_uuid_to_str(const ble_uuid_t *uuid, char *dst)
+{
+    if (uuid->type == BLE_UUID_TYPE_16)
+    {
+        snprintf(dst, BLE_UUID_STR_LEN, "0x%04x", ble_uuid_u16(uuid));
+    }
+    else
+    {
+        const uint8_t *v = ((const ble_uuid128_t *)uuid)->value;
+        char *p = dst;
+
+        for (int i = 15; i >= 0; i--)
+        {
+            p += sprintf(p, "%02x", v[i]);
+            if (i == 12 || i == 10 || i == 8 || i == 6)
+            {
+                *p++ = '-';
+            }
+        }
+    }
+    return dst;
+}
+
+/* ---- Event queue and host task ---- */
+
+struct ble_hs_cfg ble_hs_cfg;
+
+static struct ble_npl_eventq host_evq;
+static pthread_mutex_t evq_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t evq_cond;
+static bool host_stop;
+static bool host_synced;
+static pthread_t host_thread;
+
+void
+ble_npl_event_init(struct ble_npl_event *ev, ble_npl_event_fn *fn, void *arg)
+{
+    memset(ev, 0, sizeof *ev);
+    ev->fn = fn;
+    ev->arg = arg;
+}
+
+void *
+ble_npl_event_get_arg(struct ble_npl_event *ev)
+{
+    return ev->arg;
+}
+
+void
+ble_npl_eventq_put(struct ble_npl_eventq *evq, struct ble_npl_event *ev)
+{
+    pthread_mutex_lock(&evq_lock);
+    if (!ev->queued)
+    {
+        ev->queued = true;
+        ev->next = NULL;
+        if (evq->tail != NULL)
+        {
+            evq->tail->next = ev;
+        }
+        else
+        {
+            evq->head = ev;
+        }
+        evq->tail = ev;
+        pthread_cond_broadcast(&evq_cond);
+    }
+    pthread_mutex_unlock(&evq_lock);
+}
+
+struct ble_npl_eventq *
+nimble_port_get_dflt_eventq(void)
+{
+    return &host_evq;
+}
+
+/* ---- Connections, GATT table and bond store ---- */
+
+typedef struct
+{
+    uint16_t attr;
+    uint16_t len;
+    int64_t at_us;                      /* Connection event that carries it */
+    uint8_t data[HOST_NOTIFY_MAX];
+} host_notify_t;
+
+typedef struct
+{
+    bool in_use;
+    struct ble_gap_conn_desc desc;
+    uint16_t mtu;
+    uint16_t peer_mtu;
+    ble_gap_event_fn *cb;
+    void *cb_arg;
+    uint16_t subs[HOST_MAX_ATTRS];      /* Subscribed value handles, 0 if free */
+    host_notify_t notify[HOST_NOTIFY_DEPTH];
+    int notify_head;
+    int notify_count;
+    int64_t anchor_us;                  /* First event at the current interval */
+    int64_t notify_last_us;             /* Event of the newest notification */
+    int64_t write_done_us;              /* When the last write was handled */
+    uint8_t write_pdus;                 /* Writes in the current event */
+    /* Sent notifications whose mbufs the controller still holds; each
+     * holds a block, so the pools bound them */
+    struct os_mbuf *tx_om[HOST_NOTIFY_DEPTH];
+    int64_t tx_at_us[HOST_NOTIFY_DEPTH];
+    int tx_head;
+    int tx_count;
+} host_conn_t;
+
+typedef struct
+{
+    uint16_t val_handle;
+    const struct ble_gatt_chr_def *chr;
+} host_attr_t;
+
+static host_conn_t host_conns[HOST_MAX_CONNS];
+static pthread_mutex_t conn_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notify_cond;
+
+static const struct ble_gatt_svc_def *svc_defs[HOST_MAX_SVC_DEFS];
+static int svc_def_count;
+static host_attr_t host_attrs[HOST_MAX_ATTRS];
+static int host_attr_count;
+
+static ble_addr_t store_peers[HOST_STORE_MAX];
+static int store_count;
+
+static struct
+{
+    bool active;
+    struct ble_gap_adv_params params;
+    int32_t duration_ms;
+    ble_gap_event_fn *cb;
+    void *cb_arg;
+    uint32_t gen;
+    uint32_t starts;
+    ble_addr_t wl[CONFIG_BT_NIMBLE_WHITELIST_SIZE];
+    uint8_t wl_len;
+    uint8_t rsp[BLE_HS_ADV_MAX_SZ];
+    uint8_t rsp_len;
+} host_adv;
+static pthread_cond_t adv_cond;
+
+static char gap_name[32] = "nimble";
+
+static host_ble_timing_t host_timing = {
+    .enc_ms = 60,
+    .update_ms = 100,
+    .mtu_ms = 30,
+    .terminate_ms = 30,
+    .update_status = 0,
+};
+
+/* conn_lock held */
+static host_conn_t *
+conn_find(uint16_t conn_handle)
+{
+    for (int i = 0; i < HOST_MAX_CONNS; i++)
+    {
+        if (host_conns[i].in_use && host_conns[i].desc.conn_handle == conn_handle)
+        {
+            return &host_conns[i];
+        }
+    }
+    return NULL;
+}
+
+/* Gives back the mbufs of the notifications sent by until_us; conn_lock
+ * held */
+static void
+conn_tx_free(host_conn_t *c, int64_t until_us)
+{
+    while (c->tx_count > 0 && c->tx_at_us[c->tx_head] <= until_us)
+    {
+        os_mbuf_free_chain(c->tx_om[c->tx_head]);
+        c->tx_head = (c->tx_head + 1) % HOST_NOTIFY_DEPTH;
+        c->tx_count--;
+    }
+}
+
+/* Called before the pools are looked at, so they show what is on the air */
+static void
+conn_tx_reap(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    pthread_mutex_lock(&conn_lock);
+    for (int i = 0; i < HOST_MAX_CONNS; i++)
+    {
+        if (host_conns[i].in_use)
+        {
+            conn_tx_free(&host_conns[i], now);
+        }
+    }
+    pthread_mutex_unlock(&conn_lock);
+}
+
+/* The first connection event at or after t_us; to the lock, the first the
+ * lock listens at.  conn_lock held */
+static int64_t
+conn_next_event(const host_conn_t *c, int64_t t_us, bool to_lock)
+{
+    int64_t itvl = c->desc.conn_itvl * 1250LL;
+
+    if (to_lock)
+    {
+        itvl *= c->desc.conn_latency + 1;
+    }
+    if (t_us <= c->anchor_us)
+    {
+        return c->anchor_us;
+    }
+    return c->anchor_us + (t_us - c->anchor_us + itvl - 1) / itvl * itvl;
+}
+
+/* Holds a script's write back until the event that carries it.  One
+ * written right after the last goes in the same event, up to a few. */
+static void
+conn_event_wait(uint16_t conn_handle)
+{
+    host_conn_t *c;
+    int64_t now = esp_timer_get_time();
+    int64_t due = 0;
+
+    pthread_mutex_lock(&conn_lock);
+    c = conn_find(conn_handle);
+    if (c != NULL)
+    {
+        if (c->write_pdus > 0 && c->write_pdus < HOST_EVENT_PDUS &&
+            now - c->write_done_us <= HOST_EVENT_GAP_US)
+        {
+            c->write_pdus++;
+        }
+        else
+        {
+            due = conn_next_event(c, now, true);
+            c->write_pdus = 1;
+        }
+    }
+    pthread_mutex_unlock(&conn_lock);
+    host_sleep_until_us(due);
+}
+
+static void
+conn_write_done(uint16_t conn_handle)
+{
+    host_conn_t *c;
+
+    pthread_mutex_lock(&conn_lock);
+    c = conn_find(conn_handle);
+    if (c != NULL)
+    {
+        c->write_done_us = esp_timer_get_time();
+    }
+    pthread_mutex_unlock(&conn_lock);
+}
+
+/* Delivers a GAP event to the connection's callback, without any lock */
+static int
+conn_event(uint16_t conn_handle, struct ble_gap_event *event)
+{
+    ble_gap_event_fn *cb;
+    void *arg;
+    host_conn_t *c;
+
+    pthread_mutex_lock(&conn_lock);
+    c = conn_find(conn_handle);
+    cb = c != NULL ? c->cb : NULL;
+    arg = c != NULL ? c->cb_arg : NULL;
+    pthread_mutex_unlock(&conn_lock);
+    return cb != NULL ? cb(event, arg) : 0;
+}
+
+static int
+store_find(const ble_addr_t *addr)
+{
+    for (int i = 0; i < store_count; i++)
+    {
+        if (ble_addr_cmp(&store_peers[i], addr) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int
+ble_store_read_peer_sec(const struct ble_store_key_sec *key,
+                        struct ble_store_value_sec *value_sec)
+{
+    int i;
+
+    pthread_mutex_lock(&conn_lock);
+    i = store_find(&key->peer_addr);
+    pthread_mutex_unlock(&conn_lock);
+    if (i < 0)
+    {
+        return BLE_HS_ENOENT;
+    }
+    memset(value_sec, 0, sizeof *value_sec);
+    value_sec->peer_addr = key->peer_addr;
+    value_sec->key_size = 16;
+    value_sec->ltk_present = 1;
+    value_sec->bonded = 1;
+    return 0;
+}
+
+int
+ble_store_util_delete_peer(const ble_addr_t *peer_id_addr)
+{
+    int i;
+
+    pthread_mutex_lock(&conn_lock);
+    i = store_find(peer_id_addr);
+    if (i >= 0)
+    {
+        store_peers[i] = store_peers[--store_count];
+    }
+    pthread_mutex_unlock(&conn_lock);
+    return i >= 0 ? 0 : BLE_HS_ENOENT;
+}
+
+int
+ble_store_util_bonded_peers(ble_addr_t *out_peer_id_addrs, int *out_num_peers, int max_peers)
+{
+    pthread_mutex_lock(&conn_lock);
+    *out_num_peers = store_count < max_peers ? store_count : max_peers;
+    memcpy(out_peer_id_addrs, store_peers, *out_num_peers * sizeof store_peers[0]);
+    pthread_mutex_unlock(&conn_lock);
+    return 0;
+}
+
+int
+ble_store_util_status_rr(struct ble_store_status_event *event, void *arg)
+{
+    return 0;
+}
+
+void
+ble_store_config_init(void)
+{
+}
+
+/* A new bond; the oldest makes way when the store is full, as the
+ * round-robin status callback would have it */
+static void
+store_add(const ble_addr_t *addr)
+{
+    pthread_mutex_lock(&conn_lock);
+    if (store_find(addr) < 0)
+    {
+        if (store_count == HOST_STORE_MAX)
+        {
+            memmove(&store_peers[0], &store_peers[1], --store_count * sizeof store_peers[0]);
+        }
+        store_peers[store_count++] = *addr;
+    }
+    pthread_mutex_unlock(&conn_lock);
+}
+
+/* ---- The controller ---- */
+
+typedef enum
+{
+    CTLR_ADV_TIMEOUT,
+    CTLR_ENC_CHANGE,
+    CTLR_CONN_UPDATE,
+    CTLR_MTU,
+    CTLR_TERMINATE,
+} ctlr_ev_type_t;
+
+typedef struct ctlr_ev
+{
+    struct ble_npl_event ev;
+    ctlr_ev_type_t type;
+    int64_t due_us;
+    uint16_t conn_handle;
+    uint32_t value;
+    int status;
+    struct ctlr_ev *next;
+} ctlr_ev_t;
+
+static ctlr_ev_t *ctlr_pending;
+/* Answered events are kept for reuse, so once a few links have come and
+ * gone the fake controller makes no heap calls a test would see */
+static ctlr_ev_t *ctlr_spare;
+static pthread_mutex_t ctlr_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ctlr_cond;
+
+static void disconnect_now(uint16_t conn_handle, int reason);
+
+/* Host task: the controller's answer arrives */
+static void
+ctlr_event(struct ble_npl_event *npl)
+{
+    ctlr_ev_t *e = npl->arg;
+    struct ble_gap_event event;
+    host_conn_t *c;
+
+    memset(&event, 0, sizeof event);
+    switch (e->type)
+    {
+    case CTLR_ADV_TIMEOUT:
+    {
+        ble_gap_event_fn *cb = NULL;
+        void *arg = NULL;
+
+        pthread_mutex_lock(&conn_lock);
+        if (host_adv.active && host_adv.gen == e->value)
+        {
+            host_adv.active = false;
+            cb = host_adv.cb;
+            arg = host_adv.cb_arg;
+        }
+        pthread_mutex_unlock(&conn_lock);
+        if (cb != NULL)
+        {
+            event.type = BLE_GAP_EVENT_ADV_COMPLETE;
+            event.adv_complete.reason = BLE_HS_ETIMEOUT;
+            cb(&event, arg);
+        }
+        break;
+    }
+
+    case CTLR_ENC_CHANGE:
+        pthread_mutex_lock(&conn_lock);
+        c = conn_find(e->conn_handle);
+        if (c != NULL && e->status == 0)
+        {
+            c->desc.sec_state.encrypted = 1;
+            c->desc.sec_state.bonded = store_find(&c->desc.peer_id_addr) >= 0;
+            c->desc.sec_state.key_size = 16;
+        }
+        pthread_mutex_unlock(&conn_lock);
+        if (c != NULL)
+        {
+            event.type = BLE_GAP_EVENT_ENC_CHANGE;
+            event.enc_change.conn_handle = e->conn_handle;
+            event.enc_change.status = e->status;
+            conn_event(e->conn_handle, &event);
+        }
+        break;
+
+    case CTLR_CONN_UPDATE:
+        pthread_mutex_lock(&conn_lock);
+        c = conn_find(e->conn_handle);
+        if (c != NULL && e->status == 0)
+        {
+            /* The new interval starts at the instant, here and now */
+            c->desc.conn_itvl = e->value & 0xffff;
+            c->desc.conn_latency = e->value >> 16;
+            c->anchor_us = esp_timer_get_time();
+        }
+        pthread_mutex_unlock(&conn_lock);
+        if (c != NULL)
+        {
+            event.type = BLE_GAP_EVENT_CONN_UPDATE;
+            event.conn_update.conn_handle = e->conn_handle;
+            event.conn_update.status = e->status;
+            conn_event(e->conn_handle, &event);
+        }
+        break;
+
+    case CTLR_MTU:
+        pthread_mutex_lock(&conn_lock);
+        c = conn_find(e->conn_handle);
+        if (c != NULL)
+        {
+            c->mtu = e->value;
+        }
+        pthread_mutex_unlock(&conn_lock);
+        if (c != NULL)
+        {
+            event.type = BLE_GAP_EVENT_MTU;
+            event.mtu.conn_handle = e->conn_handle;
+            event.mtu.channel_id = 4;
+            event.mtu.value = e->value;
+            conn_event(e->conn_handle, &event);
+        }
+        break;
+
+    case CTLR_TERMINATE:
+        disconnect_now(e->conn_handle, e->status);
+        break;
+    }
+    pthread_mutex_lock(&ctlr_lock);
+    e->next = ctlr_spare;
+    ctlr_spare = e;
+    pthread_mutex_unlock(&ctlr_lock);
+}
+
+/* Queues an answer for the host task after delay_ms */
+static void
+ctlr_post(ctlr_ev_type_t type, uint16_t conn_handle, uint32_t value, int status,
+          uint32_t delay_ms)
+{
+    ctlr_ev_t *e;
+    ctlr_ev_t **link;
+
+    pthread_mutex_lock(&ctlr_lock);
+    e = ctlr_spare;
+    if (e != NULL)
+    {
+        ctlr_spare = e->next;
+    }
+    pthread_mutex_unlock(&ctlr_lock);
+    if (e == NULL)
+    {
+        e = malloc(sizeof *e);
+    }
+    memset(e, 0, sizeof *e);
+    e->type = type;
+    e->conn_handle = conn_handle;
+    e->value = value;
+    e->status = status;
+    e->due_us = esp_timer_get_time() + (int64_t)delay_ms * 1000;
+    ble_npl_event_init(&e->ev, ctlr_event, e);
+
+    pthread_mutex_lock(&ctlr_lock);
+    /* A new advertising timeout makes the pending ones no-ops; drop them */
+    for (link = &ctlr_pending; type == CTLR_ADV_TIMEOUT && *link != NULL; )
+    {
+        ctlr_ev_t *old = *link;
+
+        if (old->type != CTLR_ADV_TIMEOUT)
+        {
+            link = &old->next;
+            continue;
+        }
+        *link = old->next;
+        old->next = ctlr_spare;
+        ctlr_spare = old;
+    }
+    for (link = &ctlr_pending; *link != NULL && (*link)->due_us <= e->due_us;
+         link = &(*link)->next)
+    {
+    }
+    e->next = *link;
+    *link = e;
+    pthread_cond_signal(&ctlr_cond);
+    pthread_mutex_unlock(&ctlr_lock);
+}
+
+static void
+ctlr_task(void *arg)
+{
+    pthread_mutex_lock(&ctlr_lock);
+    for (;;)
+    {
+        ctlr_ev_t *e = ctlr_pending;
+
+        if (e == NULL)
+        {
+            host_cond_wait_until(&ctlr_cond, &ctlr_lock, -1);
+        }
+        else if (e->due_us > esp_timer_get_time())
+        {
+            host_cond_wait_until(&ctlr_cond, &ctlr_lock, e->due_us);
+        }
+        else
+        {
+            ctlr_pending = e->next;
+            ble_npl_eventq_put(&host_evq, &e->ev);
+        }
+    }
+}
+
+esp_err_t
+nimble_port_init(void)
+{
+    host_cond_init(&evq_cond);
+    host_cond_init(&notify_cond);
+    host_cond_init(&adv_cond);
+    host_cond_init(&ctlr_cond);
+    msys_init();
+    if (xTaskCreate(ctlr_task, "btController", 4096, NULL, 23, NULL) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/* Assigns attribute handles and reports them, as ble_gatts_start() does */
+static void
+gatts_start(void)
+{
+    struct ble_gatt_register_ctxt ctxt;
+    uint16_t handle = 1;
+
+    /* The GAP and GATT services come first */
+    handle += 8;
+    for (int d = 0; d < svc_def_count; d++)
+    {
+        for (const struct ble_gatt_svc_def *svc = svc_defs[d]; svc->type != 0; svc++)
+        {
+            memset(&ctxt, 0, sizeof ctxt);
+            ctxt.op = BLE_GATT_REGISTER_OP_SVC;
+            ctxt.svc.handle = handle++;
+            ctxt.svc.svc_def = svc;
+            if (ble_hs_cfg.gatts_register_cb != NULL)
+            {
+                ble_hs_cfg.gatts_register_cb(&ctxt, ble_hs_cfg.gatts_register_arg);
+            }
+            for (const struct ble_gatt_chr_def *chr = svc->characteristics;
+                 chr != NULL && chr->uuid != NULL; chr++)
+            {
+                memset(&ctxt, 0, sizeof ctxt);
+                ctxt.op = BLE_GATT_REGISTER_OP_CHR;
+                ctxt.chr.def_handle = handle++;
+                ctxt.chr.val_handle = handle++;
+                ctxt.chr.svc_def = svc;
+                ctxt.chr.chr_def = chr;
+                if (chr->flags & (BLE_GATT_CHR_F_NOTIFY | BLE_GATT_CHR_F_INDICATE))
+                {
+                    handle++;   /* Client characteristic configuration */
+                }
+                if (chr->val_handle != NULL)
+                {
+                    *chr->val_handle = ctxt.chr.val_handle;
+                }
+                assert(host_attr_count < HOST_MAX_ATTRS);
+                host_attrs[host_attr_count].val_handle = ctxt.chr.val_handle;
+                host_attrs[host_attr_count++].chr = chr;
+                if (ble_hs_cfg.gatts_register_cb != NULL)
+                {
+                    ble_hs_cfg.gatts_register_cb(&ctxt, ble_hs_cfg.gatts_register_arg);
+                }
+            }
+        }
+    }
+}
+
+void
+nimble_port_run(void)
+{
+    host_thread = pthread_self();
+    gatts_start();
+    if (ble_hs_cfg.sync_cb != NULL)
+    {
+        ble_hs_cfg.sync_cb();
+    }
+    pthread_mutex_lock(&evq_lock);
+    host_synced = true;
+    while (!host_stop)
+    {
+        struct ble_npl_event *ev = host_evq.head;
+
+        if (ev == NULL)
+        {
+            host_cond_wait_until(&evq_cond, &evq_lock, -1);
+            continue;
+        }
+        host_evq.head = ev->next;
+        if (host_evq.head == NULL)
+        {
+            host_evq.tail = NULL;
+        }
+        ev->queued = false;
+        pthread_mutex_unlock(&evq_lock);
+        ev->fn(ev);
+        pthread_mutex_lock(&evq_lock);
+    }
+    pthread_mutex_unlock(&evq_lock);
+}
+
+int
+nimble_port_stop(void)
+{
+    pthread_mutex_lock(&evq_lock);
+    host_stop = true;
+    pthread_cond_broadcast(&evq_cond);
+    pthread_mutex_unlock(&evq_lock);
+    return 0;
+}
+
+void
+nimble_port_freertos_init(TaskFunction_t host_task_fn)
+{
+    xTaskCreate(host_task_fn, "nimble_host", CONFIG_BT_NIMBLE_HOST_TASK_STACK_SIZE,
+                NULL, 21, NULL);
+}
+
+void
+nimble_port_freertos_deinit(void)
+{
+}
+
+/* ---- GAP ---- */
+
+int
+ble_hs_util_ensure_addr(int prefer_random)
+{
+    return 0;
+}
+
+int
+ble_hs_id_infer_auto(int privacy, uint8_t *out_addr_type)
+{
+    *out_addr_type = BLE_ADDR_PUBLIC;
+    return 0;
+}
+
+int
+ble_hs_id_copy_addr(uint8_t id_addr_type, uint8_t *out_id_addr, int *out_is_nrpa)
+{
+    static const uint8_t addr[6] = { 0x02, 0x00, 0x00, 0xc0, 0xa4, 0x24 };
+
+    memcpy(out_id_addr, addr, sizeof addr);
+    if (out_is_nrpa != NULL)
+    {
+        *out_is_nrpa = 0;
+    }
+    return 0;
+}
+
+void
+ble_svc_gap_init(void)
+{
+}
+
+void
+ble_svc_gatt_init(void)
+{
+}
+
+const char *
+ble_svc_gap_device_name(void)
+{
+    return gap_name;
+}
+
+int
+ble_svc_gap_device_name_set(const char *name)
+{
+    if (strlen(name) >= sizeof gap_name)
+    {
+        return BLE_HS_EINVAL;
+    }
+    strcpy(gap_name, name);
+    return 0;
+}
+
+int
+ble_gap_conn_find(uint16_t handle, struct ble_gap_conn_desc *out_desc)
+{
+    host_conn_t *c;
+
+    pthread_mutex_lock(&conn_lock);
+    c = conn_find(handle);
+    if (c != NULL && out_desc != NULL)
+    {
+        *out_desc = c->desc;
+    }
+    pthread_mutex_unlock(&conn_lock);
+    return c != NULL ? 0 : BLE_HS_ENOTCONN;
+}
+
+uint16_t
+ble_att_mtu(uint16_t conn_handle)
+{
+    host_conn_t *c;
+    uint16_t mtu;
+
+    pthread_mutex_lock(&conn_lock);
+    c = conn_find(conn_handle);
+    mtu = c != NULL ? c->mtu : 0;
+    pthread_mutex_unlock(&conn_lock);
+    return mtu;
+}
+
+static bool
+conn_exists(uint16_t conn_handle)
+{
+    return ble_gap_conn_find(conn_handle, NULL) == 0;
+}
+
+int
+ble_gap_terminate(uint16_t conn_handle, uint8_t hci_reason)
+{
+    if (!conn_exists(conn_handle))
+    {
+        return BLE_HS_ENOTCONN;
+    }
+    ctlr_post(CTLR_TERMINATE, conn_handle, 0, BLE_HS_HCI_ERR(BLE_ERR_CONN_TERM_LOCAL),
+              host_timing.terminate_ms);
+    return 0;
+}
+
+int
+ble_gap_update_params(uint16_t conn_handle, const struct ble_gap_upd_params *params)
+{
+    if (!conn_exists(conn_handle))
+    {
+        return BLE_HS_ENOTCONN;
+    }
+    /* The central settles on the shortest interval it was offered */
+    ctlr_post(CTLR_CONN_UPDATE, conn_handle,
+              params->itvl_min | (uint32_t)params->latency << 16,
+              BLE_HS_HCI_ERR(host_timing.update_status), host_timing.update_ms);
+    return 0;
+}
+
+int
+ble_gap_set_data_len(uint16_t conn_handle, uint16_t tx_octets, uint16_t tx_time)
+{
+    return conn_exists(conn_handle) ? 0 : BLE_HS_ENOTCONN;
+}
+
+int
+ble_gap_set_prefered_le_phy(uint16_t conn_handle, uint8_t tx_phys_mask,
+                            uint8_t rx_phys_mask, uint16_t phy_opts)
+{
+    return conn_exists(conn_handle) ? 0 : BLE_HS_ENOTCONN;
+}
+
+int
+ble_gap_security_initiate(uint16_t conn_handle)
+{
+    struct ble_gap_conn_desc desc;
+    bool bonded;
+
+    if (ble_gap_conn_find(conn_handle, &desc) != 0)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+    if (desc.sec_state.encrypted)
+    {
+        return BLE_HS_EALREADY;
+    }
+    pthread_mutex_lock(&conn_lock);
+    bonded = store_find(&desc.peer_id_addr) >= 0;
+    pthread_mutex_unlock(&conn_lock);
+    /* A bond restarts encryption with its keys; otherwise the central is
+     * asked to pair, which the script does with host_ble_pair() */
+    if (bonded)
+    {
+        ctlr_post(CTLR_ENC_CHANGE, conn_handle, 0, 0, host_timing.enc_ms);
+    }
+    return 0;
+}
+
+int
+ble_gattc_exchange_mtu(uint16_t conn_handle, ble_gatt_mtu_fn *cb, void *cb_arg)
+{
+    uint16_t mtu;
+    host_conn_t *c;
+
+    pthread_mutex_lock(&conn_lock);
+    c = conn_find(conn_handle);
+    mtu = c != NULL ? c->peer_mtu : 0;
+    pthread_mutex_unlock(&conn_lock);
+    if (c == NULL)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+    if (mtu > CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU)
+    {
+        mtu = CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU;
+    }
+    ctlr_post(CTLR_MTU, conn_handle, mtu, 0, host_timing.mtu_ms);
+    return 0;
+}
+
+int
+ble_gap_adv_start(uint8_t own_addr_type, const ble_addr_t *direct_addr,
+                  int32_t duration_ms, const struct ble_gap_adv_params *adv_params,
+                  ble_gap_event_fn *cb, void *cb_arg)
+{
+    uint32_t gen;
+
+    pthread_mutex_lock(&conn_lock);
+    if (host_adv.active)
+    {
+        pthread_mutex_unlock(&conn_lock);
+        return BLE_HS_EALREADY;
+    }
+    host_adv.active = true;
+    host_adv.params = *adv_params;
+    host_adv.duration_ms = duration_ms;
+    host_adv.cb = cb;
+    host_adv.cb_arg = cb_arg;
+    host_adv.starts++;
+    gen = ++host_adv.gen;
+    pthread_cond_broadcast(&adv_cond);
+    pthread_mutex_unlock(&conn_lock);
+
+    if (duration_ms != BLE_HS_FOREVER)
+    {
+        ctlr_post(CTLR_ADV_TIMEOUT, BLE_HS_CONN_HANDLE_NONE, gen, 0, duration_ms);
+    }
+    return 0;
+}
+
+int
+ble_gap_adv_stop(void)
+{
+    int rc = 0;
+
+    pthread_mutex_lock(&conn_lock);
+    if (!host_adv.active)
+    {
+        rc = BLE_HS_EALREADY;
+    }
+    host_adv.active = false;
+    host_adv.gen++;
+    pthread_mutex_unlock(&conn_lock);
+    return rc;
+}
+
+int
+ble_gap_adv_active(void)
+{
+    int active;
+
+    pthread_mutex_lock(&conn_lock);
+    active = host_adv.active;
+    pthread_mutex_unlock(&conn_lock);
+    return active;
+}
+
+int
+ble_gap_adv_set_fields(const struct ble_hs_adv_fields *fields)
+{
+    /* Flags, TX power, the name and the UUID list, as encoded */
+    int len = 3 + 3 + (fields->name_len + 2) + (2 * fields->num_uuids16 + 2);
+
+    return len <= BLE_HS_ADV_MAX_SZ ? 0 : BLE_HS_EMSGSIZE;
+}
+
+int
+ble_gap_adv_rsp_set_data(const uint8_t *data, int data_len)
+{
+    if (data_len > BLE_HS_ADV_MAX_SZ)
+    {
+        return BLE_HS_EINVAL;
+    }
+    pthread_mutex_lock(&conn_lock);
+    memcpy(host_adv.rsp, data, data_len);
+    host_adv.rsp_len = data_len;
+    pthread_mutex_unlock(&conn_lock);
+    return 0;
+}
+
+int
+ble_gap_wl_set(const ble_addr_t *addrs, uint8_t white_list_count)
+{
+    int rc = 0;
+
+    if (white_list_count > CONFIG_BT_NIMBLE_WHITELIST_SIZE)
+    {
+        return BLE_HS_EINVAL;
+    }
+    pthread_mutex_lock(&conn_lock);
+    /* The controller will not change a list advertising is filtering on */
+    if (host_adv.active && host_adv.params.filter_policy != BLE_HCI_ADV_FILT_NONE)
+    {
+        rc = BLE_HS_EBUSY;
+    }
+    else
+    {
+        memcpy(host_adv.wl, addrs, white_list_count * sizeof addrs[0]);
+        host_adv.wl_len = white_list_count;
+    }
+    pthread_mutex_unlock(&conn_lock);
+    return rc;
+}
+
+/* ---- GATT server ---- */
+
+int
+ble_gatts_count_cfg(const struct ble_gatt_svc_def *defs)
+{
+    return 0;
+}
+
+int
+ble_gatts_add_svcs(const struct ble_gatt_svc_def *svcs)
+{
+    if (svc_def_count == HOST_MAX_SVC_DEFS)
+    {
+        return BLE_HS_ENOMEM;
+    }
+    svc_defs[svc_def_count++] = svcs;
+    return 0;
+}
+
+int
+ble_gatts_notify_custom(uint16_t conn_handle, uint16_t att_handle, struct os_mbuf *om)
+{
+    struct ble_gap_event event;
+    host_conn_t *c;
+
+    pthread_mutex_lock(&conn_lock);
+    c = conn_find(conn_handle);
+    if (c != NULL)
+    {
+        host_notify_t *n;
+        uint16_t len = OS_MBUF_PKTLEN(om);
+
+        /* The oldest goes when a script stops reading */
+        if (c->notify_count == HOST_NOTIFY_DEPTH)
+        {
+            c->notify_head = (c->notify_head + 1) % HOST_NOTIFY_DEPTH;
+            c->notify_count--;
+        }
+        n = &c->notify[(c->notify_head + c->notify_count++) % HOST_NOTIFY_DEPTH];
+        /* ATT truncates to the MTU */
+        if (len > c->mtu - 3)
+        {
+            len = c->mtu - 3;
+        }
+        n->attr = att_handle;
+        n->len = len;
+        /* In order, even across an interval change */
+        n->at_us = conn_next_event(c, esp_timer_get_time(), false);
+        if (n->at_us < c->notify_last_us)
+        {
+            n->at_us = c->notify_last_us;
+        }
+        c->notify_last_us = n->at_us;
+        os_mbuf_copydata(om, 0, len, n->data);
+        pthread_cond_broadcast(&notify_cond);
+        if (host_timing.tx_held)
+        {
+            /* Consumed, but only free once its event has carried it */
+            assert(c->tx_count < HOST_NOTIFY_DEPTH);
+            c->tx_om[(c->tx_head + c->tx_count) % HOST_NOTIFY_DEPTH] = om;
+            c->tx_at_us[(c->tx_head + c->tx_count++) % HOST_NOTIFY_DEPTH] = n->at_us;
+            om = NULL;
+        }
+    }
+    pthread_mutex_unlock(&conn_lock);
+    os_mbuf_free_chain(om);
+    if (c == NULL)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+
+    memset(&event, 0, sizeof event);
+    event.type = BLE_GAP_EVENT_NOTIFY_TX;
+    event.notify_tx.conn_handle = conn_handle;
+    event.notify_tx.attr_handle = att_handle;
+    event.notify_tx.status = 0;
+    conn_event(conn_handle, &event);
+    return 0;
+}
+
+/* ---- Scripted central ---- */
+
+typedef struct
+{
+    struct ble_npl_event ev;
+    int (*fn)(void *arg);
+    void *arg;
+    int rc;
+    bool done;
+} host_call_t;
+
+static pthread_mutex_t call_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t call_cond = PTHREAD_COND_INITIALIZER;
+
+static void
+call_event(struct ble_npl_event *ev)
+{
+    host_call_t *call = ev->arg;
+    int rc = call->fn(call->arg);
+
+    pthread_mutex_lock(&call_lock);
+    call->rc = rc;
+    call->done = true;
+    pthread_cond_broadcast(&call_cond);
+    pthread_mutex_unlock(&call_lock);
+}
+
+/* Runs fn on the host task and returns what it returned */
+static int
+host_call(int (*fn)(void *arg), void *arg)
+{
+    host_call_t call = {
+        .fn = fn,
+        .arg = arg,
+    };
+
+    ble_npl_event_init(&call.ev, call_event, &call);
+    ble_npl_eventq_put(&host_evq, &call.ev);
+    pthread_mutex_lock(&call_lock);
+    while (!call.done)
+    {
+        pthread_cond_wait(&call_cond, &call_lock);
+    }
+    pthread_mutex_unlock(&call_lock);
+    return call.rc;
+}
+
+void
+host_ble_get_timing(host_ble_timing_t *out)
+{
+    *out = host_timing;
+}
+
+void
+host_ble_set_timing(const host_ble_timing_t *timing)
+{
+    host_timing = *timing;
+}
+
+bool
+host_ble_wait_adv(uint32_t timeout_ms)
+{
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    bool ok = true;
+
+    pthread_mutex_lock(&conn_lock);
+    while (!host_adv.active && ok)
+    {
+        ok = host_cond_wait_until(&adv_cond, &conn_lock, deadline);
+    }
+    ok = host_adv.active;
+    pthread_mutex_unlock(&conn_lock);
+    return ok;
+}
+
+void
+host_ble_get_adv(host_ble_adv_t *out)
+{
+    pthread_mutex_lock(&conn_lock);
+    out->active = host_adv.active;
+    out->itvl_min = host_adv.params.itvl_min;
+    out->itvl_max = host_adv.params.itvl_max;
+    out->filter_policy = host_adv.params.filter_policy;
+    out->duration_ms = host_adv.duration_ms;
+    out->starts = host_adv.starts;
+    out->accept_list_len = host_adv.wl_len;
+    memcpy(out->rsp, host_adv.rsp, host_adv.rsp_len);
+    out->rsp_len = host_adv.rsp_len;
+    pthread_mutex_unlock(&conn_lock);
+}
+
+typedef struct
+{
+    const ble_addr_t *peer;
+    uint16_t conn_handle;
+} connect_args_t;
+
+/* conn_lock held */
+static bool
+adv_admits(const ble_addr_t *peer)
+{
+    if (!host_adv.active)
+    {
+        return false;
+    }
+    if (host_adv.params.filter_policy != BLE_HCI_ADV_FILT_CONN &&
+        host_adv.params.filter_policy != BLE_HCI_ADV_FILT_BOTH)
+    {
+        return true;
+    }
+    for (int i = 0; i < host_adv.wl_len; i++)
+    {
+        if (ble_addr_cmp(&host_adv.wl[i], peer) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int
+connect_call(void *arg)
+{
+    connect_args_t *a = arg;
+    struct ble_gap_event event;
+    host_conn_t *c = NULL;
+    uint16_t handle = 1;
+
+    pthread_mutex_lock(&conn_lock);
+    if (!adv_admits(a->peer))
+    {
+        pthread_mutex_unlock(&conn_lock);
+        return BLE_HS_EAGAIN;
+    }
+    /* The lowest free handle, as the controller hands them out */
+    while (conn_find(handle) != NULL)
+    {
+        handle++;
+    }
+    for (int i = 0; i < HOST_MAX_CONNS && c == NULL; i++)
+    {
+        if (!host_conns[i].in_use)
+        {
+            c = &host_conns[i];
+        }
+    }
+    if (c == NULL)
+    {
+        pthread_mutex_unlock(&conn_lock);
+        return BLE_HS_ENOMEM;
+    }
+    memset(c, 0, sizeof *c);
+    c->in_use = true;
+    c->desc.conn_handle = handle;
+    c->desc.peer_id_addr = *a->peer;
+    c->desc.peer_ota_addr = *a->peer;
+    ble_hs_id_copy_addr(BLE_ADDR_PUBLIC, c->desc.our_id_addr.val, NULL);
+    c->desc.our_ota_addr = c->desc.our_id_addr;
+    c->desc.conn_itvl = HOST_CONN_ITVL;
+    c->desc.supervision_timeout = HOST_CONN_TIMEOUT;
+    c->anchor_us = esp_timer_get_time();
+    c->desc.role = 1;
+    c->mtu = BLE_ATT_MTU_DFLT;
+    c->peer_mtu = HOST_PEER_MTU;
+    c->cb = host_adv.cb;
+    c->cb_arg = host_adv.cb_arg;
+    /* Connecting ends advertising */
+    host_adv.active = false;
+    host_adv.gen++;
+    pthread_mutex_unlock(&conn_lock);
+
+    a->conn_handle = handle;
+    memset(&event, 0, sizeof event);
+    event.type = BLE_GAP_EVENT_LINK_ESTAB;
+    event.link_estab.conn_handle = handle;
+    event.link_estab.status = 0;
+    conn_event(handle, &event);
+    return 0;
+}
+
+int
+host_ble_connect(const ble_addr_t *peer, uint32_t timeout_ms, uint16_t *conn_handle)
+{
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    connect_args_t a = {
+        .peer = peer,
+    };
+    int rc;
+
+    for (;;)
+    {
+        rc = host_call(connect_call, &a);
+        if (rc != BLE_HS_EAGAIN)
+        {
+            break;
+        }
+        /* Wait for the next advertising start, or poll past a filter */
+        pthread_mutex_lock(&conn_lock);
+        host_cond_wait_until(&adv_cond, &conn_lock,
+                             esp_timer_get_time() + 10000 < deadline ?
+                             esp_timer_get_time() + 10000 : deadline);
+        pthread_mutex_unlock(&conn_lock);
+        if (esp_timer_get_time() >= deadline)
+        {
+            return BLE_HS_ETIMEOUT;
+        }
+    }
+    if (rc == 0)
+    {
+        *conn_handle = a.conn_handle;
+    }
+    return rc;
+}
+
+/* Host task: the link is gone; subscriptions end first, as in NimBLE */
+static void
+disconnect_now(uint16_t conn_handle, int reason)
+{
+    struct ble_gap_event event;
+    uint16_t subs[HOST_MAX_ATTRS];
+    ble_gap_event_fn *cb;
+    void *arg;
+    host_conn_t *c;
+
+    pthread_mutex_lock(&conn_lock);
+    c = conn_find(conn_handle);
+    if (c == NULL)
+    {
+        pthread_mutex_unlock(&conn_lock);
+        return;
+    }
+    memcpy(subs, c->subs, sizeof subs);
+    cb = c->cb;
+    arg = c->cb_arg;
+    pthread_mutex_unlock(&conn_lock);
+
+    for (int i = 0; i < HOST_MAX_ATTRS; i++)
+    {
+        if (subs[i] != 0)
+        {
+            memset(&event, 0, sizeof event);
+            event.type = BLE_GAP_EVENT_SUBSCRIBE;
+            event.subscribe.conn_handle = conn_handle;
+            event.subscribe.attr_handle = subs[i];
+            event.subscribe.reason = BLE_GAP_SUBSCRIBE_REASON_TERM;
+            event.subscribe.prev_notify = 1;
+            event.subscribe.cur_notify = 0;
+            cb(&event, arg);
+        }
+    }
+
+    memset(&event, 0, sizeof event);
+    pthread_mutex_lock(&conn_lock);
+    event.disconnect.conn = c->desc;
+    conn_tx_free(c, INT64_MAX);
+    c->in_use = false;
+    pthread_cond_broadcast(&notify_cond);
+    pthread_mutex_unlock(&conn_lock);
+    event.type = BLE_GAP_EVENT_DISCONNECT;
+    event.disconnect.reason = reason;
+    cb(&event, arg);
+}
+
+typedef struct
+{
+    uint16_t conn_handle;
+    uint16_t attr;
+    int value;
+    const void *data;
+    void *buf;
+    uint16_t len;
+    uint16_t *out_len;
+} gatt_args_t;
+
+static int
+disconnect_call(void *arg)
+{
+    gatt_args_t *a = arg;
+
+    if (!conn_exists(a->conn_handle))
+    {
+        return BLE_HS_ENOTCONN;
+    }
+    disconnect_now(a->conn_handle, BLE_HS_HCI_ERR(a->value));
+    return 0;
+}
+
+int
+host_ble_disconnect(uint16_t conn_handle, uint8_t reason)
+{
+    gatt_args_t a = {
+        .conn_handle = conn_handle,
+        .value = reason,
+    };
+
+    return host_call(disconnect_call, &a);
+}
+
+static const host_attr_t *
+attr_find(uint16_t val_handle)
+{
+    for (int i = 0; i < host_attr_count; i++)
+    {
+        if (host_attrs[i].val_handle == val_handle)
+        {
+            return &host_attrs[i];
+        }
+    }
+    return NULL;
+}
+
+uint16_t
+host_ble_val_handle(uint16_t uuid16)
+{
+    for (int i = 0; i < host_attr_count; i++)
+    {
+        if (ble_uuid_u16(host_attrs[i].chr->uuid) == uuid16)
+        {
+            return host_attrs[i].val_handle;
+        }
+    }
+    return 0;
+}
+
+static int
+subscribe_call(void *arg)
+{
+    gatt_args_t *a = arg;
+    const host_attr_t *attr = attr_find(a->attr);
+    struct ble_gap_event event;
+    host_conn_t *c;
+    int slot = -1;
+    bool prev = false;
+
+    if (attr == NULL || !(attr->chr->flags & BLE_GATT_CHR_F_NOTIFY))
+    {
+        return BLE_HS_ERR_ATT_BASE + BLE_ATT_ERR_INVALID_HANDLE;
+    }
+    pthread_mutex_lock(&conn_lock);
+    c = conn_find(a->conn_handle);
+    if (c == NULL)
+    {
+        pthread_mutex_unlock(&conn_lock);
+        return BLE_HS_ENOTCONN;
+    }
+    for (int i = 0; i < HOST_MAX_ATTRS; i++)
+    {
+        if (c->subs[i] == a->attr)
+        {
+            prev = true;
+            slot = i;
+        }
+        else if (c->subs[i] == 0 && slot < 0)
+        {
+            slot = i;
+        }
+    }
+    c->subs[slot] = a->value ? a->attr : 0;
+    pthread_mutex_unlock(&conn_lock);
+
+    memset(&event, 0, sizeof event);
+    event.type = BLE_GAP_EVENT_SUBSCRIBE;
+    event.subscribe.conn_handle = a->conn_handle;
+    event.subscribe.attr_handle = a->attr;
+    event.subscribe.reason = BLE_GAP_SUBSCRIBE_REASON_WRITE;
+    event.subscribe.prev_notify = prev;
+    event.subscribe.cur_notify = a->value != 0;
+    conn_event(a->conn_handle, &event);
+    return 0;
+}
+
+int
+host_ble_subscribe(uint16_t conn_handle, uint16_t val_handle, bool notify)
+{
+    gatt_args_t a = {
+        .conn_handle = conn_handle,
+        .attr = val_handle,
+        .value = notify,
+    };
+
+    return host_call(subscribe_call, &a);
+}
+
+/* The checks the ATT server makes before calling the access callback */
+static int
+access_check(const gatt_args_t *a, const host_attr_t *attr, bool write,
+             struct ble_gap_conn_desc *desc)
+{
+    uint16_t f = attr != NULL ? attr->chr->flags : 0;
+
+    if (attr == NULL)
+    {
+        return BLE_ATT_ERR_INVALID_HANDLE;
+    }
+    if (ble_gap_conn_find(a->conn_handle, desc) != 0)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+    if (write ? !(f & (BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_NO_RSP)) :
+        !(f & BLE_GATT_CHR_F_READ))
+    {
+        return write ? BLE_ATT_ERR_WRITE_NOT_PERMITTED : BLE_ATT_ERR_READ_NOT_PERMITTED;
+    }
+    if ((f & (write ? BLE_GATT_CHR_F_WRITE_ENC : BLE_GATT_CHR_F_READ_ENC)) &&
+        !desc->sec_state.encrypted)
+    {
+        return BLE_ATT_ERR_INSUFFICIENT_ENC;
+    }
+    return 0;
+}
+
+static int
+write_call(void *arg)
+{
+    gatt_args_t *a = arg;
+    const host_attr_t *attr = attr_find(a->attr);
+    struct ble_gatt_access_ctxt ctxt;
+    struct ble_gap_conn_desc desc;
+    const uint8_t *src = a->data;
+    uint16_t mtu = ble_att_mtu(a->conn_handle);
+    uint16_t frag;
+    uint16_t left = a->len;
+    struct os_mbuf *om = NULL;
+    struct os_mbuf *last = NULL;
+    int rc = access_check(a, attr, true, &desc);
+
+    if (rc != 0)
+    {
+        return rc;
+    }
+    /* One buffer per ATT PDU: a single write, or each prepared fragment */
+    frag = a->len <= mtu - 3 ? mtu - 3 : mtu - 5;
+    do
+    {
+        uint16_t n = left < frag ? left : frag;
+        struct os_mbuf *m = ble_hs_mbuf_from_flat(src, n);
+
+        if (m == NULL)
+        {
+            os_mbuf_free_chain(om);
+            return BLE_ATT_ERR_INSUFFICIENT_RES;
+        }
+        if (om == NULL)
+        {
+            om = m;
+        }
+        else
+        {
+            SLIST_NEXT(last, om_next) = m;
+            om->om_pktlen += n;
+        }
+        last = m;
+        while (SLIST_NEXT(last, om_next) != NULL)
+        {
+            last = SLIST_NEXT(last, om_next);
+        }
+        src += n;
+        left -= n;
+    } while (left > 0);
+
+    memset(&ctxt, 0, sizeof ctxt);
+    ctxt.op = BLE_GATT_ACCESS_OP_WRITE_CHR;
+    ctxt.om = om;
+    ctxt.chr = attr->chr;
+    rc = attr->chr->access_cb(a->conn_handle, a->attr, &ctxt, attr->chr->arg);
+    os_mbuf_free_chain(ctxt.om);
+    return rc;
+}
+
+int
+host_ble_write(uint16_t conn_handle, uint16_t val_handle, const void *data, uint16_t len)
+{
+    gatt_args_t a = {
+        .conn_handle = conn_handle,
+        .attr = val_handle,
+        .data = data,
+        .len = len,
+    };
+    int rc;
+
+    conn_event_wait(conn_handle);
+    rc = host_call(write_call, &a);
+    conn_write_done(conn_handle);
+    return rc;
+}
+
+static int
+read_call(void *arg)
+{
+    gatt_args_t *a = arg;
+    const host_attr_t *attr = attr_find(a->attr);
+    struct ble_gatt_access_ctxt ctxt;
+    struct ble_gap_conn_desc desc;
+    int rc = access_check(a, attr, false, &desc);
+
+    if (rc != 0)
+    {
+        return rc;
+    }
+    memset(&ctxt, 0, sizeof ctxt);
+    ctxt.op = BLE_GATT_ACCESS_OP_READ_CHR;
+    ctxt.om = os_msys_get_pkthdr(0, 0);
+    ctxt.chr = attr->chr;
+    if (ctxt.om == NULL)
+    {
+        return BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
+    rc = attr->chr->access_cb(a->conn_handle, a->attr, &ctxt, attr->chr->arg);
+    if (rc == 0)
+    {
+        ble_hs_mbuf_to_flat(ctxt.om, a->buf, a->len, a->out_len);
+    }
+    os_mbuf_free_chain(ctxt.om);
+    return rc;
+}
+
+int
+host_ble_read(uint16_t conn_handle, uint16_t val_handle, void *buf, uint16_t max,
+              uint16_t *len)
+{
+    gatt_args_t a = {
+        .conn_handle = conn_handle,
+        .attr = val_handle,
+        .buf = buf,
+        .len = max,
+        .out_len = len,
+    };
+
+    return host_call(read_call, &a);
+}
+
+static int
+mtu_call(void *arg)
+{
+    gatt_args_t *a = arg;
+    struct ble_gap_event event;
+    host_conn_t *c;
+    uint16_t mtu = a->value < CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU ?
+                   a->value : CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU;
+
+    pthread_mutex_lock(&conn_lock);
+    c = conn_find(a->conn_handle);
+    if (c != NULL)
+    {
+        c->peer_mtu = a->value;
+        c->mtu = mtu;
+    }
+    pthread_mutex_unlock(&conn_lock);
+    if (c == NULL)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+    memset(&event, 0, sizeof event);
+    event.type = BLE_GAP_EVENT_MTU;
+    event.mtu.conn_handle = a->conn_handle;
+    event.mtu.channel_id = 4;
+    event.mtu.value = mtu;
+    conn_event(a->conn_handle, &event);
+    return 0;
+}
+
+int
+host_ble_exchange_mtu(uint16_t conn_handle, uint16_t mtu)
+{
+    gatt_args_t a = {
+        .conn_handle = conn_handle,
+        .value = mtu,
+    };
+
+    return host_call(mtu_call, &a);
+}
+
+static int
+pair_call(void *arg)
+{
+    gatt_args_t *a = arg;
+    struct ble_gap_conn_desc desc;
+    struct ble_gap_event event;
+    bool known;
+
+    if (ble_gap_conn_find(a->conn_handle, &desc) != 0)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+    pthread_mutex_lock(&conn_lock);
+    known = store_find(&desc.peer_id_addr) >= 0;
+    pthread_mutex_unlock(&conn_lock);
+    if (known)
+    {
+        memset(&event, 0, sizeof event);
+        event.type = BLE_GAP_EVENT_REPEAT_PAIRING;
+        event.repeat_pairing.conn_handle = a->conn_handle;
+        event.repeat_pairing.peer_id_addr = desc.peer_id_addr;
+        if (conn_event(a->conn_handle, &event) != BLE_GAP_REPEAT_PAIRING_RETRY)
+        {
+            return BLE_HS_EALREADY;
+        }
+    }
+    if (a->value)
+    {
+        store_add(&desc.peer_id_addr);
+    }
+    ctlr_post(CTLR_ENC_CHANGE, a->conn_handle, 0, 0, 0);
+    return 0;
+}
+
+int
+host_ble_pair(uint16_t conn_handle, bool bond)
+{
+    gatt_args_t a = {
+        .conn_handle = conn_handle,
+        .value = bond,
+    };
+
+    return host_call(pair_call, &a);
+}
+
+static int
+encrypt_call(void *arg)
+{
+    gatt_args_t *a = arg;
+    struct ble_gap_conn_desc desc;
+    bool known;
+
+    if (ble_gap_conn_find(a->conn_handle, &desc) != 0)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+    pthread_mutex_lock(&conn_lock);
+    known = store_find(&desc.peer_id_addr) >= 0;
+    pthread_mutex_unlock(&conn_lock);
+    /* Without keys the lock answers with a missing-key failure */
+    ctlr_post(CTLR_ENC_CHANGE, a->conn_handle, 0, known ? 0 : BLE_HS_HCI_ERR(0x06),
+              host_timing.enc_ms);
+    return 0;
+}
+
+int
+host_ble_encrypt(uint16_t conn_handle)
+{
+    gatt_args_t a = {
+        .conn_handle = conn_handle,
+    };
+
+    return host_call(encrypt_call, &a);
+}
+
+int
+host_ble_notify_wait(uint16_t conn_handle, uint16_t val_handle, void *buf, uint16_t max,
+                     uint32_t timeout_ms, int64_t *at_us)
+{
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    int len = -1;
+
+    pthread_mutex_lock(&conn_lock);
+    for (;;)
+    {
+        host_conn_t *c = conn_find(conn_handle);
+        int64_t until = deadline;
+
+        for (int i = 0; c != NULL && i < c->notify_count; i++)
+        {
+            host_notify_t *n = &c->notify[(c->notify_head + i) % HOST_NOTIFY_DEPTH];
+
+            if (val_handle != 0 && n->attr != val_handle)
+            {
+                continue;
+            }
+            if (n->at_us > esp_timer_get_time())
+            {
+                /* Not on the air before its connection event */
+                until = n->at_us < deadline ? n->at_us : deadline;
+                break;
+            }
+            len = n->len < max ? n->len : max;
+            memcpy(buf, n->data, len);
+            if (at_us != NULL)
+            {
+                *at_us = n->at_us;
+            }
+            /* Close the gap, keeping the rest in order */
+            for (int j = i; j > 0; j--)
+            {
+                c->notify[(c->notify_head + j) % HOST_NOTIFY_DEPTH] =
+                    c->notify[(c->notify_head + j - 1) % HOST_NOTIFY_DEPTH];
+            }
+            c->notify_head = (c->notify_head + 1) % HOST_NOTIFY_DEPTH;
+            c->notify_count--;
+            break;
+        }
+        if (len >= 0 || c == NULL ||
+            (!host_cond_wait_until(&notify_cond, &conn_lock, until) && until == deadline))
+        {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&conn_lock);
+    return len;
+}
+
+void
+host_ble_notify_flush(uint16_t conn_handle)
+{
+    host_conn_t *c;
+
+    pthread_mutex_lock(&conn_lock);
+    c = conn_find(conn_handle);
+    if (c != NULL)
+    {
+        c->notify_count = 0;
+    }
+    pthread_mutex_unlock(&conn_lock);
+}
+
+int64_t
+host_ble_host_cpu_us(void)
+{
+    struct timespec ts;
+    clockid_t clock;
+
+    if (!host_synced || pthread_getcpuclockid(host_thread, &clock) != 0 ||
+        clock_gettime(clock, &ts) != 0)
+    {
+        return 0;
+    }
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,301 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <string.h>
+#include "mbedtls/sha1.h"
+#include "mbedtls/sha256.h"
+
+/* FIPS 180-4 SHA-1 and SHA-256 behind the mbedTLS calls the lock makes */
+#define ROL(x, n)               (((x) << (n)) | ((x) >> (32 - (n))))
+#define ROR(x, n)               (((x) >> (n)) | ((x) << (32 - (n))))
+
+static uint32_t
+get_be32(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void
+put_be32(unsigned char *p, uint32_t x)
+{
+    p[0] = x >> 24;
+    p[1] = x >> 16;
+    p[2] = x >> 8;
+    p[3] = x;
+}
+
+static void
+sha1_block(mbedtls_sha1_context *ctx, const unsigned char *data)
+{
+    uint32_t w[80];
+    uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2];
+    uint32_t d = ctx->state[3], e = ctx->state[4];
+
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = get_be32(data + 4 * i);
+    }
+    for (int i = 16; i < 80; i++)
+    {
+        w[i] = ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    for (int i = 0; i < 80; i++)
+    {
+        uint32_t f, k, t;
+
+        if (i < 20)
+        {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        }
+        else if (i < 40)
+        {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        }
+        else if (i < 60)
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        t = ROL(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ROL(b, 30);
+        b = a;
+        a = t;
+    }
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+    ctx->state[4] += e;
+}
+
+void
+mbedtls_sha1_init(mbedtls_sha1_context *ctx)
+{
+    memset(ctx, 0, sizeof *ctx);
+}
+
+void
+mbedtls_sha1_free(mbedtls_sha1_context *ctx)
+{
+    memset(ctx, 0, sizeof *ctx);
+}
+
+int
+mbedtls_sha1_starts(mbedtls_sha1_context *ctx)
+{
+    static const uint32_t iv[5] = {
+        0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0,
+    };
+
+    ctx->total[0] = ctx->total[1] = 0;
+    memcpy(ctx->state, iv, sizeof iv);
+    return 0;
+}
+
+int
+mbedtls_sha1_update(mbedtls_sha1_context *ctx, const unsigned char *input, size_t ilen)
+{
+    while (ilen > 0)
+    {
+        size_t fill = ctx->total[0] & 63;
+        size_t n = 64 - fill < ilen ? 64 - fill : ilen;
+
+        memcpy(ctx->buffer + fill, input, n);
+        ctx->total[0] += n;
+        if (ctx->total[0] < n)
+        {
+            ctx->total[1]++;
+        }
+        input += n;
+        ilen -= n;
+        if (fill + n == 64)
+        {
+            sha1_block(ctx, ctx->buffer);
+        }
+    }
+    return 0;
+}
+
+/* Appends the padding and the bit length shared by both digests */
+static void
+sha_pad(uint32_t total[2], unsigned char pad[128], size_t *padn)
+{
+    uint64_t bits = ((uint64_t)total[1] << 32 | total[0]) << 3;
+    size_t fill = total[0] & 63;
+
+    *padn = (fill < 56 ? 56 : 120) - fill;
+    memset(pad, 0, *padn);
+    pad[0] = 0x80;
+    put_be32(pad + *padn, bits >> 32);
+    put_be32(pad + *padn + 4, (uint32_t)bits);
+    *padn += 8;
+}
+
+int
+mbedtls_sha1_finish(mbedtls_sha1_context *ctx, unsigned char output[20])
+{
+    unsigned char pad[128];
+    size_t n;
+
+    sha_pad(ctx->total, pad, &n);
+    mbedtls_sha1_update(ctx, pad, n);
+    for (int i = 0; i < 5; i++)
+    {
+        put_be32(output + 4 * i, ctx->state[i]);
+    }
+    return 0;
+}
+
+int
+mbedtls_sha1(const unsigned char *input, size_t ilen, unsigned char output[20])
+{
+    mbedtls_sha1_context ctx;
+
+    mbedtls_sha1_init(&ctx);
+    mbedtls_sha1_starts(&ctx);
+    mbedtls_sha1_update(&ctx, input, ilen);
+    mbedtls_sha1_finish(&ctx, output);
+    mbedtls_sha1_free(&ctx);
+    return 0;
+}
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void
+sha256_block(mbedtls_sha256_context *ctx, const unsigned char *data)
+{
+    uint32_t w[64];
+    uint32_t s[8];
+
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = get_be32(data + 4 * i);
+    }
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    memcpy(s, ctx->state, sizeof s);
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t S1 = ROR(s[4], 6) ^ ROR(s[4], 11) ^ ROR(s[4], 25);
+        uint32_t ch = (s[4] & s[5]) ^ (~s[4] & s[6]);
+        uint32_t t1 = s[7] + S1 + ch + sha256_k[i] + w[i];
+        uint32_t S0 = ROR(s[0], 2) ^ ROR(s[0], 13) ^ ROR(s[0], 22);
+        uint32_t maj = (s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]);
+
+        memmove(&s[1], &s[0], 7 * sizeof s[0]);
+        s[4] += t1;
+        s[0] = t1 + S0 + maj;
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        ctx->state[i] += s[i];
+    }
+}
+
+void
+mbedtls_sha256_init(mbedtls_sha256_context *ctx)
+{
+    memset(ctx, 0, sizeof *ctx);
+}
+
+void
+mbedtls_sha256_free(mbedtls_sha256_context *ctx)
+{
+    memset(ctx, 0, sizeof *ctx);
+}
+
+int
+mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224)
+{
+    static const uint32_t iv256[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    static const uint32_t iv224[8] = {
+        0xc1059ed8, 0x367cd507, 0x3070dd17, 0xf70e5939,
+        0xffc00b31, 0x68581511, 0x64f98fa7, 0xbefa4fa4,
+    };
+
+    ctx->total[0] = ctx->total[1] = 0;
+    ctx->is224 = is224;
+    memcpy(ctx->state, is224 ? iv224 : iv256, sizeof ctx->state);
+    return 0;
+}
+
+int
+mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+    while (ilen > 0)
+    {
+        size_t fill = ctx->total[0] & 63;
+        size_t n = 64 - fill < ilen ? 64 - fill : ilen;
+
+        memcpy(ctx->buffer + fill, input, n);
+        ctx->total[0] += n;
+        if (ctx->total[0] < n)
+        {
+            ctx->total[1]++;
+        }
+        input += n;
+        ilen -= n;
+        if (fill + n == 64)
+        {
+            sha256_block(ctx, ctx->buffer);
+        }
+    }
+    return 0;
+}
+
+int
+mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char *output)
+{
+    unsigned char pad[128];
+    size_t n;
+
+    sha_pad(ctx->total, pad, &n);
+    mbedtls_sha256_update(ctx, pad, n);
+    for (int i = 0; i < (ctx->is224 ? 7 : 8); i++)
+    {
+        put_be32(output + 4 * i, ctx->state[i]);
+    }
+    return 0;
+}
+
+int
+mbedtls_sha256(const unsigned char *input, size_t ilen, unsigned char *output, int is224)
+{
+    mbedtls_sha256_context ctx;
+
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, is224);
+    mbedtls_sha256_update(&ctx, input, ilen);
+    mbedtls_sha256_finish(&ctx, output);
+    mbedtls_sha256_free(&ctx);
+    return 0;
+}
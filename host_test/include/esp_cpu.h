@@ -0,0 +1,16 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef uint32_t esp_cpu_cycle_count_t;
+
+/* A CPU_TICKS_PER_US clock derived from CLOCK_MONOTONIC */
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void);
+
+int esp_cpu_get_core_id(void);
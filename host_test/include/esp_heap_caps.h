@@ -0,0 +1,23 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define MALLOC_CAP_DEFAULT              (1 << 12)
+#define MALLOC_CAP_8BIT                 (1 << 2)
+
+/* The host heap is sized as HOST_HEAP_SIZE; use is what malloc reports */
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_minimum_free_size(uint32_t caps);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+typedef void (*esp_alloc_failed_hook_t)(size_t size, uint32_t caps, const char *function_name);
+
+esp_err_t heap_caps_register_failed_alloc_callback(esp_alloc_failed_hook_t callback);
@@ -0,0 +1,14 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#include "modlog/modlog.h"
+
+#define ESP_LOGE(tag, fmt, ...)         MODLOG_DFLT(ERROR, "%s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)         MODLOG_DFLT(WARN, "%s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)         MODLOG_DFLT(INFO, "%s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...)         MODLOG_DFLT(DEBUG, "%s: " fmt "\n", tag, ##__VA_ARGS__)
@@ -0,0 +1,29 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define BLE_ATT_MTU_DFLT                        23
+#define BLE_ATT_MTU_MAX                         527
+
+#define BLE_ATT_ERR_INVALID_HANDLE              0x01
+#define BLE_ATT_ERR_READ_NOT_PERMITTED          0x02
+#define BLE_ATT_ERR_WRITE_NOT_PERMITTED         0x03
+#define BLE_ATT_ERR_INVALID_PDU                 0x04
+#define BLE_ATT_ERR_INSUFFICIENT_AUTHEN         0x05
+#define BLE_ATT_ERR_REQ_NOT_SUPPORTED           0x06
+#define BLE_ATT_ERR_INVALID_OFFSET              0x07
+#define BLE_ATT_ERR_INSUFFICIENT_AUTHOR         0x08
+#define BLE_ATT_ERR_ATTR_NOT_LONG               0x0b
+#define BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN      0x0d
+#define BLE_ATT_ERR_UNLIKELY                    0x0e
+#define BLE_ATT_ERR_INSUFFICIENT_ENC            0x0f
+#define BLE_ATT_ERR_INSUFFICIENT_RES            0x11
+
+/* Negotiated MTU of a connection, 0 if there is none */
+uint16_t ble_att_mtu(uint16_t conn_handle);
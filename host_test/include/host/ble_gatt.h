@@ -0,0 +1,122 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "host/ble_uuid.h"
+
+struct os_mbuf;
+
+#define BLE_GATT_ACCESS_OP_READ_CHR             0
+#define BLE_GATT_ACCESS_OP_WRITE_CHR            1
+#define BLE_GATT_ACCESS_OP_READ_DSC             2
+#define BLE_GATT_ACCESS_OP_WRITE_DSC            3
+
+#define BLE_GATT_CHR_F_BROADCAST                0x0001
+#define BLE_GATT_CHR_F_READ                     0x0002
+#define BLE_GATT_CHR_F_WRITE_NO_RSP             0x0004
+#define BLE_GATT_CHR_F_WRITE                    0x0008
+#define BLE_GATT_CHR_F_NOTIFY                   0x0010
+#define BLE_GATT_CHR_F_INDICATE                 0x0020
+#define BLE_GATT_CHR_F_READ_ENC                 0x0200
+#define BLE_GATT_CHR_F_READ_AUTHEN              0x0400
+#define BLE_GATT_CHR_F_WRITE_ENC                0x1000
+#define BLE_GATT_CHR_F_WRITE_AUTHEN             0x2000
+
+#define BLE_GATT_SVC_TYPE_END                   0
+#define BLE_GATT_SVC_TYPE_PRIMARY               1
+#define BLE_GATT_SVC_TYPE_SECONDARY             2
+
+#define BLE_GATT_REGISTER_OP_SVC                1
+#define BLE_GATT_REGISTER_OP_CHR                2
+#define BLE_GATT_REGISTER_OP_DSC                3
+
+struct ble_gatt_access_ctxt;
+typedef int ble_gatt_access_fn(uint16_t conn_handle, uint16_t attr_handle,
+                               struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+struct ble_gatt_dsc_def
+{
+    const ble_uuid_t *uuid;
+    uint8_t att_flags;
+    uint8_t min_key_size;
+    ble_gatt_access_fn *access_cb;
+    void *arg;
+};
+
+struct ble_gatt_chr_def
+{
+    const ble_uuid_t *uuid;
+    ble_gatt_access_fn *access_cb;
+    void *arg;
+    struct ble_gatt_dsc_def *descriptors;
+    uint16_t flags;
+    uint8_t min_key_size;
+    uint16_t *val_handle;
+};
+
+struct ble_gatt_svc_def
+{
+    uint8_t type;
+    const ble_uuid_t *uuid;
+    const struct ble_gatt_svc_def **includes;
+    const struct ble_gatt_chr_def *characteristics;
+};
+
+struct ble_gatt_access_ctxt
+{
+    uint8_t op;
+    struct os_mbuf *om;
+    union
+    {
+        const struct ble_gatt_chr_def *chr;
+        const struct ble_gatt_dsc_def *dsc;
+    };
+};
+
+struct ble_gatt_register_ctxt
+{
+    uint8_t op;
+    union
+    {
+        struct
+        {
+            uint16_t handle;
+            const struct ble_gatt_svc_def *svc_def;
+        } svc;
+
+        struct
+        {
+            uint16_t def_handle;
+            uint16_t val_handle;
+            const struct ble_gatt_svc_def *svc_def;
+            const struct ble_gatt_chr_def *chr_def;
+        } chr;
+
+        struct
+        {
+            uint16_t handle;
+            const struct ble_gatt_svc_def *svc_def;
+            const struct ble_gatt_chr_def *chr_def;
+            const struct ble_gatt_dsc_def *dsc_def;
+        } dsc;
+    };
+};
+
+struct ble_gatt_error
+{
+    uint16_t status;
+    uint16_t att_handle;
+};
+
+typedef int ble_gatt_mtu_fn(uint16_t conn_handle, const struct ble_gatt_error *error,
+                            uint16_t mtu, void *arg);
+
+int ble_gatts_count_cfg(const struct ble_gatt_svc_def *defs);
+int ble_gatts_add_svcs(const struct ble_gatt_svc_def *svcs);
+int ble_gatts_notify_custom(uint16_t conn_handle, uint16_t att_handle, struct os_mbuf *om);
+int ble_gattc_exchange_mtu(uint16_t conn_handle, ble_gatt_mtu_fn *cb, void *cb_arg);
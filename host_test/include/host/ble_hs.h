@@ -0,0 +1,82 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+/*
+ * The NimBLE host API the lock uses, implemented in-process by
+ * fakes/nimble_host.c: GAP connections and GATT access driven by a test
+ * script instead of a radio.
+ */
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "nimble/ble.h"
+#include "nimble/nimble_npl.h"
+#include "os/os_mbuf.h"
+#include "host/ble_att.h"
+#include "host/ble_gap.h"
+#include "host/ble_gatt.h"
+#include "host/ble_hs_adv.h"
+#include "host/ble_hs_id.h"
+#include "host/ble_hs_mbuf.h"
+#include "host/ble_store.h"
+#include "host/ble_uuid.h"
+
+#define BLE_HS_FOREVER                  INT32_MAX
+
+#define BLE_HS_CONN_HANDLE_NONE         0xffff
+
+#define BLE_HS_EAGAIN                   1
+#define BLE_HS_EALREADY                 2
+#define BLE_HS_EINVAL                   3
+#define BLE_HS_EMSGSIZE                 4
+#define BLE_HS_ENOENT                   5
+#define BLE_HS_ENOMEM                   6
+#define BLE_HS_ENOTCONN                 7
+#define BLE_HS_ENOTSUP                  8
+#define BLE_HS_EAPP                     9
+#define BLE_HS_EBADDATA                 10
+#define BLE_HS_EOS                      11
+#define BLE_HS_ECONTROLLER              12
+#define BLE_HS_ETIMEOUT                 13
+#define BLE_HS_EDONE                    14
+#define BLE_HS_EBUSY                    15
+#define BLE_HS_EREJECT                  16
+#define BLE_HS_EUNKNOWN                 17
+#define BLE_HS_EROLE                    18
+#define BLE_HS_ETIMEOUT_HCI             19
+#define BLE_HS_ENOMEM_EVT               20
+#define BLE_HS_ENOADDR                  21
+#define BLE_HS_ENOTSYNCED               22
+
+/* Status codes from the controller and the peer, offset into the BLE_HS_E* space */
+#define BLE_HS_ERR_ATT_BASE             0x100
+#define BLE_HS_ERR_HCI_BASE             0x200
+#define BLE_HS_HCI_ERR(x)               ((x) ? BLE_HS_ERR_HCI_BASE + (x) : 0)
+
+struct ble_store_status_event;
+
+struct ble_hs_cfg
+{
+    void (*reset_cb)(int reason);
+    void (*sync_cb)(void);
+    void (*gatts_register_cb)(struct ble_gatt_register_ctxt *ctxt, void *arg);
+    void *gatts_register_arg;
+    int (*store_status_cb)(struct ble_store_status_event *event, void *arg);
+    void *store_status_arg;
+    uint8_t sm_io_cap;
+    unsigned sm_oob_data_flag:1;
+    unsigned sm_bonding:1;
+    unsigned sm_mitm:1;
+    unsigned sm_sc:1;
+    unsigned sm_keypress:1;
+    uint8_t sm_our_key_dist;
+    uint8_t sm_their_key_dist;
+};
+
+extern struct ble_hs_cfg ble_hs_cfg;
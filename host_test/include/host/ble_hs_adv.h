@@ -0,0 +1,36 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "host/ble_uuid.h"
+
+#define BLE_HS_ADV_MAX_SZ               31
+
+#define BLE_HS_ADV_TYPE_FLAGS           0x01
+#define BLE_HS_ADV_TYPE_MFG_DATA        0xff
+
+#define BLE_HS_ADV_F_DISC_LTD           0x01
+#define BLE_HS_ADV_F_DISC_GEN           0x02
+#define BLE_HS_ADV_F_BREDR_UNSUP        0x04
+
+#define BLE_HS_ADV_TX_PWR_LVL_AUTO      (-128)
+
+struct ble_hs_adv_fields
+{
+    uint8_t flags;
+    const ble_uuid16_t *uuids16;
+    uint8_t num_uuids16;
+    unsigned uuids16_is_complete:1;
+    const uint8_t *name;
+    uint8_t name_len;
+    unsigned name_is_complete:1;
+    int8_t tx_pwr_lvl;
+    unsigned tx_pwr_lvl_is_present:1;
+    const uint8_t *mfg_data;
+    uint8_t mfg_data_len;
+};
@@ -0,0 +1,42 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "nimble/ble.h"
+
+struct ble_store_key_sec
+{
+    ble_addr_t peer_addr;
+    uint16_t ediv;
+    uint64_t rand_num;
+    unsigned ediv_rand_present:1;
+    uint8_t idx;
+};
+
+struct ble_store_value_sec
+{
+    ble_addr_t peer_addr;
+    uint8_t key_size;
+    uint16_t ediv;
+    uint64_t rand_num;
+    uint8_t ltk[16];
+    unsigned ltk_present:1;
+    unsigned authenticated:1;
+    unsigned sc:1;
+    unsigned bonded:1;
+};
+
+struct ble_store_status_event;
+
+/* 0 if the store holds keys for the peer, else BLE_HS_ENOENT */
+int ble_store_read_peer_sec(const struct ble_store_key_sec *key,
+                            struct ble_store_value_sec *value_sec);
+int ble_store_util_delete_peer(const ble_addr_t *peer_id_addr);
+int ble_store_util_bonded_peers(ble_addr_t *out_peer_id_addrs, int *out_num_peers,
+                                int max_peers);
+int ble_store_util_status_rr(struct ble_store_status_event *event, void *arg);
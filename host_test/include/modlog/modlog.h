@@ -0,0 +1,24 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#define MODLOG_LEVEL_DEBUG              0
+#define MODLOG_LEVEL_INFO               1
+#define MODLOG_LEVEL_WARN               2
+#define MODLOG_LEVEL_ERROR              3
+#define MODLOG_LEVEL_CRITICAL           4
+
+/* Lines below this level are dropped; WARN unless LOCK_HOST_LOG says otherwise */
+extern int host_log_level;
+
+void host_log(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define MODLOG_DFLT(ml_lvl_, ...) do {                                      \
+        if (MODLOG_LEVEL_##ml_lvl_ >= host_log_level) {                     \
+            host_log(MODLOG_LEVEL_##ml_lvl_, __VA_ARGS__);                  \
+        }                                                                   \
+    } while (0)
@@ -0,0 +1,69 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define BLE_ADDR_PUBLIC                 0x00
+#define BLE_ADDR_RANDOM                 0x01
+#define BLE_ADDR_PUBLIC_ID              0x02
+#define BLE_ADDR_RANDOM_ID              0x03
+
+#define BLE_ERR_REM_USER_CONN_TERM      0x13
+#define BLE_ERR_CONN_TERM_LOCAL         0x16
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t val[6];
+} ble_addr_t;
+
+static inline int
+ble_addr_cmp(const ble_addr_t *a, const ble_addr_t *b)
+{
+    int type_diff = a->type - b->type;
+
+    return type_diff != 0 ? type_diff : memcmp(a->val, b->val, sizeof a->val);
+}
+
+static inline void
+put_le16(void *buf, uint16_t x)
+{
+    uint8_t *u8ptr = buf;
+
+    u8ptr[0] = (uint8_t)x;
+    u8ptr[1] = (uint8_t)(x >> 8);
+}
+
+static inline void
+put_le32(void *buf, uint32_t x)
+{
+    uint8_t *u8ptr = buf;
+
+    u8ptr[0] = (uint8_t)x;
+    u8ptr[1] = (uint8_t)(x >> 8);
+    u8ptr[2] = (uint8_t)(x >> 16);
+    u8ptr[3] = (uint8_t)(x >> 24);
+}
+
+static inline uint16_t
+get_le16(const void *buf)
+{
+    const uint8_t *u8ptr = buf;
+
+    return u8ptr[0] | (uint16_t)u8ptr[1] << 8;
+}
+
+static inline uint32_t
+get_le32(const void *buf)
+{
+    const uint8_t *u8ptr = buf;
+
+    return u8ptr[0] | (uint32_t)u8ptr[1] << 8 | (uint32_t)u8ptr[2] << 16 |
+           (uint32_t)u8ptr[3] << 24;
+}
@@ -0,0 +1,32 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+struct ble_npl_event;
+typedef void ble_npl_event_fn(struct ble_npl_event *ev);
+
+/* An event sits on at most one queue; putting it again while queued does
+ * nothing, as with the FreeRTOS port */
+struct ble_npl_event
+{
+    bool queued;
+    ble_npl_event_fn *fn;
+    void *arg;
+    struct ble_npl_event *next;
+};
+
+struct ble_npl_eventq
+{
+    struct ble_npl_event *head;
+    struct ble_npl_event *tail;
+};
+
+void ble_npl_event_init(struct ble_npl_event *ev, ble_npl_event_fn *fn, void *arg);
+void *ble_npl_event_get_arg(struct ble_npl_event *ev);
+void ble_npl_eventq_put(struct ble_npl_eventq *evq, struct ble_npl_event *ev);
@@ -0,0 +1,18 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include "nimble/nimble_npl.h"
+
+esp_err_t nimble_port_init(void);
+
+/* Runs the default event queue until nimble_port_stop() */
+void nimble_port_run(void);
+int nimble_port_stop(void);
+
+struct ble_npl_eventq *nimble_port_get_dflt_eventq(void);
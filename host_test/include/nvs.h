@@ -0,0 +1,10 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+/* Only the error codes; lock_hal_host.c keeps NVS in memory */
+#include "esp_err.h"
@@ -0,0 +1,47 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/queue.h>
+#include "os/os_mempool.h"
+
+/*
+ * Chained buffers from fixed-size pools, as in NimBLE.  The packet length
+ * lives in the first buffer of a chain; every buffer owns a block of its
+ * pool, so running a pool dry fails allocations like on the target.
+ */
+struct os_mbuf_pool;
+
+struct os_mbuf
+{
+    uint8_t *om_data;
+    uint8_t om_flags;
+    uint8_t om_pkthdr_len;
+    uint16_t om_len;
+    struct os_mbuf_pool *om_omp;
+    SLIST_ENTRY(os_mbuf) om_next;
+    uint16_t om_pktlen;             /* Chain length; first buffer only */
+    uint16_t om_size;               /* Room in om_databuf */
+    uint8_t om_databuf[];
+};
+
+#define OS_MBUF_PKTLEN(om)              ((om)->om_pktlen)
+
+struct os_mbuf *os_msys_get_pkthdr(uint16_t dsize, uint16_t user_hdr_len);
+
+/* 0, or OS_ENOMEM with as much appended as fitted, as in NimBLE */
+int os_mbuf_append(struct os_mbuf *om, const void *data, uint16_t len);
+struct os_mbuf *os_mbuf_dup(struct os_mbuf *om);
+int os_mbuf_free_chain(struct os_mbuf *om);
+int os_mbuf_copydata(const struct os_mbuf *om, int off, int len, void *dst);
+
+int os_msys_count(void);
+int os_msys_num_free(void);
+
+#define OS_ENOMEM                       1
+#define OS_EINVAL                       2
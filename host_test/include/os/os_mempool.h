@@ -0,0 +1,26 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define OS_MEMPOOL_INFO_NAME_LEN        32
+
+struct os_mempool;
+
+struct os_mempool_info
+{
+    int omi_block_size;
+    int omi_num_blocks;
+    int omi_num_free;
+    int omi_min_free;
+    char omi_name[OS_MEMPOOL_INFO_NAME_LEN];
+};
+
+/* Walks every pool; NULL starts at the first and ends the walk */
+struct os_mempool *os_mempool_info_get_next(struct os_mempool *mp,
+                                            struct os_mempool_info *omi);
@@ -0,0 +1,115 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * Configuration of the host build: the committed sdkconfig, limited to the
+ * options the lock sources read.  It differs in two places: four doors let
+ * the per-door paths run side by side, and bonding is on, with the bonded
+ * fast reconnect, so that path is tested as well.
+ */
+#pragma once
+
+/* Example Configuration */
+#define CONFIG_EXAMPLE_IO_TYPE                   3
+#define CONFIG_EXAMPLE_BONDING                   1
+
+/* Door Lock Configuration */
+#define CONFIG_LOCK_DOOR_COUNT                   4
+#define CONFIG_LOCK_DOOR0_GPIO                   2
+#define CONFIG_LOCK_DOOR1_GPIO                   4
+#define CONFIG_LOCK_DOOR2_GPIO                   5
+#define CONFIG_LOCK_DOOR3_GPIO                   18
+#define CONFIG_LOCK_SERVO_TRAVEL_MS              300
+/* Overridden where a test builds a module at another setting */
+#ifndef CONFIG_LOCK_SERVO_RANGE_DEG
+#define CONFIG_LOCK_SERVO_MIN_PULSE_US           500
+#define CONFIG_LOCK_SERVO_MAX_PULSE_US           2500
+#define CONFIG_LOCK_SERVO_RANGE_DEG              180
+#endif
+#define CONFIG_LOCK_SERVO_LOCKED_DEG             90
+#define CONFIG_LOCK_SERVO_OPEN_DEG               46
+#if !CONFIG_LOCK_SERVO_PROFILE_LINEAR && !CONFIG_LOCK_SERVO_PROFILE_TRAPEZOID
+#define CONFIG_LOCK_SERVO_PROFILE_SCURVE         1
+#endif
+#define CONFIG_LOCK_HOLD_MS                      1000
+#define CONFIG_LOCK_WELCOME_DELAY_MS             100
+#define CONFIG_LOCK_SUBSCRIBE_DELAY_MS           50
+#define CONFIG_LOCK_DEFER_MAX_JOBS               16
+#define CONFIG_LOCK_BRIDGE_RING_SIZE             4096
+#define CONFIG_LOCK_BRIDGE_COALESCE_MS           10
+#define CONFIG_LOCK_BRIDGE_MAX_RETRIES           8
+#define CONFIG_LOCK_FANOUT_WINDOW                4
+#ifndef CONFIG_LOCK_FANOUT_SLOW_THROTTLE
+#define CONFIG_LOCK_FANOUT_SLOW_DROP             1
+#endif
+#define CONFIG_LOCK_POLICY_FAST_ITVL_MS          15
+#define CONFIG_LOCK_POLICY_IDLE_MS               2000
+#define CONFIG_LOCK_POLICY_RELAX_MS              15000
+#define CONFIG_LOCK_ADV_FAST_MS                  30000
+#define CONFIG_LOCK_ADV_FAST_ITVL_MS             30
+#define CONFIG_LOCK_ADV_SLOW_ITVL_MS             1022
+#define CONFIG_LOCK_ADV_STATUS                   1
+#define CONFIG_LOCK_BOND_FAST                    1
+#define CONFIG_LOCK_BOND_CACHE_SIZE              4
+#define CONFIG_LOCK_ADV_BOND_MS                  3000
+#define CONFIG_LOCK_BOND_RESUME_S                300
+#define CONFIG_LOCK_FRAME_MAX                    256
+#define CONFIG_LOCK_FRAME_SHORT_WRITE_ENDS       1
+#define CONFIG_LOCK_FRAME_GAP_MS                 3000
+#define CONFIG_LOCK_DEFAULT_PIN                  "200296"
+/* Overridden where a test builds a module at another setting */
+#ifndef CONFIG_LOCK_CRED_MAX_USERS
+#define CONFIG_LOCK_CRED_MAX_USERS               1000
+#endif
+#define CONFIG_LOCK_ACCESS_MAX                   32
+#define CONFIG_LOCK_TZ_OFFSET_MIN                480
+#define CONFIG_LOCK_TOTP_MAX_USERS               16
+#define CONFIG_LOCK_TOTP_STEP_S                  30
+#ifndef CONFIG_LOCK_TOTP_DIGITS
+#define CONFIG_LOCK_TOTP_DIGITS                  6
+#endif
+#define CONFIG_LOCK_TOTP_WINDOW                  1
+#define CONFIG_LOCK_RATE_PEERS                   16
+#define CONFIG_LOCK_RATE_PER_S                   2
+#define CONFIG_LOCK_RATE_BURST                   5
+#define CONFIG_LOCK_LOCKOUT_FAILS                3
+#define CONFIG_LOCK_LOCKOUT_BASE_MS              2000
+#define CONFIG_LOCK_LOCKOUT_MAX_S                600
+#define CONFIG_LOCK_BLOG_ASYNC                   1
+#define CONFIG_LOCK_BLOG_RING_RECORDS            128
+#define CONFIG_LOCK_AUDIT_BATCH                  8
+#define CONFIG_LOCK_AUDIT_FLUSH_MS               1000
+#define CONFIG_LOCK_STATUS_COALESCE_MS           30
+#define CONFIG_LOCK_CONSOLE                      1
+#define CONFIG_LOCK_OTA                          1
+#define CONFIG_LOCK_OTA_BUF_SIZE                 4096
+#define CONFIG_LOCK_OTA_RESUME_S                 300
+#define CONFIG_LOCK_DIAG                         1
+#define CONFIG_LOCK_DIAG_UNLOCK_BUDGET_MS        250
+#define CONFIG_LOCK_MEM_ACCT                     1
+#define CONFIG_LOCK_PM                           1
+#define CONFIG_LOCK_PM_MIN_FREQ_MHZ              40
+#define CONFIG_LOCK_SERVO_POWER_GPIO             -1
+#define CONFIG_LOCK_PM_SERVO_SETTLE_MS           300
+#define CONFIG_LOCK_PM_UART_IDLE_MS              1000
+
+/* NimBLE */
+#define CONFIG_BT_NIMBLE_MAX_CONNECTIONS         3
+#define CONFIG_BT_NIMBLE_MAX_BONDS               3
+#define CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU       256
+#define CONFIG_BT_NIMBLE_HOST_TASK_STACK_SIZE    4096
+#define CONFIG_BT_NIMBLE_WHITELIST_SIZE          12
+#define CONFIG_BT_NIMBLE_MSYS_1_BLOCK_COUNT      12
+#define CONFIG_BT_NIMBLE_MSYS_1_BLOCK_SIZE       256
+#define CONFIG_BT_NIMBLE_MSYS_2_BLOCK_COUNT      24
+#define CONFIG_BT_NIMBLE_MSYS_2_BLOCK_SIZE       320
+
+/* System */
+#define CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ          160
+#define CONFIG_ESP_TIMER_TASK_STACK_SIZE         3584
+#define CONFIG_FREERTOS_HZ                       1000
+#define CONFIG_FREERTOS_USE_TICKLESS_IDLE        1
+#define CONFIG_PM_ENABLE                         1
@@ -0,0 +1,11 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+void ble_svc_gap_init(void);
+const char *ble_svc_gap_device_name(void);
+int ble_svc_gap_device_name_set(const char *name);
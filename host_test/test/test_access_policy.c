@@ -0,0 +1,384 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * Access policies.  The compiler on fixed rules and on rules it must
+ * refuse, the day numbers both ways over their whole range, then random
+ * rules whose compiled decisions must match a walk over their windows at
+ * random times.  The time of a compiled decision and of the walk are
+ * reported.  Last, on the running lock: a weekday PIN opens on Friday and
+ * not on Saturday, a guest PIN opens once and is revoked, and a restricted
+ * PIN is refused while the clock is unset, each with its audit record.
+ *
+ * Usage: test_access_policy [seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host_ble.h"
+#include "host_app.h"
+#include "lock_hal.h"
+#include "cred_store.h"
+#include "audit_log.h"
+#include "access_policy.h"
+
+#define TEST_RULES              10000
+#define TEST_DECISIONS          200
+#define TEST_TIMED              (20 * 1000 * 1000)
+#define TEST_TIMES              4096
+#define TEST_SPP_UUID           0xABF1
+#define TEST_DAY_S              86400
+#define TEST_TZ_S               (CONFIG_LOCK_TZ_OFFSET_MIN * 60)
+/* Friday 2026-10-16 */
+#define TEST_FRIDAY             20742
+#define TEST_WEEKDAY_PIN        "246810"
+#define TEST_GUEST_PIN          "135791"
+#define TEST_GRANTED            "口令正确"
+
+static uint32_t rng_state;
+
+static uint32_t
+rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/*
+ * The rule as written: 1 inside its windows, 0 outside them, -1 outside
+ * its dates
+ */
+static int
+walk_windows(const access_rule_t *r, int64_t t)
+{
+    int64_t day = t / TEST_DAY_S;
+    int wd = (day + 3) % 7;
+    int prev = (wd + 6) % 7;
+    int h = t % TEST_DAY_S / 3600;
+
+    if (day < r->from_day || (r->until_day != ACCESS_DAY_NONE && day > r->until_day))
+    {
+        return -1;
+    }
+    if (r->nwindows == 0)
+    {
+        return 1;
+    }
+    for (int i = 0; i < r->nwindows; i++)
+    {
+        const access_window_t *w = &r->windows[i];
+
+        if (w->end_hour > w->start_hour)
+        {
+            if ((w->days >> wd & 1) && h >= w->start_hour && h < w->end_hour)
+            {
+                return 1;
+            }
+        }
+        else if (((w->days >> wd & 1) && h >= w->start_hour) ||
+                 ((w->days >> prev & 1) && h < w->end_hour))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int64_t
+at(int32_t day, int hour)
+{
+    return (int64_t)day * TEST_DAY_S + hour * 3600;
+}
+
+static void
+test_compile(void)
+{
+    access_rule_t r = { .until_day = ACCESS_DAY_NONE };
+    access_policy_t p;
+
+    /* Monday to Friday, 9 to 18 */
+    r.nwindows = 1;
+    r.windows[0] = (access_window_t){ 0x1F, 9, 18 };
+    HOST_CHECK(access_policy_compile(&r, &p) == ESP_OK);
+    HOST_CHECK(access_policy_decide(&p, at(TEST_FRIDAY, 9)) == ACCESS_ALLOW);
+    HOST_CHECK(access_policy_decide(&p, at(TEST_FRIDAY, 18) - 1) == ACCESS_ALLOW);
+    HOST_CHECK(access_policy_decide(&p, at(TEST_FRIDAY, 18)) == ACCESS_DENY_HOURS);
+    HOST_CHECK(access_policy_decide(&p, at(TEST_FRIDAY, 9) - 1) == ACCESS_DENY_HOURS);
+    HOST_CHECK(access_policy_decide(&p, at(TEST_FRIDAY + 1, 10)) == ACCESS_DENY_HOURS);
+    HOST_CHECK(access_policy_decide(&p, -1) == ACCESS_DENY_DATES);
+
+    /* Sunday 22 to 6 runs into Monday morning */
+    r.windows[0] = (access_window_t){ ACCESS_SUN, 22, 6 };
+    HOST_CHECK(access_policy_compile(&r, &p) == ESP_OK);
+    HOST_CHECK(access_policy_decide(&p, at(TEST_FRIDAY + 2, 22)) == ACCESS_ALLOW);
+    HOST_CHECK(access_policy_decide(&p, at(TEST_FRIDAY + 3, 5)) == ACCESS_ALLOW);
+    HOST_CHECK(access_policy_decide(&p, at(TEST_FRIDAY + 3, 6)) == ACCESS_DENY_HOURS);
+    HOST_CHECK(access_policy_decide(&p, at(TEST_FRIDAY + 2, 5)) == ACCESS_DENY_HOURS);
+
+    /* Any hour on one day, once */
+    r.nwindows = 0;
+    r.from_day = TEST_FRIDAY;
+    r.until_day = TEST_FRIDAY;
+    r.once = true;
+    HOST_CHECK(access_policy_compile(&r, &p) == ESP_OK);
+    HOST_CHECK(access_policy_decide(&p, at(TEST_FRIDAY, 0)) == ACCESS_ALLOW_ONCE);
+    HOST_CHECK(access_policy_decide(&p, at(TEST_FRIDAY, 24) - 1) == ACCESS_ALLOW_ONCE);
+    HOST_CHECK(access_policy_decide(&p, at(TEST_FRIDAY, 0) - 1) == ACCESS_DENY_DATES);
+    HOST_CHECK(access_policy_decide(&p, at(TEST_FRIDAY + 1, 0)) == ACCESS_DENY_DATES);
+    /* SPENT is the store's; decide ignores it */
+    p.flags |= ACCESS_F_SPENT;
+    HOST_CHECK(access_policy_decide(&p, at(TEST_FRIDAY, 12)) == ACCESS_ALLOW_ONCE);
+
+    /* Refused */
+    r.from_day = TEST_FRIDAY + 1;
+    HOST_CHECK(access_policy_compile(&r, &p) == ESP_ERR_INVALID_ARG);
+    r.from_day = 0;
+    r.until_day = ACCESS_DAY_NONE;
+    r.nwindows = ACCESS_MAX_WINDOWS + 1;
+    HOST_CHECK(access_policy_compile(&r, &p) == ESP_ERR_INVALID_ARG);
+    r.nwindows = 1;
+    r.windows[0] = (access_window_t){ 0, 1, 2 };
+    HOST_CHECK(access_policy_compile(&r, &p) == ESP_ERR_INVALID_ARG);
+    r.windows[0] = (access_window_t){ 0x80, 1, 2 };
+    HOST_CHECK(access_policy_compile(&r, &p) == ESP_ERR_INVALID_ARG);
+    r.windows[0] = (access_window_t){ ACCESS_MON, 24, 2 };
+    HOST_CHECK(access_policy_compile(&r, &p) == ESP_ERR_INVALID_ARG);
+    r.windows[0] = (access_window_t){ ACCESS_MON, 2, 25 };
+    HOST_CHECK(access_policy_compile(&r, &p) == ESP_ERR_INVALID_ARG);
+    r.windows[0] = (access_window_t){ ACCESS_MON, 2, 0 };
+    HOST_CHECK(access_policy_compile(&r, &p) == ESP_ERR_INVALID_ARG);
+    printf("compile: ok\n");
+}
+
+static void
+test_days(void)
+{
+    int y, m, d;
+
+    HOST_CHECK(access_policy_day(1970, 1, 1) == 0);
+    HOST_CHECK(access_policy_day(2026, 10, 16) == TEST_FRIDAY);
+    HOST_CHECK(access_policy_day(2024, 2, 29) > 0);
+    HOST_CHECK(access_policy_day(2025, 2, 29) == -1);
+    HOST_CHECK(access_policy_day(2100, 2, 29) == -1);
+    HOST_CHECK(access_policy_day(2000, 2, 29) > 0);
+    HOST_CHECK(access_policy_day(1969, 12, 31) == -1);
+    HOST_CHECK(access_policy_day(2026, 13, 1) == -1);
+    HOST_CHECK(access_policy_day(2026, 4, 31) == -1);
+    /* ACCESS_DAY_NONE is not a date */
+    HOST_CHECK(access_policy_day(2149, 6, 6) == -1);
+    for (int32_t k = 0; k < ACCESS_DAY_NONE; k++)
+    {
+        access_policy_date(k, &y, &m, &d);
+        HOST_CHECK(access_policy_day(y, m, d) == k);
+    }
+    printf("days: ok\n");
+}
+
+static void
+random_rule(access_rule_t *r)
+{
+    memset(r, 0, sizeof *r);
+    r->nwindows = rng() % (ACCESS_MAX_WINDOWS + 1);
+    for (int k = 0; k < r->nwindows; k++)
+    {
+        r->windows[k] = (access_window_t){ 1 + rng() % ACCESS_DAILY, rng() % 24, 1 + rng() % 24 };
+    }
+    r->from_day = rng() % 2 ? 0 : 20000 + rng() % 1000;
+    r->until_day = rng() % 2 ? ACCESS_DAY_NONE : r->from_day + rng() % 1500;
+    r->once = rng() % 4 == 0;
+}
+
+static int64_t
+random_time(void)
+{
+    return 20000LL * TEST_DAY_S + (int64_t)rng() % (3000LL * TEST_DAY_S);
+}
+
+/* Compiled decisions against the walk, then the time of each */
+static void
+test_random(access_rule_t *rules, access_policy_t *pols)
+{
+    int64_t times[TEST_TIMES];
+    volatile int sink = 0;
+    int64_t t0;
+    double compiled_ns;
+    double walk_ns;
+
+    for (int i = 0; i < TEST_RULES; i++)
+    {
+        random_rule(&rules[i]);
+        HOST_CHECK(access_policy_compile(&rules[i], &pols[i]) == ESP_OK);
+    }
+    for (int i = 0; i < TEST_RULES; i++)
+    {
+        for (int k = 0; k < TEST_DECISIONS; k++)
+        {
+            int64_t t = random_time();
+            int walk = walk_windows(&rules[i], t);
+            access_verdict_t v = access_policy_decide(&pols[i], t);
+
+            if (walk == 1)
+            {
+                HOST_CHECK(v == (rules[i].once ? ACCESS_ALLOW_ONCE : ACCESS_ALLOW));
+            }
+            else
+            {
+                HOST_CHECK(v == (walk == 0 ? ACCESS_DENY_HOURS : ACCESS_DENY_DATES));
+            }
+        }
+    }
+    printf("random: %d rules, %d decisions match the walk\n", TEST_RULES,
+           TEST_RULES * TEST_DECISIONS);
+
+    for (int i = 0; i < TEST_TIMES; i++)
+    {
+        times[i] = random_time();
+    }
+    t0 = esp_timer_get_time();
+    for (int i = 0; i < TEST_TIMED; i++)
+    {
+        sink += access_policy_decide(&pols[(unsigned)i * 7919u % TEST_RULES], times[i % TEST_TIMES]);
+    }
+    compiled_ns = (esp_timer_get_time() - t0) * 1000.0 / TEST_TIMED;
+    t0 = esp_timer_get_time();
+    for (int i = 0; i < TEST_TIMED; i++)
+    {
+        sink += walk_windows(&rules[(unsigned)i * 7919u % TEST_RULES], times[i % TEST_TIMES]);
+    }
+    walk_ns = (esp_timer_get_time() - t0) * 1000.0 / TEST_TIMED;
+    printf("decide: %.1f ns compiled, %.1f ns walking up to %d windows; %zu bytes a policy\n",
+           compiled_ns, walk_ns, ACCESS_MAX_WINDOWS, sizeof(access_policy_t));
+}
+
+/* The next committed audit record; the log writes in batches */
+static void
+audit_next(uint32_t *cursor, audit_rec_t *rec)
+{
+    for (int ms = 0; ms < 5000; ms += 10)
+    {
+        if (audit_log_read(cursor, rec, 1) == 1)
+        {
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    HOST_CHECK(!"no audit record");
+}
+
+/* One PIN over a fresh link; returns whether the door opened */
+static bool
+try_pin(int peer_n, const char *pin, uint32_t *cursor, uint16_t user, audit_result_t result)
+{
+    static uint16_t spp;
+    ble_addr_t peer;
+    audit_rec_t rec;
+    uint16_t conn;
+    char buf[512];
+    int len;
+
+    if (spp == 0)
+    {
+        spp = host_ble_val_handle(TEST_SPP_UUID);
+        HOST_CHECK(spp != 0);
+    }
+    /* Slower than the PIN limiter refills */
+    vTaskDelay(pdMS_TO_TICKS(1000 / CONFIG_LOCK_RATE_PER_S + 100));
+    host_app_peer(peer_n, &peer);
+    HOST_CHECK(host_ble_connect(&peer, 2000, &conn) == 0);
+    HOST_CHECK(host_ble_exchange_mtu(conn, 247) == 0);
+    HOST_CHECK(host_ble_subscribe(conn, spp, true) == 0);
+    HOST_CHECK(host_ble_notify_wait(conn, spp, buf, sizeof buf, 2000, NULL) > 0);
+    HOST_CHECK(host_ble_write(conn, spp, pin, strlen(pin)) == 0);
+    len = host_ble_notify_wait(conn, spp, buf, sizeof buf - 1, 2000, NULL);
+    HOST_CHECK(len > 0);
+    buf[len] = '\0';
+    HOST_CHECK(host_ble_disconnect(conn, BLE_ERR_REM_USER_CONN_TERM) == 0);
+
+    audit_next(cursor, &rec);
+    HOST_CHECK(rec.cred_id == user && rec.method == AUDIT_METHOD_PIN && rec.result == result);
+    return strstr(buf, TEST_GRANTED) != NULL;
+}
+
+static void
+test_on_lock(void)
+{
+    access_rule_t weekdays = { .until_day = ACCESS_DAY_NONE, .nwindows = 1 };
+    access_rule_t guest = { .from_day = TEST_FRIDAY, .until_day = TEST_FRIDAY + 1,
+                            .once = true };
+    uint32_t cursor = 0;
+    uint16_t staff;
+    uint16_t visitor;
+    audit_rec_t rec;
+
+    host_app_start();
+    while (audit_log_read(&cursor, &rec, 1) == 1)
+    {
+    }
+    HOST_CHECK(cred_store_add(TEST_WEEKDAY_PIN, strlen(TEST_WEEKDAY_PIN), CRED_DOORS_ALL,
+                              &staff) == ESP_OK);
+    HOST_CHECK(cred_store_add(TEST_GUEST_PIN, strlen(TEST_GUEST_PIN), CRED_DOORS_ALL,
+                              &visitor) == ESP_OK);
+    weekdays.windows[0] = (access_window_t){ 0x1F, 9, 18 };
+    HOST_CHECK(access_policy_set(staff, &weekdays) == ESP_OK);
+    HOST_CHECK(access_policy_set(visitor, &guest) == ESP_OK);
+    HOST_CHECK(access_policy_set(0, &weekdays) == ESP_ERR_INVALID_ARG);
+    HOST_CHECK(access_policy_set(CRED_USER_NONE - 1, &weekdays) != ESP_OK);
+    HOST_CHECK(access_policy_count() == 2);
+
+    /* No clock yet: restricted users are refused, the rest are not */
+    HOST_CHECK(lock_hal_wall_time() < LOCK_HAL_CLOCK_VALID);
+    HOST_CHECK(access_policy_check(staff) == ACCESS_DENY_CLOCK);
+    HOST_CHECK(!try_pin(1, TEST_WEEKDAY_PIN, &cursor, staff, AUDIT_RESULT_SCHEDULE));
+    HOST_CHECK(try_pin(1, CONFIG_LOCK_DEFAULT_PIN, &cursor, 0, AUDIT_RESULT_GRANTED));
+
+    /* Friday 10:00 local, then Saturday */
+    lock_hal_set_wall_time(at(TEST_FRIDAY, 10) - TEST_TZ_S);
+    HOST_CHECK(try_pin(2, TEST_WEEKDAY_PIN, &cursor, staff, AUDIT_RESULT_GRANTED));
+    lock_hal_set_wall_time(at(TEST_FRIDAY + 1, 10) - TEST_TZ_S);
+    HOST_CHECK(!try_pin(2, TEST_WEEKDAY_PIN, &cursor, staff, AUDIT_RESULT_SCHEDULE));
+
+    /* The guest opens once; then the PIN and its policy are gone */
+    HOST_CHECK(try_pin(3, TEST_GUEST_PIN, &cursor, visitor, AUDIT_RESULT_GRANTED));
+    for (int ms = 0; ms < 2000 && cred_store_live(visitor); ms += 10)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    HOST_CHECK(!cred_store_live(visitor));
+    HOST_CHECK(access_policy_count() == 1);
+    HOST_CHECK(!try_pin(3, TEST_GUEST_PIN, &cursor, CRED_USER_NONE, AUDIT_RESULT_DENIED));
+
+    HOST_CHECK(access_policy_clear(staff) == ESP_OK);
+    HOST_CHECK(access_policy_count() == 0);
+    HOST_CHECK(try_pin(2, TEST_WEEKDAY_PIN, &cursor, staff, AUDIT_RESULT_GRANTED));
+    printf("on the lock: ok\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    access_rule_t *rules;
+    access_policy_t *pols;
+
+    rng_state = argc > 1 ? strtoul(argv[1], NULL, 0) : 0x5ce4a017;
+    HOST_CHECK(rng_state != 0);
+    printf("seed 0x%08x\n", (unsigned)rng_state);
+
+    rules = malloc(TEST_RULES * sizeof *rules);
+    pols = malloc(TEST_RULES * sizeof *pols);
+    HOST_CHECK(rules != NULL && pols != NULL);
+
+    test_compile();
+    test_days();
+    test_random(rules, pols);
+    test_on_lock();
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * The host task stays responsive while a door cycles.  One central
+ * unlocks door 0; while the servo travels and holds, a second central
+ * connects and reads the status characteristic over and over.  Every read
+ * is a round trip through the host task, so its worst case bounds how long
+ * any GAP or GATT callback waited.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host/ble_hs.h"
+#include "host_ble.h"
+#include "host_hal.h"
+#include "host_app.h"
+#include "actuator.h"
+
+#define TEST_SPP_UUID           0xABF1
+#define TEST_STATUS_UUID        0xABF4
+
+/* Far below the one-second stall of a blocking open_door() */
+#define TEST_MAX_CALLBACK_US    20000
+
+int
+main(void)
+{
+    uint16_t spp;
+    uint16_t status;
+    uint16_t conn_a;
+    uint16_t conn_b;
+    ble_addr_t peer;
+    uint8_t buf[256];
+    uint16_t len;
+    struct ble_gap_conn_desc desc;
+    int64_t t0;
+    int64_t connect_us;
+    int64_t worst_us = 0;
+    int reads = 0;
+    bool saw_hold = false;
+
+    host_app_start();
+    spp = host_ble_val_handle(TEST_SPP_UUID);
+    status = host_ble_val_handle(TEST_STATUS_UUID);
+    HOST_CHECK(spp != 0 && status != 0);
+
+    host_app_peer(1, &peer);
+    HOST_CHECK(host_ble_connect(&peer, 2000, &conn_a) == 0);
+    HOST_CHECK(host_ble_subscribe(conn_a, spp, true) == 0);
+    HOST_CHECK(host_ble_notify_wait(conn_a, spp, buf, sizeof buf, 2000, NULL) > 0);
+
+    /* The write returns once the access callback did; it must not wait
+     * for the door.  Carrying it takes up to one connection interval. */
+    HOST_CHECK(ble_gap_conn_find(conn_a, &desc) == 0);
+    t0 = esp_timer_get_time();
+    HOST_CHECK(host_ble_write(conn_a, spp, CONFIG_LOCK_DEFAULT_PIN,
+                              strlen(CONFIG_LOCK_DEFAULT_PIN)) == 0);
+    HOST_CHECK(esp_timer_get_time() - t0 < TEST_MAX_CALLBACK_US + desc.conn_itvl * 1250);
+    HOST_CHECK(host_ble_notify_wait(conn_a, spp, buf, sizeof buf, 1000, NULL) > 0);
+    /* The actuator task takes the command from its queue */
+    for (int i = 0; i < 50 && actuator_get_state(0) == ACTUATOR_STATE_IDLE; i++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    HOST_CHECK(actuator_get_state(0) != ACTUATOR_STATE_IDLE);
+
+    /* A second link comes up while the servo moves */
+    host_app_peer(2, &peer);
+    t0 = esp_timer_get_time();
+    HOST_CHECK(host_ble_connect(&peer, 3000, &conn_b) == 0);
+    connect_us = esp_timer_get_time() - t0;
+
+    while (actuator_get_state(0) != ACTUATOR_STATE_IDLE)
+    {
+        int64_t us;
+
+        saw_hold |= actuator_get_state(0) == ACTUATOR_STATE_HOLDING;
+        t0 = esp_timer_get_time();
+        HOST_CHECK(host_ble_read(conn_b, status, buf, sizeof buf, &len) == 0);
+        us = esp_timer_get_time() - t0;
+        worst_us = us > worst_us ? us : worst_us;
+        reads++;
+        vTaskDelay(pdMS_TO_TICKS(2));
+    }
+
+    printf("door cycle: %d status reads, worst host round trip %lld us, "
+           "second connect %lld us\n", reads, (long long)worst_us, (long long)connect_us);
+    HOST_CHECK(saw_hold);
+    HOST_CHECK(reads > 100);
+    HOST_CHECK(worst_us < TEST_MAX_CALLBACK_US);
+
+    HOST_CHECK(host_ble_disconnect(conn_b, BLE_ERR_REM_USER_CONN_TERM) == 0);
+    HOST_CHECK(host_ble_disconnect(conn_a, BLE_ERR_REM_USER_CONN_TERM) == 0);
+    printf("PASS\n");
+    return 0;
+}
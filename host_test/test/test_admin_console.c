@@ -0,0 +1,384 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * The admin console on the running lock.  The word splitter on its own,
+ * then commands typed on the bridge UART: each reply, the usage lines for
+ * malformed arguments, and the effect on the credential store, an access
+ * policy, a door and the clock.  Console lines mixed into bridged data,
+ * arriving in random cuts, must be answered and never reach a BLE
+ * subscriber, while the bridged bytes arrive whole.  Last, the console's
+ * counters must account for every line sent.
+ *
+ * Usage: test_admin_console [seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host_ble.h"
+#include "host_hal.h"
+#include "host_app.h"
+#include "lock_hal.h"
+#include "admin_console.h"
+
+#define TEST_SPP_UUID           0xABF1
+#define TEST_REPLY_MS           2000
+/* A reply is complete once the console has been quiet this long */
+#define TEST_QUIET_MS           50
+
+static char reply[2048];
+static uint32_t sent_lines;
+static uint32_t rng_state;
+
+static uint32_t
+rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/* Collects what the console writes until it has been quiet a while */
+static const char *
+take_reply(void)
+{
+    size_t len = 0;
+    int quiet_ms = 0;
+
+    for (int ms = 0; ms < TEST_REPLY_MS; ms += 5)
+    {
+        size_t n = host_uart_take(&reply[len], sizeof reply - 1 - len);
+
+        len += n;
+        quiet_ms = n > 0 ? 0 : quiet_ms + 5;
+        if (len > 0 && quiet_ms >= TEST_QUIET_MS)
+        {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    reply[len] = '\0';
+    return reply;
+}
+
+/* Types one command line, ended in CRLF, and returns the reply */
+static const char *
+console(const char *line)
+{
+    char buf[256];
+    int len = snprintf(buf, sizeof buf, "%c%s\r\n", ADMIN_CONSOLE_PREFIX, line);
+
+    HOST_CHECK(len > 0 && len < (int)sizeof buf);
+    HOST_CHECK(host_uart_inject(buf, len));
+    sent_lines++;
+    return take_reply();
+}
+
+static void
+expect_reply(const char *line, const char *want)
+{
+    const char *got = console(line);
+
+    if (strcmp(got, want) != 0)
+    {
+        fprintf(stderr, "!%s: got \"%s\", expected \"%s\"\n", line, got, want);
+    }
+    HOST_CHECK(strcmp(got, want) == 0);
+}
+
+static void
+expect_prefix(const char *line, const char *want)
+{
+    const char *got = console(line);
+
+    if (strncmp(got, want, strlen(want)) != 0)
+    {
+        fprintf(stderr, "!%s: got \"%s\", expected \"%s...\"\n", line, got, want);
+    }
+    HOST_CHECK(strncmp(got, want, strlen(want)) == 0);
+}
+
+/* Types a line that has no reply and waits until the console ran it */
+static void
+blank(const char *line)
+{
+    admin_console_stats_t st;
+
+    HOST_CHECK(host_uart_inject(line, strlen(line)));
+    sent_lines++;
+    for (int ms = 0; ms < TEST_REPLY_MS; ms++)
+    {
+        admin_console_get_stats(&st);
+        if (st.lines + st.dropped == sent_lines)
+        {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    HOST_CHECK(st.lines + st.dropped == sent_lines);
+    vTaskDelay(pdMS_TO_TICKS(TEST_QUIET_MS));
+    HOST_CHECK(host_uart_take(reply, sizeof reply) == 0);
+}
+
+static void
+test_split(void)
+{
+    char *argv[4];
+    char line[64];
+
+    strcpy(line, "  cred\tadd   4711 \t");
+    HOST_CHECK(admin_console_split(line, argv, 4) == 3);
+    HOST_CHECK(strcmp(argv[0], "cred") == 0);
+    HOST_CHECK(strcmp(argv[1], "add") == 0);
+    HOST_CHECK(strcmp(argv[2], "4711") == 0);
+    /* Split in place */
+    HOST_CHECK(argv[0] == &line[2] && argv[2] == &line[13]);
+
+    strcpy(line, "");
+    HOST_CHECK(admin_console_split(line, argv, 4) == 0);
+    strcpy(line, " \t  ");
+    HOST_CHECK(admin_console_split(line, argv, 4) == 0);
+
+    /* At most max words; the rest of the line is left alone */
+    strcpy(line, "a bb ccc dddd eeeee");
+    HOST_CHECK(admin_console_split(line, argv, 2) == 2);
+    HOST_CHECK(strcmp(argv[0], "a") == 0 && strcmp(argv[1], "bb") == 0);
+    HOST_CHECK(strcmp(&line[5], "ccc dddd eeeee") == 0);
+    HOST_CHECK(admin_console_split(line, argv, 0) == 0);
+    printf("split: ok\n");
+}
+
+static void
+test_commands(void)
+{
+    const char *got;
+    unsigned count;
+    unsigned user;
+    unsigned after;
+    uint32_t fades;
+    char line[96];
+    char want[32];
+
+    got = console("help");
+    HOST_CHECK(strstr(got, "!help") == got);
+    HOST_CHECK(strstr(got, "\n!door <n> open|lock\n") != NULL);
+    HOST_CHECK(strstr(got, "\n!cred add <pin> [doors]") != NULL);
+    HOST_CHECK(strstr(got, "\n!policy <user>") != NULL);
+    HOST_CHECK(strstr(got, "\n!time [unix seconds]\n") != NULL);
+
+    expect_reply("nonsense", "unknown command nonsense; try !help\n");
+    expect_reply("HELP", "unknown command HELP; try !help\n");
+    /* Blank command lines are run but not answered */
+    blank("!\r\n");
+    blank("!  \t\n");
+
+    /* Credentials, with the words spread out by spaces and tabs */
+    got = console("  cred \t count ");
+    HOST_CHECK(sscanf(got, "%u\n", &count) == 1);
+    got = console("cred add 4711 0x3");
+    HOST_CHECK(sscanf(got, "user %u\nok\n", &user) == 1);
+    HOST_CHECK(strstr(got, "\nok\n") != NULL);
+    HOST_CHECK(sscanf(console("cred count"), "%u", &after) == 1 && after == count + 1);
+    expect_reply("cred add 1 0x100", "door mask must be 0-0xff\n");
+    expect_reply("cred", "usage: cred add <pin> [doors] | del <user> | count\n");
+    expect_reply("cred del x", "usage: cred add <pin> [doors] | del <user> | count\n");
+    /* An access policy on the new user, read back as hours per day */
+    snprintf(line, sizeof line, "policy %u mon-fri/9-18,sat/10-14 2026-10-16..2026-12-31 once",
+             user);
+    expect_reply(line, "ok\n");
+    snprintf(line, sizeof line, "policy %u", user);
+    expect_reply(line, "mon 09-18\ntue 09-18\nwed 09-18\nthu 09-18\nfri 09-18\nsat 10-14\n"
+                 "sun\nfrom 2026-10-16\nuntil 2026-12-31\nonce\n");
+    snprintf(line, sizeof line, "policy %u sun+mon/22-6,daily/12-13 ..2027-01-01", user);
+    expect_reply(line, "ok\n");
+    snprintf(line, sizeof line, "policy %u", user);
+    /* Each night runs into the next morning, Sunday's into Monday's */
+    expect_reply(line, "mon 00-06 12-13 22-24\ntue 00-06 12-13\nwed 12-13\nthu 12-13\n"
+                 "fri 12-13\nsat 12-13\nsun 12-13 22-24\nuntil 2027-01-01\n");
+    expect_prefix("policy 1 mon-/9-18", "usage: policy");
+    expect_prefix("policy 1 mon/9-18x", "usage: policy");
+    expect_prefix("policy 1 mon/9-25", "usage: policy");
+    expect_prefix("policy 1 any 2026-13-01..", "usage: policy");
+    expect_reply("policy 1 any 2026-10-16..2026-10-15", "error: ESP_ERR_INVALID_ARG\n");
+    snprintf(line, sizeof line, "policy %u clear", user);
+    expect_reply(line, "ok\n");
+    snprintf(line, sizeof line, "policy %u", user);
+    snprintf(want, sizeof want, "user %u: any time\n", user);
+    expect_reply(line, want);
+    snprintf(reply, sizeof reply, "cred del %u", user);
+    expect_reply(reply, "ok\n");
+    HOST_CHECK(sscanf(console("cred count"), "%u", &after) == 1 && after == count);
+
+    /* A door, numbered in any base strtoul() takes */
+    expect_reply("door 9 open", "usage: door <0-3> open|lock\n");
+    expect_reply("door 1 ajar", "usage: door <0-3> open|lock\n");
+    expect_reply("door 1", "usage: door <0-3> open|lock\n");
+    fades = host_ledc_fades(1);
+    expect_reply("door 0x1 open", "ok\n");
+    HOST_CHECK(host_ledc_wait(1, fades, 1000, NULL));
+    expect_reply("door 1 lock", "ok\n");
+
+    /* The clock */
+    expect_reply("time 5", "usage: time [unix seconds]\n");
+    expect_reply("time 1800000000x", "usage: time [unix seconds]\n");
+    expect_reply("time 1800000000", "1800000000\n");
+    HOST_CHECK(lock_hal_wall_time() >= 1800000000 && lock_hal_wall_time() < 1800000010);
+
+    expect_reply("totp 2 abc", "secret must be 1-32 bytes of hex\n");
+    expect_prefix("totp", "usage: totp");
+    expect_prefix("policy 1 xyz/1-2", "usage: policy");
+    expect_prefix("log 0", "");
+    printf("commands: ok\n");
+}
+
+/*
+ * Bridged lines with console lines in between, written in random cuts.
+ * The subscriber must see exactly the bridged bytes, and every console
+ * line must be answered.
+ */
+static void
+test_mixed(void)
+{
+    static const char *const bridged[] = {
+        "sensor 1 21.5C\r\n", "hello\n", "not a !command\r\n", "x\n",
+        "$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6A\r\n",
+    };
+    uint16_t spp = host_ble_val_handle(TEST_SPP_UUID);
+    uint16_t conn;
+    ble_addr_t peer;
+    char stream[4096];
+    char expect[4096];
+    char got[4096];
+    size_t stream_len = 0;
+    size_t expect_len = 0;
+    size_t got_len = 0;
+    size_t cmd_end[40];
+    int commands = 0;
+    int answers = 0;
+
+    host_app_peer(1, &peer);
+    HOST_CHECK(host_ble_connect(&peer, 2000, &conn) == 0);
+    /* Few enough notifications that the test's queue never overflows */
+    HOST_CHECK(host_ble_exchange_mtu(conn, 247) == 0);
+    HOST_CHECK(host_ble_subscribe(conn, spp, true) == 0);
+    /* The banner */
+    HOST_CHECK(host_ble_notify_wait(conn, spp, (uint8_t *)got, sizeof got, 2000, NULL) > 0);
+    host_ble_notify_flush(conn);
+
+    for (int i = 0; i < 40; i++)
+    {
+        const char *line = bridged[rng() % 5];
+
+        memcpy(&stream[stream_len], line, strlen(line));
+        stream_len += strlen(line);
+        memcpy(&expect[expect_len], line, strlen(line));
+        expect_len += strlen(line);
+        if (i % 4 == 1)
+        {
+            const char *cmd = rng() % 2 ? "!time\r\n" : "!cred count\n";
+
+            memcpy(&stream[stream_len], cmd, strlen(cmd));
+            stream_len += strlen(cmd);
+            cmd_end[commands++] = stream_len;
+        }
+    }
+
+    for (size_t off = 0; off < stream_len;)
+    {
+        size_t n = 1 + rng() % 40;
+        int typed = 0;
+
+        /* A command typed while the last one runs is dropped; a write
+         * stops at the end of a command, and its reply is waited for, as
+         * someone at the console would */
+        while (typed < commands && cmd_end[typed] <= off)
+        {
+            typed++;
+        }
+        n = n < stream_len - off ? n : stream_len - off;
+        if (typed < commands && n > cmd_end[typed] - off)
+        {
+            n = cmd_end[typed] - off;
+        }
+        HOST_CHECK(host_uart_inject(&stream[off], n));
+        off += n;
+        typed += typed < commands && cmd_end[typed] == off;
+        for (int ms = 0; answers < typed && ms < TEST_REPLY_MS; ms++)
+        {
+            char out[64];
+            size_t len = host_uart_take(out, sizeof out);
+
+            for (size_t i = 0; i < len; i++)
+            {
+                answers += out[i] == '\n';
+            }
+            vTaskDelay(pdMS_TO_TICKS(1));
+        }
+        HOST_CHECK(answers == typed);
+        vTaskDelay(pdMS_TO_TICKS(rng() % 20));
+    }
+    sent_lines += commands;
+
+    while (got_len < expect_len)
+    {
+        int n = host_ble_notify_wait(conn, spp, (uint8_t *)&got[got_len],
+                                     sizeof got - got_len, 2000, NULL);
+        HOST_CHECK(n > 0);
+        got_len += n;
+    }
+    /* Nothing more follows */
+    HOST_CHECK(host_ble_notify_wait(conn, spp, (uint8_t *)&got[got_len],
+                                    sizeof got - got_len, 200, NULL) < 0);
+    HOST_CHECK(got_len == expect_len && memcmp(got, expect, expect_len) == 0);
+
+    printf("mixed: %zu bytes in, %zu bridged, %d commands answered\n",
+           stream_len, got_len, answers);
+    HOST_CHECK(answers == commands);
+    HOST_CHECK(host_uart_take(reply, sizeof reply) == 0);
+    HOST_CHECK(host_ble_disconnect(conn, BLE_ERR_REM_USER_CONN_TERM) == 0);
+}
+
+static void
+test_stats(void)
+{
+    admin_console_stats_t st;
+    char line[ADMIN_CONSOLE_LINE_MAX + 100];
+
+    /* A command cut at the line buffer still runs, on what fit */
+    memset(line, ' ', sizeof line);
+    memcpy(line, "time", 4);
+    line[sizeof line - 1] = '\0';
+    HOST_CHECK(console(line)[0] != '\0');
+
+    admin_console_get_stats(&st);
+    printf("stats: %u lines, %u dropped, %u overlong, %u sent\n", (unsigned)st.lines,
+           (unsigned)st.dropped, (unsigned)st.overlong, (unsigned)sent_lines);
+    HOST_CHECK(st.lines + st.dropped == sent_lines);
+    HOST_CHECK(st.dropped == 0);
+    HOST_CHECK(st.overlong == 1);
+}
+
+int
+main(int argc, char **argv)
+{
+    rng_state = argc > 1 ? strtoul(argv[1], NULL, 0) : 0x1c0ffee5;
+    HOST_CHECK(rng_state != 0);
+    printf("seed 0x%08x\n", (unsigned)rng_state);
+
+    host_app_start();
+    /* Whatever the lock wrote while booting */
+    host_uart_take(reply, sizeof reply);
+
+    test_split();
+    test_commands();
+    test_mixed();
+    test_stats();
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,259 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * adv_sched_step() on its own.  Scripted sequences cover boot, the end of
+ * a burst, connections that leave room for more, a bond leaving with and
+ * without the accept-list window, and the clock passing through zero.
+ * Then an hour of simulated use: phones turn up at random and connect at
+ * the first advertising event they may answer, and the schedule's
+ * time-to-discovery statistics must agree with the simulation's own.
+ *
+ * Usage: test_adv_sched [seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "sdkconfig.h"
+#include "host_app.h"
+#include "adv_sched.h"
+
+#define TEST_ITVL(ms)           ((ms) * 8 / 5)
+#define TEST_SIM_MS             (3600u * 1000)
+/* Random advDelay the controller adds to every interval, up to 10 ms */
+#define TEST_ADV_DELAY_MS       10
+
+static const adv_sched_cfg_t cfg = {
+    .fast_ms = CONFIG_LOCK_ADV_FAST_MS,
+    .bond_ms = CONFIG_LOCK_ADV_BOND_MS,
+    .itvl = {
+        [ADV_SCHED_FAST] = TEST_ITVL(CONFIG_LOCK_ADV_FAST_ITVL_MS),
+        [ADV_SCHED_SLOW] = TEST_ITVL(CONFIG_LOCK_ADV_SLOW_ITVL_MS),
+        [ADV_SCHED_BONDED] = TEST_ITVL(CONFIG_LOCK_ADV_FAST_ITVL_MS),
+    },
+};
+
+static const char *const phase_name[ADV_SCHED_PHASES] = { "fast", "slow", "bonded" };
+
+static uint32_t rng_state;
+
+static uint32_t
+rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/* What every plan must look like for its phase */
+static void
+check_plan(const adv_sched_t *s, const adv_plan_t *plan)
+{
+    HOST_CHECK(plan->itvl_min == cfg.itvl[s->phase]);
+    HOST_CHECK(plan->itvl_max == cfg.itvl[s->phase] + cfg.itvl[s->phase] / 8);
+    HOST_CHECK(plan->accept_list == (s->phase == ADV_SCHED_BONDED));
+    if (s->phase == ADV_SCHED_SLOW)
+    {
+        HOST_CHECK(plan->duration_ms == ADV_SCHED_FOREVER);
+    }
+    else
+    {
+        HOST_CHECK(plan->duration_ms > 0);
+        HOST_CHECK((uint32_t)plan->duration_ms <=
+                   (s->phase == ADV_SCHED_BONDED ? cfg.bond_ms : cfg.fast_ms));
+    }
+}
+
+static void
+test_scripted(uint32_t t0)
+{
+    adv_sched_t s = { 0 };
+    adv_plan_t plan;
+    uint32_t t = t0;
+
+    /* Boot: a full fast burst, then slow until someone connects */
+    HOST_CHECK(adv_sched_step(&s, &cfg, ADV_SCHED_EV_BOOT, t, &plan));
+    HOST_CHECK(s.phase == ADV_SCHED_FAST && plan.duration_ms == (int32_t)cfg.fast_ms);
+    check_plan(&s, &plan);
+    t += cfg.fast_ms;
+    HOST_CHECK(adv_sched_step(&s, &cfg, ADV_SCHED_EV_BURST_END, t, &plan));
+    HOST_CHECK(s.phase == ADV_SCHED_SLOW);
+    check_plan(&s, &plan);
+
+    /* Found while slow, counted from boot */
+    t += 5000;
+    HOST_CHECK(!adv_sched_step(&s, &cfg, ADV_SCHED_EV_CONNECT, t, &plan));
+    HOST_CHECK(s.stats.found[ADV_SCHED_SLOW] == 1 && s.stats.last_ms == cfg.fast_ms + 5000);
+    /* A second connection was not looked for */
+    HOST_CHECK(!adv_sched_step(&s, &cfg, ADV_SCHED_EV_CONNECT, t + 10, &plan));
+    HOST_CHECK(s.stats.found[ADV_SCHED_SLOW] == 1);
+
+    /* A disconnect starts a new burst; a connection 10 s in leaves 20 s of
+     * it for a restart 2 s later */
+    t += 60000;
+    HOST_CHECK(adv_sched_step(&s, &cfg, ADV_SCHED_EV_DISCONNECT, t, &plan));
+    HOST_CHECK(s.phase == ADV_SCHED_FAST);
+    HOST_CHECK(!adv_sched_step(&s, &cfg, ADV_SCHED_EV_CONNECT, t + 10000, &plan));
+    HOST_CHECK(s.stats.found[ADV_SCHED_FAST] == 1 && s.stats.last_ms == 10000);
+    HOST_CHECK(adv_sched_step(&s, &cfg, ADV_SCHED_EV_RESUME, t + 12000, &plan));
+    HOST_CHECK(s.phase == ADV_SCHED_FAST && plan.duration_ms == (int32_t)cfg.fast_ms - 12000);
+    check_plan(&s, &plan);
+    HOST_CHECK(!adv_sched_step(&s, &cfg, ADV_SCHED_EV_CONNECT, t + 12500, &plan));
+    HOST_CHECK(s.stats.found[ADV_SCHED_FAST] == 2 && s.stats.last_ms == 500);
+
+    /* Past the burst, a restart goes slow at once */
+    HOST_CHECK(adv_sched_step(&s, &cfg, ADV_SCHED_EV_RESUME, t + cfg.fast_ms, &plan));
+    HOST_CHECK(s.phase == ADV_SCHED_SLOW);
+    check_plan(&s, &plan);
+    HOST_CHECK(!adv_sched_step(&s, &cfg, ADV_SCHED_EV_CONNECT, t + cfg.fast_ms + 1, &plan));
+
+    /* A bond leaves: accept list only, then open to everyone */
+    t += 100000;
+    HOST_CHECK(adv_sched_step(&s, &cfg, ADV_SCHED_EV_BOND_LOST, t, &plan));
+    HOST_CHECK(s.phase == ADV_SCHED_BONDED && plan.duration_ms == (int32_t)cfg.bond_ms);
+    check_plan(&s, &plan);
+    HOST_CHECK(adv_sched_step(&s, &cfg, ADV_SCHED_EV_BURST_END, t + cfg.bond_ms, &plan));
+    HOST_CHECK(s.phase == ADV_SCHED_FAST && plan.duration_ms == (int32_t)cfg.fast_ms);
+    check_plan(&s, &plan);
+    HOST_CHECK(!adv_sched_step(&s, &cfg, ADV_SCHED_EV_CONNECT, t + cfg.bond_ms + 40, &plan));
+    HOST_CHECK(s.stats.found[ADV_SCHED_FAST] == 3 && s.stats.last_ms == cfg.bond_ms + 40);
+
+    /* The bond comes back inside its window */
+    t += 100000;
+    adv_sched_step(&s, &cfg, ADV_SCHED_EV_BOND_LOST, t, &plan);
+    HOST_CHECK(!adv_sched_step(&s, &cfg, ADV_SCHED_EV_CONNECT, t + 200, &plan));
+    HOST_CHECK(s.stats.found[ADV_SCHED_BONDED] == 1 && s.stats.max_ms[ADV_SCHED_BONDED] == 200);
+
+    /* Restarted after the window: a full fast burst, not the list */
+    HOST_CHECK(adv_sched_step(&s, &cfg, ADV_SCHED_EV_RESUME, t + cfg.bond_ms + 1, &plan));
+    HOST_CHECK(s.phase == ADV_SCHED_FAST && plan.duration_ms == (int32_t)cfg.fast_ms);
+    check_plan(&s, &plan);
+
+    /* Without the window a bond leaving is a plain disconnect */
+    {
+        adv_sched_cfg_t no_bond = cfg;
+
+        no_bond.bond_ms = 0;
+        HOST_CHECK(adv_sched_step(&s, &no_bond, ADV_SCHED_EV_BOND_LOST, t + 60000, &plan));
+        HOST_CHECK(s.phase == ADV_SCHED_FAST && !plan.accept_list);
+        HOST_CHECK(plan.duration_ms == (int32_t)cfg.fast_ms);
+    }
+}
+
+/* Phones turn up a random while after the last one left; half are the
+ * bond that just left.  One link at a time. */
+static void
+test_simulated(void)
+{
+    adv_sched_t s = { 0 };
+    adv_sched_stats_t want = { 0 };
+    adv_plan_t plan;
+    uint64_t wait_ms[ADV_SCHED_PHASES] = { 0 };
+    uint32_t wait_max[ADV_SCHED_PHASES] = { 0 };
+    uint32_t start = UINT32_MAX - TEST_SIM_MS / 3;
+    uint32_t plan_at = start;
+    uint32_t adv_end = 0;
+    uint32_t next_adv;
+    uint32_t arrive;
+    uint32_t leave = 0;
+    uint32_t since = start;
+    bool advertising;
+    bool connected = false;
+    bool bonded = false;
+
+    HOST_CHECK(adv_sched_step(&s, &cfg, ADV_SCHED_EV_BOOT, start, &plan));
+    advertising = true;
+    next_adv = start + 1;
+    arrive = start + rng() % 60000;
+    adv_end = start + plan.duration_ms;
+
+    for (uint32_t i = 1; i < TEST_SIM_MS; i++)
+    {
+        uint32_t now = start + i;
+        bool restart = false;
+        adv_sched_ev_t ev = ADV_SCHED_EV_BOOT;
+
+        if (connected && now == leave)
+        {
+            connected = false;
+            ev = bonded ? ADV_SCHED_EV_BOND_LOST : ADV_SCHED_EV_DISCONNECT;
+            restart = true;
+            since = now;
+            /* Sometimes the same phone again, soon; sometimes someone new */
+            bonded = rng() % 2;
+            arrive = now + (bonded ? rng() % 5000 : rng() % 120000);
+        }
+        else if (advertising && plan.duration_ms != ADV_SCHED_FOREVER && now == adv_end)
+        {
+            ev = ADV_SCHED_EV_BURST_END;
+            restart = true;
+        }
+        else if (advertising && now == next_adv)
+        {
+            if ((int32_t)(now - arrive) >= 0 && (!plan.accept_list || bonded))
+            {
+                uint32_t ttd = now - since;
+                /* From when this plan first let the phone in */
+                uint32_t wait = now - ((int32_t)(arrive - plan_at) > 0 ? arrive : plan_at);
+
+                want.found[s.phase]++;
+                want.total_ms[s.phase] += ttd;
+                want.max_ms[s.phase] = ttd > want.max_ms[s.phase] ? ttd : want.max_ms[s.phase];
+                wait_ms[s.phase] += wait;
+                wait_max[s.phase] = wait > wait_max[s.phase] ? wait : wait_max[s.phase];
+                HOST_CHECK(!adv_sched_step(&s, &cfg, ADV_SCHED_EV_CONNECT, now, &plan));
+                HOST_CHECK(s.stats.last_ms == ttd);
+                advertising = false;
+                connected = true;
+                leave = now + 1000 + rng() % 30000;
+                continue;
+            }
+            next_adv = now + plan.itvl_min * 5 / 8 + rng() % (TEST_ADV_DELAY_MS + 1);
+        }
+        if (restart)
+        {
+            HOST_CHECK(adv_sched_step(&s, &cfg, ev, now, &plan));
+            check_plan(&s, &plan);
+            advertising = true;
+            plan_at = now;
+            next_adv = now + 1;
+            adv_end = now + plan.duration_ms;
+        }
+    }
+
+    printf("simulated hour:\n");
+    for (int ph = 0; ph < ADV_SCHED_PHASES; ph++)
+    {
+        HOST_CHECK(s.stats.found[ph] == want.found[ph]);
+        HOST_CHECK(s.stats.total_ms[ph] == want.total_ms[ph]);
+        HOST_CHECK(s.stats.max_ms[ph] == want.max_ms[ph]);
+        if (want.found[ph] == 0)
+        {
+            continue;
+        }
+        printf("  %-6s %4u connections, phone waited %6.1f ms on average, %4u ms at most\n",
+               phase_name[ph], (unsigned)want.found[ph], (double)wait_ms[ph] / want.found[ph],
+               (unsigned)wait_max[ph]);
+        /* Never more than one interval and its advDelay */
+        HOST_CHECK(wait_max[ph] <= cfg.itvl[ph] * 5 / 8 + TEST_ADV_DELAY_MS + 1);
+    }
+    HOST_CHECK(want.found[ADV_SCHED_FAST] > 0 && want.found[ADV_SCHED_SLOW] > 0 &&
+               want.found[ADV_SCHED_BONDED] > 0);
+}
+
+int
+main(int argc, char **argv)
+{
+    rng_state = argc > 1 ? strtoul(argv[1], NULL, 0) : 0x0adb5c3d;
+    HOST_CHECK(rng_state != 0);
+    printf("seed 0x%08x\n", (unsigned)rng_state);
+
+    test_scripted(1000);
+    test_scripted(UINT32_MAX - 50000);
+    test_simulated();
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,252 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * The audit log on the file-backed "audit" partition, with flash timed
+ * like SPI flash where it matters.  Measures how long a record takes to
+ * become durable, alone and as part of a full batch, and the sustained
+ * append rate.  Then wraps the log, reads it back through a cursor that
+ * is resumed midway, and recovers the write position as a reboot would,
+ * including after a torn write.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_timer.h"
+#include "host_hal.h"
+#include "host_app.h"
+
+/* For the write position and audit_recover() */
+#include "audit_log.c"
+
+#define TEST_BATCH_ROUNDS       40
+#define TEST_THROUGHPUT_RECORDS (16 * AUDIT_SLOTS_PER_SECTOR)
+
+static uint32_t
+durable_now(void)
+{
+    uint32_t d;
+
+    portENTER_CRITICAL(&audit_lock);
+    d = audit_durable;
+    portEXIT_CRITICAL(&audit_lock);
+    return d;
+}
+
+/* Waits until seq is in flash; returns the time since since_us */
+static int64_t
+wait_durable(uint32_t seq, int64_t since_us)
+{
+    int64_t deadline = since_us + 5 * 1000000;
+
+    while ((int32_t)(durable_now() - seq) <= 0)
+    {
+        HOST_CHECK(esp_timer_get_time() < deadline);
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    return esp_timer_get_time() - since_us;
+}
+
+static void
+append(uint16_t n)
+{
+    ble_addr_t peer;
+
+    host_app_peer(n, &peer);
+    HOST_CHECK(audit_log_append(&peer, n, n % CONFIG_LOCK_DOOR_COUNT, AUDIT_METHOD_PIN,
+                                AUDIT_RESULT_GRANTED) == ESP_OK);
+}
+
+/* Fewer than a batch wait for the flush timer */
+static void
+test_partial(void)
+{
+    int64_t t0 = esp_timer_get_time();
+    uint32_t seq = audit_next;
+    int64_t us;
+
+    append(1);
+    append(2);
+    us = wait_durable(seq + 1, t0);
+    printf("partial batch durable after %lld ms\n", (long long)us / 1000);
+    HOST_CHECK(us < (CONFIG_LOCK_AUDIT_FLUSH_MS + 500) * 1000LL);
+}
+
+/* A full batch wakes the commit task at once */
+static void
+test_batch(void)
+{
+    int64_t us[TEST_BATCH_ROUNDS];
+
+    host_flash_timing(true);
+    for (int r = 0; r < TEST_BATCH_ROUNDS; r++)
+    {
+        int64_t t0 = esp_timer_get_time();
+
+        for (int i = 0; i < AUDIT_BATCH; i++)
+        {
+            append(i);
+        }
+        us[r] = wait_durable(audit_next - 1, t0);
+    }
+    host_flash_timing(false);
+    printf("full batch of %d durable after p50 %lld us, p99 %lld us (timed flash)\n",
+           AUDIT_BATCH, (long long)host_percentile(us, TEST_BATCH_ROUNDS, 50),
+           (long long)host_percentile(us, TEST_BATCH_ROUNDS, 99));
+    /* A page write, plus a sector erase on every fourth batch */
+    HOST_CHECK(host_percentile(us, TEST_BATCH_ROUNDS, 50) < 50 * 1000);
+    HOST_CHECK(host_percentile(us, TEST_BATCH_ROUNDS, 99) < 200 * 1000);
+}
+
+/* As fast as the staging buffer takes records */
+static void
+test_throughput(void)
+{
+    audit_stats_t before;
+    audit_stats_t after;
+    uint32_t waits = 0;
+    int64_t t0;
+    int64_t us;
+
+    host_flash_timing(true);
+    audit_log_get_stats(&before);
+    t0 = esp_timer_get_time();
+    for (uint32_t i = 0; i < TEST_THROUGHPUT_RECORDS; )
+    {
+        ble_addr_t peer;
+
+        host_app_peer(i, &peer);
+        if (audit_log_append(&peer, i, 0, AUDIT_METHOD_TOTP, AUDIT_RESULT_DENIED) == ESP_OK)
+        {
+            i++;
+            continue;
+        }
+        waits++;
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    us = wait_durable(audit_next - 1, t0);
+    host_flash_timing(false);
+    audit_log_get_stats(&after);
+    printf("throughput: %u records in %lld ms, %.0f records/s, %u batches, %u erases, "
+           "%u full-staging waits, longest commit %u ms\n",
+           (unsigned)TEST_THROUGHPUT_RECORDS, (long long)us / 1000,
+           TEST_THROUGHPUT_RECORDS * 1e6 / us, (unsigned)(after.batches - before.batches),
+           (unsigned)(after.erases - before.erases), (unsigned)waits,
+           (unsigned)after.max_commit_ms);
+    /* Callers were told about every record that did not fit */
+    HOST_CHECK(after.dropped - before.dropped == waits);
+    HOST_CHECK(after.erases - before.erases >= TEST_THROUGHPUT_RECORDS / AUDIT_SLOTS_PER_SECTOR);
+}
+
+/* Past the end of the partition, then the whole log through a cursor */
+static void
+test_wrap_and_read(void)
+{
+    static audit_rec_t recs[AUDIT_READ_MAX];
+    uint32_t target = audit_next + audit_slots + AUDIT_SLOTS_PER_SECTOR / 2;
+    uint32_t cursor = 0;
+    uint32_t expect;
+    uint32_t durable;
+    uint32_t count = 0;
+    int n;
+
+    while (audit_next < target)
+    {
+        if (audit_log_append(NULL, audit_next, 0, AUDIT_METHOD_BOND,
+                             AUDIT_RESULT_GRANTED) != ESP_OK)
+        {
+            vTaskDelay(pdMS_TO_TICKS(1));
+        }
+    }
+    wait_durable(audit_next - 1, esp_timer_get_time());
+    durable = durable_now();
+
+    /* Cursor 0 was overwritten long ago: the read starts at the oldest */
+    expect = audit_oldest(durable);
+    HOST_CHECK(expect >= durable - audit_slots);
+    while ((n = audit_log_read(&cursor, recs, AUDIT_READ_MAX)) > 0)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            HOST_CHECK(recs[i].seq == expect);
+            expect++;
+        }
+        count += n;
+        /* A reader that goes away and comes back with its cursor */
+        if (count == AUDIT_SLOTS_PER_SECTOR)
+        {
+            uint32_t resumed = cursor;
+
+            HOST_CHECK(audit_log_read(&resumed, recs, 1) == 1 && recs[0].seq == cursor);
+        }
+    }
+    printf("wrapped: %u records readable of %u written, oldest %u\n", (unsigned)count,
+           (unsigned)durable, (unsigned)audit_oldest(durable));
+    HOST_CHECK(expect == durable && cursor == durable);
+    HOST_CHECK(count >= (audit_sectors - 1) * AUDIT_SLOTS_PER_SECTOR);
+}
+
+/* The write position found from flash alone, as after a reboot */
+static void
+test_recover(void)
+{
+    static const audit_rec_t zero;
+    audit_rec_t rec;
+    uint32_t next;
+    uint32_t torn;
+    uint32_t cursor;
+
+    /* Away from a sector start, so the torn record is not a sector's first */
+    while (audit_next % AUDIT_SLOTS_PER_SECTOR < 4)
+    {
+        append(3);
+    }
+    wait_durable(audit_next - 1, esp_timer_get_time());
+    next = durable_now();
+    HOST_CHECK(audit_recover() == next);
+
+    /* Power lost halfway through the newest record */
+    torn = next - 1;
+    HOST_CHECK(lock_hal_part_write(audit_part, (torn % audit_slots) * sizeof rec + AUDIT_CRC_LEN,
+                                   &zero, sizeof rec.crc) == ESP_OK);
+    next = audit_recover();
+    printf("recovered: torn record %u, writing resumes at %u\n", (unsigned)torn,
+           (unsigned)next);
+    HOST_CHECK(next % AUDIT_SLOTS_PER_SECTOR == 0 && next > torn);
+
+    /* The log carries on from there; what came before the torn record
+     * stays readable */
+    portENTER_CRITICAL(&audit_lock);
+    audit_next = audit_durable = next;
+    portEXIT_CRITICAL(&audit_lock);
+    append(4);
+    wait_durable(next, esp_timer_get_time());
+    cursor = torn - 1;
+    HOST_CHECK(audit_log_read(&cursor, &rec, 1) == 1 && rec.seq == torn - 1);
+    HOST_CHECK(audit_log_read(&cursor, &rec, 1) == 1 && rec.seq == next);
+}
+
+int
+main(void)
+{
+    lock_hal_part_t part;
+    size_t size;
+
+    /* Start from an erased partition */
+    HOST_CHECK(lock_hal_part_find(AUDIT_PART_LABEL, &part, &size) == ESP_OK);
+    HOST_CHECK(lock_hal_part_erase(part, 0, size) == ESP_OK);
+    HOST_CHECK(audit_log_init() == ESP_OK);
+    HOST_CHECK(audit_next == 0);
+    printf("partition: %u sectors, %u records\n", (unsigned)audit_sectors,
+           (unsigned)audit_slots);
+
+    test_partial();
+    test_batch();
+    test_throughput();
+    test_wrap_and_read();
+    test_recover();
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,228 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * The deferred logger's ring, driven directly: records come back in order
+ * with their arguments, a full ring counts drops instead of overwriting,
+ * and four producer threads racing a consumer lose nothing they were not
+ * told about and keep their own order.  Then the cost of a BLOG() call
+ * against formatting the same record on the spot, as LOCK_BLOG_ASYNC=n
+ * and the MODLOG_DFLT calls before it did.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "host_app.h"
+
+/* The ring and blog_pop() are static */
+#include "blog.c"
+
+#define TEST_PRODUCERS          4
+#define TEST_PER_PRODUCER       100000
+#define TEST_COST_CALLS         1000000
+#define TEST_PRINT_CALLS        20000
+#define TEST_UART_BAUD          115200
+
+static volatile bool producers_go;
+
+/* blog_init() without its drain task: the test pops itself */
+static void
+ring_reset(void)
+{
+    for (uint32_t i = 0; i < BLOG_RING_SIZE; i++)
+    {
+        blog_ring[i].seq = i;
+    }
+    blog_head = blog_tail = 0;
+    blog_recorded = blog_dropped = 0;
+}
+
+static void
+test_order(void)
+{
+    blog_slot_t r;
+
+    ring_reset();
+    for (uint32_t i = 0; i < BLOG_RING_SIZE / 2; i++)
+    {
+        BLOG(MTU, i, 4, 247);
+    }
+    BLOG(CONN_ESTAB, 7);
+    for (uint32_t i = 0; i < BLOG_RING_SIZE / 2; i++)
+    {
+        HOST_CHECK(blog_pop(&r));
+        HOST_CHECK(r.id == BLOG_MTU && r.nargs == 3);
+        HOST_CHECK(r.args[0] == i && r.args[1] == 4 && r.args[2] == 247);
+        HOST_CHECK(r.args[3] == 0 && r.args[5] == 0);
+    }
+    HOST_CHECK(blog_pop(&r));
+    HOST_CHECK(r.id == BLOG_CONN_ESTAB && r.nargs == 1 && r.args[0] == 7 && r.args[1] == 0);
+    HOST_CHECK(!blog_pop(&r));
+    printf("order: ok\n");
+}
+
+static void
+test_full(void)
+{
+    blog_stats_t st;
+    blog_slot_t r;
+
+    ring_reset();
+    for (uint32_t i = 0; i < BLOG_RING_SIZE + 10; i++)
+    {
+        BLOG(CONN_ESTAB, i);
+    }
+    blog_get_stats(&st);
+    HOST_CHECK(st.recorded == BLOG_RING_SIZE && st.dropped == 10);
+
+    /* The oldest records survive; the ring takes new ones once drained */
+    HOST_CHECK(blog_pop(&r) && r.args[0] == 0);
+    BLOG(CONN_ESTAB, 1000);
+    for (uint32_t i = 1; i < BLOG_RING_SIZE; i++)
+    {
+        HOST_CHECK(blog_pop(&r) && r.args[0] == i);
+    }
+    HOST_CHECK(blog_pop(&r) && r.args[0] == 1000);
+    HOST_CHECK(!blog_pop(&r));
+    printf("full ring: %u recorded, %u dropped\n", (unsigned)st.recorded, (unsigned)st.dropped);
+}
+
+static void *
+producer_run(void *arg)
+{
+    uint32_t id = (uintptr_t)arg;
+
+    while (!producers_go)
+    {
+    }
+    for (uint32_t i = 0; i < TEST_PER_PRODUCER; i++)
+    {
+        BLOG(CONN_UPDATE, id, i);
+        /* Bursts, so the consumer keeps up with some of them */
+        if (i % 64 == 63)
+        {
+            usleep(50);
+        }
+    }
+    return NULL;
+}
+
+static void
+test_concurrent(void)
+{
+    pthread_t threads[TEST_PRODUCERS];
+    int64_t last[TEST_PRODUCERS];
+    uint32_t popped = 0;
+    uint32_t running = TEST_PRODUCERS;
+    blog_stats_t st;
+    blog_slot_t r;
+
+    ring_reset();
+    producers_go = false;
+    for (int i = 0; i < TEST_PRODUCERS; i++)
+    {
+        last[i] = -1;
+        HOST_CHECK(pthread_create(&threads[i], NULL, producer_run, (void *)(uintptr_t)i) == 0);
+    }
+    producers_go = true;
+    while (running > 0 || blog_pop(&r))
+    {
+        if (running > 0 && !blog_pop(&r))
+        {
+            blog_get_stats(&st);
+            running = st.recorded + st.dropped < TEST_PRODUCERS * TEST_PER_PRODUCER;
+            continue;
+        }
+        HOST_CHECK(r.id == BLOG_CONN_UPDATE && r.args[0] < TEST_PRODUCERS);
+        /* Each producer's records come out in the order it made them */
+        HOST_CHECK((int64_t)r.args[1] > last[r.args[0]]);
+        last[r.args[0]] = r.args[1];
+        popped++;
+    }
+    for (int i = 0; i < TEST_PRODUCERS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    HOST_CHECK(!blog_pop(&r));
+    blog_get_stats(&st);
+    printf("concurrent: %d producers x %d, %u popped, %u dropped\n", TEST_PRODUCERS,
+           TEST_PER_PRODUCER, (unsigned)popped, (unsigned)st.dropped);
+    HOST_CHECK(st.recorded == popped);
+    HOST_CHECK(st.recorded + st.dropped == TEST_PRODUCERS * TEST_PER_PRODUCER);
+}
+
+static void
+test_cost(void)
+{
+    static const uint8_t addr[6] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+    blog_slot_t r;
+    char line[BLOG_LINE_MAX];
+    int64_t t0;
+    double record_ns;
+    double print_ns;
+    int saved;
+    int null;
+    int len;
+
+    /* The record the desc dump makes on every GAP event */
+    ring_reset();
+    t0 = esp_timer_get_time();
+    for (uint32_t i = 0; i < TEST_COST_CALLS; i++)
+    {
+        BLOG(CONN_DESC, i, 0, BLOG_ADDR(addr), BLOG_ADDR(addr));
+        if ((i & BLOG_RING_MASK) == BLOG_RING_MASK)
+        {
+            /* Keeps the ring from filling, as the drain task would */
+            ring_reset();
+        }
+    }
+    record_ns = (esp_timer_get_time() - t0) * 1000.0 / TEST_COST_CALLS;
+
+    /* The synchronous path, formatting and writing a line; stderr goes
+     * nowhere meanwhile */
+    ring_reset();
+    BLOG(CONN_DESC, 1, 0, BLOG_ADDR(addr), BLOG_ADDR(addr));
+    HOST_CHECK(blog_pop(&r));
+    host_log_level = MODLOG_LEVEL_INFO;
+    fflush(stderr);
+    saved = dup(STDERR_FILENO);
+    null = open("/dev/null", O_WRONLY);
+    HOST_CHECK(saved >= 0 && null >= 0);
+    dup2(null, STDERR_FILENO);
+    t0 = esp_timer_get_time();
+    for (uint32_t i = 0; i < TEST_PRINT_CALLS; i++)
+    {
+        blog_print(&r);
+    }
+    print_ns = (esp_timer_get_time() - t0) * 1000.0 / TEST_PRINT_CALLS;
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(null);
+    close(saved);
+    host_log_level = MODLOG_LEVEL_WARN;
+
+    /* What the same line costs on a 115200 baud console, 10 bits a byte */
+    len = snprintf(line, sizeof line, blog_fmt[BLOG_CONN_DESC], 1u, 0u,
+                   BLOG_ADDR(addr), BLOG_ADDR(addr));
+    len += snprintf(NULL, 0, "[%u.%06u] \n", 0u, 0u);
+    printf("cost per call: BLOG() %.0f ns, formatted on the spot %.0f ns "
+           "+ %.1f ms of UART for %d bytes\n", record_ns, print_ns,
+           len * 10 * 1000.0 / TEST_UART_BAUD, len);
+    HOST_CHECK(record_ns < print_ns);
+}
+
+int
+main(void)
+{
+    test_order();
+    test_full();
+    test_concurrent();
+    test_cost();
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,268 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * The UART bridge under pressure.  Two phones subscribe, one of them at the
+ * default 23-byte MTU, so every chunk is fragmented down to 20 bytes.  All
+ * of the larger msys pool and all but TEST_MSYS_FREE blocks of the smaller
+ * one are held by the test, and a sent notification keeps its mbufs until
+ * its connection event, so submits and sends run out of mbufs and the
+ * bridge has to back off and retry.  A sender then writes TEST_BYTES at
+ * each baud rate, paced by the line rate, and like the real one stops
+ * while RTS is deasserted: the driver's RX buffer is full.
+ *
+ * The UART must not overflow, and the fan-out must have been short of
+ * mbufs at least once, or the test proved nothing.  Built with
+ * CONFIG_LOCK_FANOUT_SLOW_THROTTLE both phones must get every byte in
+ * order.  With CONFIG_LOCK_FANOUT_SLOW_DROP a phone that the other leaves a
+ * window behind may lose chunks, but each one must show in its drop
+ * counter: what it got and what was dropped add up to what was sent.
+ *
+ * Usage: test_bridge [bytes]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "os/os_mbuf.h"
+#include "host_ble.h"
+#include "host_hal.h"
+#include "host_app.h"
+#include "lock_hal.h"
+#include "fanout.h"
+#include "uart_bridge.h"
+
+#define TEST_SPP_UUID           0xABF1
+#define TEST_BYTES              12288
+#define TEST_BYTES_MAX          65536
+#define TEST_PHONES             2
+#define TEST_SMALL_MTU          BLE_ATT_MTU_DFLT
+#define TEST_BIG_MTU            247
+/* Blocks of the smaller msys pool left to the lock */
+#define TEST_MSYS_FREE          9
+/* The RX buffer lock_hal_esp.c installs the driver with */
+#define TEST_UART_RX            4096
+#define TEST_SLICE_MS           2
+#define TEST_WAIT_MS            10000
+/* Silence after the sender is done that means nothing more is coming */
+#define TEST_QUIET_MS           2000
+
+static const uint32_t test_bauds[] = { 115200, 230400 };
+
+static uint16_t spp;
+static uint8_t sent[TEST_BYTES_MAX];
+static volatile bool sending;
+
+typedef struct
+{
+    pthread_t thread;
+    uint16_t conn;
+    size_t len;
+    size_t have;
+    uint8_t got[TEST_BYTES_MAX];
+} phone_t;
+
+static phone_t phones[TEST_PHONES];
+
+/* Reads bridged bytes until all have come, or the lock stops sending */
+static void *
+phone_run(void *arg)
+{
+    phone_t *p = arg;
+
+    /* With chunks dropped, the wait for the rest times out */
+    while (p->have < p->len)
+    {
+        int n = host_ble_notify_wait(p->conn, spp, &p->got[p->have], p->len - p->have,
+                                     sending ? TEST_WAIT_MS : TEST_QUIET_MS, NULL);
+        if (n <= 0)
+        {
+            break;
+        }
+        p->have += n;
+    }
+    return NULL;
+}
+
+static uint16_t
+join(uint32_t n, uint16_t mtu)
+{
+    ble_addr_t peer;
+    uint16_t conn;
+    uint8_t buf[512];
+
+    host_app_peer(n, &peer);
+    HOST_CHECK(host_ble_connect(&peer, TEST_WAIT_MS, &conn) == 0);
+    if (mtu != BLE_ATT_MTU_DFLT)
+    {
+        HOST_CHECK(host_ble_exchange_mtu(conn, mtu) == 0);
+    }
+    HOST_CHECK(host_ble_subscribe(conn, spp, true) == 0);
+    /* The banner, so only bridged data is left to read */
+    HOST_CHECK(host_ble_notify_wait(conn, spp, buf, sizeof buf, TEST_WAIT_MS, NULL) > 0);
+    return conn;
+}
+
+/*
+ * Writes len bytes at baud, 10 bits a byte, never more than the RX buffer
+ * has room for.  Returns the milliseconds RTS held the sender.
+ */
+static uint32_t
+send_paced(uint32_t baud, size_t len)
+{
+    size_t per_slice = baud / 10 * TEST_SLICE_MS / 1000;
+    int64_t moved_us = esp_timer_get_time();
+    TickType_t wake = xTaskGetTickCount();
+    uint32_t held_ms = 0;
+    size_t off = 0;
+
+    while (off < len)
+    {
+        size_t room = TEST_UART_RX - lock_hal_uart_buffered();
+        size_t n = len - off < per_slice ? len - off : per_slice;
+
+        if (n > room)
+        {
+            n = room;
+            held_ms += TEST_SLICE_MS;
+        }
+        /* Held off, but never for good */
+        if (n > 0)
+        {
+            moved_us = esp_timer_get_time();
+        }
+        HOST_CHECK(esp_timer_get_time() - moved_us < TEST_WAIT_MS * 1000LL);
+        /* Only the bridge takes from the buffer, so the room is still there */
+        HOST_CHECK(host_uart_inject(&sent[off], n));
+        off += n;
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(TEST_SLICE_MS));
+    }
+    return held_ms;
+}
+
+static void
+run(uint32_t baud, size_t bytes)
+{
+    fanout_conn_stats_t before[TEST_PHONES];
+    fanout_conn_stats_t after[TEST_PHONES];
+    fanout_stats_t fs0;
+    fanout_stats_t fs1;
+    uart_bridge_stats_t us0;
+    uart_bridge_stats_t us1;
+    uint32_t retries = 0;
+    uint32_t held_ms;
+    int64_t t0;
+    int64_t us;
+
+    for (size_t i = 0; i < bytes; i++)
+    {
+        sent[i] = i % 64 == 63 ? '\n' : 'a' + (baud / 100 + i) % 26;
+    }
+    fanout_get_stats(&fs0);
+    uart_bridge_get_stats(&us0);
+    for (int i = 0; i < TEST_PHONES; i++)
+    {
+        fanout_get_conn_stats(phones[i].conn, &before[i]);
+        phones[i].len = bytes;
+        phones[i].have = 0;
+        HOST_CHECK(pthread_create(&phones[i].thread, NULL, phone_run, &phones[i]) == 0);
+    }
+
+    sending = true;
+    t0 = esp_timer_get_time();
+    held_ms = send_paced(baud, bytes);
+    sending = false;
+    for (int i = 0; i < TEST_PHONES; i++)
+    {
+        pthread_join(phones[i].thread, NULL);
+    }
+    us = esp_timer_get_time() - t0;
+
+    fanout_get_stats(&fs1);
+    uart_bridge_get_stats(&us1);
+    for (int i = 0; i < TEST_PHONES; i++)
+    {
+        fanout_get_conn_stats(phones[i].conn, &after[i]);
+        retries += after[i].retries - before[i].retries;
+    }
+    printf("%6u baud: %5.1f KB/s delivered of %5.1f, RTS held %u ms, "
+           "%u submits refused for mbufs, %u sends retried\n", (unsigned)baud,
+           bytes / 1024.0 / (us / 1e6), baud / 10 / 1024.0, (unsigned)held_ms,
+           (unsigned)(fs1.refused_nomem - fs0.refused_nomem), (unsigned)retries);
+
+    for (int i = 0; i < TEST_PHONES; i++)
+    {
+        uint32_t tx = after[i].tx_bytes - before[i].tx_bytes;
+        uint32_t dropped = after[i].dropped_bytes - before[i].dropped_bytes;
+
+        printf("        phone %d, MTU %3u: %5u bytes, %5u dropped\n", i,
+               i == 0 ? TEST_SMALL_MTU : TEST_BIG_MTU, (unsigned)tx, (unsigned)dropped);
+        HOST_CHECK(phones[i].have == tx);
+        HOST_CHECK(tx + dropped == bytes);
+#if CONFIG_LOCK_FANOUT_SLOW_THROTTLE
+        HOST_CHECK(dropped == 0);
+        HOST_CHECK(memcmp(phones[i].got, sent, bytes) == 0);
+#endif
+    }
+    HOST_CHECK(us1.rx_bytes - us0.rx_bytes == bytes);
+    HOST_CHECK(us1.rx_overflows == us0.rx_overflows);
+    HOST_CHECK(fs1.refused_nomem - fs0.refused_nomem + retries > 0);
+}
+
+int
+main(int argc, char **argv)
+{
+    static struct os_mbuf *held[CONFIG_BT_NIMBLE_MSYS_1_BLOCK_COUNT +
+                                CONFIG_BT_NIMBLE_MSYS_2_BLOCK_COUNT];
+    size_t bytes = argc > 1 ? strtoul(argv[1], NULL, 0) : TEST_BYTES;
+    host_ble_timing_t timing;
+    int nheld = 0;
+
+    HOST_CHECK(bytes > 0 && bytes <= TEST_BYTES_MAX);
+    /* Sent notifications keep their mbufs until the link carries them.  The
+     * phones refuse parameter updates, so both links stay at the default
+     * interval however long a run takes: 0x3B, unacceptable parameters. */
+    host_ble_get_timing(&timing);
+    timing.tx_held = true;
+    timing.update_status = 0x3B;
+    host_ble_set_timing(&timing);
+    host_app_start();
+    spp = host_ble_val_handle(TEST_SPP_UUID);
+    HOST_CHECK(spp != 0);
+    phones[0].conn = join(1, TEST_SMALL_MTU);
+    phones[1].conn = join(2, TEST_BIG_MTU);
+
+    /* Too big for the smaller pool, so only the larger one is asked */
+    for (int i = 0; i < CONFIG_BT_NIMBLE_MSYS_2_BLOCK_COUNT; i++)
+    {
+        held[nheld] = os_msys_get_pkthdr(CONFIG_BT_NIMBLE_MSYS_1_BLOCK_SIZE, 0);
+        HOST_CHECK(held[nheld++] != NULL);
+    }
+    while (os_msys_num_free() > TEST_MSYS_FREE)
+    {
+        held[nheld] = os_msys_get_pkthdr(0, 0);
+        HOST_CHECK(held[nheld++] != NULL);
+    }
+
+    for (size_t i = 0; i < sizeof test_bauds / sizeof test_bauds[0]; i++)
+    {
+        run(test_bauds[i], bytes);
+    }
+
+    for (int i = 0; i < nheld; i++)
+    {
+        os_mbuf_free_chain(held[i]);
+    }
+    for (int i = 0; i < TEST_PHONES; i++)
+    {
+        HOST_CHECK(host_ble_disconnect(phones[i].conn, BLE_ERR_REM_USER_CONN_TERM) == 0);
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,239 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * conn_policy_step() on its own.  Scripted sequences cover connect, the
+ * idle step-downs, activity, requests that cross in flight, refusals and
+ * updates the central makes by itself.  Then a simulated link with random
+ * activity and a peer that takes a while to answer, and sometimes refuses,
+ * runs with the clock passing through zero: at every millisecond the
+ * wanted level must be the one the idle time calls for, a request must
+ * never be sent while another is in flight, and an agreeable peer must
+ * end up on the wanted level.
+ *
+ * Usage: test_conn_policy [seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "sdkconfig.h"
+#include "host_app.h"
+#include "conn_policy.h"
+
+#define TEST_SIM_MS             2000000
+#define TEST_ANSWER_MS          40
+
+static const conn_policy_cfg_t cfg = {
+    .fast_idle_ms = CONFIG_LOCK_POLICY_IDLE_MS,
+    .relax_idle_ms = CONFIG_LOCK_POLICY_RELAX_MS,
+    .max_rejects = 3,
+};
+
+static uint32_t rng_state;
+
+static uint32_t
+rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void
+test_idle_steps(void)
+{
+    conn_policy_t p;
+    uint32_t t = 1000;
+    uint8_t act;
+
+    act = conn_policy_step(&p, &cfg, CONN_POLICY_EV_CONNECT, t);
+    HOST_CHECK(act == (CONN_POLICY_ACT_PHY | CONN_POLICY_ACT_DATA_LEN |
+                       CONN_POLICY_ACT_PARAMS | CONN_POLICY_ACT_ARM));
+    HOST_CHECK(p.level == CONN_POLICY_FAST && p.requested == CONN_POLICY_FAST && p.pending);
+    HOST_CHECK(p.timer_ms == t + cfg.fast_idle_ms);
+
+    HOST_CHECK(conn_policy_step(&p, &cfg, CONN_POLICY_EV_UPDATED, t + 30) == 0);
+    HOST_CHECK(p.applied == CONN_POLICY_FAST && !p.pending);
+
+    /* Writes on a fast link ask for nothing */
+    HOST_CHECK(conn_policy_step(&p, &cfg, CONN_POLICY_EV_ACTIVITY, t + 500) == 0);
+    HOST_CHECK(p.level == CONN_POLICY_FAST && p.active_ms == t + 500);
+
+    /* The first timer comes too early now, and is pushed back */
+    act = conn_policy_step(&p, &cfg, CONN_POLICY_EV_TIMER, t + cfg.fast_idle_ms);
+    HOST_CHECK(act == CONN_POLICY_ACT_ARM && p.level == CONN_POLICY_FAST);
+    HOST_CHECK(p.timer_ms == t + 500 + cfg.fast_idle_ms);
+
+    t += 500 + cfg.fast_idle_ms;
+    act = conn_policy_step(&p, &cfg, CONN_POLICY_EV_TIMER, t);
+    HOST_CHECK(act == (CONN_POLICY_ACT_PARAMS | CONN_POLICY_ACT_ARM));
+    HOST_CHECK(p.level == CONN_POLICY_NORMAL && p.requested == CONN_POLICY_NORMAL);
+    HOST_CHECK(p.timer_ms == t - cfg.fast_idle_ms + cfg.relax_idle_ms);
+    conn_policy_step(&p, &cfg, CONN_POLICY_EV_UPDATED, t + 30);
+
+    t = p.timer_ms;
+    act = conn_policy_step(&p, &cfg, CONN_POLICY_EV_TIMER, t);
+    HOST_CHECK(act == CONN_POLICY_ACT_PARAMS && p.level == CONN_POLICY_RELAXED);
+    HOST_CHECK(!p.timer_armed);
+    conn_policy_step(&p, &cfg, CONN_POLICY_EV_UPDATED, t + 30);
+    HOST_CHECK(p.applied == CONN_POLICY_RELAXED && p.transitions == 3);
+
+    /* One write brings it straight back */
+    act = conn_policy_step(&p, &cfg, CONN_POLICY_EV_ACTIVITY, t + 100);
+    HOST_CHECK(act == (CONN_POLICY_ACT_PARAMS | CONN_POLICY_ACT_ARM));
+    HOST_CHECK(p.level == CONN_POLICY_FAST && p.transitions == 4);
+}
+
+/* A level change while a request is in flight goes out on its completion */
+static void
+test_crossing(void)
+{
+    conn_policy_t p;
+    uint32_t t;
+    uint8_t act;
+
+    conn_policy_step(&p, &cfg, CONN_POLICY_EV_CONNECT, 0);
+    conn_policy_step(&p, &cfg, CONN_POLICY_EV_UPDATED, 30);
+    t = cfg.fast_idle_ms;
+    act = conn_policy_step(&p, &cfg, CONN_POLICY_EV_TIMER, t);
+    HOST_CHECK(act & CONN_POLICY_ACT_PARAMS);
+    HOST_CHECK(p.pending && p.requested == CONN_POLICY_NORMAL);
+
+    act = conn_policy_step(&p, &cfg, CONN_POLICY_EV_ACTIVITY, t + 5);
+    HOST_CHECK(!(act & CONN_POLICY_ACT_PARAMS) && p.level == CONN_POLICY_FAST);
+
+    act = conn_policy_step(&p, &cfg, CONN_POLICY_EV_UPDATED, t + 40);
+    HOST_CHECK(p.applied == CONN_POLICY_NORMAL);
+    HOST_CHECK((act & CONN_POLICY_ACT_PARAMS) && p.requested == CONN_POLICY_FAST);
+    conn_policy_step(&p, &cfg, CONN_POLICY_EV_UPDATED, t + 80);
+    HOST_CHECK(p.applied == CONN_POLICY_FAST && !p.pending);
+
+    /* The central picked other parameters: ask again */
+    act = conn_policy_step(&p, &cfg, CONN_POLICY_EV_UPDATED, t + 200);
+    HOST_CHECK(p.applied == CONN_POLICY_NONE);
+    HOST_CHECK((act & CONN_POLICY_ACT_PARAMS) && p.requested == CONN_POLICY_FAST);
+}
+
+static void
+test_rejects(void)
+{
+    conn_policy_t p;
+    uint32_t t = 0;
+    uint8_t act;
+
+    conn_policy_step(&p, &cfg, CONN_POLICY_EV_CONNECT, t);
+    /* A refused level is not asked for again, however busy the link */
+    HOST_CHECK(conn_policy_step(&p, &cfg, CONN_POLICY_EV_REJECTED, t + 30) == 0);
+    HOST_CHECK(!p.pending && p.rejects == 1);
+    for (int i = 1; i <= 10; i++)
+    {
+        HOST_CHECK(conn_policy_step(&p, &cfg, CONN_POLICY_EV_ACTIVITY, t + 100 * i) == 0);
+    }
+
+    /* Another level is, until max_rejects refusals in a row */
+    conn_policy_step(&p, &cfg, CONN_POLICY_EV_TIMER, p.timer_ms);
+    t = p.timer_ms;
+    act = conn_policy_step(&p, &cfg, CONN_POLICY_EV_TIMER, t);
+    HOST_CHECK((act & CONN_POLICY_ACT_PARAMS) && p.requested == CONN_POLICY_NORMAL);
+    conn_policy_step(&p, &cfg, CONN_POLICY_EV_REJECTED, t + 30);
+    act = conn_policy_step(&p, &cfg, CONN_POLICY_EV_ACTIVITY, t + 40);
+    HOST_CHECK((act & CONN_POLICY_ACT_PARAMS) && p.requested == CONN_POLICY_FAST);
+    conn_policy_step(&p, &cfg, CONN_POLICY_EV_REJECTED, t + 70);
+    HOST_CHECK(p.rejects == cfg.max_rejects);
+    t = p.timer_ms;
+    act = conn_policy_step(&p, &cfg, CONN_POLICY_EV_TIMER, t);
+    HOST_CHECK(p.level == CONN_POLICY_NORMAL && !(act & CONN_POLICY_ACT_PARAMS));
+
+    /* The central updating by itself shows it is willing again */
+    act = conn_policy_step(&p, &cfg, CONN_POLICY_EV_UPDATED, t + 10);
+    HOST_CHECK(p.rejects == 0 && (act & CONN_POLICY_ACT_PARAMS));
+    HOST_CHECK(p.requested == CONN_POLICY_NORMAL);
+}
+
+static uint8_t
+expected_level(uint32_t idle)
+{
+    return idle < cfg.fast_idle_ms ? CONN_POLICY_FAST :
+           idle < cfg.relax_idle_ms ? CONN_POLICY_NORMAL : CONN_POLICY_RELAXED;
+}
+
+/* A link with random activity, timers that fire on time, and a peer that
+ * answers after TEST_ANSWER_MS and refuses one request in refuse_in */
+static void
+test_simulated(uint32_t refuse_in)
+{
+    conn_policy_t p;
+    uint32_t start = UINT32_MAX - TEST_SIM_MS / 2;
+    uint32_t answer_at = 0;
+    uint32_t requests = 0;
+    uint32_t refusals = 0;
+    uint32_t settled = 0;
+    uint32_t next_write = start + 1;
+    bool answering = false;
+    uint8_t act;
+
+    for (uint32_t i = 0; i < TEST_SIM_MS; i++)
+    {
+        uint32_t now = start + i;
+
+        act = i == 0 ? conn_policy_step(&p, &cfg, CONN_POLICY_EV_CONNECT, now) : 0;
+        if (now == next_write)
+        {
+            act |= conn_policy_step(&p, &cfg, CONN_POLICY_EV_ACTIVITY, now);
+            /* Bursts of writes, and quiet spells long enough to relax */
+            next_write = now + (rng() % 4 == 0 ? 1 + rng() % (2 * cfg.relax_idle_ms) :
+                                1 + rng() % 500);
+        }
+        if (p.timer_armed && p.timer_ms == now)
+        {
+            act |= conn_policy_step(&p, &cfg, CONN_POLICY_EV_TIMER, now);
+        }
+        if (answering && now == answer_at)
+        {
+            bool refuse = refuse_in != 0 && rng() % refuse_in == 0;
+
+            answering = false;
+            refusals += refuse;
+            act |= conn_policy_step(&p, &cfg, refuse ? CONN_POLICY_EV_REJECTED :
+                                    CONN_POLICY_EV_UPDATED, now);
+        }
+        if (act & CONN_POLICY_ACT_PARAMS)
+        {
+            HOST_CHECK(!answering);
+            answering = true;
+            answer_at = now + TEST_ANSWER_MS;
+            requests++;
+        }
+        HOST_CHECK(p.pending == answering);
+        HOST_CHECK(p.level == expected_level(now - p.active_ms));
+        if (refuse_in == 0 && !answering)
+        {
+            HOST_CHECK(p.applied == p.level);
+        }
+        settled += !answering && p.applied == p.level;
+    }
+    printf("simulated, %s: %u level changes, %u requests, %u refused, "
+           "%.1f%% of the time on the wanted level\n",
+           refuse_in == 0 ? "agreeable peer" : "refusing peer",
+           (unsigned)p.transitions, (unsigned)requests, (unsigned)refusals,
+           100.0 * settled / TEST_SIM_MS);
+}
+
+int
+main(int argc, char **argv)
+{
+    rng_state = argc > 1 ? strtoul(argv[1], NULL, 0) : 0x1e7c0a55;
+    HOST_CHECK(rng_state != 0);
+    printf("seed 0x%08x\n", (unsigned)rng_state);
+
+    test_idle_steps();
+    test_crossing();
+    test_rejects();
+    test_simulated(0);
+    test_simulated(4);
+    printf("PASS\n");
+    return 0;
+}
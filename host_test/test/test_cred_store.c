@@ -0,0 +1,387 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * Credential store compaction cut short, and credential changes on the
+ * running lock.
+ *
+ * A store of 256 users, ten of them revoked from the first sector, is one
+ * add away from a compaction.  That add is run once to count its flash
+ * writes and erases, then again from the same image for each of them: the
+ * operation is torn half way and every one after it fails, as a reset
+ * would leave things.  Reopened, the store must hold the users it held
+ * before, each PIN still opening as its own user, and must still take
+ * users up to its capacity.  The program is linked with the partition
+ * writes wrapped, and CMake builds it with its own copy of cred_store.c
+ * for 256 users.
+ *
+ * Then an admin session adds a user by the binary command, which runs
+ * that compaction with flash timing on.  Another phone's PIN, written just
+ * after, must be answered first, a second change from the admin while the
+ * first runs must be told busy, and a revoke must take effect.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host/ble_hs.h"
+#include "host_ble.h"
+#include "host_hal.h"
+#include "host_app.h"
+#include "lock_hal.h"
+#include "lock_proto.h"
+#include "frame_parser.h"
+#include "cred_store.h"
+
+#define TEST_SPP_UUID           0xABF1
+#define TEST_USERS              CONFIG_LOCK_CRED_MAX_USERS
+#define TEST_REVOKED            10
+#define TEST_LIVE               (TEST_USERS - TEST_REVOKED)
+#define TEST_SECTORS            3
+#define TEST_SLOTS              (LOCK_HAL_SECTOR_SIZE / 32)
+/* Opens door 0, which the text dialogue unlocks */
+#define TEST_OTHER              (TEST_USERS - 4)
+#define TEST_PIN_LEN            8
+#define TEST_NEW_PIN            "31415926"
+#define TEST_GRANTED            "口令正确"
+#define TEST_WAIT_MS            5000
+
+_Static_assert(TEST_USERS == 256, "built for 256 users, two full sectors and a spare");
+
+esp_err_t __real_lock_hal_part_write(lock_hal_part_t part, size_t off, const void *buf,
+                                     size_t len);
+esp_err_t __real_lock_hal_part_erase(lock_hal_part_t part, size_t off, size_t len);
+
+static lock_hal_part_t part;
+static uint8_t image[TEST_SECTORS * LOCK_HAL_SECTOR_SIZE];
+static bool flash_armed;
+static bool flash_dead;
+static int flash_ops;
+static int flash_crash_at;
+
+static void
+test_pin(uint32_t n, char pin[TEST_PIN_LEN + 1])
+{
+    snprintf(pin, TEST_PIN_LEN + 1, "%08u", (unsigned)(10000000 + n));
+}
+
+static uint8_t
+test_doors(uint16_t user)
+{
+    return 1 + user % 7;
+}
+
+/* True if the operation is the one the reset cuts through */
+static bool
+flash_tear(void)
+{
+    if (!flash_armed)
+    {
+        return false;
+    }
+    return flash_ops++ == flash_crash_at;
+}
+
+esp_err_t
+__wrap_lock_hal_part_write(lock_hal_part_t p, size_t off, const void *buf, size_t len)
+{
+    if (flash_dead)
+    {
+        return ESP_FAIL;
+    }
+    if (flash_tear())
+    {
+        flash_dead = true;
+        __real_lock_hal_part_write(p, off, buf, len / 2);
+        return ESP_FAIL;
+    }
+    return __real_lock_hal_part_write(p, off, buf, len);
+}
+
+esp_err_t
+__wrap_lock_hal_part_erase(lock_hal_part_t p, size_t off, size_t len)
+{
+    static uint8_t old[LOCK_HAL_SECTOR_SIZE];
+
+    if (flash_dead)
+    {
+        return ESP_FAIL;
+    }
+    if (flash_tear())
+    {
+        /* Half the sector erased, the rest as it was */
+        flash_dead = true;
+        HOST_CHECK(len == sizeof old);
+        HOST_CHECK(lock_hal_part_read(p, off, old, sizeof old) == ESP_OK);
+        __real_lock_hal_part_erase(p, off, len);
+        __real_lock_hal_part_write(p, off + len / 2, &old[len / 2], len / 2);
+        return ESP_FAIL;
+    }
+    return __real_lock_hal_part_erase(p, off, len);
+}
+
+static void
+image_restore(void)
+{
+    HOST_CHECK(__real_lock_hal_part_erase(part, 0, sizeof image) == ESP_OK);
+    HOST_CHECK(__real_lock_hal_part_write(part, 0, image, sizeof image) == ESP_OK);
+}
+
+/* The users of the saved image, and none of the PIN that never got in */
+static void
+store_check(void)
+{
+    char pin[TEST_PIN_LEN + 1];
+    uint16_t user;
+    uint8_t doors;
+    esp_err_t ret;
+
+    HOST_CHECK(cred_store_count() == TEST_LIVE);
+    HOST_CHECK(cred_store_verify(CONFIG_LOCK_DEFAULT_PIN, strlen(CONFIG_LOCK_DEFAULT_PIN),
+                                 &user, &doors) == ESP_OK && user == 0);
+    for (uint16_t u = 1; u < TEST_USERS; u++)
+    {
+        test_pin(u, pin);
+        ret = cred_store_verify(pin, TEST_PIN_LEN, &user, &doors);
+        if (u <= TEST_REVOKED)
+        {
+            HOST_CHECK(ret == ESP_ERR_NOT_FOUND && !cred_store_live(u));
+        }
+        else
+        {
+            HOST_CHECK(ret == ESP_OK && user == u && doors == test_doors(u));
+        }
+    }
+    HOST_CHECK(cred_store_verify(TEST_NEW_PIN, TEST_PIN_LEN, &user, &doors) ==
+               ESP_ERR_NOT_FOUND);
+}
+
+/* Fills the reopened store to capacity; every PIN must then open */
+static void
+store_fill(void)
+{
+    char pin[TEST_PIN_LEN + 1];
+    uint16_t user;
+    uint8_t doors;
+
+    HOST_CHECK(cred_store_add(TEST_NEW_PIN, TEST_PIN_LEN, CRED_DOORS_ALL, &user) == ESP_OK);
+    HOST_CHECK(user == 1);
+    for (uint16_t u = 2; u <= TEST_REVOKED; u++)
+    {
+        test_pin(TEST_USERS + u, pin);
+        HOST_CHECK(cred_store_add(pin, TEST_PIN_LEN, CRED_DOORS_ALL, &user) == ESP_OK);
+        HOST_CHECK(user == u);
+    }
+    HOST_CHECK(cred_store_count() == TEST_USERS);
+    for (uint16_t u = 2; u <= TEST_REVOKED; u++)
+    {
+        test_pin(TEST_USERS + u, pin);
+        HOST_CHECK(cred_store_verify(pin, TEST_PIN_LEN, &user, &doors) == ESP_OK &&
+                   user == u);
+    }
+    for (uint16_t u = TEST_REVOKED + 1; u < TEST_USERS; u++)
+    {
+        test_pin(u, pin);
+        HOST_CHECK(cred_store_verify(pin, TEST_PIN_LEN, &user, &doors) == ESP_OK &&
+                   user == u);
+    }
+}
+
+static void
+test_interrupted(void)
+{
+    char pin[TEST_PIN_LEN + 1];
+    uint16_t user;
+    size_t size;
+    int ops;
+
+    HOST_CHECK(cred_store_init() == ESP_OK);
+    HOST_CHECK(lock_hal_part_find("creds", &part, &size) == ESP_OK);
+    HOST_CHECK(size >= sizeof image);
+    for (uint16_t u = 1; u < TEST_USERS; u++)
+    {
+        test_pin(u, pin);
+        HOST_CHECK(cred_store_add(pin, TEST_PIN_LEN, test_doors(u), &user) == ESP_OK);
+        HOST_CHECK(user == u);
+    }
+    for (uint16_t u = 1; u <= TEST_REVOKED; u++)
+    {
+        HOST_CHECK(cred_store_revoke(u) == ESP_OK);
+    }
+    store_check();
+    HOST_CHECK(lock_hal_part_read(part, 0, image, sizeof image) == ESP_OK);
+
+    /* Counted once, uninterrupted */
+    flash_crash_at = -1;
+    flash_ops = 0;
+    flash_armed = true;
+    HOST_CHECK(cred_store_add(TEST_NEW_PIN, TEST_PIN_LEN, CRED_DOORS_ALL, &user) == ESP_OK);
+    flash_armed = false;
+    ops = flash_ops;
+    /* Each live record of the first sector marked, copied and made valid,
+     * the sector erased, then the new record and its state */
+    HOST_CHECK(ops == 3 * (TEST_SLOTS - TEST_REVOKED) + 1 + 2);
+
+    for (int k = 0; k < ops; k++)
+    {
+        image_restore();
+        HOST_CHECK(cred_store_init() == ESP_OK);
+        flash_crash_at = k;
+        flash_ops = 0;
+        flash_dead = false;
+        flash_armed = true;
+        HOST_CHECK(cred_store_add(TEST_NEW_PIN, TEST_PIN_LEN, CRED_DOORS_ALL, &user) !=
+                   ESP_OK);
+        flash_armed = false;
+        flash_dead = false;
+
+        HOST_CHECK(cred_store_init() == ESP_OK);
+        store_check();
+        store_fill();
+    }
+    printf("compaction of %d flash operations cut short at each: ok\n", ops);
+}
+
+static uint16_t spp;
+
+static void
+wait_text(uint16_t conn, const char *want, int64_t *at_us)
+{
+    char buf[256];
+    int len = host_ble_notify_wait(conn, spp, buf, sizeof buf - 1, TEST_WAIT_MS, at_us);
+
+    HOST_CHECK(len > 0);
+    buf[len] = '\0';
+    HOST_CHECK(want == NULL || strstr(buf, want) != NULL);
+}
+
+static uint16_t
+phone(uint32_t n)
+{
+    ble_addr_t peer;
+    uint16_t conn;
+
+    host_app_peer(n, &peer);
+    HOST_CHECK(host_ble_connect(&peer, TEST_WAIT_MS, &conn) == 0);
+    HOST_CHECK(host_ble_exchange_mtu(conn, 247) == 0);
+    HOST_CHECK(host_ble_subscribe(conn, spp, true) == 0);
+    wait_text(conn, NULL, NULL);
+    return conn;
+}
+
+static void
+send_cmd(uint16_t conn, uint8_t op, uint8_t seq, const char *pin, uint16_t user)
+{
+    uint8_t frame[LOCK_PROTO_REPLY_MAX];
+    lock_writer_t w;
+    int len;
+
+    lock_proto_begin(&w, frame, sizeof frame, op, seq, LOCK_RES_OK);
+    if (pin != NULL)
+    {
+        lock_proto_put(&w, LOCK_TLV_CODE, pin, strlen(pin));
+    }
+    else
+    {
+        lock_proto_put_u16(&w, LOCK_TLV_USER, user);
+    }
+    len = lock_proto_end(&w);
+    HOST_CHECK(len > 0);
+    /* The writer builds replies: a request has no reply bit, and its RESULT
+     * is ignored */
+    frame[3] = op;
+    HOST_CHECK(host_ble_write(conn, spp, frame, len) == 0);
+}
+
+static uint8_t
+wait_result(uint16_t conn, uint8_t op, uint8_t seq, uint16_t *user, int64_t *at_us)
+{
+    uint8_t buf[LOCK_PROTO_REPLY_MAX];
+    lock_msg_t msg;
+    uint8_t res;
+    int len = host_ble_notify_wait(conn, spp, buf, sizeof buf, TEST_WAIT_MS, at_us);
+
+    HOST_CHECK(len > 3 && buf[0] == FRAME_BIN_MAGIC);
+    HOST_CHECK(lock_proto_decode(&buf[3], len - 3, &msg) == ESP_OK);
+    HOST_CHECK(msg.op == (op | LOCK_OP_REPLY) && msg.seq == seq);
+    HOST_CHECK(lock_proto_get_u8(&msg, LOCK_TLV_RESULT, &res));
+    if (user != NULL)
+    {
+        HOST_CHECK(lock_proto_get_u16(&msg, LOCK_TLV_USER, user));
+    }
+    return res;
+}
+
+static void
+test_over_ble(void)
+{
+    struct ble_gap_conn_desc desc;
+    char pin[TEST_PIN_LEN + 1];
+    uint16_t admin;
+    uint16_t other;
+    uint16_t user;
+    uint8_t doors;
+    int64_t granted_us;
+    int64_t added_us;
+
+    image_restore();
+    host_app_start();
+    spp = host_ble_val_handle(TEST_SPP_UUID);
+    HOST_CHECK(spp != 0);
+    HOST_CHECK(cred_store_count() == TEST_LIVE);
+
+    admin = phone(1);
+    HOST_CHECK(host_ble_pair(admin, false) == 0);
+    for (int i = 0; i < 200; i++)
+    {
+        HOST_CHECK(ble_gap_conn_find(admin, &desc) == 0);
+        if (desc.sec_state.encrypted)
+        {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    HOST_CHECK(desc.sec_state.encrypted);
+    HOST_CHECK(host_ble_write(admin, spp, CONFIG_LOCK_DEFAULT_PIN,
+                              strlen(CONFIG_LOCK_DEFAULT_PIN)) == 0);
+    wait_text(admin, TEST_GRANTED, NULL);
+    other = phone(2);
+
+    /* The add compacts a sector: about a third of a second of flash work */
+    host_flash_timing(true);
+    send_cmd(admin, LOCK_OP_CRED_ADD, 1, TEST_NEW_PIN, 0);
+    send_cmd(admin, LOCK_OP_CRED_REVOKE, 2, NULL, TEST_OTHER);
+    test_pin(TEST_OTHER, pin);
+    HOST_CHECK(host_ble_write(other, spp, pin, TEST_PIN_LEN) == 0);
+    HOST_CHECK(wait_result(admin, LOCK_OP_CRED_REVOKE, 2, NULL, NULL) == LOCK_RES_BUSY);
+    wait_text(other, TEST_GRANTED, &granted_us);
+    HOST_CHECK(wait_result(admin, LOCK_OP_CRED_ADD, 1, &user, &added_us) == LOCK_RES_OK);
+    host_flash_timing(false);
+    HOST_CHECK(user == 1);
+    printf("unlock answered %lld ms before the add that compacted\n",
+           (long long)(added_us - granted_us) / 1000);
+    HOST_CHECK(granted_us < added_us);
+    HOST_CHECK(cred_store_verify(TEST_NEW_PIN, TEST_PIN_LEN, &user, &doors) == ESP_OK &&
+               user == 1);
+
+    send_cmd(admin, LOCK_OP_CRED_REVOKE, 3, NULL, 1);
+    HOST_CHECK(wait_result(admin, LOCK_OP_CRED_REVOKE, 3, NULL, NULL) == LOCK_RES_OK);
+    HOST_CHECK(!cred_store_live(1));
+    send_cmd(admin, LOCK_OP_CRED_REVOKE, 4, NULL, 1);
+    HOST_CHECK(wait_result(admin, LOCK_OP_CRED_REVOKE, 4, NULL, NULL) == LOCK_RES_DENIED);
+
+    HOST_CHECK(host_ble_disconnect(other, BLE_ERR_REM_USER_CONN_TERM) == 0);
+    HOST_CHECK(host_ble_disconnect(admin, BLE_ERR_REM_USER_CONN_TERM) == 0);
+}
+
+int
+main(void)
+{
+    test_interrupted();
+    test_over_ble();
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,355 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * frame_parser against a model of the stream.  Random text and binary
+ * frames, some longer than FRAME_MAX, are serialized and fed back in
+ * random cuts, flat and as mbuf chains; the parser must hand back exactly
+ * the frames that fit and count the rest.  Random bytes must never make it
+ * emit more than FRAME_MAX, and a frame left incomplete must not outlive
+ * a pause of FRAME_GAP_MS.  Then a throughput run over segments the size
+ * of a 247-byte MTU payload.
+ *
+ * Usage: test_frame_parser [seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "host/ble_hs.h"
+#include "nimble/nimble_port.h"
+#include "host_app.h"
+#include "frame_parser.h"
+
+#define TEST_FRAMES             20000
+#define TEST_STREAM_MAX         (TEST_FRAMES * (FRAME_MAX + 64))
+#define TEST_THROUGHPUT_BYTES   (64u << 20)
+#define TEST_SEGMENT            244
+
+typedef struct
+{
+    frame_type_t type;
+    uint16_t len;
+    uint32_t off;               /* Payload offset in the stream */
+} test_frame_t;
+
+static uint8_t *stream;
+static size_t stream_len;
+static test_frame_t *expect;
+static int expect_count;
+static int expect_overflows;
+
+static int got_count;
+static size_t got_bytes;
+static bool got_ok = true;
+
+static uint32_t rng_state;
+
+static uint32_t
+rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/* Appends one random frame to the stream and, if it fits, to expect */
+static void
+gen_frame(void)
+{
+    bool binary = rng() % 2;
+    /* One frame in 16 is too long */
+    uint32_t len = rng() % 16 == 0 ? FRAME_MAX + 1 + rng() % 64 : 1 + rng() % FRAME_MAX;
+    uint32_t off;
+
+    if (binary)
+    {
+        stream[stream_len++] = FRAME_BIN_MAGIC;
+        stream[stream_len++] = len & 0xff;
+        stream[stream_len++] = len >> 8;
+        off = stream_len;
+        for (uint32_t i = 0; i < len; i++)
+        {
+            stream[stream_len++] = rng();
+        }
+    }
+    else
+    {
+        off = stream_len;
+        for (uint32_t i = 0; i < len; i++)
+        {
+            /* Printable, so never '\r', '\n' or the binary magic */
+            stream[stream_len++] = ' ' + rng() % 95;
+        }
+        /* Half the lines end in CRLF */
+        if (rng() % 2)
+        {
+            stream[stream_len++] = '\r';
+        }
+        stream[stream_len++] = '\n';
+    }
+
+    if (len > FRAME_MAX)
+    {
+        expect_overflows++;
+        return;
+    }
+    expect[expect_count].type = binary ? FRAME_TYPE_BINARY : FRAME_TYPE_TEXT;
+    expect[expect_count].len = len;
+    expect[expect_count].off = off;
+    expect_count++;
+}
+
+static void
+check_cb(void *arg, frame_type_t type, const uint8_t *data, uint16_t len)
+{
+    const test_frame_t *e = got_count < expect_count ? &expect[got_count] : NULL;
+
+    if (e == NULL || e->type != type || e->len != len ||
+        memcmp(data, &stream[e->off], len) != 0)
+    {
+        if (got_ok)
+        {
+            fprintf(stderr, "frame %d: type %d len %u, expected type %d len %u\n",
+                    got_count, type, len, e != NULL ? (int)e->type : -1,
+                    e != NULL ? e->len : 0);
+        }
+        got_ok = false;
+    }
+    got_count++;
+}
+
+static void
+count_cb(void *arg, frame_type_t type, const uint8_t *data, uint16_t len)
+{
+    if (len > FRAME_MAX)
+    {
+        got_ok = false;
+    }
+    got_count++;
+    got_bytes += len;
+}
+
+static void
+check_result(const frame_parser_t *p, const char *how)
+{
+    printf("%s: %d frames, %d too long\n", how, got_count, (int)p->overflows);
+    HOST_CHECK(got_ok);
+    HOST_CHECK(got_count == expect_count);
+    HOST_CHECK((int)p->frames == expect_count);
+    HOST_CHECK((int)p->overflows == expect_overflows);
+}
+
+/* The model stream in random cuts of 1 .. 600 bytes */
+static void
+test_random_cuts(void)
+{
+    static frame_parser_t p;
+    size_t off = 0;
+
+    frame_parser_reset(&p);
+    p.frames = p.overflows = 0;
+    got_count = 0;
+    while (off < stream_len)
+    {
+        size_t n = 1 + rng() % 600;
+
+        n = n < stream_len - off ? n : stream_len - off;
+        frame_parser_feed(&p, &stream[off], n, false, check_cb, NULL);
+        off += n;
+    }
+    check_result(&p, "random cuts");
+}
+
+/* The model stream as writes of chained mbufs, up to 4 segments each */
+static void
+test_mbuf_chains(void)
+{
+    static frame_parser_t p;
+    size_t off = 0;
+
+    frame_parser_reset(&p);
+    p.frames = p.overflows = 0;
+    got_count = 0;
+    while (off < stream_len)
+    {
+        struct os_mbuf *om = NULL;
+        struct os_mbuf *last = NULL;
+        int segs = 1 + rng() % 4;
+
+        for (int s = 0; s < segs && off < stream_len; s++)
+        {
+            size_t n = 1 + rng() % 200;
+            struct os_mbuf *m;
+
+            n = n < stream_len - off ? n : stream_len - off;
+            m = ble_hs_mbuf_from_flat(&stream[off], n);
+            HOST_CHECK(m != NULL);
+            if (om == NULL)
+            {
+                om = m;
+            }
+            else
+            {
+                SLIST_NEXT(last, om_next) = m;
+                om->om_pktlen += n;
+            }
+            for (last = m; SLIST_NEXT(last, om_next) != NULL; last = SLIST_NEXT(last, om_next))
+            {
+            }
+            off += n;
+        }
+        frame_parser_feed_mbuf(&p, om, false, check_cb, NULL);
+        os_mbuf_free_chain(om);
+    }
+    check_result(&p, "mbuf chains");
+    HOST_CHECK(os_msys_num_free() == os_msys_count());
+}
+
+/* Short writes end text frames; a bare PIN arrives without '\n' */
+static void
+test_end_of_write(void)
+{
+    static frame_parser_t p;
+    static const uint8_t pin[] = "200296";
+
+    frame_parser_reset(&p);
+    p.frames = 0;
+    got_count = 0;
+    got_bytes = 0;
+    frame_parser_feed(&p, pin, 3, false, count_cb, NULL);
+    HOST_CHECK(got_count == 0);
+    frame_parser_feed(&p, &pin[3], 3, true, count_cb, NULL);
+    HOST_CHECK(got_count == 1 && got_bytes == 6);
+
+    /* A binary frame is not ended by the write; it waits for its length */
+    frame_parser_feed(&p, (const uint8_t[]){ FRAME_BIN_MAGIC, 4, 0, 1, 2 }, 5, true,
+                      count_cb, NULL);
+    HOST_CHECK(got_count == 1);
+    frame_parser_feed(&p, (const uint8_t[]){ 3, 4 }, 2, true, count_cb, NULL);
+    HOST_CHECK(got_count == 2 && got_bytes == 10);
+}
+
+/* A binary header whose payload never comes holds the stream only until
+ * the next write after a pause; the text behind it is parsed */
+static void
+test_stale_frame(void)
+{
+    static frame_parser_t p;
+    static const uint8_t pin[] = "200296\n";
+    uint32_t now = UINT32_MAX - FRAME_GAP_MS / 2;
+
+    frame_parser_reset(&p);
+    p.frames = 0;
+    got_count = 0;
+    got_bytes = 0;
+    HOST_CHECK(!frame_parser_begin_write(&p, now));
+    frame_parser_feed(&p, (const uint8_t[]){ FRAME_BIN_MAGIC, 8, 0, 1 }, 4, true,
+                      count_cb, NULL);
+
+    /* Within the gap it is the rest of the frame */
+    now += FRAME_GAP_MS;
+    HOST_CHECK(!frame_parser_begin_write(&p, now));
+    frame_parser_feed(&p, (const uint8_t[]){ 2, 3 }, 2, true, count_cb, NULL);
+    HOST_CHECK(got_count == 0);
+
+    /* After it, across the clock's wrap, the frame is given up */
+    now += FRAME_GAP_MS + 1;
+    HOST_CHECK(frame_parser_begin_write(&p, now));
+    frame_parser_feed(&p, pin, sizeof pin - 1, true, count_cb, NULL);
+    HOST_CHECK(got_count == 1 && got_bytes == 6);
+    HOST_CHECK(p.stale == 1);
+
+    /* A pause between whole frames drops nothing */
+    now += 10 * FRAME_GAP_MS;
+    HOST_CHECK(!frame_parser_begin_write(&p, now));
+    frame_parser_feed(&p, pin, sizeof pin - 1, true, count_cb, NULL);
+    HOST_CHECK(got_count == 2 && p.stale == 1);
+    printf("stale frame: dropped after %u ms\n", (unsigned)FRAME_GAP_MS);
+}
+
+/* Arbitrary bytes: never a frame over the limit */
+static void
+test_random_bytes(void)
+{
+    static frame_parser_t p;
+    uint8_t buf[512];
+
+    frame_parser_reset(&p);
+    got_count = 0;
+    for (int i = 0; i < 200000; i++)
+    {
+        size_t n = rng() % sizeof buf;
+
+        for (size_t j = 0; j < n; j++)
+        {
+            /* Skewed towards the bytes the parser branches on */
+            uint32_t r = rng() % 8;
+
+            buf[j] = r == 0 ? '\n' : r == 1 ? FRAME_BIN_MAGIC : r == 2 ? '\r' : rng();
+        }
+        frame_parser_feed(&p, buf, n, rng() % 2, count_cb, NULL);
+    }
+    printf("random bytes: %d frames, %u too long\n", got_count, (unsigned)p.overflows);
+    HOST_CHECK(got_ok);
+}
+
+static void
+test_throughput(void)
+{
+    static frame_parser_t p;
+    size_t fed = 0;
+    int64_t t0;
+    int64_t us;
+
+    frame_parser_reset(&p);
+    got_count = 0;
+    got_bytes = 0;
+    t0 = esp_timer_get_time();
+    while (fed < TEST_THROUGHPUT_BYTES)
+    {
+        for (size_t off = 0; off < stream_len; off += TEST_SEGMENT)
+        {
+            size_t n = stream_len - off < TEST_SEGMENT ? stream_len - off : TEST_SEGMENT;
+
+            frame_parser_feed(&p, &stream[off], n, false, count_cb, NULL);
+        }
+        fed += stream_len;
+    }
+    us = esp_timer_get_time() - t0;
+    printf("throughput: %zu MB in %lld ms, %.1f MB/s, %.0f frames/s\n",
+           fed >> 20, (long long)us / 1000, (double)fed / us,
+           got_count * 1e6 / us);
+    HOST_CHECK(got_ok);
+}
+
+int
+main(int argc, char **argv)
+{
+    rng_state = argc > 1 ? strtoul(argv[1], NULL, 0) : 0x2d9a7c11;
+    HOST_CHECK(rng_state != 0);
+    printf("seed 0x%08x\n", (unsigned)rng_state);
+
+    /* The msys pools, for the chained writes */
+    HOST_CHECK(nimble_port_init() == ESP_OK);
+    stream = malloc(TEST_STREAM_MAX);
+    expect = malloc(TEST_FRAMES * sizeof *expect);
+    HOST_CHECK(stream != NULL && expect != NULL);
+    for (int i = 0; i < TEST_FRAMES; i++)
+    {
+        gen_frame();
+    }
+
+    test_random_cuts();
+    test_mbuf_chains();
+    test_end_of_write();
+    test_stale_frame();
+    test_random_bytes();
+    test_throughput();
+    printf("PASS\n");
+    return 0;
+}
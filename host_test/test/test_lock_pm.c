@@ -0,0 +1,166 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * Power-management locks around one visit.  The lock starts idle, with
+ * every path released, as it would be asleep between advertising events.
+ * A phone connects, subscribes and writes the PIN at once.  The door must
+ * start moving within CONFIG_LOCK_DIAG_UNLOCK_BUDGET_MS of the connect, and
+ * lock_diag must count no late unlock.  Along the way the BLE path is held
+ * while the phone talks, the UART path while it is subscribed and the
+ * actuator path while the servo moves.  Every path is let go once the
+ * visit is over.
+ *
+ * Usage: test_lock_pm
+ */
+#include <stdio.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host_ble.h"
+#include "host_hal.h"
+#include "host_app.h"
+#include "actuator.h"
+#include "lock_diag.h"
+#include "lock_pm.h"
+
+#define TEST_SPP_UUID           0xABF1
+#define TEST_WAIT_MS            5000
+#define TEST_GRANTED            "口令正确"
+#define TEST_LINE               "pm: bridged while subscribed\n"
+
+static const char *const path_name[LOCK_PM_PATHS] = { "ble", "uart", "actuator" };
+
+static uint32_t
+held(lock_pm_path_t path)
+{
+    lock_pm_stats_t st;
+
+    lock_pm_get_stats(path, &st);
+    return st.held;
+}
+
+/* Waits for every holder of path to let go */
+static bool
+released(lock_pm_path_t path, uint32_t timeout_ms)
+{
+    int64_t deadline = esp_timer_get_time() + timeout_ms * 1000LL;
+
+    while (held(path) != 0)
+    {
+        if (esp_timer_get_time() > deadline)
+        {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return true;
+}
+
+static uint32_t
+late_unlocks(void)
+{
+    uint8_t dump[DIAG_DUMP_SIZE];
+    const uint8_t *p = &dump[8 + 4 * DIAG_CNT_UNLOCK_LATE];
+
+    HOST_CHECK(lock_diag_dump(dump, sizeof dump) == DIAG_DUMP_SIZE);
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+int
+main(void)
+{
+    lock_pm_stats_t before[LOCK_PM_PATHS];
+    lock_pm_stats_t after;
+    uint32_t fades;
+    uint32_t late;
+    ble_addr_t peer;
+    uint16_t conn;
+    uint16_t spp;
+    char buf[512];
+    int64_t t_wake;
+    int64_t t_write;
+    int64_t at;
+    int len;
+
+    host_app_start();
+    spp = host_ble_val_handle(TEST_SPP_UUID);
+    HOST_CHECK(spp != 0);
+
+    /* Idle: nothing holds the clocks up */
+    for (int i = 0; i < LOCK_PM_PATHS; i++)
+    {
+        HOST_CHECK(released(i, CONFIG_LOCK_PM_UART_IDLE_MS + 1000));
+        lock_pm_get_stats(i, &before[i]);
+    }
+    late = late_unlocks();
+    fades = host_ledc_fades(0);
+
+    /* Connect, subscribe and say the PIN without waiting for the banner */
+    host_app_peer(1, &peer);
+    t_wake = esp_timer_get_time();
+    HOST_CHECK(host_ble_connect(&peer, TEST_WAIT_MS, &conn) == 0);
+    HOST_CHECK(host_ble_exchange_mtu(conn, 247) == 0);
+    HOST_CHECK(host_ble_subscribe(conn, spp, true) == 0);
+    HOST_CHECK(held(LOCK_PM_UART) > 0);
+    t_write = esp_timer_get_time();
+    HOST_CHECK(host_ble_write(conn, spp, CONFIG_LOCK_DEFAULT_PIN,
+                              strlen(CONFIG_LOCK_DEFAULT_PIN)) == 0);
+    HOST_CHECK(held(LOCK_PM_BLE) > 0);
+    HOST_CHECK(host_ledc_wait(0, fades, CONFIG_LOCK_DIAG_UNLOCK_BUDGET_MS, &at));
+    HOST_CHECK(held(LOCK_PM_ACTUATOR) > 0);
+    printf("connect to unlock %lld us, write to unlock %lld us, budget %d ms\n",
+           (long long)(at - t_wake), (long long)(at - t_write),
+           CONFIG_LOCK_DIAG_UNLOCK_BUDGET_MS);
+    HOST_CHECK(at - t_wake < CONFIG_LOCK_DIAG_UNLOCK_BUDGET_MS * 1000LL);
+
+    /* The verdict; the banner may come before or after it */
+    do
+    {
+        len = host_ble_notify_wait(conn, spp, buf, sizeof buf - 1, TEST_WAIT_MS, NULL);
+        HOST_CHECK(len > 0);
+        buf[len] = '\0';
+    } while (strstr(buf, TEST_GRANTED) == NULL);
+
+    /* The door closes and its path lets go once the servo has settled.  The
+     * fade may start before the task has left IDLE, so that comes first. */
+    while (actuator_get_state(0) == ACTUATOR_STATE_IDLE)
+    {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    while (actuator_get_state(0) != ACTUATOR_STATE_IDLE)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    HOST_CHECK(released(LOCK_PM_ACTUATOR, CONFIG_LOCK_PM_SERVO_SETTLE_MS + 1000));
+
+    /* Still subscribed, so UART bytes long after the last one get through */
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_LOCK_PM_UART_IDLE_MS + 200));
+    HOST_CHECK(held(LOCK_PM_UART) > 0);
+    host_ble_notify_flush(conn);
+    HOST_CHECK(host_uart_inject(TEST_LINE, strlen(TEST_LINE)));
+    len = host_ble_notify_wait(conn, spp, buf, sizeof buf, TEST_WAIT_MS, NULL);
+    HOST_CHECK(len == (int)strlen(TEST_LINE) && memcmp(buf, TEST_LINE, len) == 0);
+
+    /* Unsubscribed, the UART path goes once the line has gone quiet */
+    HOST_CHECK(host_ble_subscribe(conn, spp, false) == 0);
+    HOST_CHECK(released(LOCK_PM_UART, CONFIG_LOCK_PM_UART_IDLE_MS + 1000));
+    HOST_CHECK(host_ble_disconnect(conn, BLE_ERR_REM_USER_CONN_TERM) == 0);
+    HOST_CHECK(released(LOCK_PM_BLE, TEST_WAIT_MS));
+
+    for (int i = 0; i < LOCK_PM_PATHS; i++)
+    {
+        lock_pm_get_stats(i, &after);
+        printf("pm %-8s %u windows, longest %u ms\n", path_name[i],
+               (unsigned)(after.acquires - before[i].acquires),
+               (unsigned)(after.max_us / 1000));
+        HOST_CHECK(after.acquires > before[i].acquires);
+    }
+    HOST_CHECK(late_unlocks() == late);
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,308 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * The binary command codec.  Random replies are built with the writer,
+ * framed, run through the frame parser and decoded again, and must come
+ * back TLV for TLV; every capacity short of a reply must fail cleanly and
+ * every truncation must be caught.  Then one unlock each way on the lock
+ * itself, counting what goes over the air.
+ *
+ * Usage: test_lock_proto [seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_ble.h"
+#include "host_app.h"
+#include "frame_parser.h"
+#include "lock_proto.h"
+
+#define TEST_ROUNDS             20000
+#define TEST_TLVS_MAX           6
+#define TEST_VAL_MAX            36
+#define TEST_BUF                (3 + LOCK_PROTO_HDR_LEN + 3 + TEST_TLVS_MAX * (2 + TEST_VAL_MAX))
+#define TEST_SPP_UUID           0xABF1
+#define TEST_QUIET_MS           300
+/* Link-layer payload without data length extension, and L2CAP + ATT headers */
+#define TEST_LL_PAYLOAD         27
+#define TEST_ATT_OVERHEAD       7
+
+_Static_assert(TEST_BUF - 3 <= FRAME_MAX, "test replies must fit a frame");
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t len;
+    uint8_t val[TEST_VAL_MAX];
+} test_tlv_t;
+
+static uint32_t rng_state;
+
+static uint32_t
+rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static uint8_t frame_out[FRAME_MAX];
+static uint16_t frame_out_len;
+static int frame_count;
+
+static void
+frame_cb(void *arg, frame_type_t type, const uint8_t *data, uint16_t len)
+{
+    HOST_CHECK(type == FRAME_TYPE_BINARY);
+    memcpy(frame_out, data, len);
+    frame_out_len = len;
+    frame_count++;
+}
+
+/* Builds a random reply, frames and parses it, and checks every TLV */
+static void
+test_round_trip(void)
+{
+    static frame_parser_t p;
+    test_tlv_t tlvs[TEST_TLVS_MAX];
+    uint8_t buf[TEST_BUF];
+    lock_writer_t w;
+    lock_msg_t msg;
+    uint8_t op = rng();
+    uint8_t seq = rng();
+    lock_result_t result = rng() % (LOCK_RES_FAILED + 1);
+    int ntlv = rng() % (TEST_TLVS_MAX + 1);
+    uint16_t off = 0;
+    int len;
+
+    lock_proto_begin(&w, buf, sizeof buf, op, seq, result);
+    for (int i = 0; i < ntlv; i++)
+    {
+        test_tlv_t *t = &tlvs[i];
+
+        t->type = LOCK_TLV_VERSION + rng() % 32;
+        t->len = rng() % (TEST_VAL_MAX + 1);
+        for (int j = 0; j < t->len; j++)
+        {
+            t->val[j] = rng();
+        }
+        if (t->len == 1 && rng() % 2)
+        {
+            lock_proto_put_u8(&w, t->type, t->val[0]);
+        }
+        else if (t->len == 2 && rng() % 2)
+        {
+            lock_proto_put_u16(&w, t->type, t->val[0] | t->val[1] << 8);
+        }
+        else
+        {
+            lock_proto_put(&w, t->type, t->val, t->len);
+        }
+    }
+    len = lock_proto_end(&w);
+    HOST_CHECK(len > 0 && len <= (int)sizeof buf);
+
+    frame_parser_reset(&p);
+    frame_count = 0;
+    frame_parser_feed(&p, buf, len, true, frame_cb, NULL);
+    HOST_CHECK(frame_count == 1 && frame_out_len == len - 3);
+
+    HOST_CHECK(lock_proto_decode(frame_out, frame_out_len, &msg) == ESP_OK);
+    HOST_CHECK(msg.op == (op | LOCK_OP_REPLY) && msg.seq == seq);
+    HOST_CHECK(msg.tlv[0] == LOCK_TLV_RESULT && msg.tlv[1] == 1 && msg.tlv[2] == result);
+    off = 3;
+    for (int i = 0; i < ntlv; i++)
+    {
+        const test_tlv_t *t = &tlvs[i];
+        const uint8_t *val;
+        uint8_t vlen;
+        uint16_t u16;
+
+        HOST_CHECK(msg.tlv[off] == t->type && msg.tlv[off + 1] == t->len);
+        HOST_CHECK(memcmp(&msg.tlv[off + 2], t->val, t->len) == 0);
+        off += 2 + t->len;
+
+        /* find() returns the first of a type */
+        HOST_CHECK(lock_proto_find(&msg, t->type, &val, &vlen));
+        for (int j = 0; j < i; j++)
+        {
+            if (tlvs[j].type == t->type)
+            {
+                t = &tlvs[j];
+                break;
+            }
+        }
+        HOST_CHECK(vlen == t->len && memcmp(val, t->val, vlen) == 0);
+        HOST_CHECK(lock_proto_get_u16(&msg, t->type, &u16) == (t->len == 2));
+        if (t->len == 2)
+        {
+            HOST_CHECK(u16 == (t->val[0] | t->val[1] << 8));
+        }
+    }
+    HOST_CHECK(off == msg.tlv_len);
+
+    /* Any capacity short of the reply fails; none writes past it */
+    for (int cap = 0; cap < len; cap++)
+    {
+        uint8_t small[TEST_BUF + 1];
+
+        small[cap] = 0x5A;
+        lock_proto_begin(&w, small, cap, op, seq, result);
+        for (int i = 0; i < ntlv; i++)
+        {
+            lock_proto_put(&w, tlvs[i].type, tlvs[i].val, tlvs[i].len);
+        }
+        HOST_CHECK(lock_proto_end(&w) == -1);
+        HOST_CHECK(small[cap] == 0x5A);
+    }
+
+    /* A payload cut short is malformed unless cut at a TLV boundary */
+    for (uint16_t cut = 0; cut < frame_out_len; cut++)
+    {
+        bool boundary = cut == LOCK_PROTO_HDR_LEN;
+        esp_err_t ret;
+
+        for (uint16_t t = 0; t + LOCK_PROTO_HDR_LEN < cut && !boundary;
+             t += 2 + msg.tlv[t + 1])
+        {
+            boundary = t + 2 + msg.tlv[t + 1] + LOCK_PROTO_HDR_LEN == cut;
+        }
+        ret = lock_proto_decode(frame_out, cut, &msg);
+        if (cut < LOCK_PROTO_HDR_LEN)
+        {
+            HOST_CHECK(ret == ESP_ERR_INVALID_SIZE);
+            continue;
+        }
+        HOST_CHECK(ret == (boundary ? ESP_OK : ESP_ERR_INVALID_ARG));
+        /* Still answerable */
+        HOST_CHECK(msg.op == (op | LOCK_OP_REPLY) && msg.seq == seq);
+    }
+}
+
+/* Notifications until none for TEST_QUIET_MS; counts values and packets */
+static void
+drain(uint16_t conn, uint16_t val, uint32_t *bytes, uint32_t *pdus, uint32_t *packets,
+      uint8_t *last, int *last_len)
+{
+    uint8_t buf[512];
+    int n;
+
+    while ((n = host_ble_notify_wait(conn, val, buf, sizeof buf, TEST_QUIET_MS, NULL)) >= 0)
+    {
+        *bytes += n;
+        *pdus += 1;
+        *packets += (TEST_ATT_OVERHEAD + n + TEST_LL_PAYLOAD - 1) / TEST_LL_PAYLOAD;
+        if (last != NULL)
+        {
+            memcpy(last, buf, n);
+            *last_len = n;
+        }
+    }
+}
+
+static void
+sent(uint16_t len, uint32_t *bytes, uint32_t *pdus, uint32_t *packets)
+{
+    *bytes += len;
+    *pdus += 1;
+    *packets += (TEST_ATT_OVERHEAD + len + TEST_LL_PAYLOAD - 1) / TEST_LL_PAYLOAD;
+}
+
+/* One unlock in the text dialogue and one in binary mode */
+static void
+test_air_bytes(void)
+{
+    const char *pin = CONFIG_LOCK_DEFAULT_PIN;
+    uint8_t code_len = strlen(pin);
+    uint8_t hello[] = { FRAME_BIN_MAGIC, 2, 0, LOCK_OP_HELLO, 1 };
+    uint8_t unlock[3 + LOCK_PROTO_HDR_LEN + 2 + 16];
+    uint8_t reply[512];
+    int reply_len = 0;
+    uint32_t text[3] = { 0 };
+    uint32_t bin[3] = { 0 };
+    uint32_t banner_bytes;
+    lock_msg_t msg;
+    uint8_t res;
+    uint16_t user;
+    uint16_t spp;
+    uint16_t conn;
+    ble_addr_t peer;
+
+    host_app_start();
+    spp = host_ble_val_handle(TEST_SPP_UUID);
+    HOST_CHECK(spp != 0);
+
+    /* Text: the banner, the PIN, the result */
+    host_app_peer(1, &peer);
+    HOST_CHECK(host_ble_connect(&peer, 2000, &conn) == 0);
+    HOST_CHECK(host_ble_exchange_mtu(conn, 247) == 0);
+    HOST_CHECK(host_ble_subscribe(conn, spp, true) == 0);
+    drain(conn, spp, &text[0], &text[1], &text[2], NULL, NULL);
+    banner_bytes = text[0];
+    HOST_CHECK(banner_bytes > 0);
+    HOST_CHECK(host_ble_write(conn, spp, pin, code_len) == 0);
+    sent(code_len, &text[0], &text[1], &text[2]);
+    drain(conn, spp, &text[0], &text[1], &text[2], NULL, NULL);
+    HOST_CHECK(text[0] > banner_bytes + code_len);
+    HOST_CHECK(host_ble_disconnect(conn, BLE_ERR_REM_USER_CONN_TERM) == 0);
+
+    /* Binary: HELLO before the banner is due, then UNLOCK */
+    host_app_peer(2, &peer);
+    HOST_CHECK(host_ble_connect(&peer, 2000, &conn) == 0);
+    HOST_CHECK(host_ble_exchange_mtu(conn, 247) == 0);
+    HOST_CHECK(host_ble_subscribe(conn, spp, true) == 0);
+    HOST_CHECK(host_ble_write(conn, spp, hello, sizeof hello) == 0);
+    drain(conn, spp, &bin[0], &bin[1], &bin[2], reply, &reply_len);
+    HOST_CHECK(bin[1] == 1 && reply[0] == FRAME_BIN_MAGIC);
+    memset(bin, 0, sizeof bin);
+
+    unlock[0] = FRAME_BIN_MAGIC;
+    unlock[1] = LOCK_PROTO_HDR_LEN + 2 + code_len;
+    unlock[2] = 0;
+    unlock[3] = LOCK_OP_UNLOCK;
+    unlock[4] = 2;
+    unlock[5] = LOCK_TLV_CODE;
+    unlock[6] = code_len;
+    memcpy(&unlock[7], pin, code_len);
+    HOST_CHECK(host_ble_write(conn, spp, unlock, 7 + code_len) == 0);
+    sent(7 + code_len, &bin[0], &bin[1], &bin[2]);
+    drain(conn, spp, &bin[0], &bin[1], &bin[2], reply, &reply_len);
+    HOST_CHECK(bin[1] == 2);
+    HOST_CHECK(reply_len > 3 && reply[0] == FRAME_BIN_MAGIC);
+    HOST_CHECK(lock_proto_decode(&reply[3], reply_len - 3, &msg) == ESP_OK);
+    HOST_CHECK(msg.op == (LOCK_OP_UNLOCK | LOCK_OP_REPLY) && msg.seq == 2);
+    HOST_CHECK(lock_proto_get_u8(&msg, LOCK_TLV_RESULT, &res) && res == LOCK_RES_OK);
+    HOST_CHECK(lock_proto_get_u16(&msg, LOCK_TLV_USER, &user) && user == 0);
+    HOST_CHECK(host_ble_disconnect(conn, BLE_ERR_REM_USER_CONN_TERM) == 0);
+
+    printf("per unlock, %u-digit PIN:\n", code_len);
+    printf("  text:   %4u B in %u ATT PDUs, %2u LL packets, banner %u B\n",
+           (unsigned)text[0], (unsigned)text[1], (unsigned)text[2], (unsigned)banner_bytes);
+    printf("  binary: %4u B in %u ATT PDUs, %2u LL packets, one round trip\n",
+           (unsigned)bin[0], (unsigned)bin[1], (unsigned)bin[2]);
+    /* One write and one notification, each in a single packet */
+    HOST_CHECK(bin[2] == 2);
+    HOST_CHECK(bin[0] < text[0]);
+}
+
+int
+main(int argc, char **argv)
+{
+    rng_state = argc > 1 ? strtoul(argv[1], NULL, 0) : 0x6c0dec5a;
+    HOST_CHECK(rng_state != 0);
+    printf("seed 0x%08x\n", (unsigned)rng_state);
+
+    for (int i = 0; i < TEST_ROUNDS; i++)
+    {
+        test_round_trip();
+    }
+    printf("round trip: %d replies\n", TEST_ROUNDS);
+    test_air_bytes();
+    printf("PASS\n");
+    return 0;
+}
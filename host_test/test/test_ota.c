@@ -0,0 +1,572 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * Firmware update, first the pipe alone and then the service on the lock.
+ *
+ * ota_pipe is driven by a client that sends random chunk sizes, loses
+ * chunks and goes back after a NACK or a reconnect, and by a writer that
+ * lags behind it at random and writes each buffer through lock_hal_ota_*()
+ * into the file-backed ota_0 partition.  What lands in the partition must
+ * be the image, byte for byte, for sizes on and around block boundaries.
+ *
+ * Then a central updates the running lock over the OTA service, with the
+ * flash timed like SPI flash: one chunk lost on purpose, the link dropped
+ * a third of the way in and the session resumed.  With chunks the size of
+ * a 247-byte MTU the rate must stay above 50 KB/s; the fake link takes no
+ * air time, so this is the rate the flash pipeline can sustain.  A wrong hash, an image
+ * that is not an app, and the authorization checks are refused.
+ *
+ * Usage: test_ota [seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mbedtls/sha256.h"
+#include "host_ble.h"
+#include "host_hal.h"
+#include "host_app.h"
+#include "lock_hal.h"
+#include "ota_pipe.h"
+#include "ota_svc.h"
+
+#define TEST_SPP_UUID           0xABF1
+#define TEST_CTRL_UUID          0xABF9
+#define TEST_DATA_UUID          0xABFA
+#define TEST_CAP                CONFIG_LOCK_OTA_BUF_SIZE
+/* A data write at the 247-byte MTU: offset plus payload */
+#define TEST_CHUNK              (247 - 3 - 4)
+#define TEST_IMAGE_MAX          (300 * 1024)
+#define TEST_MIN_KBPS           50
+#define TEST_IMAGE_MAGIC        0xE9
+
+static uint8_t image[TEST_IMAGE_MAX];
+static uint8_t back[TEST_IMAGE_MAX];
+static uint8_t pipe_buf[OTA_PIPE_BUFS][TEST_CAP];
+static uint32_t rng_state;
+
+static uint32_t
+rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void
+gen_image(uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++)
+    {
+        image[i] = rng();
+    }
+    image[0] = TEST_IMAGE_MAGIC;
+}
+
+/* What the update wrote, read back from the partition's backing file */
+static void
+check_partition(uint32_t size)
+{
+    const char *dir = getenv("LOCK_HOST_FLASH_DIR");
+    char path[256];
+    FILE *f;
+
+    snprintf(path, sizeof path, "%s/ota_0.bin", dir != NULL ? dir : ".");
+    f = fopen(path, "rb");
+    HOST_CHECK(f != NULL);
+    HOST_CHECK(fread(back, 1, size, f) == size);
+    fclose(f);
+    HOST_CHECK(memcmp(back, image, size) == 0);
+}
+
+/*
+ * One image through the pipe.  The client keeps below the window end and
+ * loses one chunk in 50; the writer takes the oldest full buffer one step
+ * in three, and always once the client has to wait.
+ */
+static void
+pipe_run(uint32_t size, int *nacks, int *resumes)
+{
+    static ota_pipe_t p;
+    uint8_t queue[OTA_PIPE_BUFS];
+    int queued = 0;
+    uint32_t sent = 0;
+    long steps = 0;
+
+    gen_image(size);
+    ota_pipe_init(&p, pipe_buf[0], pipe_buf[1], TEST_CAP, size);
+    HOST_CHECK(lock_hal_ota_begin(size) == ESP_OK);
+    while (!ota_pipe_complete(&p))
+    {
+        uint32_t end = ota_pipe_window_end(&p);
+
+        HOST_CHECK(++steps < 10000000);
+        if (sent < end)
+        {
+            uint32_t n = 1 + rng() % TEST_CHUNK;
+            uint8_t ready;
+            ota_pipe_rx_t rx;
+            int idx;
+
+            n = n < end - sent ? n : end - sent;
+            if (rng() % 50 == 0)
+            {
+                /* Lost on the air */
+                sent += n;
+                continue;
+            }
+            rx = ota_pipe_rx(&p, sent, &image[sent], n, &ready);
+            if (rx == OTA_PIPE_GAP)
+            {
+                HOST_CHECK(ready == 0);
+                (*nacks)++;
+                sent = p.received;
+                continue;
+            }
+            HOST_CHECK(rx == OTA_PIPE_OK);
+            sent += n;
+            while ((idx = ota_pipe_next_ready(&p, &ready)) >= 0)
+            {
+                HOST_CHECK(queued < OTA_PIPE_BUFS);
+                queue[queued++] = idx;
+            }
+            if (rng() % 100 == 0)
+            {
+                /* Reconnected; BEGIN says where to go on from */
+                (*resumes)++;
+                sent = p.received;
+            }
+        }
+        else if (sent > p.received)
+        {
+            /* The tail was lost and no ACK came; resend */
+            sent = p.received;
+        }
+
+        if (queued > 0 && (rng() % 3 == 0 || sent >= end))
+        {
+            uint8_t idx = queue[0];
+
+            HOST_CHECK(lock_hal_ota_write(p.buf[idx], p.len[idx]) == ESP_OK);
+            ota_pipe_written(&p, idx);
+            memmove(queue, &queue[1], --queued);
+        }
+    }
+    HOST_CHECK(queued == 0 && p.received == size);
+    HOST_CHECK(lock_hal_ota_end() == ESP_OK);
+    check_partition(size);
+}
+
+static void
+test_pipe_images(void)
+{
+    static const uint32_t sizes[] = {
+        1, TEST_CHUNK, TEST_CAP - 1, TEST_CAP, TEST_CAP + 1,
+        2 * TEST_CAP, 2 * TEST_CAP + 7, 3 * TEST_CAP - 1, TEST_IMAGE_MAX,
+    };
+    int nacks = 0;
+    int resumes = 0;
+    int images = 0;
+
+    for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; i++, images++)
+    {
+        pipe_run(sizes[i], &nacks, &resumes);
+    }
+    for (int i = 0; i < 40; i++, images++)
+    {
+        pipe_run(1 + rng() % TEST_IMAGE_MAX, &nacks, &resumes);
+    }
+    printf("pipe: %d images, %d gaps, %d resumes\n", images, nacks, resumes);
+    HOST_CHECK(nacks > 0 && resumes > 0);
+}
+
+/* Refusals, and the chunk that ends the image across a block boundary */
+static void
+test_pipe_edges(void)
+{
+    static ota_pipe_t p;
+    uint8_t data[TEST_CAP];
+    uint8_t ready;
+
+    memset(data, 0x5a, sizeof data);
+    ota_pipe_init(&p, pipe_buf[0], pipe_buf[1], TEST_CAP, 2 * TEST_CAP + 100);
+    HOST_CHECK(ota_pipe_window_end(&p) == 2 * TEST_CAP);
+    HOST_CHECK(ota_pipe_rx(&p, 10, data, 10, &ready) == OTA_PIPE_GAP && ready == 0);
+    HOST_CHECK(ota_pipe_rx(&p, 0, data, TEST_CAP + 1, &ready) == OTA_PIPE_OVERRUN);
+    HOST_CHECK(ota_pipe_rx(&p, 0, data, TEST_CAP - 50, &ready) == OTA_PIPE_OK && ready == 0);
+    HOST_CHECK(ota_pipe_rx(&p, 0, data, 10, &ready) == OTA_PIPE_STALE);
+    /* Fills buffer 0 and starts buffer 1 */
+    HOST_CHECK(ota_pipe_rx(&p, TEST_CAP - 50, data, 100, &ready) == OTA_PIPE_OK);
+    HOST_CHECK(ready == 1 && ota_pipe_next_ready(&p, &ready) == 0 && ready == 0);
+    HOST_CHECK(ota_pipe_rx(&p, TEST_CAP + 50, data, TEST_CAP - 50, &ready) == OTA_PIPE_OK);
+    HOST_CHECK(ready == 2);
+    /* Both buffers busy: nothing more until the writer catches up */
+    HOST_CHECK(ota_pipe_rx(&p, 2 * TEST_CAP, data, 1, &ready) == OTA_PIPE_OVERRUN);
+    ota_pipe_written(&p, 0);
+    HOST_CHECK(ota_pipe_window_end(&p) == 2 * TEST_CAP + 100);
+    ota_pipe_written(&p, 1);
+    HOST_CHECK(ota_pipe_rx(&p, 2 * TEST_CAP, data, 100, &ready) == OTA_PIPE_OK);
+    HOST_CHECK(ready == 1 && ota_pipe_complete(&p) == false);
+    ota_pipe_written(&p, 0);
+    HOST_CHECK(ota_pipe_complete(&p));
+
+    /* The last chunk fills buffer 0 and ends the image in buffer 1 */
+    ota_pipe_init(&p, pipe_buf[0], pipe_buf[1], TEST_CAP, TEST_CAP + 20);
+    HOST_CHECK(ota_pipe_rx(&p, 0, data, TEST_CAP - 20, &ready) == OTA_PIPE_OK && ready == 0);
+    HOST_CHECK(ota_pipe_rx(&p, TEST_CAP - 20, data, 40, &ready) == OTA_PIPE_OK);
+    HOST_CHECK(ready == 3);
+    HOST_CHECK(ota_pipe_next_ready(&p, &ready) == 0);
+    HOST_CHECK(ota_pipe_next_ready(&p, &ready) == 1);
+    HOST_CHECK(ota_pipe_next_ready(&p, &ready) == -1);
+    ota_pipe_written(&p, 0);
+    ota_pipe_written(&p, 1);
+    HOST_CHECK(ota_pipe_complete(&p));
+    printf("pipe edges: ok\n");
+}
+
+/*
+ * The service on the running lock
+ */
+static uint16_t spp;
+static uint16_t ctrl;
+static uint16_t data_chr;
+
+typedef struct
+{
+    uint8_t evt;
+    uint8_t status;
+    uint32_t a;
+    uint32_t b;
+} test_evt_t;
+
+/* Pairs, and waits for the link to be encrypted */
+static void
+pair(uint16_t conn)
+{
+    uint8_t st[13];
+    uint16_t len;
+    int rc = BLE_ATT_ERR_INSUFFICIENT_ENC;
+
+    HOST_CHECK(host_ble_pair(conn, false) == 0);
+    for (int i = 0; i < 200 && rc == BLE_ATT_ERR_INSUFFICIENT_ENC; i++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(5));
+        rc = host_ble_read(conn, ctrl, st, sizeof st, &len);
+    }
+    HOST_CHECK(rc == 0);
+}
+
+/* A link that may update: encrypted, with a code that opens every door */
+static uint16_t
+ota_connect(uint32_t n)
+{
+    ble_addr_t peer;
+    uint16_t conn;
+    uint8_t buf[64];
+
+    host_app_peer(n, &peer);
+    HOST_CHECK(host_ble_connect(&peer, 2000, &conn) == 0);
+    HOST_CHECK(host_ble_exchange_mtu(conn, 247) == 0);
+    HOST_CHECK(host_ble_subscribe(conn, spp, true) == 0);
+    HOST_CHECK(host_ble_notify_wait(conn, spp, buf, sizeof buf, 2000, NULL) > 0);
+    pair(conn);
+    HOST_CHECK(host_ble_write(conn, spp, CONFIG_LOCK_DEFAULT_PIN,
+                              strlen(CONFIG_LOCK_DEFAULT_PIN)) == 0);
+    HOST_CHECK(host_ble_notify_wait(conn, spp, buf, sizeof buf, 2000, NULL) > 0);
+    HOST_CHECK(host_ble_subscribe(conn, ctrl, true) == 0);
+    return conn;
+}
+
+static bool
+wait_evt(uint16_t conn, uint32_t timeout_ms, test_evt_t *e)
+{
+    uint8_t buf[16];
+    int len = host_ble_notify_wait(conn, ctrl, buf, sizeof buf, timeout_ms, NULL);
+
+    if (len < 2)
+    {
+        return false;
+    }
+    memset(e, 0, sizeof *e);
+    e->evt = buf[0];
+    e->status = buf[1];
+    if (len >= 6)
+    {
+        e->a = get_le32(&buf[2]);
+    }
+    if (len >= 10)
+    {
+        e->b = get_le32(&buf[6]);
+    }
+    return true;
+}
+
+static void
+ota_begin(uint16_t conn, uint32_t size, const uint8_t *sha, test_evt_t *e)
+{
+    uint8_t req[1 + 4 + 32];
+
+    req[0] = OTA_OP_BEGIN;
+    put_le32(&req[1], size);
+    memcpy(&req[5], sha, 32);
+    HOST_CHECK(host_ble_write(conn, ctrl, req, sizeof req) == 0);
+    HOST_CHECK(wait_evt(conn, 2000, e) && e->evt == OTA_EVT_BEGIN);
+}
+
+static int
+send_chunk(uint16_t conn, uint32_t off, uint32_t n)
+{
+    uint8_t buf[4 + TEST_CHUNK];
+
+    put_le32(buf, off);
+    memcpy(&buf[4], &image[off], n);
+    return host_ble_write(conn, data_chr, buf, 4 + n);
+}
+
+/*
+ * Streams the image from *sent until the last ACK, or until stop_at
+ * bytes are in flight past it, whichever comes first.
+ *
+ * @return the final event: DONE at the end, else the last one seen.
+ */
+static test_evt_t
+stream(uint16_t conn, uint32_t size, uint32_t *sent, uint32_t *window, uint32_t stop_at,
+       uint32_t drop_at, int *nacks)
+{
+    test_evt_t e = { 0 };
+
+    for (;;)
+    {
+        while (*sent < *window && *sent < stop_at)
+        {
+            uint32_t n = *window - *sent < TEST_CHUNK ? *window - *sent : TEST_CHUNK;
+
+            if (*sent >= drop_at)
+            {
+                /* Lost; the next chunk is out of order */
+                drop_at = UINT32_MAX;
+            }
+            else
+            {
+                HOST_CHECK(send_chunk(conn, *sent, n) == 0);
+            }
+            *sent += n;
+        }
+        if (*sent >= stop_at && stop_at < size)
+        {
+            return e;
+        }
+        HOST_CHECK(wait_evt(conn, 5000, &e));
+        if (e.evt == OTA_EVT_NACK)
+        {
+            HOST_CHECK(e.status == OTA_STATUS_GAP);
+            (*nacks)++;
+            *sent = e.a;
+        }
+        else if (e.evt == OTA_EVT_ACK)
+        {
+            HOST_CHECK(e.status == OTA_STATUS_OK);
+            *window = e.b;
+        }
+        else
+        {
+            return e;
+        }
+    }
+}
+
+static void
+sha256(uint32_t size, uint8_t *sha)
+{
+    HOST_CHECK(mbedtls_sha256(image, size, sha, 0) == 0);
+}
+
+static void
+test_update(void)
+{
+    uint32_t size = TEST_IMAGE_MAX - 1234;
+    uint8_t sha[32];
+    uint8_t st[13];
+    uint16_t len;
+    uint16_t conn;
+    uint32_t sent = 0;
+    uint32_t window;
+    uint32_t restarts;
+    int nacks = 0;
+    int64_t t0;
+    int64_t us;
+    test_evt_t e;
+
+    gen_image(size);
+    sha256(size, sha);
+    host_flash_timing(true);
+
+    conn = ota_connect(1);
+    t0 = esp_timer_get_time();
+    ota_begin(conn, size, sha, &e);
+    HOST_CHECK(e.status == OTA_STATUS_OK && e.a == 0 && e.b == 2 * TEST_CAP);
+    window = e.b;
+
+    /* Lose a chunk in the second block, drop the link a third in */
+    e = stream(conn, size, &sent, &window, size / 3, 5 * TEST_CHUNK + TEST_CAP, &nacks);
+    HOST_CHECK(nacks == 1);
+    HOST_CHECK(host_ble_disconnect(conn, BLE_ERR_REM_USER_CONN_TERM) == 0);
+
+    /* Back on a new link, from another central */
+    conn = ota_connect(2);
+    ota_begin(conn, size, sha, &e);
+    HOST_CHECK(e.status == OTA_STATUS_OK);
+    printf("update: resumed at %u of %u\n", (unsigned)e.a, (unsigned)size);
+    HOST_CHECK(e.a > 0 && e.a <= sent && e.b > e.a);
+    sent = e.a;
+    window = e.b;
+    e = stream(conn, size, &sent, &window, size, UINT32_MAX, &nacks);
+    us = esp_timer_get_time() - t0;
+    HOST_CHECK(e.evt == OTA_EVT_DONE && e.status == OTA_STATUS_OK);
+    printf("update: %u bytes, %d NACK, %lld ms, %lld KB/s with flash timing\n",
+           (unsigned)size, nacks, (long long)us / 1000, (long long)size * 1000 / us);
+    HOST_CHECK((long long)size * 1000 / us >= TEST_MIN_KBPS);
+    host_flash_timing(false);
+
+    HOST_CHECK(host_ble_read(conn, ctrl, st, sizeof st, &len) == 0 && len == sizeof st);
+    HOST_CHECK(st[0] == OTA_STATE_DONE && get_le32(&st[1]) == size);
+    HOST_CHECK(get_le32(&st[5]) == size && get_le32(&st[9]) == size);
+    check_partition(size);
+
+    /* APPLY restarts once the response is out */
+    restarts = host_hal_restarts();
+    st[0] = OTA_OP_APPLY;
+    HOST_CHECK(host_ble_write(conn, ctrl, st, 1) == 0);
+    for (int i = 0; i < 200 && host_hal_restarts() == restarts; i++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    HOST_CHECK(host_hal_restarts() == restarts + 1);
+    HOST_CHECK(host_ble_disconnect(conn, BLE_ERR_REM_USER_CONN_TERM) == 0);
+}
+
+/* Images the lock must not select for boot, and who may not ask */
+static void
+test_refused(void)
+{
+    uint32_t size = 3 * TEST_CAP + 17;
+    uint8_t sha[32];
+    uint8_t op;
+    uint32_t sent = 0;
+    uint32_t window;
+    int nacks = 0;
+    uint16_t conn;
+    uint16_t other;
+    ble_addr_t peer;
+    test_evt_t e;
+
+    conn = ota_connect(3);
+
+    /* The process outlived the restart; a detached session is anyone's
+     * to end */
+    op = OTA_OP_ABORT;
+    HOST_CHECK(host_ble_write(conn, ctrl, &op, 1) == 0);
+
+    /* Nothing to apply, and no session to take data */
+    op = OTA_OP_APPLY;
+    HOST_CHECK(host_ble_write(conn, ctrl, &op, 1) == 0);
+    HOST_CHECK(wait_evt(conn, 2000, &e) && e.evt == OTA_EVT_DONE &&
+               e.status == OTA_STATUS_STATE);
+    HOST_CHECK(send_chunk(conn, 0, 16) == BLE_ATT_ERR_INSUFFICIENT_AUTHOR);
+    memset(sha, 0, sizeof sha);
+    ota_begin(conn, 0, sha, &e);
+    HOST_CHECK(e.status == OTA_STATUS_SIZE);
+    ota_begin(conn, 2u << 20, sha, &e);
+    HOST_CHECK(e.status == OTA_STATUS_SIZE);
+
+    /* A hash that does not match */
+    gen_image(size);
+    sha256(size, sha);
+    sha[7] ^= 1;
+    ota_begin(conn, size, sha, &e);
+    HOST_CHECK(e.status == OTA_STATUS_OK);
+    window = e.b;
+    e = stream(conn, size, &sent, &window, size, UINT32_MAX, &nacks);
+    HOST_CHECK(e.evt == OTA_EVT_DONE && e.status == OTA_STATUS_HASH);
+    HOST_CHECK(host_ble_write(conn, ctrl, &op, 1) == 0);
+    HOST_CHECK(wait_evt(conn, 2000, &e) && e.status == OTA_STATUS_STATE);
+
+    /* The right hash of something that is not an app image */
+    image[0] = 0;
+    sha256(size, sha);
+    sent = 0;
+    ota_begin(conn, size, sha, &e);
+    window = e.b;
+    e = stream(conn, size, &sent, &window, size, UINT32_MAX, &nacks);
+    HOST_CHECK(e.evt == OTA_EVT_DONE && e.status == OTA_STATUS_IMAGE);
+
+    /* Unencrypted, and encrypted without a code */
+    host_app_peer(4, &peer);
+    HOST_CHECK(host_ble_connect(&peer, 2000, &other) == 0);
+    HOST_CHECK(host_ble_write(other, ctrl, &op, 1) == BLE_ATT_ERR_INSUFFICIENT_ENC);
+    HOST_CHECK(send_chunk(other, 0, 16) == BLE_ATT_ERR_INSUFFICIENT_ENC);
+    pair(other);
+    HOST_CHECK(host_ble_write(other, ctrl, &op, 1) == BLE_ATT_ERR_INSUFFICIENT_AUTHOR);
+
+    /* A session another link owns */
+    image[0] = TEST_IMAGE_MAGIC;
+    sha256(size, sha);
+    ota_begin(conn, size, sha, &e);
+    HOST_CHECK(e.status == OTA_STATUS_OK);
+    HOST_CHECK(host_ble_disconnect(other, BLE_ERR_REM_USER_CONN_TERM) == 0);
+    other = ota_connect(5);
+    ota_begin(other, size, sha, &e);
+    HOST_CHECK(e.status == OTA_STATUS_BUSY);
+    op = OTA_OP_ABORT;
+    HOST_CHECK(host_ble_write(other, ctrl, &op, 1) == BLE_ATT_ERR_INSUFFICIENT_AUTHOR);
+    HOST_CHECK(host_ble_write(conn, ctrl, &op, 1) == 0);
+    ota_begin(other, size, sha, &e);
+    HOST_CHECK(e.status == OTA_STATUS_OK && e.a == 0);
+
+    HOST_CHECK(host_ble_disconnect(other, BLE_ERR_REM_USER_CONN_TERM) == 0);
+    HOST_CHECK(host_ble_disconnect(conn, BLE_ERR_REM_USER_CONN_TERM) == 0);
+    printf("refused: ok\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    int nacks = 0;
+    int resumes = 0;
+    int64_t t0;
+    int64_t us;
+
+    rng_state = argc > 1 ? strtoul(argv[1], NULL, 0) : 0x0a7a0a7a;
+    HOST_CHECK(rng_state != 0);
+    printf("seed 0x%08x\n", (unsigned)rng_state);
+
+    test_pipe_edges();
+    test_pipe_images();
+    /* The copy into the staging buffers alone */
+    t0 = esp_timer_get_time();
+    for (int i = 0; i < 20; i++)
+    {
+        pipe_run(TEST_IMAGE_MAX, &nacks, &resumes);
+    }
+    us = esp_timer_get_time() - t0;
+    printf("pipe: %.1f MB/s through the file-backed partition\n",
+           20.0 * TEST_IMAGE_MAX / us);
+
+    host_app_start();
+    spp = host_ble_val_handle(TEST_SPP_UUID);
+    ctrl = host_ble_val_handle(TEST_CTRL_UUID);
+    data_chr = host_ble_val_handle(TEST_DATA_UUID);
+    HOST_CHECK(spp != 0 && ctrl != 0 && data_chr != 0);
+
+    test_update();
+    test_refused();
+    printf("PASS\n");
+    return 0;
+}
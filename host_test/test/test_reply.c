@@ -0,0 +1,148 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * Single replies when the host is out of mbufs.  The test takes every
+ * small msys buffer for itself while a phone connects, so the banner is
+ * refused; once the buffers come back the banner must still arrive, ahead
+ * of the answer to the PIN written next.  A second phone is kept starved
+ * past the last retry, and its banner must be given up and counted, after
+ * which the connection answers as usual.
+ *
+ * Usage: test_reply
+ */
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "os/os_mbuf.h"
+#include "host_ble.h"
+#include "host_app.h"
+#include "mem_acct.h"
+#include "reply.h"
+
+#define TEST_SPP_UUID           0xABF1
+#define TEST_HOLD_MAX           64
+#define TEST_WAIT_MS            5000
+#define TEST_QUIET_MS           300
+/* Longer than the welcome delay and every retry's backoff together */
+#define TEST_STARVE_MS          (CONFIG_LOCK_WELCOME_DELAY_MS + 1500)
+#define TEST_GRANTED            "口令正确"
+#define TEST_WRONG              "不对"
+
+static struct os_mbuf *held[TEST_HOLD_MAX];
+static int nheld;
+static uint16_t spp;
+
+/* Takes every buffer a notify would come from */
+static void
+starve(void)
+{
+    while (nheld < TEST_HOLD_MAX && (held[nheld] = os_msys_get_pkthdr(0, 0)) != NULL)
+    {
+        nheld++;
+    }
+    HOST_CHECK(nheld < TEST_HOLD_MAX);
+}
+
+static void
+feed(int keep)
+{
+    while (nheld > keep)
+    {
+        os_mbuf_free_chain(held[--nheld]);
+    }
+}
+
+static void
+expect_reply(uint16_t conn, const char *what)
+{
+    char buf[512];
+    int len = host_ble_notify_wait(conn, spp, buf, sizeof buf - 1, TEST_WAIT_MS, NULL);
+
+    HOST_CHECK(len > 0);
+    buf[len] = '\0';
+    HOST_CHECK(strstr(buf, what) != NULL);
+}
+
+static uint16_t
+connect_starved(uint32_t n)
+{
+    ble_addr_t peer;
+    uint16_t conn;
+
+    host_app_peer(n, &peer);
+    starve();
+    HOST_CHECK(host_ble_connect(&peer, TEST_WAIT_MS, &conn) == 0);
+    HOST_CHECK(host_ble_exchange_mtu(conn, 247) == 0);
+    HOST_CHECK(host_ble_subscribe(conn, spp, true) == 0);
+    return conn;
+}
+
+/* The banner waits out the shortage, and the PIN's answer queues behind it */
+static void
+test_retry(void)
+{
+    mem_acct_stats_t before;
+    mem_acct_stats_t after;
+    uint16_t conn;
+    char buf[64];
+
+    mem_acct_get_stats(&before);
+    conn = connect_starved(1);
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_LOCK_WELCOME_DELAY_MS + 50));
+    HOST_CHECK(host_ble_notify_wait(conn, spp, buf, sizeof buf, TEST_QUIET_MS, NULL) <= 0);
+
+    /* Room for the write only; its answer cannot go ahead of the banner */
+    feed(1);
+    HOST_CHECK(host_ble_write(conn, spp, "nope", 4) == 0);
+    feed(0);
+    expect_reply(conn, ">");
+    expect_reply(conn, TEST_WRONG);
+    mem_acct_get_stats(&after);
+    HOST_CHECK(after.cnt[MEM_CNT_MSYS_FAIL] > before.cnt[MEM_CNT_MSYS_FAIL]);
+    HOST_CHECK(after.cnt[MEM_CNT_REPLY_LOST] == before.cnt[MEM_CNT_REPLY_LOST]);
+    HOST_CHECK(host_ble_disconnect(conn, BLE_ERR_REM_USER_CONN_TERM) == 0);
+    printf("retry: banner and answer delivered in order\n");
+}
+
+/* Starved past the last retry, the banner is dropped and counted */
+static void
+test_lost(void)
+{
+    mem_acct_stats_t before;
+    mem_acct_stats_t after;
+    uint16_t conn;
+    char buf[64];
+
+    mem_acct_get_stats(&before);
+    conn = connect_starved(2);
+    vTaskDelay(pdMS_TO_TICKS(TEST_STARVE_MS));
+    feed(0);
+    HOST_CHECK(host_ble_notify_wait(conn, spp, buf, sizeof buf, TEST_QUIET_MS, NULL) <= 0);
+    mem_acct_get_stats(&after);
+    HOST_CHECK(after.cnt[MEM_CNT_REPLY_LOST] == before.cnt[MEM_CNT_REPLY_LOST] + 1);
+
+    /* Nothing left queued, so the next answer goes straight out */
+    HOST_CHECK(host_ble_write(conn, spp, CONFIG_LOCK_DEFAULT_PIN,
+                              strlen(CONFIG_LOCK_DEFAULT_PIN)) == 0);
+    expect_reply(conn, TEST_GRANTED);
+    HOST_CHECK(host_ble_disconnect(conn, BLE_ERR_REM_USER_CONN_TERM) == 0);
+    printf("lost: banner given up after %d retries\n", REPLY_MAX_RETRIES);
+}
+
+int
+main(void)
+{
+    host_app_start();
+    spp = host_ble_val_handle(TEST_SPP_UUID);
+    HOST_CHECK(spp != 0);
+
+    test_retry();
+    test_lost();
+    printf("PASS\n");
+    return 0;
+}
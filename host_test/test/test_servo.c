@@ -0,0 +1,176 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * The compile-time angle -> duty table and profile points against the
+ * same formulas in floating point, for the pulse range and profile this
+ * program was built with.  Then moves on the host LEDC, one long and one
+ * too short for every segment to change the duty: each must end on its
+ * target and take the time it was given.
+ */
+#include <stdio.h>
+#include <math.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host_hal.h"
+#include "host_app.h"
+
+/* The table is static */
+#include "servo.c"
+
+#define TEST_DOOR               0
+/* Wake-up delay allowed per segment on a loaded host */
+#define TEST_SEG_SLACK_MS       10
+
+static volatile bool fade_ended;
+
+static bool
+fade_end(void *arg)
+{
+    fade_ended = true;
+    return false;
+}
+
+static const char *
+profile_name(void)
+{
+#if CONFIG_LOCK_SERVO_PROFILE_LINEAR
+    return "linear";
+#elif CONFIG_LOCK_SERVO_PROFILE_TRAPEZOID
+    return "trapezoid";
+#else
+    return "S-curve";
+#endif
+}
+
+static double
+profile_exact(double t)
+{
+#if CONFIG_LOCK_SERVO_PROFILE_LINEAR
+    return t;
+#elif CONFIG_LOCK_SERVO_PROFILE_TRAPEZOID
+    return t <= 0.25 ? 8.0 / 3 * t * t :
+           t <= 0.75 ? 4.0 / 3 * t - 1.0 / 6 : 1 - 8.0 / 3 * (1 - t) * (1 - t);
+#else
+    return t * t * t * (10 - 15 * t + 6 * t * t);
+#endif
+}
+
+static void
+test_duty_table(void)
+{
+    double ticks_per_us = (double)(1u << LOCK_HAL_SERVO_RES_BITS) / SERVO_PERIOD_US;
+
+    for (int deg = 0; deg <= CONFIG_LOCK_SERVO_RANGE_DEG; deg++)
+    {
+        double pulse = CONFIG_LOCK_SERVO_MIN_PULSE_US + (double)deg *
+                       (CONFIG_LOCK_SERVO_MAX_PULSE_US - CONFIG_LOCK_SERVO_MIN_PULSE_US) /
+                       CONFIG_LOCK_SERVO_RANGE_DEG;
+        double exact = pulse * ticks_per_us;
+        uint32_t duty = servo_angle_to_duty(deg);
+
+        /* Rounded to nearest, and more degrees is never less duty */
+        HOST_CHECK(fabs(duty - exact) <= 0.5);
+        HOST_CHECK(duty == SERVO_DUTY(deg));
+        HOST_CHECK(deg == 0 || duty > servo_angle_to_duty(deg - 1));
+        HOST_CHECK(duty <= SERVO_DUTY_MAX);
+    }
+    /* Out-of-range angles hold the end stops */
+    HOST_CHECK(servo_angle_to_duty(-1) == servo_angle_to_duty(0));
+    HOST_CHECK(servo_angle_to_duty(-1000) == servo_angle_to_duty(0));
+    for (int deg = CONFIG_LOCK_SERVO_RANGE_DEG; deg <= SERVO_LUT_DEG + 10; deg++)
+    {
+        HOST_CHECK(servo_angle_to_duty(deg) == SERVO_DUTY(CONFIG_LOCK_SERVO_RANGE_DEG));
+    }
+    printf("duty table: %u..%u ticks over %d degrees, %.1f ticks a degree\n",
+           (unsigned)servo_angle_to_duty(0),
+           (unsigned)servo_angle_to_duty(CONFIG_LOCK_SERVO_RANGE_DEG),
+           CONFIG_LOCK_SERVO_RANGE_DEG,
+           (double)(servo_angle_to_duty(CONFIG_LOCK_SERVO_RANGE_DEG) - servo_angle_to_duty(0)) /
+           CONFIG_LOCK_SERVO_RANGE_DEG);
+}
+
+static void
+test_profile(void)
+{
+    printf("%s profile:", profile_name());
+    for (int k = 0; k <= SERVO_SEGMENTS; k++)
+    {
+        double exact = 1000 * profile_exact((double)k / SERVO_SEGMENTS);
+
+        printf(" %u", servo_profile_point(k));
+        HOST_CHECK(fabs(servo_profile_point(k) - exact) <= 0.5);
+        HOST_CHECK(k == 0 || servo_profile_point(k) >= servo_profile_point(k - 1));
+    }
+    printf("\n");
+    HOST_CHECK(servo_profile_point(0) == 0 && servo_profile_point(SERVO_SEGMENTS) == 1000);
+}
+
+/* Runs a move to its end the way the actuator does; returns its length */
+static int64_t
+run_move(servo_t *s, int deg, uint32_t ms, uint32_t *fades)
+{
+    uint32_t before = host_ledc_fades(TEST_DOOR);
+    int64_t t0 = esp_timer_get_time();
+    bool done;
+
+    fade_ended = false;
+    done = servo_move(s, deg, ms);
+    while (!done)
+    {
+        while (!fade_ended)
+        {
+            vTaskDelay(pdMS_TO_TICKS(1));
+        }
+        fade_ended = false;
+        HOST_CHECK(host_ledc_duty(TEST_DOOR) == s->duty);
+        done = servo_fade_done(s);
+    }
+    *fades = host_ledc_fades(TEST_DOOR) - before;
+    HOST_CHECK(host_ledc_duty(TEST_DOOR) == servo_angle_to_duty(deg));
+    return esp_timer_get_time() - t0;
+}
+
+static void
+test_moves(void)
+{
+    uint32_t ms = CONFIG_LOCK_SERVO_TRAVEL_MS;
+    uint32_t want = ms / SERVO_SEGMENTS * SERVO_SEGMENTS;
+    uint32_t limit = want + SERVO_SEGMENTS * TEST_SEG_SLACK_MS;
+    uint32_t fades;
+    int64_t us;
+    servo_t s;
+
+    lock_hal_servo_init(TEST_DOOR, fade_end, NULL);
+    servo_park(&s, TEST_DOOR, CONFIG_LOCK_SERVO_LOCKED_DEG);
+    HOST_CHECK(host_ledc_duty(TEST_DOOR) == servo_angle_to_duty(CONFIG_LOCK_SERVO_LOCKED_DEG));
+
+    us = run_move(&s, CONFIG_LOCK_SERVO_OPEN_DEG, ms, &fades);
+    printf("open: %u fades in %lld ms\n", (unsigned)fades, (long long)us / 1000);
+    HOST_CHECK(fades == SERVO_SEGMENTS);
+    HOST_CHECK(us >= want * 1000LL && us < limit * 1000LL);
+
+    /* One degree: the first segments round to no change and their time
+     * must carry over */
+    us = run_move(&s, CONFIG_LOCK_SERVO_OPEN_DEG + 1, ms, &fades);
+    printf("one degree: %u fades in %lld ms\n", (unsigned)fades, (long long)us / 1000);
+    HOST_CHECK(fades >= 1 && fades <= SERVO_SEGMENTS);
+    HOST_CHECK(us >= want * 1000LL && us < limit * 1000LL);
+
+    /* Nothing to do */
+    HOST_CHECK(servo_move(&s, CONFIG_LOCK_SERVO_OPEN_DEG + 1, ms));
+}
+
+int
+main(void)
+{
+    test_duty_table();
+    test_profile();
+    test_moves();
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,228 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * Heap use of the running lock over many sessions.  Each round a new phone
+ * connects, unlocks with the PIN, receives a burst of bridged UART data,
+ * then a binary unlock, and leaves.  After a few rounds to warm up, the
+ * rounds that follow must make no heap call at all: the program is linked
+ * with malloc, calloc, realloc and free wrapped.  The msys pools must be
+ * back to full after every round, and mem_acct must count no failed
+ * allocation and no notify refused for lack of buffers.
+ *
+ * Usage: test_soak [rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <execinfo.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "os/os_mbuf.h"
+#include "host_ble.h"
+#include "host_hal.h"
+#include "host_app.h"
+#include "lock_proto.h"
+#include "mem_acct.h"
+
+#define TEST_SPP_UUID           0xABF1
+#define TEST_WARMUP             5
+#define TEST_ROUNDS             100
+#define TEST_BRIDGE_BYTES       2048
+#define TEST_PEER               1000
+#define TEST_GRANTED            "口令正确"
+#define TEST_POOLS              8
+/* Generous, so a loaded machine running the suite in parallel keeps up */
+#define TEST_WAIT_MS            10000
+/* Longest the host may take to return a closed session's buffers */
+#define TEST_SETTLE_MS          1000
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+void __real_free(void *p);
+
+static uint32_t heap_calls;
+static volatile bool heap_trace;
+static uint16_t spp;
+
+/* Counts a call; the first few after the warm-up say where they came from */
+static void
+heap_count(void)
+{
+    void *bt[8];
+
+    if (__atomic_fetch_add(&heap_calls, 1, __ATOMIC_RELAXED) < 4 && heap_trace)
+    {
+        fprintf(stderr, "heap call:\n");
+        backtrace_symbols_fd(bt, backtrace(bt, 8), 2);
+    }
+}
+
+void *
+__wrap_malloc(size_t size)
+{
+    heap_count();
+    return __real_malloc(size);
+}
+
+void *
+__wrap_calloc(size_t n, size_t size)
+{
+    heap_count();
+    return __real_calloc(n, size);
+}
+
+void *
+__wrap_realloc(void *p, size_t size)
+{
+    heap_count();
+    return __real_realloc(p, size);
+}
+
+void
+__wrap_free(void *p)
+{
+    if (p != NULL)
+    {
+        heap_count();
+    }
+    __real_free(p);
+}
+
+static void
+wait_reply(uint16_t conn, char *buf, size_t max)
+{
+    int len = host_ble_notify_wait(conn, spp, buf, max - 1, TEST_WAIT_MS, NULL);
+
+    HOST_CHECK(len > 0);
+    buf[len] = '\0';
+}
+
+/*
+ * The host frees a closed session's buffers on its own task, after the
+ * disconnect has been reported, so the pools are given a moment to fill.
+ */
+static bool
+pools_settled(void)
+{
+    int64_t deadline = esp_timer_get_time() + TEST_SETTLE_MS * 1000LL;
+
+    while (os_msys_num_free() != os_msys_count())
+    {
+        if (esp_timer_get_time() > deadline)
+        {
+            return false;
+        }
+        vTaskDelay(1);
+    }
+    return true;
+}
+
+static void
+round_trip(uint32_t n)
+{
+    static uint8_t sent[TEST_BRIDGE_BYTES];
+    static uint8_t got[TEST_BRIDGE_BYTES];
+    uint8_t frame[LOCK_PROTO_REPLY_MAX];
+    lock_writer_t w;
+    ble_addr_t peer;
+    uint16_t conn;
+    char buf[512];
+    size_t have = 0;
+    int len;
+
+    host_app_peer(TEST_PEER + n, &peer);
+    HOST_CHECK(host_ble_connect(&peer, TEST_WAIT_MS, &conn) == 0);
+    HOST_CHECK(host_ble_exchange_mtu(conn, 247) == 0);
+    HOST_CHECK(host_ble_subscribe(conn, spp, true) == 0);
+    wait_reply(conn, buf, sizeof buf);
+    HOST_CHECK(strchr(buf, '>') != NULL);
+    HOST_CHECK(host_ble_write(conn, spp, CONFIG_LOCK_DEFAULT_PIN,
+                              strlen(CONFIG_LOCK_DEFAULT_PIN)) == 0);
+    wait_reply(conn, buf, sizeof buf);
+    HOST_CHECK(strstr(buf, TEST_GRANTED) != NULL);
+
+    /* Bridged lines, never the console's prefix */
+    for (size_t i = 0; i < sizeof sent; i++)
+    {
+        sent[i] = i % 64 == 63 ? '\n' : 'a' + (n + i) % 26;
+    }
+    HOST_CHECK(host_uart_inject(sent, sizeof sent));
+    while (have < sizeof sent)
+    {
+        len = host_ble_notify_wait(conn, spp, &got[have], sizeof got - have,
+                                   TEST_WAIT_MS, NULL);
+        HOST_CHECK(len > 0);
+        have += len;
+    }
+    HOST_CHECK(memcmp(got, sent, sizeof sent) == 0);
+
+    /* The same unlock as an app sends it */
+    lock_proto_begin(&w, frame, sizeof frame, LOCK_OP_UNLOCK, n & 0xff, LOCK_RES_OK);
+    lock_proto_put(&w, LOCK_TLV_CODE, CONFIG_LOCK_DEFAULT_PIN, strlen(CONFIG_LOCK_DEFAULT_PIN));
+    len = lock_proto_end(&w);
+    HOST_CHECK(len > 0);
+    HOST_CHECK(host_ble_write(conn, spp, frame, len) == 0);
+    len = host_ble_notify_wait(conn, spp, buf, sizeof buf, TEST_WAIT_MS, NULL);
+    HOST_CHECK(len > 0);
+
+    HOST_CHECK(host_ble_disconnect(conn, BLE_ERR_REM_USER_CONN_TERM) == 0);
+}
+
+int
+main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : TEST_ROUNDS;
+    mem_acct_stats_t before;
+    mem_acct_stats_t after;
+    mem_pool_info_t pools[TEST_POOLS];
+    uint32_t calls;
+    int64_t t0;
+    int n;
+
+    HOST_CHECK(rounds > 0);
+    host_app_start();
+    spp = host_ble_val_handle(TEST_SPP_UUID);
+    HOST_CHECK(spp != 0);
+
+    for (int i = 0; i < TEST_WARMUP; i++)
+    {
+        round_trip(i);
+    }
+    mem_acct_get_stats(&before);
+    /* Booting creates tasks and queues, so the wrapping is live */
+    HOST_CHECK(__atomic_load_n(&heap_calls, __ATOMIC_RELAXED) > 0);
+    heap_trace = true;
+    __atomic_store_n(&heap_calls, 0, __ATOMIC_RELAXED);
+    t0 = esp_timer_get_time();
+    for (int i = 0; i < rounds; i++)
+    {
+        round_trip(TEST_WARMUP + i);
+        HOST_CHECK(pools_settled());
+    }
+    calls = __atomic_load_n(&heap_calls, __ATOMIC_RELAXED);
+    mem_acct_get_stats(&after);
+
+    printf("%d rounds in %lld ms: %d unlocks, %d KB bridged, %u heap calls\n", rounds,
+           (long long)(esp_timer_get_time() - t0) / 1000, 2 * rounds,
+           rounds * TEST_BRIDGE_BYTES / 1024, (unsigned)calls);
+    n = mem_acct_pools(pools, TEST_POOLS);
+    for (int i = 0; i < n; i++)
+    {
+        printf("pool %-15s %3u x %4uB, peak %3u used\n", pools[i].name, pools[i].blocks,
+               pools[i].block_size, pools[i].blocks - pools[i].min_free);
+        HOST_CHECK(pools[i].min_free > 0);
+    }
+    HOST_CHECK(calls == 0);
+    for (int c = 0; c < MEM_CNT_COUNT; c++)
+    {
+        HOST_CHECK(after.cnt[c] == before.cnt[c]);
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * RFC 6238 Appendix B, SHA-1 column, against totp.c.  The source is
+ * included so the code generator can be checked at every vector time,
+ * including those before the lock accepts the clock as set; the vectors
+ * that are after it then go through totp_verify() with the skew window
+ * and the replay guard.  Built with 8 digits, as the RFC lists them, and
+ * with the default 6, which are their last six.
+ */
+#include "totp.c"
+#include "host_app.h"
+
+#define TEST_USER               3
+
+static const uint8_t test_secret[] = "12345678901234567890";
+
+static const struct
+{
+    int64_t t;
+    uint32_t code;              /* 8 digits */
+} test_vectors[] = {
+    { 59, 94287082 },
+    { 1111111109, 7081804 },
+    { 1111111111, 14050471 },
+    { 1234567890, 89005924 },
+    { 2000000000, 69279037 },
+    { 20000000000, 65353130 },
+};
+
+static uint32_t
+expect_code(uint32_t code8)
+{
+    return TOTP_DIGITS == 8 ? code8 : code8 % 1000000;
+}
+
+static esp_err_t
+verify_step(int64_t step)
+{
+    char code[TOTP_DIGITS + 1];
+    uint8_t user = 0xFF;
+    esp_err_t ret;
+
+    snprintf(code, sizeof code, "%0*u", TOTP_DIGITS,
+             (unsigned)totp_code(test_secret, 20, step));
+    ret = totp_verify(code, TOTP_DIGITS, &user);
+    HOST_CHECK(ret != ESP_OK || user == TEST_USER);
+    return ret;
+}
+
+/* Codes at and around T through totp_verify() */
+static void
+check_window(int64_t t)
+{
+    int64_t step = t / TOTP_STEP_S;
+
+    lock_hal_set_wall_time(t);
+    totp_clock_changed();
+
+    /* Outside the window either side */
+    HOST_CHECK(verify_step(step - TOTP_WINDOW - 1) == ESP_ERR_NOT_FOUND);
+    HOST_CHECK(verify_step(step + TOTP_WINDOW + 1) == ESP_ERR_NOT_FOUND);
+    /* Oldest first: each accepted code retires it and every earlier one */
+    HOST_CHECK(verify_step(step - TOTP_WINDOW) == ESP_OK);
+    HOST_CHECK(verify_step(step - TOTP_WINDOW) == ESP_ERR_NOT_FOUND);
+    HOST_CHECK(verify_step(step) == ESP_OK);
+    HOST_CHECK(verify_step(step) == ESP_ERR_NOT_FOUND);
+    HOST_CHECK(verify_step(step - TOTP_WINDOW) == ESP_ERR_NOT_FOUND);
+    HOST_CHECK(verify_step(step + TOTP_WINDOW) == ESP_OK);
+    HOST_CHECK(verify_step(step + TOTP_WINDOW) == ESP_ERR_NOT_FOUND);
+}
+
+int
+main(void)
+{
+    const int64_t t = 2000000000;
+    const int64_t step = t / TOTP_STEP_S;
+
+    for (size_t i = 0; i < sizeof test_vectors / sizeof test_vectors[0]; i++)
+    {
+        uint32_t code = totp_code(test_secret, 20, test_vectors[i].t / TOTP_STEP_S);
+
+        printf("T=%lld %0*u\n", (long long)test_vectors[i].t, TOTP_DIGITS, (unsigned)code);
+        HOST_CHECK(code == expect_code(test_vectors[i].code));
+    }
+
+    HOST_CHECK(totp_init() == ESP_OK);
+    HOST_CHECK(totp_set_secret(TEST_USER, test_secret, 20) == ESP_OK);
+    /* The vectors after the clock counts as set; the later one last, as
+     * the replay guard then refuses every earlier step */
+    HOST_CHECK(t >= TOTP_CLOCK_VALID);
+    check_window(t);
+
+    /* A clock set back to before it was ever set accepts no code */
+    lock_hal_set_wall_time(t + 10 * TOTP_STEP_S);
+    totp_clock_changed();
+    lock_hal_set_wall_time(59);
+    totp_clock_changed();
+    HOST_CHECK(verify_step(step + 10) == ESP_ERR_NOT_FOUND);
+    HOST_CHECK(verify_step(59 / TOTP_STEP_S) == ESP_ERR_NOT_FOUND);
+    lock_hal_set_wall_time(t + 10 * TOTP_STEP_S);
+    totp_clock_changed();
+    HOST_CHECK(verify_step(step + 10) == ESP_OK);
+
+    /* A removed user's codes stop at once */
+    HOST_CHECK(totp_remove(TEST_USER) == ESP_OK);
+    HOST_CHECK(verify_step(step + 10 + TOTP_WINDOW) == ESP_ERR_NOT_FOUND);
+    HOST_CHECK(totp_set_secret(TEST_USER, test_secret, 20) == ESP_OK);
+    HOST_CHECK(verify_step(step + 10 + TOTP_WINDOW) == ESP_OK);
+
+    check_window(20000000000);
+    printf("PASS\n");
+    return 0;
+}
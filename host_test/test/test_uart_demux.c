@@ -0,0 +1,270 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * The bridge's console demultiplexer against a model of the stream.
+ * Bridged and console lines, with LF and CRLF endings, are read back in
+ * every cut at one and two points and in random cuts; the bytes left to
+ * bridge and the bytes handed to the console must be exactly the model's.
+ * Then the throughput of bridged-only and mixed data in reads the size of
+ * a UART burst.  Builds its own copy of uart_bridge.c, with the console
+ * replaced by a recorder.
+ *
+ * Usage: test_uart_demux [seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "host_app.h"
+#include "../../main/uart_bridge.c"
+
+#define TEST_STREAM_MAX         (1u << 20)
+#define TEST_THROUGHPUT_BYTES   (256u << 20)
+#define TEST_READ               256
+
+static uint8_t *stream;
+static size_t stream_len;
+static uint8_t *expect_bridge;
+static size_t expect_bridge_len;
+static uint8_t *expect_console;
+static size_t expect_console_len;
+static uint32_t expect_lines;
+
+static uint8_t *work;
+static uint8_t *got_bridge;
+static size_t got_bridge_len;
+static uint8_t *got_console;
+static size_t got_console_len;
+static uint32_t got_lines;
+static bool got_record = true;
+
+static uint32_t rng_state;
+
+static uint32_t
+rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/* The console as the bridge sees it */
+void
+admin_console_feed(const uint8_t *data, int len)
+{
+    if (got_record)
+    {
+        memcpy(&got_console[got_console_len], data, len);
+    }
+    got_console_len += len;
+    if (len > 0 && (data[len - 1] == '\n' || data[len - 1] == '\r'))
+    {
+        got_lines++;
+    }
+}
+
+static void
+put(uint8_t *buf, size_t *len, const void *data, size_t n)
+{
+    memcpy(&buf[*len], data, n);
+    *len += n;
+}
+
+/*
+ * Appends one line to the stream and to the model.  A console line reaches
+ * the console without the '\n' of its CRLF; a bridged line is passed on
+ * byte for byte.
+ */
+static void
+gen_line(bool console, bool crlf, size_t len)
+{
+    uint8_t line[200];
+
+    for (size_t i = 0; i < len; i++)
+    {
+        /* Printable, so never a line end; '!' can appear past the start */
+        line[i] = ' ' + rng() % 95;
+    }
+    line[0] = console ? ADMIN_CONSOLE_PREFIX : 'a' + rng() % 26;
+    if (crlf)
+    {
+        line[len++] = '\r';
+    }
+    line[len++] = '\n';
+
+    put(stream, &stream_len, line, len);
+    if (console)
+    {
+        put(expect_console, &expect_console_len, line, crlf ? len - 1 : len);
+        expect_lines++;
+    }
+    else
+    {
+        put(expect_bridge, &expect_bridge_len, line, len);
+    }
+}
+
+static void
+gen_stream(size_t max, int console_pct)
+{
+    stream_len = 0;
+    expect_bridge_len = 0;
+    expect_console_len = 0;
+    expect_lines = 0;
+    while (stream_len + 256 < max)
+    {
+        gen_line(rng() % 100 < (uint32_t)console_pct, rng() % 2, 1 + rng() % 150);
+    }
+}
+
+static void
+demux_reset(void)
+{
+    bridge_line_start = true;
+    bridge_in_console = false;
+    bridge_skip_lf = false;
+    got_bridge_len = 0;
+    got_console_len = 0;
+    got_lines = 0;
+}
+
+/* One read from the UART: copied into the ring, then sorted there */
+static void
+demux_read(const uint8_t *data, size_t n)
+{
+    int keep;
+
+    memcpy(work, data, n);
+    keep = bridge_demux(work, n);
+    HOST_CHECK(keep >= 0 && (size_t)keep <= n);
+    memcpy(&got_bridge[got_bridge_len], work, keep);
+    got_bridge_len += keep;
+}
+
+static bool
+demux_matches(void)
+{
+    return got_bridge_len == expect_bridge_len &&
+           memcmp(got_bridge, expect_bridge, got_bridge_len) == 0 &&
+           got_console_len == expect_console_len &&
+           memcmp(got_console, expect_console, got_console_len) == 0 &&
+           got_lines == expect_lines;
+}
+
+/* A short stream cut at every one and every two points */
+static void
+test_every_cut(void)
+{
+    int runs = 0;
+
+    gen_stream(0, 0);
+    gen_line(false, false, 5);
+    gen_line(true, true, 6);
+    gen_line(false, true, 3);
+    gen_line(true, false, 1);
+    gen_line(true, true, 9);
+    gen_line(false, false, 7);
+    gen_line(true, false, 4);
+    gen_line(false, true, 2);
+
+    for (size_t a = 0; a <= stream_len; a++)
+    {
+        for (size_t b = a; b <= stream_len; b++)
+        {
+            demux_reset();
+            demux_read(stream, a);
+            demux_read(&stream[a], b - a);
+            demux_read(&stream[b], stream_len - b);
+            if (!demux_matches())
+            {
+                fprintf(stderr, "cut at %zu and %zu: %zu bridged, %zu console\n",
+                        a, b, got_bridge_len, got_console_len);
+            }
+            HOST_CHECK(demux_matches());
+            runs++;
+        }
+    }
+    printf("every cut: %zu bytes, %d chunkings\n", stream_len, runs);
+}
+
+/* A long stream, a third console, in random reads of 1 .. 600 bytes */
+static void
+test_random_cuts(void)
+{
+    size_t off = 0;
+
+    gen_stream(TEST_STREAM_MAX, 33);
+    demux_reset();
+    while (off < stream_len)
+    {
+        size_t n = 1 + rng() % 600;
+
+        n = n < stream_len - off ? n : stream_len - off;
+        demux_read(&stream[off], n);
+        off += n;
+    }
+    printf("random cuts: %zu bytes, %u console lines, %zu bytes bridged\n",
+           stream_len, (unsigned)got_lines, got_bridge_len);
+    HOST_CHECK(demux_matches());
+}
+
+/* Bytes sorted per second, reads of TEST_READ bytes straight into the ring */
+static double
+throughput(int console_pct)
+{
+    size_t fed = 0;
+    int64_t t0;
+    int64_t us;
+
+    gen_stream(TEST_STREAM_MAX, console_pct);
+    demux_reset();
+    /* Only counted from here on */
+    got_record = false;
+    t0 = esp_timer_get_time();
+    while (fed < TEST_THROUGHPUT_BYTES)
+    {
+        for (size_t off = 0; off < stream_len; off += TEST_READ)
+        {
+            size_t n = stream_len - off < TEST_READ ? stream_len - off : TEST_READ;
+
+            memcpy(work, &stream[off], n);
+            got_bridge_len += bridge_demux(work, n);
+        }
+        fed += stream_len;
+    }
+    us = esp_timer_get_time() - t0;
+    got_record = true;
+    printf("throughput, %d%% console: %zu MB in %lld ms, %.0f MB/s\n", console_pct,
+           fed >> 20, (long long)us / 1000, (double)fed / us);
+    return (double)fed / us;
+}
+
+int
+main(int argc, char **argv)
+{
+    rng_state = argc > 1 ? strtoul(argv[1], NULL, 0) : 0x6b1e22d5;
+    HOST_CHECK(rng_state != 0);
+    printf("seed 0x%08x\n", (unsigned)rng_state);
+
+    stream = malloc(TEST_STREAM_MAX);
+    expect_bridge = malloc(TEST_STREAM_MAX);
+    expect_console = malloc(TEST_STREAM_MAX);
+    got_bridge = malloc(TEST_STREAM_MAX);
+    got_console = malloc(TEST_STREAM_MAX);
+    work = malloc(TEST_READ > 600 ? TEST_READ : 600);
+    HOST_CHECK(stream != NULL && expect_bridge != NULL && expect_console != NULL &&
+               got_bridge != NULL && got_console != NULL && work != NULL);
+
+    test_every_cut();
+    test_random_cuts();
+    /* Bridged data is scanned in place; far above any UART rate either way */
+    HOST_CHECK(throughput(0) > 50);
+    HOST_CHECK(throughput(10) > 50);
+    printf("PASS\n");
+    return 0;
+}
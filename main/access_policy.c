@@ -0,0 +1,138 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <string.h>
+#include "access_policy.h"
+
+#define ACCESS_DAY_S                86400
+/* 1970-01-01 was a Thursday; weekdays count from Monday */
+#define ACCESS_EPOCH_WEEKDAY        3
+
+static const char *const access_verdict_names[] = {
+    "allow", "allow once", "outside hours", "outside dates", "spent", "no clock",
+};
+
+static void
+access_set_hours(uint8_t *map, int from, int to)
+{
+    for (int bit = from; bit < to; bit++)
+    {
+        map[bit >> 3] |= 1u << (bit & 7);
+    }
+}
+
+esp_err_t
+access_policy_compile(const access_rule_t *rule, access_policy_t *out)
+{
+    memset(out, 0, sizeof *out);
+    if (rule->nwindows > ACCESS_MAX_WINDOWS || rule->from_day > rule->until_day)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (rule->nwindows == 0)
+    {
+        memset(out->hours, 0xFF, sizeof out->hours);
+    }
+
+    for (int i = 0; i < rule->nwindows; i++)
+    {
+        const access_window_t *w = &rule->windows[i];
+
+        if (w->days == 0 || (w->days & ~ACCESS_DAILY) != 0 ||
+            w->start_hour > 23 || w->end_hour == 0 || w->end_hour > 24)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+        for (int d = 0; d < 7; d++)
+        {
+            if (!(w->days & (1u << d)))
+            {
+                continue;
+            }
+            if (w->end_hour > w->start_hour)
+            {
+                access_set_hours(out->hours, d * 24 + w->start_hour, d * 24 + w->end_hour);
+            }
+            else
+            {
+                /* Runs into the next day; Sunday night into Monday morning */
+                access_set_hours(out->hours, d * 24 + w->start_hour, d * 24 + 24);
+                access_set_hours(out->hours, (d + 1) % 7 * 24, (d + 1) % 7 * 24 + w->end_hour);
+            }
+        }
+    }
+
+    out->from_day = rule->from_day;
+    out->until_day = rule->until_day;
+    out->flags = rule->once ? ACCESS_F_ONCE : 0;
+    return ESP_OK;
+}
+
+access_verdict_t
+access_policy_decide(const access_policy_t *p, int64_t local_s)
+{
+    uint32_t day;
+    uint32_t bit;
+
+    if (local_s < 0)
+    {
+        return ACCESS_DENY_DATES;
+    }
+    day = local_s / ACCESS_DAY_S;
+    if (day < p->from_day || (p->until_day != ACCESS_DAY_NONE && day > p->until_day))
+    {
+        return ACCESS_DENY_DATES;
+    }
+    bit = (day + ACCESS_EPOCH_WEEKDAY) % 7 * 24 + local_s % ACCESS_DAY_S / 3600;
+    if (!(p->hours[bit >> 3] & (1u << (bit & 7))))
+    {
+        return ACCESS_DENY_HOURS;
+    }
+    return (p->flags & ACCESS_F_ONCE) ? ACCESS_ALLOW_ONCE : ACCESS_ALLOW;
+}
+
+/* Days from civil, proleptic Gregorian (H. Hinnant's algorithm) */
+int32_t
+access_policy_day(int year, int month, int mday)
+{
+    static const uint8_t mdays[] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    int32_t era, yoe, doy, doe, days;
+
+    if (year < 1970 || month < 1 || month > 12 || mday < 1 || mday > mdays[month - 1] ||
+        (month == 2 && mday == 29 && (year % 4 != 0 || (year % 100 == 0 && year % 400 != 0))))
+    {
+        return -1;
+    }
+    year -= month <= 2;
+    era = year / 400;
+    yoe = year - era * 400;
+    doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + mday - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    days = era * 146097 + doe - 719468;
+    return days < ACCESS_DAY_NONE ? days : -1;
+}
+
+void
+access_policy_date(uint16_t day, int *year, int *month, int *mday)
+{
+    int32_t z = day + 719468;
+    int32_t era = z / 146097;
+    int32_t doe = z - era * 146097;
+    int32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int32_t mp = (5 * doy + 2) / 153;
+
+    *mday = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = yoe + era * 400 + (*month <= 2);
+}
+
+const char *
+access_verdict_str(access_verdict_t v)
+{
+    return v < sizeof access_verdict_names / sizeof access_verdict_names[0] ?
+           access_verdict_names[v] : "?";
+}
@@ -0,0 +1,141 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef ACCESS_POLICY_H
+#define ACCESS_POLICY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Per-user access schedules for PIN users.
+ *
+ * A rule is a few weekly windows (a set of weekdays and an hour range),
+ * optional first and last valid dates, and a one-time flag for guest
+ * codes.  Rules are compiled when stored: the windows become a 168-bit map
+ * with one bit per hour of the week and the dates become two day numbers,
+ * so a decision is a date compare and one bit test however many windows
+ * the rule had.  Times are local, CONFIG_LOCK_TZ_OFFSET_MIN from UTC, with
+ * no daylight saving.
+ *
+ * Users without a policy open at any time, and user 0 (the admin PIN) can
+ * never be given one, so a bad schedule cannot lock everybody out.  A
+ * restricted user is refused while the wall clock has not been set.  TOTP
+ * users are not covered.
+ *
+ * access_policy_compile() and access_policy_decide() are pure so they can
+ * be driven from a host test; the per-user table and its NVS copy live in
+ * access_policy_store.c.
+ */
+#define ACCESS_WEEK_HOURS           (7 * 24)
+#define ACCESS_MAX_WINDOWS          8
+#define ACCESS_DAY_NONE             0xFFFF  /* until_day: no last day */
+
+/* access_window_t.days, bit n for weekday n */
+#define ACCESS_MON                  0x01
+#define ACCESS_SUN                  0x40
+#define ACCESS_DAILY                0x7F
+
+#define ACCESS_F_ONCE               0x01    /* Revoke the PIN after one unlock */
+#define ACCESS_F_SPENT              0x80    /* RAM only: a one-time PIN was used */
+
+typedef struct
+{
+    uint8_t days;               /* Weekday mask, Monday = bit 0 */
+    uint8_t start_hour;         /* 0-23 */
+    uint8_t end_hour;           /* 1-24, exclusive; <= start runs past midnight */
+} access_window_t;
+
+/* A rule as an operator writes it */
+typedef struct
+{
+    access_window_t windows[ACCESS_MAX_WINDOWS];
+    uint8_t nwindows;           /* 0 for any hour */
+    uint16_t from_day;          /* First valid day, local days since 1970-01-01 */
+    uint16_t until_day;         /* Last valid day, or ACCESS_DAY_NONE */
+    bool once;
+} access_rule_t;
+
+/* The compiled form, as kept in RAM and NVS */
+typedef struct
+{
+    uint8_t hours[ACCESS_WEEK_HOURS / 8];   /* Bit day * 24 + hour */
+    uint8_t flags;
+    uint16_t from_day;
+    uint16_t until_day;
+} access_policy_t;
+
+typedef enum
+{
+    ACCESS_ALLOW = 0,
+    ACCESS_ALLOW_ONCE,          /* Allowed; the PIN is now spent */
+    ACCESS_DENY_HOURS,          /* Outside the weekly windows */
+    ACCESS_DENY_DATES,          /* Before the first or after the last day */
+    ACCESS_DENY_SPENT,          /* One-time PIN already used */
+    ACCESS_DENY_CLOCK,          /* Wall clock not set */
+} access_verdict_t;
+
+#define ACCESS_DENIED(v)            ((v) >= ACCESS_DENY_HOURS)
+
+/**
+ * Compiles a rule.
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG for an empty day mask, an hour out
+ *         of range, too many windows or a last day before the first.
+ */
+esp_err_t access_policy_compile(const access_rule_t *rule, access_policy_t *out);
+
+/* Decides at local_s, seconds since 1970-01-01 local time.  Ignores SPENT. */
+access_verdict_t access_policy_decide(const access_policy_t *p, int64_t local_s);
+
+/* Local day number of a calendar date, for from_day/until_day; -1 if invalid */
+int32_t access_policy_day(int year, int month, int mday);
+
+/* Inverse of access_policy_day() */
+void access_policy_date(uint16_t day, int *year, int *month, int *mday);
+
+const char *access_verdict_str(access_verdict_t v);
+
+/* Loads the table from NVS. */
+esp_err_t access_policy_init(void);
+
+/**
+ * Gives a live PIN user a policy, or removes it if the rule allows any
+ * time on any day with no once flag.
+ *
+ * @return ESP_OK; ESP_ERR_INVALID_ARG for a bad rule or user 0;
+ *         ESP_ERR_NOT_FOUND if the user has no live PIN; ESP_ERR_NO_MEM if
+ *         CONFIG_LOCK_ACCESS_MAX users already have one; an NVS error.
+ */
+esp_err_t access_policy_set(uint16_t user, const access_rule_t *rule);
+
+/* Drops a user's policy.  Call whenever a PIN is revoked or added, as
+ * user ids are reused. */
+esp_err_t access_policy_clear(uint16_t user);
+
+/* Copies a user's compiled policy.  Returns false if unrestricted. */
+bool access_policy_get(uint16_t user, access_policy_t *out);
+
+/**
+ * The unlock-time check: a table lookup, a date compare and a bit test.
+ * On ACCESS_ALLOW_ONCE the PIN is marked spent at once and revoked, with
+ * its policy, from the deferred-work task.
+ */
+access_verdict_t access_policy_check(uint16_t user);
+
+/* Users with a policy */
+int access_policy_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
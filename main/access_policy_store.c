@@ -0,0 +1,282 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "cred_store.h"
+#include "defer.h"
+#include "access_policy.h"
+
+/*
+ * Compiled policies sit in a small table; a byte per possible user maps
+ * the user id to its slot plus one, 0 for none, so the unlock path finds
+ * a policy without searching.  Changes are serialised by a mutex and
+ * written to NVS as one blob of the slots in use; the check on the host
+ * task only takes the spinlock.
+ */
+#define ACCESS_NVS_NS           "access"
+#define ACCESS_NVS_KEY          "table"
+#define ACCESS_MAX              CONFIG_LOCK_ACCESS_MAX
+#define ACCESS_USERS            CONFIG_LOCK_CRED_MAX_USERS
+#define ACCESS_TZ_S             (CONFIG_LOCK_TZ_OFFSET_MIN * 60)
+
+_Static_assert(ACCESS_MAX < 0xFF, "slot numbers must fit the index");
+
+typedef struct
+{
+    uint16_t user;              /* CRED_USER_NONE if the slot is free */
+    access_policy_t policy;
+} access_rec_t;
+
+static access_rec_t access_table[ACCESS_MAX];
+static uint8_t access_index[ACCESS_USERS];
+static int access_used;
+/* NVS image; only touched with the mutex held */
+static access_rec_t access_blob[ACCESS_MAX];
+static SemaphoreHandle_t access_mutex;
+static portMUX_TYPE access_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Writes the slots in use.  Mutex held. */
+static esp_err_t
+access_save(void)
+{
+    int n = 0;
+
+    portENTER_CRITICAL(&access_lock);
+    for (int i = 0; i < ACCESS_MAX; i++)
+    {
+        if (access_table[i].user != CRED_USER_NONE)
+        {
+            access_blob[n] = access_table[i];
+            access_blob[n++].policy.flags &= ~ACCESS_F_SPENT;
+        }
+    }
+    portEXIT_CRITICAL(&access_lock);
+
+    if (n == 0)
+    {
+        esp_err_t ret = lock_hal_nvs_erase(ACCESS_NVS_NS, ACCESS_NVS_KEY);
+
+        return ret == ESP_ERR_NVS_NOT_FOUND ? ESP_OK : ret;
+    }
+    return lock_hal_nvs_set(ACCESS_NVS_NS, ACCESS_NVS_KEY, access_blob, n * sizeof access_blob[0]);
+}
+
+/* Puts a policy in slot, or frees the slot if policy is NULL.  Mutex held. */
+static void
+access_store_slot(int slot, uint16_t user, const access_policy_t *policy)
+{
+    portENTER_CRITICAL(&access_lock);
+    if (policy != NULL)
+    {
+        access_used += access_table[slot].user == CRED_USER_NONE;
+        access_table[slot].user = user;
+        access_table[slot].policy = *policy;
+        access_index[user] = slot + 1;
+    }
+    else if (access_table[slot].user != CRED_USER_NONE)
+    {
+        access_used--;
+        access_index[access_table[slot].user] = 0;
+        access_table[slot].user = CRED_USER_NONE;
+    }
+    portEXIT_CRITICAL(&access_lock);
+}
+
+esp_err_t
+access_policy_init(void)
+{
+    size_t len = sizeof access_blob;
+    esp_err_t ret;
+
+    access_mutex = xSemaphoreCreateMutex();
+    if (access_mutex == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < ACCESS_MAX; i++)
+    {
+        access_table[i].user = CRED_USER_NONE;
+    }
+
+    ret = lock_hal_nvs_get(ACCESS_NVS_NS, ACCESS_NVS_KEY, access_blob, &len);
+    if (ret != ESP_OK)
+    {
+        if (ret != ESP_ERR_NVS_NOT_FOUND)
+        {
+            MODLOG_DFLT(ERROR, "access policies not loaded: %s\n", esp_err_to_name(ret));
+        }
+        len = 0;
+    }
+    for (size_t i = 0; i < len / sizeof access_blob[0]; i++)
+    {
+        uint16_t user = access_blob[i].user;
+
+        if (user != 0 && user < ACCESS_USERS && access_index[user] == 0)
+        {
+            access_store_slot(access_used, user, &access_blob[i].policy);
+        }
+    }
+    MODLOG_DFLT(INFO, "access: %d user policies, UTC%+d min\n", access_used,
+                CONFIG_LOCK_TZ_OFFSET_MIN);
+    return ESP_OK;
+}
+
+esp_err_t
+access_policy_set(uint16_t user, const access_rule_t *rule)
+{
+    access_rec_t old;
+    access_policy_t policy;
+    esp_err_t ret;
+    int slot;
+
+    if (user == 0 || user >= ACCESS_USERS || access_policy_compile(rule, &policy) != ESP_OK)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (rule->nwindows == 0 && rule->from_day == 0 && rule->until_day == ACCESS_DAY_NONE &&
+        !rule->once)
+    {
+        return access_policy_clear(user);
+    }
+    if (!cred_store_live(user))
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    xSemaphoreTake(access_mutex, portMAX_DELAY);
+    slot = access_index[user] - 1;
+    if (slot < 0)
+    {
+        for (slot = 0; slot < ACCESS_MAX && access_table[slot].user != CRED_USER_NONE; slot++)
+        {
+        }
+        if (slot == ACCESS_MAX)
+        {
+            xSemaphoreGive(access_mutex);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    old = access_table[slot];
+    access_store_slot(slot, user, &policy);
+    ret = access_save();
+    if (ret != ESP_OK)
+    {
+        /* Keep RAM in step with what survives a reboot */
+        access_store_slot(slot, old.user, old.user != CRED_USER_NONE ? &old.policy : NULL);
+    }
+    xSemaphoreGive(access_mutex);
+
+    MODLOG_DFLT(INFO, "access: user=%d policy %s\n", user, ret == ESP_OK ? "set" : "not saved");
+    return ret;
+}
+
+esp_err_t
+access_policy_clear(uint16_t user)
+{
+    esp_err_t ret = ESP_OK;
+    int slot;
+
+    if (user >= ACCESS_USERS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(access_mutex, portMAX_DELAY);
+    slot = access_index[user] - 1;
+    if (slot >= 0)
+    {
+        access_store_slot(slot, user, NULL);
+        ret = access_save();
+    }
+    xSemaphoreGive(access_mutex);
+    return ret;
+}
+
+bool
+access_policy_get(uint16_t user, access_policy_t *out)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&access_lock);
+    if (user < ACCESS_USERS && access_index[user] != 0)
+    {
+        *out = access_table[access_index[user] - 1].policy;
+        found = true;
+    }
+    portEXIT_CRITICAL(&access_lock);
+    return found;
+}
+
+/* Deferred from the check so the flash writes stay off the unlock path */
+static void
+access_spend_job(uint16_t conn_handle, void *arg)
+{
+    uint16_t user = (uintptr_t)arg;
+    esp_err_t ret = cred_store_revoke(user);
+
+    if (ret == ESP_OK || ret == ESP_ERR_NOT_FOUND)
+    {
+        ret = access_policy_clear(user);
+    }
+    MODLOG_DFLT(INFO, "access: one-time user=%d revoked; %s\n", user, esp_err_to_name(ret));
+}
+
+access_verdict_t
+access_policy_check(uint16_t user)
+{
+    access_verdict_t v = ACCESS_ALLOW;
+    access_policy_t *p;
+    int64_t now;
+
+    if (user >= ACCESS_USERS || access_index[user] == 0)
+    {
+        return ACCESS_ALLOW;
+    }
+    now = lock_hal_wall_time();
+
+    portENTER_CRITICAL(&access_lock);
+    if (access_index[user] != 0)
+    {
+        p = &access_table[access_index[user] - 1].policy;
+        if (now < LOCK_HAL_CLOCK_VALID)
+        {
+            v = ACCESS_DENY_CLOCK;
+        }
+        else if (p->flags & ACCESS_F_SPENT)
+        {
+            v = ACCESS_DENY_SPENT;
+        }
+        else
+        {
+            v = access_policy_decide(p, now + ACCESS_TZ_S);
+            if (v == ACCESS_ALLOW_ONCE)
+            {
+                /* Refused from here on, even before the revoke lands */
+                p->flags |= ACCESS_F_SPENT;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&access_lock);
+
+    if (v == ACCESS_ALLOW_ONCE &&
+        defer_submit(DEFER_CONN_NONE, 0, access_spend_job, (void *)(uintptr_t)user) != ESP_OK)
+    {
+        /* Stays spent until a reboot */
+        MODLOG_DFLT(ERROR, "access: revoke of one-time user=%d not queued\n", user);
+    }
+    return v;
+}
+
+int
+access_policy_count(void)
+{
+    return access_used;
+}
@@ -0,0 +1,383 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "lock_diag.h"
+#include "lock_pm.h"
+#include "servo.h"
+#include "mem_acct.h"
+#include "actuator.h"
+
+#define ACTUATOR_QUEUE_LEN      8
+#define ACTUATOR_MAX_CBS        4
+#define ACTUATOR_TASK_STACK     3072
+#define ACTUATOR_TASK_PRIO      6
+
+/* Items posted to a door's actuator task: a user command, a hold timer
+ * expiry or the end of a servo fade segment */
+typedef enum
+{
+    ACTUATOR_EVT_CMD = 0,
+    ACTUATOR_EVT_TIMER,
+    ACTUATOR_EVT_FADE,
+} actuator_evt_type_t;
+
+typedef struct
+{
+    actuator_evt_type_t type;
+    actuator_cmd_t cmd;
+} actuator_evt_t;
+
+/* One independent state machine per door; only its own task touches it */
+typedef struct
+{
+    uint8_t door;
+    QueueHandle_t queue;
+    esp_timer_handle_t timer;
+    volatile actuator_state_t state;
+    servo_t servo;
+    /* Set by the fade ISR; the queued event only wakes the task, so a fade
+     * end is not lost when commands have filled the queue */
+    volatile bool fade_end;
+    bool powered;               /* Servo powered and the PM lock held */
+} actuator_t;
+
+static actuator_t actuators[ACTUATOR_DOORS];
+
+static struct
+{
+    actuator_state_cb_t cb;
+    void *arg;
+} actuator_cbs[ACTUATOR_MAX_CBS];
+
+static void
+actuator_timer_cb(void *arg)
+{
+    actuator_t *act = arg;
+    actuator_evt_t evt = {
+        .type = ACTUATOR_EVT_TIMER,
+    };
+
+    /* Runs on the esp_timer task; never block it */
+    xQueueSend(act->queue, &evt, 0);
+}
+
+static bool
+actuator_fade_isr(void *arg)
+{
+    actuator_t *act = arg;
+    actuator_evt_t evt = {
+        .type = ACTUATOR_EVT_FADE,
+    };
+    BaseType_t woken = pdFALSE;
+
+    /* The fade API is not ISR-safe; the next segment starts on the task */
+    act->fade_end = true;
+    xQueueSendFromISR(act->queue, &evt, &woken);
+    return woken == pdTRUE;
+}
+
+static void
+actuator_arm(actuator_t *act, uint32_t ms)
+{
+    esp_timer_stop(act->timer);
+    ESP_ERROR_CHECK(esp_timer_start_once(act->timer, (uint64_t)ms * 1000));
+}
+
+/* The servo is powered and the clocks held from the start of a move until
+ * it has settled back at the locked position */
+static void
+actuator_power_up(actuator_t *act)
+{
+    if (!act->powered)
+    {
+        act->powered = true;
+        lock_pm_acquire(LOCK_PM_ACTUATOR);
+        servo_power(&act->servo, true);
+    }
+}
+
+static void
+actuator_power_down(actuator_t *act)
+{
+    if (act->powered)
+    {
+        servo_power(&act->servo, false);
+        lock_pm_release(LOCK_PM_ACTUATOR);
+        act->powered = false;
+    }
+}
+
+static void
+actuator_enter(actuator_t *act, actuator_state_t state)
+{
+    act->state = state;
+    MODLOG_DFLT(INFO, "Door %d %s\n", act->door, actuator_state_str(state));
+
+    for (int i = 0; i < ACTUATOR_MAX_CBS; i++)
+    {
+        if (actuator_cbs[i].cb != NULL)
+        {
+            actuator_cbs[i].cb(act->door, state, actuator_cbs[i].arg);
+        }
+    }
+}
+
+/* The servo has reached the end of its move */
+static void
+actuator_travel_done(actuator_t *act)
+{
+    switch (act->state)
+    {
+    case ACTUATOR_STATE_OPENING:
+        DIAG_CALL(lock_diag_servo_stop(act->door));
+        actuator_arm(act, CONFIG_LOCK_HOLD_MS);
+        actuator_enter(act, ACTUATOR_STATE_HOLDING);
+        break;
+
+    case ACTUATOR_STATE_CLOSING:
+        DIAG_CALL(lock_diag_servo_stop(act->door));
+#if CONFIG_LOCK_PM
+        /* The fade ends before the horn does; power off once it is there */
+        actuator_arm(act, CONFIG_LOCK_PM_SERVO_SETTLE_MS);
+#endif
+        actuator_enter(act, ACTUATOR_STATE_IDLE);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void
+actuator_start_move(actuator_t *act, int deg, actuator_state_t state)
+{
+    bool there;
+
+    /* The hold timer only runs while HOLDING */
+    esp_timer_stop(act->timer);
+    actuator_power_up(act);
+    DIAG_CALL(lock_diag_servo_start(act->door));
+    there = servo_move(&act->servo, deg, CONFIG_LOCK_SERVO_TRAVEL_MS);
+    actuator_enter(act, state);
+    if (there)
+    {
+        actuator_travel_done(act);
+    }
+}
+
+static void
+actuator_start_open(actuator_t *act)
+{
+    actuator_start_move(act, CONFIG_LOCK_SERVO_OPEN_DEG, ACTUATOR_STATE_OPENING);
+}
+
+static void
+actuator_start_close(actuator_t *act)
+{
+    actuator_start_move(act, CONFIG_LOCK_SERVO_LOCKED_DEG, ACTUATOR_STATE_CLOSING);
+}
+
+static void
+actuator_handle_cmd(actuator_t *act, actuator_cmd_t cmd)
+{
+    switch (act->state)
+    {
+    case ACTUATOR_STATE_IDLE:
+    case ACTUATOR_STATE_CLOSING:
+        if (cmd == ACTUATOR_CMD_UNLOCK)
+        {
+            DIAG_CALL(lock_diag_unlock_served(act->door));
+            actuator_start_open(act);
+        }
+        break;
+
+    case ACTUATOR_STATE_OPENING:
+        if (cmd == ACTUATOR_CMD_LOCK)
+        {
+            actuator_start_close(act);
+        }
+        break;
+
+    case ACTUATOR_STATE_HOLDING:
+        if (cmd == ACTUATOR_CMD_UNLOCK)
+        {
+            /* Another valid unlock while open; extend the hold time */
+            DIAG_CALL(lock_diag_unlock_served(act->door));
+            actuator_arm(act, CONFIG_LOCK_HOLD_MS);
+        }
+        else
+        {
+            actuator_start_close(act);
+        }
+        break;
+    }
+}
+
+static void
+actuator_handle_timer(actuator_t *act)
+{
+    switch (act->state)
+    {
+    case ACTUATOR_STATE_HOLDING:
+        actuator_start_close(act);
+        break;
+
+    case ACTUATOR_STATE_IDLE:
+        /* Settled at the locked position */
+        actuator_power_down(act);
+        break;
+
+    default:
+        /* Stale expiry that raced with a state change */
+        break;
+    }
+}
+
+static void
+actuator_task(void *param)
+{
+    actuator_t *act = param;
+    actuator_evt_t evt;
+
+    mem_acct_track_task(NULL, ACTUATOR_TASK_STACK);
+    for (;;)
+    {
+        if (xQueueReceive(act->queue, &evt, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+
+        switch (evt.type)
+        {
+        case ACTUATOR_EVT_CMD:
+            actuator_handle_cmd(act, evt.cmd);
+            break;
+
+        case ACTUATOR_EVT_TIMER:
+            actuator_handle_timer(act);
+            break;
+
+        case ACTUATOR_EVT_FADE:
+            break;
+        }
+
+        if (act->fade_end)
+        {
+            act->fade_end = false;
+            if (servo_fade_done(&act->servo))
+            {
+                actuator_travel_done(act);
+            }
+        }
+    }
+}
+
+esp_err_t
+actuator_init(void)
+{
+    for (int door = 0; door < ACTUATOR_DOORS; door++)
+    {
+        actuator_t *act = &actuators[door];
+        const esp_timer_create_args_t timer_args = {
+            .callback = actuator_timer_cb,
+            .arg = act,
+            .name = "actuator",
+        };
+        char name[configMAX_TASK_NAME_LEN];
+
+        act->door = door;
+        act->state = ACTUATOR_STATE_IDLE;
+        act->queue = xQueueCreate(ACTUATOR_QUEUE_LEN, sizeof(actuator_evt_t));
+        if (act->queue == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+
+        ESP_ERROR_CHECK(esp_timer_create(&timer_args, &act->timer));
+
+        lock_hal_servo_init(door, actuator_fade_isr, act);
+        servo_park(&act->servo, door, CONFIG_LOCK_SERVO_LOCKED_DEG);
+        act->powered = true;
+        lock_pm_acquire(LOCK_PM_ACTUATOR);
+#if CONFIG_LOCK_PM
+        actuator_arm(act, CONFIG_LOCK_PM_SERVO_SETTLE_MS);
+#endif
+
+        snprintf(name, sizeof name, "actTask%d", door);
+        if (xTaskCreate(actuator_task, name, ACTUATOR_TASK_STACK, act,
+                        ACTUATOR_TASK_PRIO, NULL) != pdPASS)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t
+actuator_register_cb(actuator_state_cb_t cb, void *arg)
+{
+    for (int i = 0; i < ACTUATOR_MAX_CBS; i++)
+    {
+        if (actuator_cbs[i].cb == NULL)
+        {
+            actuator_cbs[i].arg = arg;
+            actuator_cbs[i].cb = cb;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t
+actuator_request(uint8_t door, actuator_cmd_t cmd)
+{
+    actuator_evt_t evt = {
+        .type = ACTUATOR_EVT_CMD,
+        .cmd = cmd,
+    };
+
+    if (door >= ACTUATOR_DOORS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (xQueueSend(actuators[door].queue, &evt, 0) != pdTRUE)
+    {
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+actuator_state_t
+actuator_get_state(uint8_t door)
+{
+    return door < ACTUATOR_DOORS ? actuators[door].state : ACTUATOR_STATE_IDLE;
+}
+
+const char *
+actuator_state_str(actuator_state_t state)
+{
+    switch (state)
+    {
+    case ACTUATOR_STATE_IDLE:
+        return "locked";
+    case ACTUATOR_STATE_OPENING:
+        return "opening";
+    case ACTUATOR_STATE_HOLDING:
+        return "open";
+    case ACTUATOR_STATE_CLOSING:
+        return "closing";
+    default:
+        return "unknown";
+    }
+}
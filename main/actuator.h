@@ -0,0 +1,74 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef ACTUATOR_H
+#define ACTUATOR_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ACTUATOR_DOORS              CONFIG_LOCK_DOOR_COUNT
+#define ACTUATOR_DOORS_ALL          ((uint8_t)((1u << ACTUATOR_DOORS) - 1))
+
+/* Door actuator states, driven by each door's actuator task */
+typedef enum
+{
+    ACTUATOR_STATE_IDLE = 0,    /* Servo at the locked position */
+    ACTUATOR_STATE_OPENING,     /* Servo travelling to the open position */
+    ACTUATOR_STATE_HOLDING,     /* Door held open */
+    ACTUATOR_STATE_CLOSING,     /* Servo travelling back to the locked position */
+} actuator_state_t;
+
+typedef enum
+{
+    ACTUATOR_CMD_UNLOCK = 0,    /* Open the door, or extend the hold time if already open */
+    ACTUATOR_CMD_LOCK,          /* Close the door immediately */
+} actuator_cmd_t;
+
+/**
+ * Lock-state callback.  Runs on the door's actuator task, so callbacks for
+ * different doors may run concurrently; keep it short and do not call
+ * actuator_request() with a blocking expectation from inside it.
+ */
+typedef void (*actuator_state_cb_t)(uint8_t door, actuator_state_t state, void *arg);
+
+/**
+ * Configures the LEDC servo output of every door, parks each servo at the
+ * locked position and starts one actuator task per door.  Doors never wait
+ * on each other.
+ */
+esp_err_t actuator_init(void);
+
+/**
+ * Registers a callback invoked on every state transition.
+ *
+ * @return ESP_OK, or ESP_ERR_NO_MEM when all callback slots are in use.
+ */
+esp_err_t actuator_register_cb(actuator_state_cb_t cb, void *arg);
+
+/**
+ * Queues a command for a door's actuator task.  Never blocks, so it is safe
+ * to call from NimBLE host callbacks.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for a door that does not exist, or
+ *         ESP_ERR_TIMEOUT when that door's command queue is full.
+ */
+esp_err_t actuator_request(uint8_t door, actuator_cmd_t cmd);
+
+actuator_state_t actuator_get_state(uint8_t door);
+
+const char *actuator_state_str(actuator_state_t state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,747 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "actuator.h"
+#include "cred_store.h"
+#include "access_policy.h"
+#include "totp.h"
+#include "audit_log.h"
+#include "rate_limit.h"
+#include "lock_status.h"
+#include "lock_diag.h"
+#include "lock_pm.h"
+#include "adv_sched.h"
+#include "bond_cache.h"
+#include "mem_acct.h"
+#include "uart_bridge.h"
+#include "admin_console.h"
+
+#define CONSOLE_TASK_STACK      4096
+#define CONSOLE_TASK_PRIO       3
+#define CONSOLE_ARGS_MAX        6
+#define CONSOLE_LOG_BATCH       4
+#define CONSOLE_LOG_MAX         32
+#define CONSOLE_POOLS_MAX       16
+
+/* Owned by the bridge task while !console_busy, by the console task while
+ * console_busy */
+static char console_line[ADMIN_CONSOLE_LINE_MAX];
+static int console_len;
+static volatile bool console_busy;
+static TaskHandle_t console_task_handle;
+static admin_console_stats_t console_stats;
+
+/* Only the console task writes replies */
+static char console_out[160];
+
+typedef struct
+{
+    const char *name;
+    const char *usage;
+    void (*fn)(int argc, char **argv);
+} console_cmd_t;
+
+static void
+console_printf(const char *fmt, ...)
+{
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(console_out, sizeof console_out, fmt, ap);
+    va_end(ap);
+    if (len >= (int)sizeof console_out)
+    {
+        len = sizeof console_out - 1;
+    }
+    if (len > 0)
+    {
+        lock_hal_uart_write(console_out, len);
+    }
+}
+
+static void
+console_result(esp_err_t ret)
+{
+    console_printf(ret == ESP_OK ? "ok\n" : "error: %s\n", esp_err_to_name(ret));
+}
+
+/* Parses a whole unsigned number in any base strtoul() takes */
+static bool
+console_number(const char *s, unsigned long max, unsigned long *out)
+{
+    char *end;
+
+    *out = strtoul(s, &end, 0);
+    return *s != '\0' && *end == '\0' && *out <= max;
+}
+
+/* Decodes hex in place; returns the byte count, or -1 if s is not hex */
+static int
+console_unhex(char *s)
+{
+    int len = strlen(s);
+
+    if (len % 2 != 0)
+    {
+        return -1;
+    }
+    for (int i = 0; i < len; i += 2)
+    {
+        char pair[3] = { s[i], s[i + 1], '\0' };
+        char *end;
+
+        s[i / 2] = strtoul(pair, &end, 16);
+        if (*end != '\0')
+        {
+            return -1;
+        }
+    }
+    return len / 2;
+}
+
+static void
+cmd_stats(int argc, char **argv)
+{
+    lock_status_t st;
+    uart_bridge_stats_t bridge;
+    rate_limit_stats_t rl;
+    audit_stats_t audit;
+    adv_sched_stats_t adv;
+#if CONFIG_LOCK_BOND_FAST
+    bond_stats_t bond;
+#endif
+
+    lock_status_get(&st);
+    uart_bridge_get_stats(&bridge);
+    rate_limit_get_stats(&rl);
+    audit_log_get_stats(&audit);
+    adv_sched_get_stats(&adv);
+#if CONFIG_LOCK_BOND_FAST
+    bond_cache_get_stats(&bond);
+#endif
+
+    console_printf("fw %u.%u.%u, uptime %llds, clock %s\n", st.fw[0], st.fw[1], st.fw[2],
+                   (long long)(lock_hal_now_us() / 1000000),
+                   lock_hal_wall_time() >= LOCK_HAL_CLOCK_VALID ? "set" : "not set");
+    for (int door = 0; door < ACTUATOR_DOORS; door++)
+    {
+        console_printf("door %d: %s\n", door, actuator_state_str(actuator_get_state(door)));
+    }
+    console_printf("creds %u (%d scheduled), denied %u, lockouts %u\n", cred_store_count(),
+                   access_policy_count(), st.denied, st.lockouts);
+    console_printf("rate: admitted %u, rate %u, lockout %u, evictions %u\n",
+                   (unsigned)rl.admitted, (unsigned)rl.rejected_rate,
+                   (unsigned)rl.rejected_lockout, (unsigned)rl.evictions);
+    console_printf("audit: appended %u, dropped %u, batches %u, erases %u\n",
+                   (unsigned)audit.appended, (unsigned)audit.dropped,
+                   (unsigned)audit.batches, (unsigned)audit.erases);
+    console_printf("bridge: rx %u bytes, %u overflows\n",
+                   (unsigned)bridge.rx_bytes, (unsigned)bridge.rx_overflows);
+    console_printf("adv: found %u fast (avg %ums), %u slow (avg %ums)\n",
+                   (unsigned)adv.found[ADV_SCHED_FAST],
+                   (unsigned)(adv.found[ADV_SCHED_FAST] ?
+                              adv.total_ms[ADV_SCHED_FAST] / adv.found[ADV_SCHED_FAST] : 0),
+                   (unsigned)adv.found[ADV_SCHED_SLOW],
+                   (unsigned)(adv.found[ADV_SCHED_SLOW] ?
+                              adv.total_ms[ADV_SCHED_SLOW] / adv.found[ADV_SCHED_SLOW] : 0));
+#if CONFIG_LOCK_BOND_FAST
+    console_printf("adv: found %u by bonds only (avg %ums)\n",
+                   (unsigned)adv.found[ADV_SCHED_BONDED],
+                   (unsigned)(adv.found[ADV_SCHED_BONDED] ?
+                              adv.total_ms[ADV_SCHED_BONDED] / adv.found[ADV_SCHED_BONDED] : 0));
+    for (int i = 0; i < BOND_PATHS; i++)
+    {
+        console_printf("connect to unlock, %s: %u (avg %ums, max %ums)\n", bond_path_str(i),
+                       (unsigned)bond.unlocks[i],
+                       (unsigned)(bond.unlocks[i] ? bond.total_ms[i] / bond.unlocks[i] : 0),
+                       (unsigned)bond.max_ms[i]);
+    }
+    console_printf("bond: %u early encryptions, %u resumed, %u evictions\n",
+                   (unsigned)bond.early_enc, (unsigned)bond.resumed,
+                   (unsigned)bond.evictions);
+#endif
+    console_printf("console: %u lines, %u dropped, %u overlong\n",
+                   (unsigned)console_stats.lines, (unsigned)console_stats.dropped,
+                   (unsigned)console_stats.overlong);
+    lock_pm_report();
+}
+
+/* Prints committed audit records from a sequence number on */
+static void
+cmd_log(int argc, char **argv)
+{
+    static const char *const method_str[] = { "pin", "totp", "bond" };
+    static const char *const result_str[] = { "granted", "denied", "schedule" };
+    audit_rec_t recs[CONSOLE_LOG_BATCH];
+    unsigned long seq = 0;
+    uint32_t cursor;
+    int shown = 0;
+    int n;
+
+    if (argc > 1 && !console_number(argv[1], UINT32_MAX, &seq))
+    {
+        console_printf("usage: log [seq]\n");
+        return;
+    }
+    cursor = seq;
+    while (shown < CONSOLE_LOG_MAX &&
+           (n = audit_log_read(&cursor, recs, CONSOLE_LOG_BATCH)) > 0)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            const audit_rec_t *r = &recs[i];
+
+            console_printf("%u %s%u door %u user %u %s %s %02x:%02x:%02x:%02x:%02x:%02x\n",
+                           (unsigned)r->seq, r->flags & AUDIT_F_WALL_CLOCK ? "" : "+",
+                           (unsigned)r->time, r->door, r->cred_id,
+                           r->method < 3 ? method_str[r->method] : "?",
+                           r->result < 3 ? result_str[r->result] : "?",
+                           r->peer[5], r->peer[4], r->peer[3], r->peer[2], r->peer[1],
+                           r->peer[0]);
+        }
+        shown += n;
+    }
+    if (shown == CONSOLE_LOG_MAX)
+    {
+        console_printf("more: log %u\n", (unsigned)cursor);
+    }
+}
+
+static void
+cmd_door(int argc, char **argv)
+{
+    unsigned long door;
+    actuator_cmd_t cmd;
+
+    if (argc != 3 || !console_number(argv[1], ACTUATOR_DOORS - 1, &door) ||
+        (strcmp(argv[2], "open") != 0 && strcmp(argv[2], "lock") != 0))
+    {
+        console_printf("usage: door <0-%d> open|lock\n", ACTUATOR_DOORS - 1);
+        return;
+    }
+    cmd = argv[2][0] == 'o' ? ACTUATOR_CMD_UNLOCK : ACTUATOR_CMD_LOCK;
+    MODLOG_DFLT(INFO, "console: door %d %s\n", (int)door, argv[2]);
+    console_result(actuator_request(door, cmd));
+}
+
+static void
+cmd_cred(int argc, char **argv)
+{
+    unsigned long val;
+    uint16_t user;
+    esp_err_t ret;
+
+    if (argc >= 3 && argc <= 4 && strcmp(argv[1], "add") == 0)
+    {
+        val = CRED_DOORS_ALL;
+        if (argc == 4 && !console_number(argv[3], 0xFF, &val))
+        {
+            console_printf("door mask must be 0-0xff\n");
+            return;
+        }
+        ret = cred_store_add(argv[2], strlen(argv[2]), val, &user);
+        if (ret == ESP_OK)
+        {
+            access_policy_clear(user);
+            console_printf("user %u\n", user);
+        }
+        console_result(ret);
+    }
+    else if (argc == 3 && strcmp(argv[1], "del") == 0 &&
+             console_number(argv[2], CRED_USER_NONE - 1, &val))
+    {
+        ret = cred_store_revoke(val);
+        if (ret == ESP_OK)
+        {
+            access_policy_clear(val);
+        }
+        console_result(ret);
+    }
+    else if (argc == 2 && strcmp(argv[1], "count") == 0)
+    {
+        console_printf("%u\n", cred_store_count());
+    }
+    else
+    {
+        console_printf("usage: cred add <pin> [doors] | del <user> | count\n");
+    }
+}
+
+static void
+cmd_totp(int argc, char **argv)
+{
+    unsigned long user;
+    int len;
+
+    if (argc != 3 || !console_number(argv[1], 0xFF, &user))
+    {
+        console_printf("usage: totp <user> <hex secret>|del\n");
+        return;
+    }
+    if (strcmp(argv[2], "del") == 0)
+    {
+        console_result(totp_remove(user));
+        return;
+    }
+    len = console_unhex(argv[2]);
+    if (len <= 0 || len > TOTP_SECRET_MAX)
+    {
+        console_printf("secret must be 1-%d bytes of hex\n", TOTP_SECRET_MAX);
+        return;
+    }
+    console_result(totp_set_secret(user, (const uint8_t *)argv[2], len));
+}
+
+static const char *const console_weekdays[] = { "mon", "tue", "wed", "thu", "fri", "sat", "sun" };
+
+static int
+console_weekday(const char *s, size_t len)
+{
+    for (int d = 0; d < 7; d++)
+    {
+        if (len == 3 && strncmp(s, console_weekdays[d], 3) == 0)
+        {
+            return d;
+        }
+    }
+    return -1;
+}
+
+/* "daily", or days and day ranges joined by '+': "mon-fri+sun" */
+static bool
+console_days(const char *s, size_t len, uint8_t *mask)
+{
+    *mask = 0;
+    if (len == 5 && strncmp(s, "daily", 5) == 0)
+    {
+        *mask = ACCESS_DAILY;
+        return true;
+    }
+    while (len >= 3)
+    {
+        int from = console_weekday(s, 3);
+        int to = from;
+
+        if (len >= 7 && s[3] == '-')
+        {
+            to = console_weekday(s + 4, 3);
+            s += 4;
+            len -= 4;
+        }
+        if (from < 0 || to < 0)
+        {
+            return false;
+        }
+        /* mon-fri, or fri-mon across the weekend */
+        for (int d = from; ; d = (d + 1) % 7)
+        {
+            *mask |= 1u << d;
+            if (d == to)
+            {
+                break;
+            }
+        }
+        s += 3;
+        len -= 3;
+        if (len == 0)
+        {
+            return true;
+        }
+        if (*s != '+')
+        {
+            return false;
+        }
+        s++;
+        len--;
+    }
+    return false;
+}
+
+/* "any", or windows joined by ',': "mon-fri/9-18,sat/10-14" */
+static bool
+console_windows(char *s, access_rule_t *rule)
+{
+    char *save;
+
+    if (strcmp(s, "any") == 0)
+    {
+        return true;
+    }
+    for (char *w = strtok_r(s, ",", &save); w != NULL; w = strtok_r(NULL, ",", &save))
+    {
+        access_window_t *win = &rule->windows[rule->nwindows];
+        char *slash = strchr(w, '/');
+        unsigned start, end;
+        int n = 0;
+
+        if (rule->nwindows == ACCESS_MAX_WINDOWS || slash == NULL ||
+            !console_days(w, slash - w, &win->days) ||
+            sscanf(slash + 1, "%u-%u%n", &start, &end, &n) != 2 || slash[1 + n] != '\0' ||
+            start > 23 || end > 24)
+        {
+            return false;
+        }
+        win->start_hour = start;
+        win->end_hour = end;
+        rule->nwindows++;
+    }
+    return rule->nwindows > 0;
+}
+
+/* YYYY-MM-DD, or empty for no limit */
+static bool
+console_date(const char *s, size_t len, uint16_t *day)
+{
+    int y, m, d, n = 0;
+    int32_t v;
+
+    if (len == 0)
+    {
+        return true;
+    }
+    if (sscanf(s, "%4d-%2d-%2d%n", &y, &m, &d, &n) != 3 || (size_t)n != len)
+    {
+        return false;
+    }
+    v = access_policy_day(y, m, d);
+    if (v < 0)
+    {
+        return false;
+    }
+    *day = v;
+    return true;
+}
+
+static void
+console_policy_show(uint16_t user)
+{
+    access_policy_t p;
+    char line[96];
+    int y, m, d;
+
+    if (!access_policy_get(user, &p))
+    {
+        console_printf("user %u: any time\n", user);
+        return;
+    }
+    for (int day = 0; day < 7; day++)
+    {
+        int len = snprintf(line, sizeof line, "%s", console_weekdays[day]);
+
+        for (int h = 0; h < 24; )
+        {
+            int bit = day * 24 + h;
+            int start = h;
+
+            if (!(p.hours[bit >> 3] & (1u << (bit & 7))))
+            {
+                h++;
+                continue;
+            }
+            while (h < 24 && (p.hours[(day * 24 + h) >> 3] & (1u << ((day * 24 + h) & 7))))
+            {
+                h++;
+            }
+            len += snprintf(line + len, sizeof line - len, " %02d-%02d", start, h);
+        }
+        console_printf("%s\n", line);
+    }
+    if (p.from_day != 0)
+    {
+        access_policy_date(p.from_day, &y, &m, &d);
+        console_printf("from %04d-%02d-%02d\n", y, m, d);
+    }
+    if (p.until_day != ACCESS_DAY_NONE)
+    {
+        access_policy_date(p.until_day, &y, &m, &d);
+        console_printf("until %04d-%02d-%02d\n", y, m, d);
+    }
+    if (p.flags & ACCESS_F_ONCE)
+    {
+        console_printf("once%s\n", (p.flags & ACCESS_F_SPENT) ? ", spent" : "");
+    }
+}
+
+static void
+cmd_policy(int argc, char **argv)
+{
+    access_rule_t rule = { .until_day = ACCESS_DAY_NONE };
+    unsigned long user;
+    int i = 3;
+
+    if (argc < 2 || !console_number(argv[1], CRED_USER_NONE - 1, &user))
+    {
+        goto usage;
+    }
+    if (argc == 2)
+    {
+        console_policy_show(user);
+        return;
+    }
+    if (argc == 3 && strcmp(argv[2], "clear") == 0)
+    {
+        console_result(access_policy_clear(user));
+        return;
+    }
+    if (!console_windows(argv[2], &rule))
+    {
+        goto usage;
+    }
+    if (i < argc && strstr(argv[i], "..") != NULL)
+    {
+        char *dots = strstr(argv[i], "..");
+
+        if (!console_date(argv[i], dots - argv[i], &rule.from_day) ||
+            !console_date(dots + 2, strlen(dots + 2), &rule.until_day))
+        {
+            goto usage;
+        }
+        i++;
+    }
+    if (i < argc && strcmp(argv[i], "once") == 0)
+    {
+        rule.once = true;
+        i++;
+    }
+    if (i != argc)
+    {
+        goto usage;
+    }
+    console_result(access_policy_set(user, &rule));
+    return;
+
+usage:
+    console_printf("usage: policy <user> [clear | <days>/<h>-<h>[,...]|any "
+                   "[yyyy-mm-dd..yyyy-mm-dd] [once]]\n");
+}
+
+static void
+cmd_time(int argc, char **argv)
+{
+    unsigned long t;
+
+    if (argc == 2)
+    {
+        if (!console_number(argv[1], UINT32_MAX, &t) || t < LOCK_HAL_CLOCK_VALID)
+        {
+            console_printf("usage: time [unix seconds]\n");
+            return;
+        }
+        lock_hal_set_wall_time(t);
+        totp_clock_changed();
+        MODLOG_DFLT(INFO, "console: clock set to %lu\n", t);
+    }
+    console_printf("%lld\n", (long long)lock_hal_wall_time());
+}
+
+#if CONFIG_LOCK_MEM_ACCT
+static void
+cmd_mem(int argc, char **argv)
+{
+    mem_task_info_t tasks[MEM_ACCT_TASKS_MAX];
+    mem_pool_info_t pools[CONSOLE_POOLS_MAX];
+    mem_acct_stats_t st;
+    int n;
+
+    mem_acct_get_stats(&st);
+    console_printf("heap: %u free, %u low-water, %u largest block\n",
+                   (unsigned)st.heap_free, (unsigned)st.heap_min_free,
+                   (unsigned)st.heap_largest);
+#if CONFIG_LOCK_MEM_HEAP_COUNT
+    console_printf("heap: %u allocs, %u frees\n", (unsigned)st.heap_allocs,
+                   (unsigned)st.heap_frees);
+#endif
+    console_printf("failed: heap %u (last %u bytes), msys %u, notify %u, replies lost %u\n",
+                   (unsigned)st.cnt[MEM_CNT_HEAP_FAIL], (unsigned)st.heap_fail_size,
+                   (unsigned)st.cnt[MEM_CNT_MSYS_FAIL], (unsigned)st.cnt[MEM_CNT_NOTIFY_ENOMEM],
+                   (unsigned)st.cnt[MEM_CNT_REPLY_LOST]);
+
+    n = mem_acct_tasks(tasks, MEM_ACCT_TASKS_MAX);
+    for (int i = 0; i < n; i++)
+    {
+        console_printf("task %-12s stack %5u, least free %5u\n", tasks[i].name,
+                       (unsigned)tasks[i].stack, (unsigned)tasks[i].min_free);
+    }
+    n = mem_acct_pools(pools, CONSOLE_POOLS_MAX);
+    for (int i = 0; i < n; i++)
+    {
+        console_printf("pool %-15s %3u x %4uB, %3u free, peak %3u used\n", pools[i].name,
+                       pools[i].blocks, pools[i].block_size, pools[i].free,
+                       pools[i].blocks - pools[i].min_free);
+    }
+}
+#endif
+
+#if CONFIG_LOCK_DIAG
+static void
+cmd_diag(int argc, char **argv)
+{
+    lock_diag_uart_dump();
+}
+#endif
+
+static void cmd_help(int argc, char **argv);
+
+static const console_cmd_t console_cmds[] = {
+    { "help",  "",                                  cmd_help },
+    { "stats", "",                                  cmd_stats },
+    { "log",   "[seq]",                             cmd_log },
+    { "door",  "<n> open|lock",                     cmd_door },
+    { "cred",  "add <pin> [doors] | del <user> | count", cmd_cred },
+    { "totp",  "<user> <hex secret>|del",           cmd_totp },
+    { "policy", "<user> [clear | <days>/<h>-<h>[,...]|any [from..until] [once]]", cmd_policy },
+    { "time",  "[unix seconds]",                    cmd_time },
+#if CONFIG_LOCK_MEM_ACCT
+    { "mem",   "(stacks, heap, mempools)",          cmd_mem },
+#endif
+#if CONFIG_LOCK_DIAG
+    { "diag",  "(binary frame, see tools/diag_decode.py)", cmd_diag },
+#endif
+};
+
+static void
+cmd_help(int argc, char **argv)
+{
+    for (size_t i = 0; i < sizeof console_cmds / sizeof console_cmds[0]; i++)
+    {
+        console_printf("%c%s %s\n", ADMIN_CONSOLE_PREFIX, console_cmds[i].name,
+                       console_cmds[i].usage);
+    }
+}
+
+int
+admin_console_split(char *line, char **argv, int max)
+{
+    int argc = 0;
+    char *p = line;
+
+    while (argc < max)
+    {
+        while (*p == ' ' || *p == '\t')
+        {
+            p++;
+        }
+        if (*p == '\0')
+        {
+            break;
+        }
+        argv[argc++] = p;
+        while (*p != '\0' && *p != ' ' && *p != '\t')
+        {
+            p++;
+        }
+        if (*p != '\0')
+        {
+            *p++ = '\0';
+        }
+    }
+    return argc;
+}
+
+static void
+console_run(char *line)
+{
+    char *argv[CONSOLE_ARGS_MAX];
+    int argc = admin_console_split(line, argv, CONSOLE_ARGS_MAX);
+
+    if (argc == 0)
+    {
+        return;
+    }
+    for (size_t i = 0; i < sizeof console_cmds / sizeof console_cmds[0]; i++)
+    {
+        if (strcmp(argv[0], console_cmds[i].name) == 0)
+        {
+            console_cmds[i].fn(argc, argv);
+            return;
+        }
+    }
+    console_printf("unknown command %s; try %chelp\n", argv[0], ADMIN_CONSOLE_PREFIX);
+}
+
+static void
+console_task(void *param)
+{
+    mem_acct_track_task(NULL, CONSOLE_TASK_STACK);
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (!console_busy)
+        {
+            continue;
+        }
+        console_stats.lines++;
+        /* Skip the prefix; the line is already NUL-terminated */
+        console_run(console_line + 1);
+        /* Lines can carry PINs and secrets; do not leave them in RAM */
+        memset(console_line, 0, sizeof console_line);
+        console_len = 0;
+        console_busy = false;
+    }
+}
+
+void
+admin_console_feed(const uint8_t *data, int len)
+{
+    bool eol = len > 0 && (data[len - 1] == '\n' || data[len - 1] == '\r');
+    int room;
+
+    if (console_busy)
+    {
+        if (eol)
+        {
+            console_stats.dropped++;
+        }
+        return;
+    }
+    if (eol)
+    {
+        len--;
+    }
+    room = sizeof console_line - 1 - console_len;
+    if (len > room)
+    {
+        if (room > 0)
+        {
+            console_stats.overlong++;
+        }
+        len = room;
+    }
+    memcpy(console_line + console_len, data, len);
+    console_len += len;
+    if (eol)
+    {
+        console_line[console_len] = '\0';
+        console_busy = true;
+        xTaskNotifyGive(console_task_handle);
+    }
+}
+
+void
+admin_console_get_stats(admin_console_stats_t *out)
+{
+    *out = console_stats;
+}
+
+esp_err_t
+admin_console_init(void)
+{
+    if (xTaskCreate(console_task, "conTask", CONSOLE_TASK_STACK, NULL,
+                    CONSOLE_TASK_PRIO, &console_task_handle) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,60 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef ADMIN_CONSOLE_H
+#define ADMIN_CONSOLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Local admin console on the bridge UART.
+ *
+ * The bridge task sorts received lines by their first byte: lines starting
+ * with ADMIN_CONSOLE_PREFIX are console commands and never reach BLE
+ * subscribers; everything else is bridged as before.  A command line is
+ * copied into one static buffer and parsed there in place by the console
+ * task, which runs below the bridge so a slow command (a log dump) never
+ * holds up bridged data.  While a command runs, further command lines are
+ * dropped and counted.  "!help" lists the commands.
+ */
+#define ADMIN_CONSOLE_PREFIX        '!'
+#define ADMIN_CONSOLE_LINE_MAX      128
+
+typedef struct
+{
+    uint32_t lines;             /* Commands run */
+    uint32_t dropped;           /* Lines lost while a command was running */
+    uint32_t overlong;          /* Lines cut at ADMIN_CONSOLE_LINE_MAX */
+} admin_console_stats_t;
+
+esp_err_t admin_console_init(void);
+
+/**
+ * Appends part of a command line, from the bridge task.  The line is
+ * complete once data ends with '\r' or '\n'.
+ */
+void admin_console_feed(const uint8_t *data, int len);
+
+/**
+ * Splits line into whitespace-separated words in place.
+ *
+ * @return the number of words stored in argv, at most max.
+ */
+int admin_console_split(char *line, char **argv, int max);
+
+void admin_console_get_stats(admin_console_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include "adv_sched.h"
+
+/* Interval window: up to an eighth above the nominal interval */
+static void
+adv_plan(const adv_sched_cfg_t *cfg, uint8_t phase, int32_t duration_ms, adv_plan_t *plan)
+{
+    plan->itvl_min = cfg->itvl[phase];
+    plan->itvl_max = cfg->itvl[phase] + cfg->itvl[phase] / 8;
+    plan->duration_ms = duration_ms;
+    plan->accept_list = phase == ADV_SCHED_BONDED;
+}
+
+bool
+adv_sched_step(adv_sched_t *s, const adv_sched_cfg_t *cfg,
+               adv_sched_ev_t ev, uint32_t now_ms, adv_plan_t *plan)
+{
+    uint32_t ttd;
+
+    switch (ev)
+    {
+    case ADV_SCHED_EV_BOND_LOST:
+        if (cfg->bond_ms > 0)
+        {
+            s->phase = ADV_SCHED_BONDED;
+            s->burst_end_ms = now_ms + cfg->bond_ms;
+            break;
+        }
+        /* fall through */
+    case ADV_SCHED_EV_BOOT:
+    case ADV_SCHED_EV_DISCONNECT:
+        s->phase = ADV_SCHED_FAST;
+        s->burst_end_ms = now_ms + cfg->fast_ms;
+        break;
+
+    case ADV_SCHED_EV_CONNECT:
+        if (s->searching)
+        {
+            ttd = now_ms - s->since_ms;
+            s->searching = false;
+            s->stats.found[s->phase]++;
+            s->stats.total_ms[s->phase] += ttd;
+            if (ttd > s->stats.max_ms[s->phase])
+            {
+                s->stats.max_ms[s->phase] = ttd;
+            }
+            s->stats.last_ms = ttd;
+        }
+        return false;
+
+    case ADV_SCHED_EV_RESUME:
+        break;
+
+    case ADV_SCHED_EV_BURST_END:
+        if (s->phase == ADV_SCHED_BONDED)
+        {
+            /* Open up to everyone for a full burst */
+            s->phase = ADV_SCHED_FAST;
+            s->burst_end_ms = now_ms + cfg->fast_ms;
+        }
+        else
+        {
+            s->phase = ADV_SCHED_SLOW;
+        }
+        break;
+    }
+
+    if (!s->searching)
+    {
+        s->searching = true;
+        s->since_ms = now_ms;
+    }
+    if (s->phase != ADV_SCHED_SLOW && (int32_t)(s->burst_end_ms - now_ms) > 0)
+    {
+        adv_plan(cfg, s->phase, s->burst_end_ms - now_ms, plan);
+    }
+    else if (s->phase == ADV_SCHED_BONDED)
+    {
+        /* Resumed after the accept-list window ran out */
+        s->phase = ADV_SCHED_FAST;
+        s->burst_end_ms = now_ms + cfg->fast_ms;
+        adv_plan(cfg, ADV_SCHED_FAST, cfg->fast_ms, plan);
+    }
+    else
+    {
+        s->phase = ADV_SCHED_SLOW;
+        adv_plan(cfg, ADV_SCHED_SLOW, ADV_SCHED_FOREVER, plan);
+    }
+    return true;
+}
@@ -0,0 +1,117 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef ADV_SCHED_H
+#define ADV_SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Advertising schedule.
+ *
+ * After boot and after every disconnect the lock advertises at a fast
+ * interval for a burst of fast_ms, so a phone that is looking finds it
+ * quickly, and then at a slow interval until someone connects.  A
+ * connection that leaves room for more resumes whatever part of the burst
+ * was left.
+ *
+ * When a bonded peer disconnects, the burst starts with bond_ms at the
+ * fast interval in which only peers on the accept list (recently seen
+ * bonds) may connect, so the phone that just left gets back in first.
+ *
+ * adv_sched_step() holds the decisions and nothing else, so it can be
+ * driven from a host test.  It also measures time to discovery: from the
+ * moment the lock starts looking for a central to the next connection,
+ * split by the phase the connection came in.  The NimBLE side lives in
+ * adv_sched_ble.c.
+ */
+#define ADV_SCHED_FOREVER           INT32_MAX   /* Same as BLE_HS_FOREVER */
+
+typedef enum
+{
+    ADV_SCHED_EV_BOOT = 0,      /* Host synced */
+    ADV_SCHED_EV_DISCONNECT,
+    ADV_SCHED_EV_BOND_LOST,     /* A bonded peer disconnected */
+    ADV_SCHED_EV_CONNECT,
+    ADV_SCHED_EV_RESUME,        /* Advertising stopped, restart it */
+    ADV_SCHED_EV_BURST_END,     /* The fast burst ran for its whole duration */
+} adv_sched_ev_t;
+
+typedef enum
+{
+    ADV_SCHED_FAST = 0,
+    ADV_SCHED_SLOW,
+    ADV_SCHED_BONDED,           /* Fast, accept list only */
+    ADV_SCHED_PHASES,
+} adv_sched_phase_t;
+
+typedef struct
+{
+    uint32_t fast_ms;           /* Length of the fast burst */
+    uint32_t bond_ms;           /* Accept-list part after a bond leaves; 0 for none */
+    uint16_t itvl[ADV_SCHED_PHASES];    /* Interval per phase, 0.625 ms units */
+} adv_sched_cfg_t;
+
+/* What to pass to the advertising start call */
+typedef struct
+{
+    uint16_t itvl_min;
+    uint16_t itvl_max;
+    int32_t duration_ms;        /* ADV_SCHED_FOREVER for no limit */
+    bool accept_list;           /* Only peers on the accept list may connect */
+} adv_plan_t;
+
+typedef struct
+{
+    uint32_t found[ADV_SCHED_PHASES];   /* Connections per phase */
+    uint32_t total_ms[ADV_SCHED_PHASES];
+    uint32_t max_ms[ADV_SCHED_PHASES];
+    uint32_t last_ms;
+} adv_sched_stats_t;
+
+typedef struct
+{
+    uint8_t phase;              /* adv_sched_phase_t */
+    bool searching;             /* Advertising for a central since since_ms */
+    uint32_t burst_end_ms;
+    uint32_t since_ms;
+    adv_sched_stats_t stats;
+} adv_sched_t;
+
+/**
+ * Feeds one event to the schedule at now_ms.
+ *
+ * @return true if advertising should be (re)started with *plan.
+ */
+bool adv_sched_step(adv_sched_t *s, const adv_sched_cfg_t *cfg,
+                    adv_sched_ev_t ev, uint32_t now_ms, adv_plan_t *plan);
+
+struct ble_gap_event;
+
+/* NimBLE side, see adv_sched_ble.c.  Events are handled on the
+ * deferred-work task. */
+
+/**
+ * Encodes the advertising data, loads it into the controller and starts
+ * the first fast burst.  Call from the host sync callback; gap_cb gets the
+ * events of every connection made through advertising.
+ */
+esp_err_t adv_sched_start(uint8_t own_addr_type,
+                          int (*gap_cb)(struct ble_gap_event *event, void *arg));
+void adv_sched_event(adv_sched_ev_t ev);
+void adv_sched_get_stats(adv_sched_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
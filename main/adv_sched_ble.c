@@ -0,0 +1,222 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "host/ble_hs.h"
+#include "services/gap/ble_svc_gap.h"
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "defer.h"
+#include "lock_status.h"
+#include "bond_cache.h"
+#include "main.h"
+#include "adv_sched.h"
+
+/* Advertising intervals are in 0.625 ms units */
+#define ADV_ITVL(ms)                ((ms) * 8 / 5)
+
+/* Manufacturer-specific data carrying the status snapshot */
+#define ADV_COMPANY_ID              0x02E5      /* Espressif Systems */
+#define ADV_RSP_LEN                 (4 + sizeof(lock_status_t))
+
+_Static_assert(ADV_SCHED_FOREVER == BLE_HS_FOREVER, "advertising duration sentinel");
+_Static_assert(ADV_RSP_LEN <= BLE_HS_ADV_MAX_SZ, "status does not fit the scan response");
+
+static const adv_sched_cfg_t adv_cfg = {
+    .fast_ms = CONFIG_LOCK_ADV_FAST_MS,
+#if CONFIG_LOCK_BOND_FAST
+    .bond_ms = CONFIG_LOCK_ADV_BOND_MS,
+#endif
+    .itvl = {
+        [ADV_SCHED_FAST] = ADV_ITVL(CONFIG_LOCK_ADV_FAST_ITVL_MS),
+        [ADV_SCHED_SLOW] = ADV_ITVL(CONFIG_LOCK_ADV_SLOW_ITVL_MS),
+        [ADV_SCHED_BONDED] = ADV_ITVL(CONFIG_LOCK_ADV_FAST_ITVL_MS),
+    },
+};
+
+/* Stepped only on the deferred-work task */
+static adv_sched_t adv_state;
+static uint8_t adv_own_addr_type;
+static int (*adv_gap_cb)(struct ble_gap_event *event, void *arg);
+static portMUX_TYPE adv_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *const adv_phase_str[ADV_SCHED_PHASES] = { "fast", "slow", "bonded" };
+
+/* Loads the remembered bonds into the accept list.  Returns false if there
+ * are none, in which case the filter would let nobody in. */
+static bool
+adv_load_accept_list(void)
+{
+    ble_addr_t addrs[CONFIG_BT_NIMBLE_WHITELIST_SIZE];
+    int n = bond_cache_accept_list(addrs, CONFIG_BT_NIMBLE_WHITELIST_SIZE);
+    int rc;
+
+    if (n == 0)
+    {
+        return false;
+    }
+    rc = ble_gap_wl_set(addrs, n);
+    if (rc != 0)
+    {
+        MODLOG_DFLT(ERROR, "error setting the accept list; rc=%d\n", rc);
+        return false;
+    }
+    return true;
+}
+
+static void
+adv_job(uint16_t conn_handle, void *arg)
+{
+    struct ble_gap_adv_params params;
+    adv_sched_ev_t ev = (adv_sched_ev_t)(uintptr_t)arg;
+    adv_plan_t plan;
+    bool searching;
+    bool start;
+    int rc;
+
+    portENTER_CRITICAL(&adv_lock);
+    searching = adv_state.searching;
+    start = adv_sched_step(&adv_state, &adv_cfg, ev, lock_hal_now_us() / 1000, &plan);
+    portEXIT_CRITICAL(&adv_lock);
+
+    if (ev == ADV_SCHED_EV_CONNECT && searching)
+    {
+        MODLOG_DFLT(INFO, "found by a central after %ums (%s advertising)\n",
+                    (unsigned)adv_state.stats.last_ms, adv_phase_str[adv_state.phase]);
+    }
+    if (!start)
+    {
+        return;
+    }
+
+    /* Restarting is the only way to change the interval */
+    if (ble_gap_adv_active())
+    {
+        ble_gap_adv_stop();
+    }
+
+    memset(&params, 0, sizeof params);
+    params.conn_mode = BLE_GAP_CONN_MODE_UND;
+    params.disc_mode = BLE_GAP_DISC_MODE_GEN;
+    params.itvl_min = plan.itvl_min;
+    params.itvl_max = plan.itvl_max;
+    /* Scans stay open to all so the status can still be seen.  The list
+     * cannot change while advertising uses it, hence after the stop. */
+    if (plan.accept_list && adv_load_accept_list())
+    {
+        params.filter_policy = BLE_HCI_ADV_FILT_CONN;
+    }
+    rc = ble_gap_adv_start(adv_own_addr_type, NULL, plan.duration_ms,
+                           &params, adv_gap_cb, NULL);
+    if (rc != 0)
+    {
+        MODLOG_DFLT(ERROR, "error enabling advertisement; rc=%d\n", rc);
+    }
+}
+
+void
+adv_sched_event(adv_sched_ev_t ev)
+{
+    /* Keeps the host task clear of HCI round trips */
+    defer_submit(DEFER_CONN_NONE, 0, adv_job, (void *)(uintptr_t)ev);
+}
+
+void
+adv_sched_get_stats(adv_sched_stats_t *out)
+{
+    portENTER_CRITICAL(&adv_lock);
+    *out = adv_state.stats;
+    portEXIT_CRITICAL(&adv_lock);
+}
+
+#if CONFIG_LOCK_ADV_STATUS
+/* Status listener: the scan response carries the latest snapshot */
+static void
+adv_status_changed(const lock_status_t *snap)
+{
+    uint8_t rsp[ADV_RSP_LEN];
+    int rc;
+
+    rsp[0] = ADV_RSP_LEN - 1;
+    rsp[1] = BLE_HS_ADV_TYPE_MFG_DATA;
+    rsp[2] = ADV_COMPANY_ID & 0xFF;
+    rsp[3] = ADV_COMPANY_ID >> 8;
+    memcpy(&rsp[4], snap, sizeof *snap);
+
+    /* Takes effect without restarting advertising */
+    rc = ble_gap_adv_rsp_set_data(rsp, sizeof rsp);
+    if (rc != 0)
+    {
+        MODLOG_DFLT(ERROR, "error setting scan response; rc=%d\n", rc);
+    }
+}
+#endif
+
+esp_err_t
+adv_sched_start(uint8_t own_addr_type,
+                int (*gap_cb)(struct ble_gap_event *event, void *arg))
+{
+    struct ble_hs_adv_fields fields;
+    const char *name;
+    int rc;
+
+    adv_own_addr_type = own_addr_type;
+    adv_gap_cb = gap_cb;
+
+    /**
+     *  Set the advertisement data included in our advertisements:
+     *     o Flags (indicates advertisement type and other general info).
+     *     o Advertising tx power.
+     *     o Device name.
+     *     o 16-bit service UUIDs (alert notifications).
+     *  The controller keeps it across advertising restarts, so this runs
+     *  once per host sync rather than every time advertising starts.
+     */
+    memset(&fields, 0, sizeof fields);
+
+    /* Advertise two flags:
+     *     o Discoverability in forthcoming advertisement (general)
+     *     o BLE-only (BR/EDR unsupported).
+     */
+    fields.flags = BLE_HS_ADV_F_DISC_GEN |
+                   BLE_HS_ADV_F_BREDR_UNSUP;
+
+    /* Indicate that the TX power level field should be included; have the
+     * stack fill this value automatically.  This is done by assigning the
+     * special value BLE_HS_ADV_TX_PWR_LVL_AUTO.
+     */
+    fields.tx_pwr_lvl_is_present = 1;
+    fields.tx_pwr_lvl = BLE_HS_ADV_TX_PWR_LVL_AUTO;
+
+    name = ble_svc_gap_device_name();
+    fields.name = (uint8_t *)name;
+    fields.name_len = strlen(name);
+    fields.name_is_complete = 1;
+
+    fields.uuids16 = (ble_uuid16_t[]){
+        BLE_UUID16_INIT(BLE_SVC_SPP_UUID16)};
+    fields.num_uuids16 = 1;
+    fields.uuids16_is_complete = 1;
+
+    rc = ble_gap_adv_set_fields(&fields);
+    if (rc != 0)
+    {
+        MODLOG_DFLT(ERROR, "error setting advertisement data; rc=%d\n", rc);
+        return ESP_FAIL;
+    }
+
+#if CONFIG_LOCK_ADV_STATUS
+    lock_status_t snap;
+
+    lock_status_get(&snap);
+    adv_status_changed(&snap);
+    lock_status_set_listener(adv_status_changed);
+#endif
+
+    adv_sched_event(ADV_SCHED_EV_BOOT);
+    return ESP_OK;
+}
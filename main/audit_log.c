@@ -0,0 +1,403 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_rom_crc.h"
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "conn_ctx.h"
+#include "mem_acct.h"
+#include "audit_log.h"
+
+/*
+ * Append-only audit log.
+ *
+ * The "audit" partition is a circular array of 32-byte records, and record
+ * number seq always lives in slot seq % slot count.  That makes the write
+ * position and any reader's cursor plain sequence numbers: after a reboot
+ * the log is recovered by finding the highest valid record, and a reader
+ * asking for a record that has been overwritten simply gets the oldest one
+ * still present.
+ *
+ * Records are numbered and staged in RAM by the caller, then written by a
+ * low-priority task in batches that never cross a sector.  A sector is
+ * erased just before the first record is written into it.
+ */
+#define AUDIT_PART_LABEL        "audit"
+#define AUDIT_SLOTS_PER_SECTOR  (LOCK_HAL_SECTOR_SIZE / sizeof(audit_rec_t))
+#define AUDIT_BATCH             CONFIG_LOCK_AUDIT_BATCH
+#define AUDIT_STAGE_SIZE        32
+#define AUDIT_CRC_LEN           offsetof(audit_rec_t, crc)
+#define AUDIT_TASK_STACK        3072
+#define AUDIT_TASK_PRIO         2
+#define AUDIT_READ_MAX          8
+
+_Static_assert(sizeof(audit_rec_t) == 32, "audit record layout");
+_Static_assert(AUDIT_BATCH <= AUDIT_STAGE_SIZE, "audit batch larger than staging");
+
+static lock_hal_part_t audit_part;
+static uint32_t audit_sectors;
+static uint32_t audit_slots;
+
+/* Records [audit_durable, audit_next) are staged and not yet in flash */
+static audit_rec_t audit_stage[AUDIT_STAGE_SIZE];
+static int64_t audit_stage_us[AUDIT_STAGE_SIZE];
+static uint32_t audit_next;
+static uint32_t audit_durable;
+static audit_stats_t audit_stats;
+static portMUX_TYPE audit_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t audit_task_handle;
+
+static audit_rec_t audit_wbuf[AUDIT_STAGE_SIZE];
+static audit_rec_t audit_rbuf[AUDIT_READ_MAX];
+
+static bool
+audit_rec_valid(const audit_rec_t *rec, uint32_t slot)
+{
+    return rec->seq % audit_slots == slot &&
+           rec->crc == esp_rom_crc32_le(0, (const uint8_t *)rec, AUDIT_CRC_LEN);
+}
+
+static bool
+audit_rec_blank(const audit_rec_t *rec)
+{
+    const uint8_t *p = (const uint8_t *)rec;
+
+    for (size_t i = 0; i < sizeof *rec; i++)
+    {
+        if (p[i] != 0xFF)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static esp_err_t
+audit_read_slot(uint32_t slot, audit_rec_t *rec, size_t n)
+{
+    return lock_hal_part_read(audit_part, slot * sizeof *rec, rec, n * sizeof *rec);
+}
+
+/* Finds the first sequence number to write after a reboot */
+static uint32_t
+audit_recover(void)
+{
+    audit_rec_t rec;
+    uint32_t last = 0;
+    bool found = false;
+    uint32_t slot;
+
+    /* The newest sector is the one whose first record is newest */
+    for (uint32_t s = 0; s < audit_sectors; s++)
+    {
+        slot = s * AUDIT_SLOTS_PER_SECTOR;
+        if (audit_read_slot(slot, &rec, 1) == ESP_OK && audit_rec_valid(&rec, slot) &&
+            (!found || (int32_t)(rec.seq - last) > 0))
+        {
+            last = rec.seq;
+            found = true;
+        }
+    }
+    if (!found)
+    {
+        return 0;
+    }
+
+    for (;;)
+    {
+        uint32_t next = last + 1;
+
+        slot = next % audit_slots;
+        if (slot % AUDIT_SLOTS_PER_SECTOR == 0)
+        {
+            return next;
+        }
+        if (audit_read_slot(slot, &rec, 1) != ESP_OK)
+        {
+            break;
+        }
+        if (audit_rec_blank(&rec))
+        {
+            return next;
+        }
+        if (!audit_rec_valid(&rec, slot) || rec.seq != next)
+        {
+            break;
+        }
+        last = next;
+    }
+    /* Torn write: continue at the next sector, which will be erased */
+    return (last / AUDIT_SLOTS_PER_SECTOR + 1) * AUDIT_SLOTS_PER_SECTOR;
+}
+
+/* Oldest sequence number still guaranteed to be in flash */
+static uint32_t
+audit_oldest(uint32_t durable)
+{
+    uint32_t sector_start = durable / AUDIT_SLOTS_PER_SECTOR * AUDIT_SLOTS_PER_SECTOR;
+    uint32_t span = (audit_sectors - 1) * AUDIT_SLOTS_PER_SECTOR;
+
+    return sector_start > span ? sector_start - span : 0;
+}
+
+/* Writes everything staged; returns false if flash refused a write */
+static bool
+audit_flush(void)
+{
+    for (;;)
+    {
+        uint32_t start;
+        uint32_t n;
+        uint32_t slot;
+        int64_t staged_us;
+        esp_err_t ret;
+
+        portENTER_CRITICAL(&audit_lock);
+        start = audit_durable;
+        n = audit_next - audit_durable;
+        portEXIT_CRITICAL(&audit_lock);
+        if (n == 0)
+        {
+            return true;
+        }
+
+        slot = start % audit_slots;
+        if (n > AUDIT_SLOTS_PER_SECTOR - slot % AUDIT_SLOTS_PER_SECTOR)
+        {
+            n = AUDIT_SLOTS_PER_SECTOR - slot % AUDIT_SLOTS_PER_SECTOR;
+        }
+
+        /* Staged records are not modified until audit_durable passes them */
+        staged_us = audit_stage_us[start % AUDIT_STAGE_SIZE];
+        for (uint32_t i = 0; i < n; i++)
+        {
+            audit_rec_t *rec = &audit_wbuf[i];
+
+            *rec = audit_stage[(start + i) % AUDIT_STAGE_SIZE];
+            rec->crc = esp_rom_crc32_le(0, (const uint8_t *)rec, AUDIT_CRC_LEN);
+        }
+
+        if (slot % AUDIT_SLOTS_PER_SECTOR == 0)
+        {
+            ret = lock_hal_part_erase(audit_part, slot * sizeof(audit_rec_t),
+                                      LOCK_HAL_SECTOR_SIZE);
+            if (ret != ESP_OK)
+            {
+                MODLOG_DFLT(ERROR, "audit erase failed; rc=%d\n", ret);
+                return false;
+            }
+            audit_stats.erases++;
+        }
+        ret = lock_hal_part_write(audit_part, slot * sizeof(audit_rec_t), audit_wbuf,
+                                  n * sizeof(audit_rec_t));
+        if (ret != ESP_OK)
+        {
+            MODLOG_DFLT(ERROR, "audit write failed; rc=%d\n", ret);
+            return false;
+        }
+
+        uint32_t commit_ms = (lock_hal_now_us() - staged_us) / 1000;
+
+        portENTER_CRITICAL(&audit_lock);
+        audit_durable += n;
+        audit_stats.batches++;
+        if (commit_ms > audit_stats.max_commit_ms)
+        {
+            audit_stats.max_commit_ms = commit_ms;
+        }
+        portEXIT_CRITICAL(&audit_lock);
+    }
+}
+
+static void
+audit_task(void *param)
+{
+    TickType_t wait = pdMS_TO_TICKS(CONFIG_LOCK_AUDIT_FLUSH_MS);
+
+    mem_acct_track_task(NULL, AUDIT_TASK_STACK);
+    for (;;)
+    {
+        /* Woken early when a batch is full; otherwise flush what is there */
+        ulTaskNotifyTake(pdTRUE, wait);
+        wait = audit_flush() ? pdMS_TO_TICKS(CONFIG_LOCK_AUDIT_FLUSH_MS)
+                             : pdMS_TO_TICKS(CONFIG_LOCK_AUDIT_FLUSH_MS * 10);
+    }
+}
+
+esp_err_t
+audit_log_init(void)
+{
+    size_t size;
+    esp_err_t ret;
+
+    ret = lock_hal_part_find(AUDIT_PART_LABEL, &audit_part, &size);
+    if (ret != ESP_OK)
+    {
+        MODLOG_DFLT(ERROR, "no \"%s\" partition\n", AUDIT_PART_LABEL);
+        return ret;
+    }
+    audit_sectors = size / LOCK_HAL_SECTOR_SIZE;
+    if (audit_sectors < 2)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    audit_slots = audit_sectors * AUDIT_SLOTS_PER_SECTOR;
+
+    audit_next = audit_durable = audit_recover();
+    MODLOG_DFLT(INFO, "audit log: next record %u, oldest %u\n",
+                (unsigned)audit_next, (unsigned)audit_oldest(audit_next));
+
+    if (xTaskCreate(audit_task, "auditTask", AUDIT_TASK_STACK, NULL,
+                    AUDIT_TASK_PRIO, &audit_task_handle) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t
+audit_log_append(const ble_addr_t *peer, uint16_t cred_id, uint8_t door,
+                 audit_method_t method, audit_result_t result)
+{
+    audit_rec_t rec;
+    int64_t now = lock_hal_wall_time();
+    bool wake;
+
+    memset(&rec, 0, sizeof rec);
+    if (now >= LOCK_HAL_CLOCK_VALID)
+    {
+        rec.time = now;
+        rec.flags |= AUDIT_F_WALL_CLOCK;
+    }
+    else
+    {
+        rec.time = lock_hal_now_us() / 1000000;
+    }
+    if (peer != NULL)
+    {
+        memcpy(rec.peer, peer->val, sizeof rec.peer);
+        rec.peer_type = peer->type;
+    }
+    rec.cred_id = cred_id;
+    rec.door = door;
+    rec.method = method;
+    rec.result = result;
+
+    portENTER_CRITICAL(&audit_lock);
+    if (audit_next - audit_durable >= AUDIT_STAGE_SIZE)
+    {
+        audit_stats.dropped++;
+        portEXIT_CRITICAL(&audit_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    rec.seq = audit_next;
+    audit_stage[audit_next % AUDIT_STAGE_SIZE] = rec;
+    audit_stage_us[audit_next % AUDIT_STAGE_SIZE] = lock_hal_now_us();
+    audit_next++;
+    audit_stats.appended++;
+    wake = audit_next - audit_durable >= AUDIT_BATCH;
+    portEXIT_CRITICAL(&audit_lock);
+
+    if (wake)
+    {
+        xTaskNotifyGive(audit_task_handle);
+    }
+    return ESP_OK;
+}
+
+int
+audit_log_read(uint32_t *cursor, audit_rec_t *out, int max)
+{
+    uint32_t durable;
+    uint32_t seq = *cursor;
+    int n = 0;
+
+    portENTER_CRITICAL(&audit_lock);
+    durable = audit_durable;
+    portEXIT_CRITICAL(&audit_lock);
+
+    if ((int32_t)(seq - audit_oldest(durable)) < 0)
+    {
+        seq = audit_oldest(durable);
+    }
+    while (n < max && (int32_t)(durable - seq) > 0)
+    {
+        uint32_t slot = seq % audit_slots;
+
+        if (audit_read_slot(slot, &out[n], 1) != ESP_OK)
+        {
+            break;
+        }
+        if (!audit_rec_valid(&out[n], slot) || out[n].seq != seq)
+        {
+            /* Lost to a torn write or a concurrent wrap; skip the sector */
+            seq = (seq / AUDIT_SLOTS_PER_SECTOR + 1) * AUDIT_SLOTS_PER_SECTOR;
+            continue;
+        }
+        seq++;
+        n++;
+    }
+    *cursor = seq;
+    return n;
+}
+
+int
+audit_log_access(uint16_t conn_handle, uint16_t attr_handle,
+                 struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    conn_ctx_t *ctx = conn_ctx_find(conn_handle);
+    uint32_t cursor;
+    uint16_t len;
+    int max;
+    int n;
+
+    if (ctx == NULL)
+    {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+
+    switch (ctxt->op)
+    {
+    case BLE_GATT_ACCESS_OP_WRITE_CHR:
+        if (ble_hs_mbuf_to_flat(ctxt->om, &cursor, sizeof cursor, &len) != 0 ||
+            len != sizeof cursor)
+        {
+            return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        }
+        ctx->audit_cursor = cursor;
+        return 0;
+
+    case BLE_GATT_ACCESS_OP_READ_CHR:
+        /* Stay below a full ATT payload so the client does not issue a read
+         * blob, which would run this callback again and skip records. */
+        max = (ctx->mtu - 2) / (int)sizeof(audit_rec_t);
+        if (max > AUDIT_READ_MAX)
+        {
+            max = AUDIT_READ_MAX;
+        }
+        n = audit_log_read(&ctx->audit_cursor, audit_rbuf, max);
+        if (os_mbuf_append(ctxt->om, audit_rbuf, n * sizeof(audit_rec_t)) != 0)
+        {
+            return BLE_ATT_ERR_INSUFFICIENT_RES;
+        }
+        return 0;
+
+    default:
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+}
+
+void
+audit_log_get_stats(audit_stats_t *out)
+{
+    portENTER_CRITICAL(&audit_lock);
+    *out = audit_stats;
+    portEXIT_CRITICAL(&audit_lock);
+}
@@ -0,0 +1,93 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef AUDIT_LOG_H
+#define AUDIT_LOG_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "host/ble_hs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    AUDIT_RESULT_GRANTED = 0,
+    AUDIT_RESULT_DENIED,
+    AUDIT_RESULT_SCHEDULE,      /* Right PIN, refused by its access policy */
+} audit_result_t;
+
+typedef enum
+{
+    AUDIT_METHOD_PIN = 0,
+    AUDIT_METHOD_TOTP,
+    AUDIT_METHOD_BOND,          /* Resumed bonded session, no code */
+} audit_method_t;
+
+#define AUDIT_F_WALL_CLOCK          0x01    /* time is Unix seconds, else uptime */
+
+/* On-flash and on-air record, little-endian */
+typedef struct
+{
+    uint32_t seq;
+    uint32_t time;
+    uint8_t peer[6];
+    uint8_t peer_type;
+    uint8_t result;
+    uint16_t cred_id;
+    uint8_t method;
+    uint8_t flags;
+    uint8_t door;
+    uint8_t reserved[7];
+    uint32_t crc;                   /* CRC-32 of the preceding bytes */
+} audit_rec_t;
+
+typedef struct
+{
+    uint32_t appended;
+    uint32_t dropped;               /* Staging buffer was full */
+    uint32_t batches;               /* Flash writes */
+    uint32_t erases;
+    uint32_t max_commit_ms;         /* Longest append-to-durable delay */
+} audit_stats_t;
+
+/**
+ * Opens the "audit" partition, finds the write position and starts the
+ * commit task.  Records are staged in RAM and written in batches of
+ * CONFIG_LOCK_AUDIT_BATCH, or after CONFIG_LOCK_AUDIT_FLUSH_MS.  The oldest
+ * sector is erased when the log wraps.
+ */
+esp_err_t audit_log_init(void);
+
+/* Queues a record; never touches flash.  Callable from any task. */
+esp_err_t audit_log_append(const ble_addr_t *peer, uint16_t cred_id, uint8_t door,
+                           audit_method_t method, audit_result_t result);
+
+/**
+ * Copies up to max committed records starting at *cursor, skipping any
+ * that have been overwritten, and advances *cursor past them.
+ *
+ * @return the number of records copied.
+ */
+int audit_log_read(uint32_t *cursor, audit_rec_t *out, int max);
+
+/**
+ * GATT access callback for the audit characteristic.  Writing a 4-byte
+ * sequence number sets the connection's cursor; each read returns the
+ * next whole records that fit in the ATT MTU, or nothing at the end.
+ */
+int audit_log_access(uint16_t conn_handle, uint16_t attr_handle,
+                     struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+void audit_log_get_stats(audit_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
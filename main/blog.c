@@ -0,0 +1,235 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "modlog/modlog.h"
+#include "mem_acct.h"
+#include "blog.h"
+
+/*
+ * Deferred binary logger.
+ *
+ * Callers copy a timestamp, an event id and a few words into a bounded
+ * multi-producer ring; a low-priority task formats the records and writes
+ * them to the console.  Each slot carries a sequence number: a producer
+ * claims a position with a compare-and-swap on the head and publishes the
+ * slot by advancing its sequence, so producers on either core or in an ISR
+ * never wait for one another or for the console.  When the ring is full the
+ * record is counted as dropped instead.
+ *
+ * With CONFIG_LOCK_BLOG_ASYNC off, records are formatted on the spot, which
+ * is how logging behaved before and is useful for comparing the two.
+ */
+#define BLOG_RING_SIZE          CONFIG_LOCK_BLOG_RING_RECORDS
+#define BLOG_RING_MASK          (BLOG_RING_SIZE - 1)
+#define BLOG_TASK_STACK         3072
+#define BLOG_TASK_PRIO          1
+#define BLOG_DRAIN_MS           20
+#define BLOG_LINE_MAX           160
+
+_Static_assert((BLOG_RING_SIZE & BLOG_RING_MASK) == 0,
+               "blog ring size must be a power of two");
+
+/* Layout after seq is what tools/blog_decode.py reads from raw output */
+typedef struct
+{
+    uint32_t seq;
+    uint32_t ts_us;
+    uint16_t id;
+    uint8_t nargs;
+    uint8_t core;
+    uint32_t args[BLOG_MAX_ARGS];
+} blog_slot_t;
+
+#if !CONFIG_LOCK_BLOG_RAW
+static const char *const blog_fmt[] = {
+#define BLOG_EVENT(name, fmt) fmt,
+#include "blog_events.h"
+#undef BLOG_EVENT
+};
+#endif
+
+#if CONFIG_LOCK_BLOG_ASYNC
+static blog_slot_t blog_ring[BLOG_RING_SIZE];
+static uint32_t blog_head;
+static uint32_t blog_tail;
+#endif
+static uint32_t blog_recorded;
+static uint32_t blog_dropped;
+
+static void
+blog_print(const blog_slot_t *r)
+{
+#if CONFIG_LOCK_BLOG_RAW
+    const uint8_t *p = (const uint8_t *)&r->ts_us;
+    char line[2 * (sizeof *r - sizeof r->seq) + 1];
+
+    for (size_t i = 0; i < sizeof *r - sizeof r->seq; i++)
+    {
+        snprintf(&line[2 * i], 3, "%02x", p[i]);
+    }
+    printf("#B %s\n", line);
+#else
+    char line[BLOG_LINE_MAX];
+    const uint32_t *a = r->args;
+
+    if (r->id >= BLOG_EVENT_COUNT)
+    {
+        return;
+    }
+    /* Every format only takes 32-bit arguments; unused ones are ignored */
+    snprintf(line, sizeof line, blog_fmt[r->id], (unsigned)a[0], (unsigned)a[1],
+             (unsigned)a[2], (unsigned)a[3], (unsigned)a[4], (unsigned)a[5]);
+    MODLOG_DFLT(INFO, "[%u.%06u] %s\n", (unsigned)(r->ts_us / 1000000),
+                (unsigned)(r->ts_us % 1000000), line);
+#endif
+}
+
+/* Forced inline so blog_record() keeps running from IRAM with the cache off */
+FORCE_INLINE_ATTR void
+blog_fill(blog_slot_t *r, uint16_t id, const uint32_t *args, uint32_t nargs)
+{
+    if (nargs > BLOG_MAX_ARGS)
+    {
+        nargs = BLOG_MAX_ARGS;
+    }
+    r->ts_us = (uint32_t)esp_timer_get_time();
+    r->id = id;
+    r->nargs = nargs;
+    r->core = esp_cpu_get_core_id();
+    memcpy(r->args, args, nargs * sizeof args[0]);
+    memset(&r->args[nargs], 0, (BLOG_MAX_ARGS - nargs) * sizeof args[0]);
+}
+
+#if CONFIG_LOCK_BLOG_ASYNC
+
+void IRAM_ATTR
+blog_record(uint16_t id, const uint32_t *args, uint32_t nargs)
+{
+    uint32_t pos = __atomic_load_n(&blog_head, __ATOMIC_RELAXED);
+    blog_slot_t *slot;
+
+    for (;;)
+    {
+        slot = &blog_ring[pos & BLOG_RING_MASK];
+        int32_t dif = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+
+        if (dif == 0)
+        {
+            if (__atomic_compare_exchange_n(&blog_head, &pos, pos + 1, false,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if (dif < 0)
+        {
+            /* Still holds a record from the previous lap */
+            __atomic_fetch_add(&blog_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+        {
+            pos = __atomic_load_n(&blog_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    blog_fill(slot, id, args, nargs);
+    __atomic_fetch_add(&blog_recorded, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+static bool
+blog_pop(blog_slot_t *out)
+{
+    blog_slot_t *slot = &blog_ring[blog_tail & BLOG_RING_MASK];
+
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != blog_tail + 1)
+    {
+        return false;
+    }
+    *out = *slot;
+    __atomic_store_n(&slot->seq, blog_tail + BLOG_RING_SIZE, __ATOMIC_RELEASE);
+    blog_tail++;
+    return true;
+}
+
+static void
+blog_task(void *param)
+{
+    uint32_t reported = 0;
+    blog_slot_t r;
+
+    mem_acct_track_task(NULL, BLOG_TASK_STACK);
+    for (;;)
+    {
+        uint32_t dropped;
+
+        while (blog_pop(&r))
+        {
+            blog_print(&r);
+        }
+
+        dropped = __atomic_load_n(&blog_dropped, __ATOMIC_RELAXED);
+        if (dropped != reported)
+        {
+            uint32_t lost = dropped - reported;
+
+            blog_fill(&r, BLOG_DROPPED, &lost, 1);
+            blog_print(&r);
+            reported = dropped;
+        }
+        vTaskDelay(pdMS_TO_TICKS(BLOG_DRAIN_MS));
+    }
+}
+
+esp_err_t
+blog_init(void)
+{
+    for (uint32_t i = 0; i < BLOG_RING_SIZE; i++)
+    {
+        blog_ring[i].seq = i;
+    }
+    if (xTaskCreate(blog_task, "blogTask", BLOG_TASK_STACK, NULL,
+                    BLOG_TASK_PRIO, NULL) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+#else /* !CONFIG_LOCK_BLOG_ASYNC */
+
+void
+blog_record(uint16_t id, const uint32_t *args, uint32_t nargs)
+{
+    blog_slot_t r;
+
+    blog_fill(&r, id, args, nargs);
+    blog_recorded++;
+    blog_print(&r);
+}
+
+esp_err_t
+blog_init(void)
+{
+    return ESP_OK;
+}
+
+#endif /* CONFIG_LOCK_BLOG_ASYNC */
+
+void
+blog_get_stats(blog_stats_t *out)
+{
+    out->recorded = __atomic_load_n(&blog_recorded, __ATOMIC_RELAXED);
+    out->dropped = __atomic_load_n(&blog_dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,55 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef BLOG_H
+#define BLOG_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BLOG_MAX_ARGS               6
+
+typedef enum
+{
+#define BLOG_EVENT(name, fmt) BLOG_##name,
+#include "blog_events.h"
+#undef BLOG_EVENT
+    BLOG_EVENT_COUNT
+} blog_event_t;
+
+typedef struct
+{
+    uint32_t recorded;
+    uint32_t dropped;           /* Records lost to a full ring */
+} blog_stats_t;
+
+/**
+ * Logs an event from blog_events.h with up to BLOG_MAX_ARGS 32-bit
+ * arguments, e.g. BLOG(MTU, conn_handle, cid, mtu).  Safe from any task or
+ * ISR; never blocks.  Formatting happens later on a low-priority task.
+ */
+#define BLOG(name, ...) \
+    blog_record(BLOG_##name, (const uint32_t[]){__VA_ARGS__}, \
+                sizeof((const uint32_t[]){__VA_ARGS__}) / sizeof(uint32_t))
+
+/* Packs a BLE address into two arguments for a "%04x%08x" pair */
+#define BLOG_ADDR(a) \
+    ((uint32_t)(a)[5] << 8 | (a)[4]), \
+    ((uint32_t)(a)[3] << 24 | (uint32_t)(a)[2] << 16 | (uint32_t)(a)[1] << 8 | (a)[0])
+
+esp_err_t blog_init(void);
+void blog_record(uint16_t id, const uint32_t *args, uint32_t nargs);
+void blog_get_stats(blog_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,28 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * Binary log events.  Each entry is BLOG_EVENT(name, format); records carry
+ * up to BLOG_MAX_ARGS 32-bit arguments, so formats may only use 32-bit
+ * conversions (%d, %u, %x).  Event ids are positions in this list: append
+ * new events at the end so tools/blog_decode.py keeps reading old captures.
+ *
+ * No include guard: blog.h and blog.c include this list with different
+ * definitions of BLOG_EVENT.
+ */
+BLOG_EVENT(DROPPED,         "%u records dropped")
+BLOG_EVENT(CONN_ESTAB,      "connection established; handle=%u")
+BLOG_EVENT(CONN_FAILED,     "connection failed; status=%d")
+BLOG_EVENT(CONN_DESC,       "handle=%u peer_ota_addr_type=%u peer_ota_addr=%04x%08x peer_id_addr=%04x%08x")
+BLOG_EVENT(CONN_PARAMS,     "handle=%u conn_itvl=%u conn_latency=%u supervision_timeout=%u sec=0x%x")
+BLOG_EVENT(DISCONNECT,      "disconnect; handle=%u reason=%d")
+BLOG_EVENT(CONN_UPDATE,     "connection updated; handle=%u status=%d")
+BLOG_EVENT(ADV_COMPLETE,    "advertise complete; reason=%d")
+BLOG_EVENT(MTU,             "mtu update event; conn_handle=%u cid=%u mtu=%u")
+BLOG_EVENT(SUBSCRIBE,       "subscribe event; conn_handle=%u attr_handle=%u reason=%u prevn=%u curn=%u curi=%u")
+BLOG_EVENT(GATT_WRITE,      "write event; conn_handle=%u attr_handle=%u len=%u")
+BLOG_EVENT(WELCOME,         "welcome sent; conn_handle=%u time-to-first-notification=%uus avg=%uus max=%uus")
+BLOG_EVENT(BRIDGE_DROP,     "bridge dropped %u bytes for conn_handle=%u rc=%d")
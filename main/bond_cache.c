@@ -0,0 +1,285 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_LOCK_BOND_FAST
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "host/ble_hs.h"
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "conn_ctx.h"
+#include "cred_store.h"
+#include "bond_cache.h"
+
+#define BOND_CACHE_SIZE         CONFIG_LOCK_BOND_CACHE_SIZE
+#define BOND_RESUME_US          ((int64_t)CONFIG_LOCK_BOND_RESUME_S * 1000000)
+
+typedef struct
+{
+    ble_addr_t addr;            /* Identity address */
+    bool in_use;
+    bool session;               /* A PIN session can be resumed */
+    uint16_t mtu;               /* ATT MTU at the last disconnect */
+    uint16_t user;
+    uint8_t doors;
+    int64_t session_us;         /* When the PIN was accepted */
+    uint32_t seen;              /* LRU stamp */
+} bond_entry_t;
+
+static bond_entry_t bond_cache[BOND_CACHE_SIZE];
+static uint32_t bond_clock;
+static bond_stats_t bond_stats;
+/* Entries change on the host task; the accept list is read elsewhere */
+static portMUX_TYPE bond_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *const bond_path_names[BOND_PATHS] = { "new", "bonded", "resumed" };
+
+static bond_entry_t *
+bond_find(const ble_addr_t *addr)
+{
+    for (int i = 0; i < BOND_CACHE_SIZE; i++)
+    {
+        if (bond_cache[i].in_use && ble_addr_cmp(&bond_cache[i].addr, addr) == 0)
+        {
+            return &bond_cache[i];
+        }
+    }
+    return NULL;
+}
+
+/* Finds or makes the entry for addr, evicting the least recently seen,
+ * and marks it as just seen */
+static bond_entry_t *
+bond_touch(const ble_addr_t *addr)
+{
+    bond_entry_t *e = bond_find(addr);
+    bond_entry_t *victim = &bond_cache[0];
+
+    portENTER_CRITICAL(&bond_lock);
+    if (e == NULL)
+    {
+        for (int i = 0; i < BOND_CACHE_SIZE; i++)
+        {
+            bond_entry_t *p = &bond_cache[i];
+
+            if (!p->in_use)
+            {
+                victim = p;
+                break;
+            }
+            if (p->seen < victim->seen)
+            {
+                victim = p;
+            }
+        }
+        if (victim->in_use)
+        {
+            bond_stats.evictions++;
+        }
+        e = victim;
+        memset(e, 0, sizeof *e);
+        e->addr = *addr;
+        e->in_use = true;
+    }
+    e->seen = ++bond_clock;
+    portEXIT_CRITICAL(&bond_lock);
+    return e;
+}
+
+void
+bond_cache_enc_change(conn_ctx_t *ctx, int status)
+{
+    struct ble_gap_conn_desc desc;
+    bond_entry_t *e;
+
+    if (status != 0 || ble_gap_conn_find(ctx->conn_handle, &desc) != 0 ||
+        !desc.sec_state.bonded)
+    {
+        return;
+    }
+
+    /* After a first pairing this is where the identity address shows up */
+    ctx->peer_id_addr = desc.peer_id_addr;
+    ctx->bonded = true;
+    e = bond_touch(&desc.peer_id_addr);
+
+    if (!e->session)
+    {
+        return;
+    }
+    if (BOND_RESUME_US == 0 || lock_hal_now_us() - e->session_us >= BOND_RESUME_US ||
+        !cred_store_live(e->user))
+    {
+        e->session = false;
+        return;
+    }
+    ctx->authed = true;
+    ctx->auth_user = e->user;
+    ctx->auth_method = AUDIT_METHOD_BOND;
+    ctx->auth_doors = e->doors;
+    ctx->resumed = true;
+    bond_stats.resumed++;
+    MODLOG_DFLT(INFO, "conn %d resumed the session of user=%d\n", ctx->conn_handle, e->user);
+}
+
+void
+bond_cache_unlocked(conn_ctx_t *ctx, bool pin)
+{
+    bond_path_t path;
+    bond_entry_t *e;
+    uint32_t ms;
+
+    if (!ctx->unlock_timed)
+    {
+        ctx->unlock_timed = true;
+        path = ctx->resumed ? BOND_PATH_RESUMED : ctx->bonded ? BOND_PATH_BONDED : BOND_PATH_NEW;
+        ms = (lock_hal_now_us() - ctx->connect_us) / 1000;
+        bond_stats.unlocks[path]++;
+        bond_stats.total_ms[path] += ms;
+        if (ms > bond_stats.max_ms[path])
+        {
+            bond_stats.max_ms[path] = ms;
+        }
+        MODLOG_DFLT(INFO, "conn %d unlocked %ums after connect (%s)\n",
+                    ctx->conn_handle, (unsigned)ms, bond_path_str(path));
+    }
+
+    /* Only a PIN starts a session: TOTP codes are meant to be used once */
+    if (ctx->bonded && pin)
+    {
+        e = bond_touch(&ctx->peer_id_addr);
+        e->session = true;
+        e->user = ctx->auth_user;
+        e->doors = ctx->auth_doors;
+        e->session_us = lock_hal_now_us();
+    }
+}
+
+void
+bond_cache_forget(const ble_addr_t *addr)
+{
+    bond_entry_t *e = bond_find(addr);
+
+    if (e != NULL)
+    {
+        portENTER_CRITICAL(&bond_lock);
+        e->in_use = false;
+        portEXIT_CRITICAL(&bond_lock);
+    }
+}
+
+int
+bond_cache_accept_list(ble_addr_t *out, int max)
+{
+    uint32_t below = UINT32_MAX;
+    int n = 0;
+
+    portENTER_CRITICAL(&bond_lock);
+    /* A handful of entries; pick the next most recent each round */
+    while (n < max)
+    {
+        bond_entry_t *best = NULL;
+
+        for (int i = 0; i < BOND_CACHE_SIZE; i++)
+        {
+            bond_entry_t *p = &bond_cache[i];
+
+            if (p->in_use && p->seen < below && (best == NULL || p->seen > best->seen))
+            {
+                best = p;
+            }
+        }
+        if (best == NULL)
+        {
+            break;
+        }
+        out[n++] = best->addr;
+        below = best->seen;
+    }
+    portEXIT_CRITICAL(&bond_lock);
+    return n;
+}
+
+void
+bond_cache_get_stats(bond_stats_t *out)
+{
+    *out = bond_stats;
+}
+
+const char *
+bond_path_str(bond_path_t path)
+{
+    return path < BOND_PATHS ? bond_path_names[path] : "?";
+}
+
+/* A peer the store holds keys for: start encryption now rather than when
+ * it first hits an encrypted attribute, and restore its MTU */
+static void
+bond_on_link(conn_ctx_t *ctx)
+{
+    struct ble_store_key_sec key;
+    struct ble_store_value_sec value;
+    bond_entry_t *e;
+    int rc;
+
+    memset(&key, 0, sizeof key);
+    key.peer_addr = ctx->peer_id_addr;
+    if (ble_store_read_peer_sec(&key, &value) != 0)
+    {
+        /* Not bonded, or a private address the controller did not resolve */
+        return;
+    }
+
+    e = bond_find(&ctx->peer_id_addr);
+    /* The banner would be wasted on a peer about to get its session back */
+    ctx->bond_wait = e != NULL && e->session;
+
+    rc = ble_gap_security_initiate(ctx->conn_handle);
+    if (rc == 0)
+    {
+        bond_stats.early_enc++;
+    }
+    else
+    {
+        MODLOG_DFLT(DEBUG, "conn %d early encryption failed; rc=%d\n", ctx->conn_handle, rc);
+    }
+    if (e != NULL && e->mtu > BLE_ATT_MTU_DFLT)
+    {
+        rc = ble_gattc_exchange_mtu(ctx->conn_handle, NULL, NULL);
+        if (rc != 0)
+        {
+            MODLOG_DFLT(DEBUG, "conn %d MTU exchange failed; rc=%d\n", ctx->conn_handle, rc);
+        }
+    }
+}
+
+static void
+bond_on_disconnect(conn_ctx_t *ctx, int reason)
+{
+    bond_entry_t *e;
+
+    if (ctx->bonded)
+    {
+        e = bond_touch(&ctx->peer_id_addr);
+        e->mtu = ctx->mtu;
+    }
+}
+
+static const conn_ctx_hooks_t bond_hooks = {
+    .on_link = bond_on_link,
+    .on_disconnect = bond_on_disconnect,
+};
+
+esp_err_t
+bond_cache_init(void)
+{
+    return conn_ctx_register_hooks(&bond_hooks);
+}
+
+#endif
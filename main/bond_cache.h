@@ -0,0 +1,93 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef BOND_CACHE_H
+#define BOND_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "host/ble_hs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fast path for bonded peers.
+ *
+ * Recently seen bonded peers are kept in a small RAM table by identity
+ * address, most recent first.  A peer the host store knows as bonded gets
+ * encryption started as soon as the link is up, without waiting for it to
+ * touch an encrypted attribute, and the MTU it used last time is exchanged
+ * at once.  Once the link is encrypted with the bond, a PIN session it
+ * opened within CONFIG_LOCK_BOND_RESUME_S is put back on the connection
+ * (conn_ctx_t.resumed), unless the PIN has been revoked since.
+ *
+ * The table also feeds the advertising accept list (see adv_sched.h) and
+ * keeps connect-to-unlock times per path, so the gain can be measured.
+ * Everything runs on the NimBLE host task, apart from the accept-list
+ * snapshot taken on the deferred-work task.
+ */
+typedef enum
+{
+    BOND_PATH_NEW = 0,          /* Not encrypted with a bond when it unlocked */
+    BOND_PATH_BONDED,           /* Bonded, but entered a code */
+    BOND_PATH_RESUMED,          /* Bonded, unlocked on a resumed session */
+    BOND_PATHS,
+} bond_path_t;
+
+typedef struct
+{
+    uint32_t unlocks[BOND_PATHS];       /* First unlock of a connection */
+    uint32_t total_ms[BOND_PATHS];      /* ... summed time since link up */
+    uint32_t max_ms[BOND_PATHS];
+    uint32_t early_enc;                 /* Encryption started on link up */
+    uint32_t resumed;                   /* Sessions restored */
+    uint32_t evictions;
+} bond_stats_t;
+
+struct conn_ctx;
+
+#if CONFIG_LOCK_BOND_FAST
+
+esp_err_t bond_cache_init(void);
+
+/* From BLE_GAP_EVENT_ENC_CHANGE; sets ctx->bonded and ctx->resumed */
+void bond_cache_enc_change(struct conn_ctx *ctx, int status);
+
+/**
+ * Call after every granted unlock.  Remembers a PIN session of a bonded
+ * peer for resumption, and times the first unlock of the connection.
+ */
+void bond_cache_unlocked(struct conn_ctx *ctx, bool pin);
+
+/* The peer is pairing afresh; its old session is void */
+void bond_cache_forget(const ble_addr_t *addr);
+
+/* Copies up to max remembered bonds, most recent first.  Returns the count. */
+int bond_cache_accept_list(ble_addr_t *out, int max);
+
+void bond_cache_get_stats(bond_stats_t *out);
+
+const char *bond_path_str(bond_path_t path);
+
+#else
+
+static inline esp_err_t bond_cache_init(void) { return ESP_OK; }
+static inline void bond_cache_enc_change(struct conn_ctx *ctx, int status) { }
+static inline void bond_cache_unlocked(struct conn_ctx *ctx, bool pin) { }
+static inline void bond_cache_forget(const ble_addr_t *addr) { }
+static inline int bond_cache_accept_list(ble_addr_t *out, int max) { return 0; }
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
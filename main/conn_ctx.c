@@ -0,0 +1,279 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "conn_ctx.h"
+
+/* Index holds pool position + 1; 0 marks an empty bucket.  Sized to at
+ * least twice the pool so linear probe chains stay short. */
+#define CONN_CTX_HASH_SIZE      ((CONN_CTX_MAX * 2) <= 8  ? 8  : \
+                                 (CONN_CTX_MAX * 2) <= 16 ? 16 : \
+                                 (CONN_CTX_MAX * 2) <= 32 ? 32 : 64)
+#define CONN_CTX_HASH_MASK      (CONN_CTX_HASH_SIZE - 1)
+#define CONN_CTX_MAX_HOOKS      8
+
+_Static_assert(CONN_CTX_MAX * 2 <= 64, "connection index too small");
+
+static conn_ctx_t conn_ctx_pool[CONN_CTX_MAX];
+static uint8_t conn_ctx_free[CONN_CTX_MAX];
+static uint8_t conn_ctx_nfree;
+static uint8_t conn_ctx_index[CONN_CTX_HASH_SIZE];
+static uint8_t conn_ctx_subs[CONN_CTX_MAX];
+static uint8_t conn_ctx_nsubs;
+static portMUX_TYPE conn_ctx_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const conn_ctx_hooks_t *conn_ctx_hooks[CONN_CTX_MAX_HOOKS];
+static int conn_ctx_nhooks;
+
+static inline uint32_t
+conn_ctx_home(uint16_t conn_handle)
+{
+    /* Fibonacci hashing spreads sequential handles across the index */
+    return ((uint32_t)conn_handle * 2654435769u) >> 26 & CONN_CTX_HASH_MASK;
+}
+
+/* Returns the index bucket holding conn_handle, or -1.  Lock held. */
+static int
+conn_ctx_bucket(uint16_t conn_handle)
+{
+    uint32_t b = conn_ctx_home(conn_handle);
+
+    for (int n = 0; n < CONN_CTX_HASH_SIZE; n++)
+    {
+        uint8_t e = conn_ctx_index[b];
+
+        if (e == 0)
+        {
+            return -1;
+        }
+        if (conn_ctx_pool[e - 1].conn_handle == conn_handle)
+        {
+            return b;
+        }
+        b = (b + 1) & CONN_CTX_HASH_MASK;
+    }
+    return -1;
+}
+
+/* Removes bucket i with backward-shift deletion.  Lock held. */
+static void
+conn_ctx_unindex(uint32_t i)
+{
+    uint32_t j = i;
+
+    conn_ctx_index[i] = 0;
+    for (;;)
+    {
+        j = (j + 1) & CONN_CTX_HASH_MASK;
+        if (conn_ctx_index[j] == 0)
+        {
+            return;
+        }
+
+        uint32_t k = conn_ctx_home(conn_ctx_pool[conn_ctx_index[j] - 1].conn_handle);
+        bool stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (stays)
+        {
+            continue;
+        }
+        conn_ctx_index[i] = conn_ctx_index[j];
+        conn_ctx_index[j] = 0;
+        i = j;
+    }
+}
+
+/* Lock held */
+static void
+conn_ctx_set_subscribed(conn_ctx_t *ctx, bool subscribed)
+{
+    if (ctx->subscribed == subscribed)
+    {
+        return;
+    }
+    if (subscribed)
+    {
+        ctx->sub_pos = conn_ctx_nsubs;
+        conn_ctx_subs[conn_ctx_nsubs++] = ctx - conn_ctx_pool;
+    }
+    else
+    {
+        uint8_t last = conn_ctx_subs[--conn_ctx_nsubs];
+
+        conn_ctx_subs[ctx->sub_pos] = last;
+        conn_ctx_pool[last].sub_pos = ctx->sub_pos;
+    }
+    ctx->subscribed = subscribed;
+}
+
+void
+conn_ctx_init(void)
+{
+    for (int i = 0; i < CONN_CTX_MAX; i++)
+    {
+        conn_ctx_free[i] = CONN_CTX_MAX - 1 - i;
+    }
+    conn_ctx_nfree = CONN_CTX_MAX;
+}
+
+esp_err_t
+conn_ctx_register_hooks(const conn_ctx_hooks_t *hooks)
+{
+    if (conn_ctx_nhooks == CONN_CTX_MAX_HOOKS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    conn_ctx_hooks[conn_ctx_nhooks++] = hooks;
+    return ESP_OK;
+}
+
+conn_ctx_t *
+conn_ctx_find(uint16_t conn_handle)
+{
+    conn_ctx_t *ctx = NULL;
+    int b;
+
+    portENTER_CRITICAL(&conn_ctx_lock);
+    b = conn_ctx_bucket(conn_handle);
+    if (b >= 0)
+    {
+        ctx = &conn_ctx_pool[conn_ctx_index[b] - 1];
+    }
+    portEXIT_CRITICAL(&conn_ctx_lock);
+
+    return ctx;
+}
+
+int
+conn_ctx_subscribers(uint16_t *handles, int max)
+{
+    int n;
+
+    portENTER_CRITICAL(&conn_ctx_lock);
+    for (n = 0; n < conn_ctx_nsubs && n < max; n++)
+    {
+        handles[n] = conn_ctx_pool[conn_ctx_subs[n]].conn_handle;
+    }
+    portEXIT_CRITICAL(&conn_ctx_lock);
+
+    return n;
+}
+
+conn_ctx_t *
+conn_ctx_link_established(const struct ble_gap_conn_desc *desc)
+{
+    conn_ctx_t *ctx;
+    uint32_t b;
+
+    portENTER_CRITICAL(&conn_ctx_lock);
+    if (conn_ctx_bucket(desc->conn_handle) >= 0 || conn_ctx_nfree == 0)
+    {
+        portEXIT_CRITICAL(&conn_ctx_lock);
+        MODLOG_DFLT(ERROR, "no connection context for conn_handle=%d\n",
+                    desc->conn_handle);
+        return NULL;
+    }
+
+    ctx = &conn_ctx_pool[conn_ctx_free[--conn_ctx_nfree]];
+    memset(ctx, 0, sizeof *ctx);
+    ctx->conn_handle = desc->conn_handle;
+    ctx->mtu = BLE_ATT_MTU_DFLT;
+    ctx->peer_id_addr = desc->peer_id_addr;
+    ctx->connect_us = lock_hal_now_us();
+    ctx->conn_itvl = desc->conn_itvl;
+
+    b = conn_ctx_home(desc->conn_handle);
+    while (conn_ctx_index[b] != 0)
+    {
+        b = (b + 1) & CONN_CTX_HASH_MASK;
+    }
+    conn_ctx_index[b] = (ctx - conn_ctx_pool) + 1;
+    portEXIT_CRITICAL(&conn_ctx_lock);
+
+    for (int i = 0; i < conn_ctx_nhooks; i++)
+    {
+        if (conn_ctx_hooks[i]->on_link != NULL)
+        {
+            conn_ctx_hooks[i]->on_link(ctx);
+        }
+    }
+    return ctx;
+}
+
+void
+conn_ctx_subscribe(uint16_t conn_handle, bool subscribed)
+{
+    conn_ctx_t *ctx = conn_ctx_find(conn_handle);
+
+    if (ctx == NULL)
+    {
+        return;
+    }
+
+    portENTER_CRITICAL(&conn_ctx_lock);
+    conn_ctx_set_subscribed(ctx, subscribed);
+    portEXIT_CRITICAL(&conn_ctx_lock);
+
+    for (int i = 0; i < conn_ctx_nhooks; i++)
+    {
+        if (conn_ctx_hooks[i]->on_subscribe != NULL)
+        {
+            conn_ctx_hooks[i]->on_subscribe(ctx);
+        }
+    }
+}
+
+void
+conn_ctx_mtu(uint16_t conn_handle, uint16_t mtu)
+{
+    conn_ctx_t *ctx = conn_ctx_find(conn_handle);
+
+    if (ctx == NULL)
+    {
+        return;
+    }
+    ctx->mtu = mtu;
+
+    for (int i = 0; i < conn_ctx_nhooks; i++)
+    {
+        if (conn_ctx_hooks[i]->on_mtu != NULL)
+        {
+            conn_ctx_hooks[i]->on_mtu(ctx);
+        }
+    }
+}
+
+void
+conn_ctx_disconnect(uint16_t conn_handle, int reason)
+{
+    conn_ctx_t *ctx = conn_ctx_find(conn_handle);
+    int b;
+
+    if (ctx == NULL)
+    {
+        return;
+    }
+
+    for (int i = 0; i < conn_ctx_nhooks; i++)
+    {
+        if (conn_ctx_hooks[i]->on_disconnect != NULL)
+        {
+            conn_ctx_hooks[i]->on_disconnect(ctx, reason);
+        }
+    }
+
+    portENTER_CRITICAL(&conn_ctx_lock);
+    conn_ctx_set_subscribed(ctx, false);
+    b = conn_ctx_bucket(conn_handle);
+    if (b >= 0)
+    {
+        conn_ctx_unindex(b);
+    }
+    conn_ctx_free[conn_ctx_nfree++] = ctx - conn_ctx_pool;
+    portEXIT_CRITICAL(&conn_ctx_lock);
+}
@@ -0,0 +1,117 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef CONN_CTX_H
+#define CONN_CTX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "host/ble_hs.h"
+#include "conn_policy.h"
+#include "frame_parser.h"
+#include "audit_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CONN_CTX_MAX                CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#define CONN_CTX_DIAG_TX_DEPTH      4
+
+/**
+ * Per-connection state shared by every subsystem.  Contexts live in a
+ * fixed pool and are found by conn_handle through a small open-addressing
+ * index, so lookup cost does not depend on CONFIG_BT_NIMBLE_MAX_CONNECTIONS.
+ *
+ * Contexts are created and released only from the NimBLE host task.  Other
+ * tasks may read them but must tolerate a context being released under
+ * them; use conn_ctx_subscribers() to take a consistent snapshot.
+ */
+typedef struct conn_ctx
+{
+    uint16_t conn_handle;
+    uint16_t mtu;                   /* Negotiated ATT MTU */
+    bool subscribed;                /* SPP characteristic notifications on */
+    bool welcome_sent;
+    uint8_t sub_pos;                /* Index in the subscriber list */
+    ble_addr_t peer_id_addr;
+    int64_t connect_us;             /* Link establishment time */
+    uint16_t conn_itvl;             /* Current interval, 1.25 ms units */
+
+    /* Connection-parameter policy */
+    conn_policy_t policy;
+    uint8_t policy_timer_gen;       /* Identifies the live policy timer */
+
+    /* UART bridge */
+    bool bridge_pm;                 /* Holds LOCK_PM_UART as a subscriber */
+
+    /* Command protocol */
+    bool binary;                    /* Client sent LOCK_OP_HELLO; no banners */
+    bool authed;                    /* A code was accepted on this link */
+    uint16_t auth_user;             /* ... and whose it was */
+    audit_method_t auth_method;     /* ... and how it was proven */
+    uint8_t auth_doors;             /* Doors that code opens, bit per door */
+
+    /* Bonded fast path, see bond_cache.h */
+    bool bonded;                    /* Encrypted with a stored bond */
+    bool resumed;                   /* Session restored without a code */
+    bool bond_wait;                 /* Banner held until encryption settles */
+    bool unlock_timed;              /* First unlock already measured */
+
+    /* Next audit record to return on the audit characteristic */
+    uint32_t audit_cursor;
+
+#if CONFIG_LOCK_DIAG
+    /* Latency probes */
+    uint32_t diag_write_us;         /* Receipt of the write being handled */
+    uint32_t diag_tx_us[CONN_CTX_DIAG_TX_DEPTH];  /* Notify submit times */
+    uint8_t diag_tx_head;
+    uint8_t diag_tx_tail;
+#endif
+
+    /* Reassembly of data written to the SPP characteristic */
+    frame_parser_t rx;
+} conn_ctx_t;
+
+/**
+ * Lifecycle hooks.  All run on the NimBLE host task after the table has been
+ * updated; on_disconnect runs just before the context is released.  Any
+ * member may be NULL.
+ */
+typedef struct
+{
+    void (*on_link)(conn_ctx_t *ctx);
+    void (*on_subscribe)(conn_ctx_t *ctx);
+    void (*on_mtu)(conn_ctx_t *ctx);
+    void (*on_disconnect)(conn_ctx_t *ctx, int reason);
+} conn_ctx_hooks_t;
+
+void conn_ctx_init(void);
+
+esp_err_t conn_ctx_register_hooks(const conn_ctx_hooks_t *hooks);
+
+/* Looks up the context for conn_handle, or NULL if it is not connected. */
+conn_ctx_t *conn_ctx_find(uint16_t conn_handle);
+
+/**
+ * Copies the handles of subscribed connections into handles.
+ *
+ * @return the number of handles written, at most max.
+ */
+int conn_ctx_subscribers(uint16_t *handles, int max);
+
+/* Event entry points, called from the GAP event handler */
+conn_ctx_t *conn_ctx_link_established(const struct ble_gap_conn_desc *desc);
+void conn_ctx_subscribe(uint16_t conn_handle, bool subscribed);
+void conn_ctx_mtu(uint16_t conn_handle, uint16_t mtu);
+void conn_ctx_disconnect(uint16_t conn_handle, int reason);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <string.h>
+#include "conn_policy.h"
+
+/* Asks for the parameters of the wanted level unless that would be
+ * pointless: a request is already in flight (the completion resends), the
+ * peer refused this very level last time or keeps refusing, or the link
+ * is already there. */
+static uint8_t
+policy_request(conn_policy_t *p, const conn_policy_cfg_t *cfg)
+{
+    if (p->pending || p->rejects >= cfg->max_rejects || p->applied == p->level ||
+        (p->rejects > 0 && p->requested == p->level))
+    {
+        return 0;
+    }
+    p->pending = true;
+    p->requested = p->level;
+    return CONN_POLICY_ACT_PARAMS;
+}
+
+static void
+policy_enter(conn_policy_t *p, uint8_t level)
+{
+    if (p->level != level)
+    {
+        p->level = level;
+        p->transitions++;
+    }
+}
+
+uint8_t
+conn_policy_step(conn_policy_t *p, const conn_policy_cfg_t *cfg,
+                 conn_policy_ev_t ev, uint32_t now_ms)
+{
+    uint8_t act = 0;
+    uint32_t idle;
+    uint32_t deadline;
+
+    switch (ev)
+    {
+    case CONN_POLICY_EV_CONNECT:
+        memset(p, 0, sizeof *p);
+        p->active_ms = now_ms;
+        policy_enter(p, CONN_POLICY_FAST);
+        act = CONN_POLICY_ACT_PHY | CONN_POLICY_ACT_DATA_LEN;
+        break;
+
+    case CONN_POLICY_EV_ACTIVITY:
+        /* The common case, a write on a fast link, costs one store */
+        p->active_ms = now_ms;
+        policy_enter(p, CONN_POLICY_FAST);
+        break;
+
+    case CONN_POLICY_EV_TIMER:
+        p->timer_armed = false;
+        idle = now_ms - p->active_ms;
+        if (p->level == CONN_POLICY_FAST && idle >= cfg->fast_idle_ms)
+        {
+            policy_enter(p, CONN_POLICY_NORMAL);
+        }
+        if (p->level == CONN_POLICY_NORMAL && idle >= cfg->relax_idle_ms)
+        {
+            policy_enter(p, CONN_POLICY_RELAXED);
+        }
+        break;
+
+    case CONN_POLICY_EV_UPDATED:
+        if (p->pending)
+        {
+            p->applied = p->requested;
+        }
+        else
+        {
+            /* The central changed the parameters on its own */
+            p->applied = CONN_POLICY_NONE;
+        }
+        p->pending = false;
+        p->rejects = 0;
+        break;
+
+    case CONN_POLICY_EV_REJECTED:
+        /* policy_request() will not ask for the refused level again */
+        p->pending = false;
+        p->rejects++;
+        break;
+    }
+
+    if (p->level == CONN_POLICY_NONE)
+    {
+        return act;
+    }
+    act |= policy_request(p, cfg);
+
+    /* One timer at a time; a later deadline than the armed one is picked
+     * up when that one fires */
+    if (p->level == CONN_POLICY_FAST)
+    {
+        deadline = p->active_ms + cfg->fast_idle_ms;
+    }
+    else if (p->level == CONN_POLICY_NORMAL)
+    {
+        deadline = p->active_ms + cfg->relax_idle_ms;
+    }
+    else
+    {
+        return act;
+    }
+    if (!p->timer_armed || (int32_t)(deadline - p->timer_ms) < 0)
+    {
+        p->timer_armed = true;
+        p->timer_ms = deadline;
+        act |= CONN_POLICY_ACT_ARM;
+    }
+    return act;
+}
+
+const char *
+conn_policy_level_str(uint8_t level)
+{
+    switch (level)
+    {
+    case CONN_POLICY_FAST:
+        return "fast";
+    case CONN_POLICY_NORMAL:
+        return "normal";
+    case CONN_POLICY_RELAXED:
+        return "relaxed";
+    default:
+        return "none";
+    }
+}
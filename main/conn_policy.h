@@ -0,0 +1,97 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef CONN_POLICY_H
+#define CONN_POLICY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Connection-parameter policy.
+ *
+ * Every link starts FAST: short interval, data length extension and, where
+ * the controller has it, the 2M PHY.  Each write from the client (an
+ * unlock exchange, a command) puts it back to FAST.  After fast_idle_ms
+ * without activity the link steps down to NORMAL, and after relax_idle_ms
+ * to RELAXED, which lets the central sleep through most events.
+ *
+ * conn_policy_step() is the whole decision logic.  It touches nothing but
+ * the state it is given, so it can be driven from a host test; the NimBLE
+ * side lives in conn_policy_ble.c.
+ */
+typedef enum
+{
+    CONN_POLICY_NONE = 0,       /* Not connected */
+    CONN_POLICY_FAST,
+    CONN_POLICY_NORMAL,
+    CONN_POLICY_RELAXED,
+    CONN_POLICY_LEVELS,
+} conn_policy_level_t;
+
+typedef enum
+{
+    CONN_POLICY_EV_CONNECT = 0,
+    CONN_POLICY_EV_ACTIVITY,    /* The client wrote something */
+    CONN_POLICY_EV_TIMER,       /* The deadline in timer_ms has passed */
+    CONN_POLICY_EV_UPDATED,     /* Parameter update procedure completed */
+    CONN_POLICY_EV_REJECTED,    /* Update refused, by the stack or the peer */
+} conn_policy_ev_t;
+
+/* Actions returned by conn_policy_step() */
+#define CONN_POLICY_ACT_PARAMS      0x01    /* Request the parameters of level */
+#define CONN_POLICY_ACT_PHY         0x02    /* Ask for the 2M PHY */
+#define CONN_POLICY_ACT_DATA_LEN    0x04    /* Ask for the largest data length */
+#define CONN_POLICY_ACT_ARM         0x08    /* Arm a timer for timer_ms */
+
+typedef struct
+{
+    uint32_t fast_idle_ms;      /* FAST -> NORMAL after this long idle */
+    uint32_t relax_idle_ms;     /* NORMAL -> RELAXED after this long idle */
+    uint8_t max_rejects;        /* Stop asking after this many refusals in a row */
+} conn_policy_cfg_t;
+
+typedef struct
+{
+    uint8_t level;              /* conn_policy_level_t wanted */
+    uint8_t requested;          /* Level of the last request sent */
+    uint8_t applied;            /* Level the link last confirmed */
+    bool pending;               /* A request is in flight */
+    bool timer_armed;
+    uint8_t rejects;            /* Refusals in a row */
+    uint16_t transitions;       /* Level changes since connect */
+    uint32_t active_ms;         /* Last activity */
+    uint32_t timer_ms;          /* Deadline of the armed timer */
+} conn_policy_t;
+
+/**
+ * Feeds one event to the state machine at time now_ms (any monotonic
+ * millisecond clock; wrap-around is handled).
+ *
+ * @return a mask of CONN_POLICY_ACT_* for the caller to carry out.
+ */
+uint8_t conn_policy_step(conn_policy_t *p, const conn_policy_cfg_t *cfg,
+                         conn_policy_ev_t ev, uint32_t now_ms);
+
+const char *conn_policy_level_str(uint8_t level);
+
+struct conn_ctx;
+
+/* NimBLE side, see conn_policy_ble.c */
+esp_err_t conn_policy_init(void);
+void conn_policy_activity(struct conn_ctx *ctx);
+void conn_policy_conn_update(uint16_t conn_handle, int status, uint16_t conn_itvl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
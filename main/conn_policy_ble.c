@@ -0,0 +1,212 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "host/ble_hs.h"
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "conn_ctx.h"
+#include "defer.h"
+#include "lock_pm.h"
+#include "conn_policy.h"
+
+/* Largest LL payload and its airtime on the 1M PHY */
+#define POLICY_DATA_LEN_OCTETS      251
+#define POLICY_DATA_LEN_TIME_US     2120
+
+/* Intervals in 1.25 ms units, timeouts in 10 ms units */
+#define POLICY_ITVL(ms)             ((ms) * 4 / 5)
+#define POLICY_TIMEOUT(ms)          ((ms) / 10)
+
+/*
+ * Within what common centrals accept: a max interval at least 15 ms above
+ * the min, interval * (latency + 1) no more than 2 s and a supervision
+ * timeout of at least three times that.
+ */
+static const struct ble_gap_upd_params policy_params[CONN_POLICY_LEVELS] = {
+    [CONN_POLICY_FAST] = {
+        .itvl_min = POLICY_ITVL(CONFIG_LOCK_POLICY_FAST_ITVL_MS),
+        .itvl_max = POLICY_ITVL(CONFIG_LOCK_POLICY_FAST_ITVL_MS + 15),
+        .latency = 0,
+        .supervision_timeout = POLICY_TIMEOUT(4000),
+    },
+    [CONN_POLICY_NORMAL] = {
+        .itvl_min = POLICY_ITVL(60),
+        .itvl_max = POLICY_ITVL(75),
+        .latency = 0,
+        .supervision_timeout = POLICY_TIMEOUT(4000),
+    },
+    [CONN_POLICY_RELAXED] = {
+        .itvl_min = POLICY_ITVL(300),
+        .itvl_max = POLICY_ITVL(315),
+        .latency = 4,
+        .supervision_timeout = POLICY_TIMEOUT(6000),
+    },
+};
+
+static const conn_policy_cfg_t policy_cfg = {
+    .fast_idle_ms = CONFIG_LOCK_POLICY_IDLE_MS,
+    .relax_idle_ms = CONFIG_LOCK_POLICY_RELAX_MS,
+    .max_rejects = 3,
+};
+
+_Static_assert(CONFIG_LOCK_POLICY_RELAX_MS > CONFIG_LOCK_POLICY_IDLE_MS,
+               "relaxed step must come after the normal one");
+
+/* The host task and the deferred-work task both step the machine */
+static portMUX_TYPE policy_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void policy_timer_job(uint16_t conn_handle, void *arg);
+
+/* A FAST link is one the client is talking on; keep the CPU at full speed
+ * for it.  Called with the old and new level of a link. */
+static void
+policy_pm(uint8_t before, uint8_t level)
+{
+    if (before != CONN_POLICY_FAST && level == CONN_POLICY_FAST)
+    {
+        lock_pm_acquire(LOCK_PM_BLE);
+    }
+    else if (before == CONN_POLICY_FAST && level != CONN_POLICY_FAST)
+    {
+        lock_pm_release(LOCK_PM_BLE);
+    }
+}
+
+static uint32_t
+policy_now_ms(void)
+{
+    return lock_hal_now_us() / 1000;
+}
+
+static void
+policy_run(conn_ctx_t *ctx, conn_policy_ev_t ev)
+{
+    uint16_t conn_handle = ctx->conn_handle;
+    uint32_t now = policy_now_ms();
+    uint8_t before;
+    uint8_t level;
+    uint8_t act;
+    uint32_t delay = 0;
+    uint8_t gen = 0;
+    int rc;
+
+    portENTER_CRITICAL(&policy_lock);
+    before = ctx->policy.level;
+    act = conn_policy_step(&ctx->policy, &policy_cfg, ev, now);
+    level = ctx->policy.level;
+    if (act & CONN_POLICY_ACT_ARM)
+    {
+        /* Older timers see a stale generation and do nothing */
+        gen = ++ctx->policy_timer_gen;
+        delay = ctx->policy.timer_ms - now;
+    }
+    portEXIT_CRITICAL(&policy_lock);
+
+    if (level != before)
+    {
+        policy_pm(before, level);
+        MODLOG_DFLT(INFO, "conn %d policy %s -> %s\n", conn_handle,
+                    conn_policy_level_str(before), conn_policy_level_str(level));
+    }
+    if (act & CONN_POLICY_ACT_DATA_LEN)
+    {
+        rc = ble_gap_set_data_len(conn_handle, POLICY_DATA_LEN_OCTETS,
+                                  POLICY_DATA_LEN_TIME_US);
+        if (rc != 0)
+        {
+            MODLOG_DFLT(DEBUG, "data length request failed; rc=%d\n", rc);
+        }
+    }
+#if CONFIG_BT_NIMBLE_LL_CFG_FEAT_LE_2M_PHY
+    if (act & CONN_POLICY_ACT_PHY)
+    {
+        rc = ble_gap_set_prefered_le_phy(conn_handle, BLE_GAP_LE_PHY_2M_MASK,
+                                         BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_CODED_ANY);
+        if (rc != 0)
+        {
+            MODLOG_DFLT(DEBUG, "PHY request failed; rc=%d\n", rc);
+        }
+    }
+#endif
+    if (act & CONN_POLICY_ACT_ARM)
+    {
+        defer_submit(conn_handle, delay, policy_timer_job, (void *)(uintptr_t)gen);
+    }
+    if (act & CONN_POLICY_ACT_PARAMS)
+    {
+        rc = ble_gap_update_params(conn_handle, &policy_params[level]);
+        if (rc != 0)
+        {
+            MODLOG_DFLT(DEBUG, "conn %d update to %s refused locally; rc=%d\n",
+                        conn_handle, conn_policy_level_str(level), rc);
+            /* Cannot ask again: the level is the one just refused */
+            policy_run(ctx, CONN_POLICY_EV_REJECTED);
+        }
+    }
+}
+
+static void
+policy_timer_job(uint16_t conn_handle, void *arg)
+{
+    conn_ctx_t *ctx = conn_ctx_find(conn_handle);
+
+    if (ctx != NULL && ctx->policy_timer_gen == (uint8_t)(uintptr_t)arg)
+    {
+        policy_run(ctx, CONN_POLICY_EV_TIMER);
+    }
+}
+
+void
+conn_policy_activity(conn_ctx_t *ctx)
+{
+    policy_run(ctx, CONN_POLICY_EV_ACTIVITY);
+}
+
+void
+conn_policy_conn_update(uint16_t conn_handle, int status, uint16_t conn_itvl)
+{
+    conn_ctx_t *ctx = conn_ctx_find(conn_handle);
+
+    if (ctx != NULL)
+    {
+        if (status == 0)
+        {
+            ctx->conn_itvl = conn_itvl;
+        }
+        policy_run(ctx, status == 0 ? CONN_POLICY_EV_UPDATED : CONN_POLICY_EV_REJECTED);
+    }
+}
+
+static void
+policy_on_link(conn_ctx_t *ctx)
+{
+    policy_run(ctx, CONN_POLICY_EV_CONNECT);
+}
+
+static void
+policy_on_disconnect(conn_ctx_t *ctx, int reason)
+{
+    uint8_t before;
+
+    /* A policy job that slips past the disconnect sees NONE and stops */
+    portENTER_CRITICAL(&policy_lock);
+    before = ctx->policy.level;
+    ctx->policy.level = CONN_POLICY_NONE;
+    portEXIT_CRITICAL(&policy_lock);
+    policy_pm(before, CONN_POLICY_NONE);
+}
+
+static const conn_ctx_hooks_t policy_hooks = {
+    .on_link = policy_on_link,
+    .on_disconnect = policy_on_disconnect,
+};
+
+esp_err_t
+conn_policy_init(void)
+{
+    return conn_ctx_register_hooks(&policy_hooks);
+}
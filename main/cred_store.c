@@ -0,0 +1,830 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "mbedtls/sha256.h"
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "cred_store.h"
+
+/*
+ * Credential store.
+ *
+ * Each PIN is one 32-byte record in the "creds" partition holding a random
+ * salt, HMAC-SHA256(device secret, salt || PIN) and the mask of doors the
+ * PIN opens.  Records are appended
+ * to a sector in order; revoking one clears its state byte in place, so
+ * adding or revoking a user writes only that user's record.  One sector is
+ * always kept erased so the sector with the most revoked records can be
+ * compacted into it when the store runs out of room.  Compaction marks each
+ * record moved before writing its copy, so after a reset at any point
+ * every user has one record cred_load() can take as the live one, and the
+ * load finishes the move.
+ *
+ * A RAM index maps a 16-bit keyed tag of the PIN to its record slot, so a
+ * lookup is one probe sequence plus one flash read whatever the user count.
+ * The index is built at init from a sequential scan of the partition, while
+ * nothing else runs yet, rather than on the first unlock on the host task.
+ *
+ * cred_mutex guards the index and the user table, which lookups read.
+ * Adding and revoking also hold cred_edit_mutex across their flash writes,
+ * a compaction included, and take cred_mutex only to change the index, so
+ * an unlock never waits for a sector to be copied or erased.
+ */
+#define CRED_PART_LABEL         "creds"
+#define CRED_NVS_NS             "cred"
+#define CRED_NVS_SECRET         "secret"
+#define CRED_SECRET_LEN         16
+#define CRED_SALT_LEN           8
+#define CRED_HASH_LEN           16
+
+#define CRED_MAX_USERS          CONFIG_LOCK_CRED_MAX_USERS
+#define CRED_REC_SIZE           32
+#define CRED_SLOTS_PER_SECTOR   (LOCK_HAL_SECTOR_SIZE / CRED_REC_SIZE)
+/* Enough sectors for every user plus the erased spare */
+#define CRED_SECTORS            ((CRED_MAX_USERS + CRED_SLOTS_PER_SECTOR - 1) / \
+                                 CRED_SLOTS_PER_SECTOR + 1)
+#define CRED_READ_BATCH         16
+
+/* Index of the next power of two at or above 1.5x the user count */
+#define CRED_SMEAR(v)           ((v) | (v) >> 1 | (v) >> 2 | (v) >> 3 | (v) >> 4 | \
+                                 (v) >> 5 | (v) >> 6 | (v) >> 7 | (v) >> 8 | \
+                                 (v) >> 9 | (v) >> 10 | (v) >> 11 | (v) >> 12 | \
+                                 (v) >> 13 | (v) >> 14 | (v) >> 15)
+#define CRED_INDEX_SIZE         (CRED_SMEAR(CRED_MAX_USERS + CRED_MAX_USERS / 2 - 1) + 1)
+#define CRED_INDEX_MASK         (CRED_INDEX_SIZE - 1)
+/* Static DRAM the index and user table may take; enough for 10000 users */
+#define CRED_RAM_BUDGET         (96 * 1024)
+
+#define CRED_STATE_EMPTY        0xFF
+#define CRED_STATE_VALID        0xFE
+#define CRED_STATE_MOVED        0xFC    /* Valid, copy being written elsewhere */
+#define CRED_STATE_REVOKED      0x00
+
+_Static_assert(CRED_MAX_USERS < 0x8000, "credential index limited to 16 bits");
+_Static_assert(CRED_INDEX_SIZE * 4 + CRED_MAX_USERS * 2 <= CRED_RAM_BUDGET,
+               "credential index too large for static DRAM");
+
+typedef struct
+{
+    uint8_t state;
+    uint8_t doors;                  /* Bit per door; 0xFF on records from before doors */
+    uint16_t user_id;
+    uint32_t tag;                   /* Keyed hash of the PIN alone */
+    uint8_t salt[CRED_SALT_LEN];
+    uint8_t hash[CRED_HASH_LEN];
+} cred_rec_t;
+
+_Static_assert(sizeof(cred_rec_t) == CRED_REC_SIZE, "credential record layout");
+
+/* Slot holds record slot + 1; 0 marks an empty bucket */
+typedef struct
+{
+    uint16_t tag;
+    uint16_t slot;
+} cred_bucket_t;
+
+static lock_hal_part_t cred_part;
+static SemaphoreHandle_t cred_mutex;
+static SemaphoreHandle_t cred_edit_mutex;
+static uint8_t cred_ipad[64];
+static uint8_t cred_opad[64];
+
+static cred_bucket_t cred_index[CRED_INDEX_SIZE];
+static uint16_t cred_user_slot[CRED_MAX_USERS];     /* Slot + 1, or 0 */
+static uint16_t cred_count;
+/* Edit mutex */
+static uint8_t cred_sector_used[CRED_SECTORS];      /* Slots written */
+static uint8_t cred_sector_live[CRED_SECTORS];      /* Slots still valid */
+static cred_rec_t cred_batch[CRED_READ_BATCH];
+
+/* HMAC-SHA256 keyed with the device secret over prefix || msg */
+static void
+cred_hmac(const uint8_t *prefix, size_t prefix_len, const void *msg, size_t len,
+          uint8_t out[32])
+{
+    mbedtls_sha256_context sha;
+
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    mbedtls_sha256_update(&sha, cred_ipad, sizeof cred_ipad);
+    mbedtls_sha256_update(&sha, prefix, prefix_len);
+    mbedtls_sha256_update(&sha, msg, len);
+    mbedtls_sha256_finish(&sha, out);
+
+    mbedtls_sha256_starts(&sha, 0);
+    mbedtls_sha256_update(&sha, cred_opad, sizeof cred_opad);
+    mbedtls_sha256_update(&sha, out, 32);
+    mbedtls_sha256_finish(&sha, out);
+    mbedtls_sha256_free(&sha);
+}
+
+static bool
+cred_equal(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    uint8_t diff = 0;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+static esp_err_t
+cred_read(uint32_t slot, cred_rec_t *rec, size_t n)
+{
+    return lock_hal_part_read(cred_part, slot * CRED_REC_SIZE, rec, n * CRED_REC_SIZE);
+}
+
+static esp_err_t
+cred_set_state(uint32_t slot, uint8_t state)
+{
+    return lock_hal_part_write(cred_part, slot * CRED_REC_SIZE, &state, 1);
+}
+
+/* Writes the body first and the state byte last, so a torn write never
+ * leaves a record that looks valid. */
+static esp_err_t
+cred_write(uint32_t slot, const cred_rec_t *rec)
+{
+    cred_rec_t body = *rec;
+    esp_err_t ret;
+
+    body.state = CRED_STATE_EMPTY;
+    ret = lock_hal_part_write(cred_part, slot * CRED_REC_SIZE, &body, sizeof body);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    return cred_set_state(slot, rec->state);
+}
+
+static inline uint32_t
+cred_home(uint16_t tag)
+{
+    return tag & CRED_INDEX_MASK;
+}
+
+static void
+cred_index_insert(uint16_t tag, uint32_t slot)
+{
+    uint32_t b = cred_home(tag);
+
+    while (cred_index[b].slot != 0)
+    {
+        b = (b + 1) & CRED_INDEX_MASK;
+    }
+    cred_index[b].tag = tag;
+    cred_index[b].slot = slot + 1;
+}
+
+static int
+cred_index_bucket(uint16_t tag, uint32_t slot)
+{
+    uint32_t b = cred_home(tag);
+
+    while (cred_index[b].slot != 0)
+    {
+        if (cred_index[b].slot == slot + 1)
+        {
+            return b;
+        }
+        b = (b + 1) & CRED_INDEX_MASK;
+    }
+    return -1;
+}
+
+/* Backward-shift deletion keeps probe chains free of tombstones */
+static void
+cred_index_remove(uint32_t i)
+{
+    uint32_t j = i;
+
+    cred_index[i].slot = 0;
+    for (;;)
+    {
+        j = (j + 1) & CRED_INDEX_MASK;
+        if (cred_index[j].slot == 0)
+        {
+            return;
+        }
+
+        uint32_t k = cred_home(cred_index[j].tag);
+        bool stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (stays)
+        {
+            continue;
+        }
+        cred_index[i] = cred_index[j];
+        cred_index[j].slot = 0;
+        i = j;
+    }
+}
+
+static bool
+cred_rec_blank(const cred_rec_t *rec)
+{
+    const uint8_t *p = (const uint8_t *)rec;
+
+    for (size_t i = 0; i < sizeof *rec; i++)
+    {
+        if (p[i] != 0xFF)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool
+cred_rec_live(const cred_rec_t *rec)
+{
+    return (rec->state == CRED_STATE_VALID || rec->state == CRED_STATE_MOVED) &&
+           rec->user_id < CRED_MAX_USERS;
+}
+
+/*
+ * Copies the live records of one sector to the end of another, then erases
+ * it.  Each record is marked moved before its copy is written, and the
+ * copy goes in valid, so a reset part way through leaves every user either
+ * its moved original alone or that and a valid copy, which cred_load()
+ * tells apart.  Edit mutex held.
+ */
+static esp_err_t
+cred_move(int victim, int spare)
+{
+    esp_err_t ret;
+
+    for (uint32_t i = 0; i < cred_sector_used[victim]; i++)
+    {
+        uint32_t from = victim * CRED_SLOTS_PER_SECTOR + i;
+        uint32_t to;
+        cred_rec_t rec;
+        int b;
+
+        ret = cred_read(from, &rec, 1);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+        if (!cred_rec_live(&rec) || cred_user_slot[rec.user_id] != from + 1)
+        {
+            continue;
+        }
+        if (cred_sector_used[spare] == CRED_SLOTS_PER_SECTOR)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        if (rec.state == CRED_STATE_VALID)
+        {
+            ret = cred_set_state(from, CRED_STATE_MOVED);
+            if (ret != ESP_OK)
+            {
+                return ret;
+            }
+        }
+        to = spare * CRED_SLOTS_PER_SECTOR + cred_sector_used[spare];
+        rec.state = CRED_STATE_VALID;
+        ret = cred_write(to, &rec);
+        cred_sector_used[spare]++;
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+        cred_sector_live[spare]++;
+
+        xSemaphoreTake(cred_mutex, portMAX_DELAY);
+        b = cred_index_bucket(rec.tag >> 16, from);
+        if (b >= 0)
+        {
+            cred_index[b].slot = to + 1;
+        }
+        cred_user_slot[rec.user_id] = to + 1;
+        xSemaphoreGive(cred_mutex);
+    }
+
+    ret = lock_hal_part_erase(cred_part, victim * LOCK_HAL_SECTOR_SIZE, LOCK_HAL_SECTOR_SIZE);
+    if (ret == ESP_OK)
+    {
+        cred_sector_used[victim] = 0;
+        cred_sector_live[victim] = 0;
+    }
+    return ret;
+}
+
+/*
+ * Finishes a compaction a reset cut short.  The moved records with no
+ * valid copy are still the live ones; they go to the sector with the least
+ * room that takes them all, which is the one the copies were going to.
+ */
+static esp_err_t
+cred_finish_move(int victim)
+{
+    int spare = -1;
+
+    for (uint32_t i = 0; i < cred_sector_used[victim]; i++)
+    {
+        uint32_t slot = victim * CRED_SLOTS_PER_SECTOR + i;
+        cred_rec_t rec;
+        esp_err_t ret = cred_read(slot, &rec, 1);
+
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+        if (rec.state != CRED_STATE_MOVED || rec.user_id >= CRED_MAX_USERS ||
+            cred_user_slot[rec.user_id] != 0)
+        {
+            continue;
+        }
+        cred_index_insert(rec.tag >> 16, slot);
+        cred_user_slot[rec.user_id] = slot + 1;
+        cred_count++;
+        cred_sector_live[victim]++;
+    }
+
+    for (int s = 0; s < CRED_SECTORS; s++)
+    {
+        uint32_t room = CRED_SLOTS_PER_SECTOR - cred_sector_used[s];
+
+        if (s != victim && room >= cred_sector_live[victim] &&
+            (spare < 0 || room < CRED_SLOTS_PER_SECTOR - cred_sector_used[spare]))
+        {
+            spare = s;
+        }
+    }
+    if (spare < 0)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    MODLOG_DFLT(WARN, "credential store: finishing the move of sector %d\n", victim);
+    return cred_move(victim, spare);
+}
+
+/* Builds the RAM index.  Only from cred_store_init(). */
+static esp_err_t
+cred_load(void)
+{
+    int64_t start = lock_hal_now_us();
+    int moving = -1;
+    esp_err_t ret;
+
+    memset(cred_index, 0, sizeof cred_index);
+    memset(cred_user_slot, 0, sizeof cred_user_slot);
+    cred_count = 0;
+
+    for (uint32_t s = 0; s < CRED_SECTORS; s++)
+    {
+        uint32_t used = 0;
+        uint32_t live = 0;
+        bool end = false;
+        bool torn = false;
+
+        for (uint32_t i = 0; i < CRED_SLOTS_PER_SECTOR && !torn; i += CRED_READ_BATCH)
+        {
+            uint32_t base = s * CRED_SLOTS_PER_SECTOR + i;
+
+            ret = cred_read(base, cred_batch, CRED_READ_BATCH);
+            if (ret != ESP_OK)
+            {
+                return ret;
+            }
+            for (uint32_t n = 0; n < CRED_READ_BATCH; n++)
+            {
+                const cred_rec_t *rec = &cred_batch[n];
+
+                if (cred_rec_blank(rec))
+                {
+                    /* Records are appended in order */
+                    end = true;
+                    continue;
+                }
+                if (end)
+                {
+                    /* Written past a blank slot: an erase was cut short */
+                    torn = true;
+                    break;
+                }
+                used = i + n + 1;
+                if (rec->state == CRED_STATE_MOVED)
+                {
+                    /* Taken once every valid record is known */
+                    moving = s;
+                    continue;
+                }
+                if (rec->state != CRED_STATE_VALID || rec->user_id >= CRED_MAX_USERS)
+                {
+                    continue;
+                }
+                if (cred_user_slot[rec->user_id] != 0)
+                {
+                    /* Left behind by a compaction from before moved records */
+                    cred_set_state(base + n, CRED_STATE_REVOKED);
+                    continue;
+                }
+                cred_index_insert(rec->tag >> 16, base + n);
+                cred_user_slot[rec->user_id] = base + n + 1;
+                cred_count++;
+                live++;
+            }
+        }
+        /* Nothing is appended to a torn sector; one holding no user is
+         * erased again */
+        cred_sector_used[s] = torn ? CRED_SLOTS_PER_SECTOR : used;
+        cred_sector_live[s] = live;
+        if (torn && live == 0 && moving != (int)s)
+        {
+            ret = lock_hal_part_erase(cred_part, s * LOCK_HAL_SECTOR_SIZE,
+                                      LOCK_HAL_SECTOR_SIZE);
+            if (ret != ESP_OK)
+            {
+                return ret;
+            }
+            cred_sector_used[s] = 0;
+        }
+    }
+
+    if (moving >= 0)
+    {
+        ret = cred_finish_move(moving);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+
+    MODLOG_DFLT(INFO, "credential store: %d users, index %d bytes, loaded in %lldus\n",
+                cred_count, (int)cred_store_ram(),
+                (long long)(lock_hal_now_us() - start));
+    return ESP_OK;
+}
+
+/* Moves the live records of the emptiest full sector into the spare one.
+ * Edit mutex held. */
+static esp_err_t
+cred_compact(void)
+{
+    int spare = -1;
+    int victim = -1;
+
+    for (int s = 0; s < CRED_SECTORS; s++)
+    {
+        if (cred_sector_used[s] == 0)
+        {
+            spare = s;
+        }
+        else if (cred_sector_live[s] < cred_sector_used[s] &&
+                 (victim < 0 || cred_sector_live[s] < cred_sector_live[victim]))
+        {
+            victim = s;
+        }
+    }
+    if (spare < 0 || victim < 0)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return cred_move(victim, spare);
+}
+
+/* Returns a free slot, or -1 if the store is full.  Edit mutex held. */
+static int
+cred_alloc_slot(void)
+{
+    for (int pass = 0; pass < 2; pass++)
+    {
+        int empty = -1;
+        int nempty = 0;
+
+        for (int s = 0; s < CRED_SECTORS; s++)
+        {
+            if (cred_sector_used[s] == 0)
+            {
+                empty = empty < 0 ? s : empty;
+                nempty++;
+            }
+            else if (cred_sector_used[s] < CRED_SLOTS_PER_SECTOR)
+            {
+                return s * CRED_SLOTS_PER_SECTOR + cred_sector_used[s];
+            }
+        }
+        if (nempty > 1)
+        {
+            return empty * CRED_SLOTS_PER_SECTOR;
+        }
+        if (pass == 0 && cred_compact() != ESP_OK)
+        {
+            break;
+        }
+    }
+    return -1;
+}
+
+/* Either mutex held */
+static bool
+cred_check_slot(uint32_t slot, uint32_t tag, const char *pin, size_t len,
+                uint16_t *user_id, uint8_t *doors)
+{
+    cred_rec_t rec;
+    uint8_t mac[32];
+
+    if (cred_read(slot, &rec, 1) != ESP_OK)
+    {
+        return false;
+    }
+    cred_hmac(rec.salt, sizeof rec.salt, pin, len, mac);
+    if (!cred_rec_live(&rec) || rec.tag != tag ||
+        !cred_equal(mac, rec.hash, sizeof rec.hash))
+    {
+        return false;
+    }
+    *user_id = rec.user_id;
+    *doors = rec.doors;
+    return true;
+}
+
+/* Either mutex held */
+static esp_err_t
+cred_lookup(const char *pin, size_t len, uint32_t *tag_out, uint16_t *user_id,
+            uint8_t *doors)
+{
+    uint8_t mac[32];
+    uint32_t tag;
+    uint32_t b;
+    bool probed = false;
+
+    cred_hmac(NULL, 0, pin, len, mac);
+    memcpy(&tag, mac, sizeof tag);
+    if (tag_out != NULL)
+    {
+        *tag_out = tag;
+    }
+
+    for (b = cred_home(tag >> 16); cred_index[b].slot != 0; b = (b + 1) & CRED_INDEX_MASK)
+    {
+        if (cred_index[b].tag != tag >> 16)
+        {
+            continue;
+        }
+        probed = true;
+        if (cred_check_slot(cred_index[b].slot - 1, tag, pin, len, user_id, doors))
+        {
+            return ESP_OK;
+        }
+    }
+    if (!probed)
+    {
+        /* Spend the same flash read and hash as a hit would */
+        uint16_t unused;
+        uint8_t unused_doors;
+        cred_check_slot(0, ~tag, pin, len, &unused, &unused_doors);
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+/* Edit mutex held */
+static esp_err_t
+cred_add_locked(const char *pin, size_t len, uint8_t doors, uint16_t *user_id)
+{
+    cred_rec_t rec;
+    uint8_t mac[32];
+    uint16_t existing;
+    uint8_t existing_doors;
+    uint16_t uid;
+    int slot;
+    esp_err_t ret;
+
+    memset(&rec, 0xFF, sizeof rec);
+    if (cred_lookup(pin, len, &rec.tag, &existing, &existing_doors) == ESP_OK)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (uid = 0; uid < CRED_MAX_USERS && cred_user_slot[uid] != 0; uid++)
+    {
+    }
+    if (uid == CRED_MAX_USERS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    slot = cred_alloc_slot();
+    if (slot < 0)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    rec.state = CRED_STATE_VALID;
+    rec.doors = doors;
+    rec.user_id = uid;
+    lock_hal_random(rec.salt, sizeof rec.salt);
+    cred_hmac(rec.salt, sizeof rec.salt, pin, len, mac);
+    memcpy(rec.hash, mac, sizeof rec.hash);
+
+    ret = cred_write(slot, &rec);
+    cred_sector_used[slot / CRED_SLOTS_PER_SECTOR]++;
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    cred_sector_live[slot / CRED_SLOTS_PER_SECTOR]++;
+    xSemaphoreTake(cred_mutex, portMAX_DELAY);
+    cred_index_insert(rec.tag >> 16, slot);
+    cred_user_slot[uid] = slot + 1;
+    cred_count++;
+    xSemaphoreGive(cred_mutex);
+    if (user_id != NULL)
+    {
+        *user_id = uid;
+    }
+    return ESP_OK;
+}
+
+esp_err_t
+cred_store_init(void)
+{
+    uint8_t secret[CRED_SECRET_LEN];
+    size_t len = sizeof secret;
+    size_t size;
+    esp_err_t ret;
+
+    ret = lock_hal_part_find(CRED_PART_LABEL, &cred_part, &size);
+    if (ret != ESP_OK)
+    {
+        MODLOG_DFLT(ERROR, "no \"%s\" partition\n", CRED_PART_LABEL);
+        return ret;
+    }
+    if (size < CRED_SECTORS * LOCK_HAL_SECTOR_SIZE)
+    {
+        MODLOG_DFLT(ERROR, "\"%s\" partition too small for %d users\n",
+                    CRED_PART_LABEL, CRED_MAX_USERS);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    cred_mutex = xSemaphoreCreateMutex();
+    cred_edit_mutex = xSemaphoreCreateMutex();
+    if (cred_mutex == NULL || cred_edit_mutex == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ret = lock_hal_nvs_get(CRED_NVS_NS, CRED_NVS_SECRET, secret, &len);
+    bool fresh = ret != ESP_OK || len != sizeof secret;
+    if (fresh)
+    {
+        /* Records hashed under a lost secret can never verify again */
+        lock_hal_random(secret, sizeof secret);
+        ret = lock_hal_part_erase(cred_part, 0, CRED_SECTORS * LOCK_HAL_SECTOR_SIZE);
+        if (ret == ESP_OK)
+        {
+            ret = lock_hal_nvs_set(CRED_NVS_NS, CRED_NVS_SECRET, secret, sizeof secret);
+        }
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+
+    memset(cred_ipad, 0x36, sizeof cred_ipad);
+    memset(cred_opad, 0x5c, sizeof cred_opad);
+    for (int i = 0; i < CRED_SECRET_LEN; i++)
+    {
+        cred_ipad[i] ^= secret[i];
+        cred_opad[i] ^= secret[i];
+    }
+    memset(secret, 0, sizeof secret);
+
+    ret = cred_load();
+    if (ret == ESP_OK && fresh && sizeof(CONFIG_LOCK_DEFAULT_PIN) > 1)
+    {
+        uint16_t uid;
+
+        ret = cred_add_locked(CONFIG_LOCK_DEFAULT_PIN,
+                              strlen(CONFIG_LOCK_DEFAULT_PIN), CRED_DOORS_ALL, &uid);
+        if (ret == ESP_OK)
+        {
+            MODLOG_DFLT(INFO, "credential store created; default PIN is user %d\n", uid);
+        }
+    }
+    return ret;
+}
+
+esp_err_t
+cred_store_verify(const char *pin, size_t len, uint16_t *user_id, uint8_t *doors)
+{
+    uint8_t scope;
+    esp_err_t ret;
+
+    if (len > CRED_PIN_MAX)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    xSemaphoreTake(cred_mutex, portMAX_DELAY);
+    ret = cred_lookup(pin, len, NULL, user_id, &scope);
+    xSemaphoreGive(cred_mutex);
+
+    if (ret == ESP_OK && doors != NULL)
+    {
+        *doors = scope;
+    }
+    return ret == ESP_OK ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t
+cred_store_add(const char *pin, size_t len, uint8_t doors, uint16_t *user_id)
+{
+    esp_err_t ret;
+
+    if (len < CRED_PIN_MIN || len > CRED_PIN_MAX || doors == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(cred_edit_mutex, portMAX_DELAY);
+    ret = cred_add_locked(pin, len, doors, user_id);
+    xSemaphoreGive(cred_edit_mutex);
+
+    return ret;
+}
+
+esp_err_t
+cred_store_revoke(uint16_t user_id)
+{
+    cred_rec_t rec;
+    uint32_t slot;
+    esp_err_t ret;
+    int b;
+
+    if (user_id >= CRED_MAX_USERS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(cred_edit_mutex, portMAX_DELAY);
+    if (cred_user_slot[user_id] == 0)
+    {
+        xSemaphoreGive(cred_edit_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    slot = cred_user_slot[user_id] - 1;
+    ret = cred_read(slot, &rec, 1);
+    if (ret == ESP_OK)
+    {
+        ret = cred_set_state(slot, CRED_STATE_REVOKED);
+    }
+    if (ret == ESP_OK)
+    {
+        xSemaphoreTake(cred_mutex, portMAX_DELAY);
+        b = cred_index_bucket(rec.tag >> 16, slot);
+        if (b >= 0)
+        {
+            cred_index_remove(b);
+        }
+        cred_user_slot[user_id] = 0;
+        cred_count--;
+        xSemaphoreGive(cred_mutex);
+        cred_sector_live[slot / CRED_SLOTS_PER_SECTOR]--;
+    }
+    xSemaphoreGive(cred_edit_mutex);
+
+    return ret;
+}
+
+uint16_t
+cred_store_count(void)
+{
+    uint16_t n;
+
+    xSemaphoreTake(cred_mutex, portMAX_DELAY);
+    n = cred_count;
+    xSemaphoreGive(cred_mutex);
+
+    return n;
+}
+
+bool
+cred_store_live(uint16_t user_id)
+{
+    bool live;
+
+    if (user_id >= CRED_MAX_USERS)
+    {
+        return false;
+    }
+    xSemaphoreTake(cred_mutex, portMAX_DELAY);
+    live = cred_user_slot[user_id] != 0;
+    xSemaphoreGive(cred_mutex);
+
+    return live;
+}
+
+size_t
+cred_store_ram(void)
+{
+    return sizeof cred_index + sizeof cred_user_slot;
+}
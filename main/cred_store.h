@@ -0,0 +1,66 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef CRED_STORE_H
+#define CRED_STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CRED_USER_NONE              0xFFFF
+#define CRED_PIN_MIN                4
+#define CRED_PIN_MAX                32
+#define CRED_DOORS_ALL              0xFF    /* Door mask: every door, present or future */
+
+/**
+ * Opens the credential store kept in the "creds" data partition.  On first
+ * boot a device secret is generated and CONFIG_LOCK_DEFAULT_PIN is added as
+ * user 0.  The RAM index is built here, from a scan of the partition, so
+ * the first unlock does not pay for it.
+ */
+esp_err_t cred_store_init(void);
+
+/**
+ * Checks a PIN.  Costs one flash read and two hashes whether or not the PIN
+ * exists.  The caller decides whether the PIN's door mask covers the door
+ * being opened.
+ *
+ * @return ESP_OK with the matching user in *user_id and its door mask (bit
+ *         n for door n) in *doors if not NULL, or ESP_ERR_NOT_FOUND.
+ */
+esp_err_t cred_store_verify(const char *pin, size_t len, uint16_t *user_id,
+                            uint8_t *doors);
+
+/* Adds a PIN that opens the doors in the mask under the lowest free user
+ * id.  Fails with ESP_ERR_INVALID_STATE if the PIN is already in use.  May
+ * compact a sector, which copies and erases flash, so it is not for the
+ * host task; cred_store_verify() does not wait for it. */
+esp_err_t cred_store_add(const char *pin, size_t len, uint8_t doors, uint16_t *user_id);
+
+/* Revokes a user.  Only that user's record is touched in flash.  Not for
+ * the host task either. */
+esp_err_t cred_store_revoke(uint16_t user_id);
+
+/* Number of live credentials */
+uint16_t cred_store_count(void);
+
+/* True if user_id has a credential that has not been revoked.  RAM only. */
+bool cred_store_live(uint16_t user_id);
+
+/* Static RAM the index and the per-user table take, in bytes */
+size_t cred_store_ram(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
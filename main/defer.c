@@ -0,0 +1,221 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "modlog/modlog.h"
+#include "mem_acct.h"
+#include "defer.h"
+
+/*
+ * Hashed timer wheel: DEFER_WHEEL_SLOTS buckets of DEFER_TICK_MS each.  A job
+ * due after more than one revolution carries a round count that is
+ * decremented every time the cursor passes its bucket.  Jobs come from a
+ * static pool and are linked by index, so nothing is allocated at runtime.
+ * The task sleeps indefinitely while the wheel is empty.
+ */
+#define DEFER_WHEEL_SLOTS       64
+#define DEFER_MAX_JOBS          CONFIG_LOCK_DEFER_MAX_JOBS
+#define DEFER_NIL               0xFF
+#define DEFER_TASK_STACK        3072
+#define DEFER_TASK_PRIO         5
+
+typedef struct
+{
+    defer_fn_t fn;
+    void *arg;
+    uint16_t conn_handle;
+    uint16_t rounds;
+    uint8_t slot;
+    uint8_t next;
+} defer_job_t;
+
+static defer_job_t defer_jobs[DEFER_MAX_JOBS];
+static uint8_t defer_wheel[DEFER_WHEEL_SLOTS];
+static uint8_t defer_free;
+static uint8_t defer_cursor;
+static uint16_t defer_pending;
+static TaskHandle_t defer_task_handle;
+static portMUX_TYPE defer_lock = portMUX_INITIALIZER_UNLOCKED;
+
+_Static_assert(DEFER_MAX_JOBS < DEFER_NIL, "job index must fit in uint8_t");
+
+static void
+defer_unlink(uint8_t idx)
+{
+    defer_job_t *job = &defer_jobs[idx];
+    uint8_t *link = &defer_wheel[job->slot];
+
+    while (*link != idx)
+    {
+        link = &defer_jobs[*link].next;
+    }
+    *link = job->next;
+
+    job->fn = NULL;
+    job->next = defer_free;
+    defer_free = idx;
+    defer_pending--;
+}
+
+/* Advances the cursor by one slot and moves due jobs to the returned list */
+static uint8_t
+defer_advance(void)
+{
+    uint8_t due = DEFER_NIL;
+    uint8_t *link;
+
+    portENTER_CRITICAL(&defer_lock);
+    defer_cursor = (defer_cursor + 1) % DEFER_WHEEL_SLOTS;
+    link = &defer_wheel[defer_cursor];
+    while (*link != DEFER_NIL)
+    {
+        uint8_t idx = *link;
+        defer_job_t *job = &defer_jobs[idx];
+
+        if (job->rounds > 0)
+        {
+            job->rounds--;
+            link = &job->next;
+            continue;
+        }
+        *link = job->next;
+        job->slot = DEFER_NIL;
+        job->next = due;
+        due = idx;
+        defer_pending--;
+    }
+    portEXIT_CRITICAL(&defer_lock);
+
+    return due;
+}
+
+static void
+defer_task(void *param)
+{
+    TickType_t tick = pdMS_TO_TICKS(DEFER_TICK_MS) ? pdMS_TO_TICKS(DEFER_TICK_MS) : 1;
+    TickType_t last_wake = xTaskGetTickCount();
+
+    mem_acct_track_task(NULL, DEFER_TASK_STACK);
+    for (;;)
+    {
+        if (defer_pending == 0)
+        {
+            /* Wheel empty; sleep until defer_submit() wakes us */
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            last_wake = xTaskGetTickCount();
+        }
+        vTaskDelayUntil(&last_wake, tick);
+
+        uint8_t idx = defer_advance();
+        while (idx != DEFER_NIL)
+        {
+            defer_job_t job;
+
+            /* Copy out and release under the lock; a cancel may have
+             * cleared fn after the job left the wheel. */
+            portENTER_CRITICAL(&defer_lock);
+            job = defer_jobs[idx];
+            defer_jobs[idx].fn = NULL;
+            defer_jobs[idx].next = defer_free;
+            defer_free = idx;
+            portEXIT_CRITICAL(&defer_lock);
+
+            if (job.fn != NULL)
+            {
+                job.fn(job.conn_handle, job.arg);
+            }
+            idx = job.next;
+        }
+    }
+}
+
+esp_err_t
+defer_init(void)
+{
+    memset(defer_wheel, DEFER_NIL, sizeof defer_wheel);
+    for (int i = 0; i < DEFER_MAX_JOBS; i++)
+    {
+        defer_jobs[i].next = (i + 1 < DEFER_MAX_JOBS) ? i + 1 : DEFER_NIL;
+    }
+    defer_free = 0;
+
+    if (xTaskCreate(defer_task, "deferTask", DEFER_TASK_STACK, NULL,
+                    DEFER_TASK_PRIO, &defer_task_handle) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t
+defer_submit(uint16_t conn_handle, uint32_t delay_ms, defer_fn_t fn, void *arg)
+{
+    uint32_t ticks = (delay_ms + DEFER_TICK_MS - 1) / DEFER_TICK_MS;
+    bool wake;
+    uint8_t idx;
+
+    if (ticks == 0)
+    {
+        ticks = 1;
+    }
+
+    portENTER_CRITICAL(&defer_lock);
+    idx = defer_free;
+    if (idx == DEFER_NIL)
+    {
+        portEXIT_CRITICAL(&defer_lock);
+        MODLOG_DFLT(ERROR, "deferred job pool exhausted\n");
+        return ESP_ERR_NO_MEM;
+    }
+    defer_job_t *job = &defer_jobs[idx];
+    defer_free = job->next;
+
+    job->fn = fn;
+    job->arg = arg;
+    job->conn_handle = conn_handle;
+    job->rounds = (ticks - 1) / DEFER_WHEEL_SLOTS;
+    job->slot = (defer_cursor + ticks) % DEFER_WHEEL_SLOTS;
+    job->next = defer_wheel[job->slot];
+    defer_wheel[job->slot] = idx;
+    wake = (defer_pending++ == 0);
+    portEXIT_CRITICAL(&defer_lock);
+
+    if (wake)
+    {
+        xTaskNotifyGive(defer_task_handle);
+    }
+    return ESP_OK;
+}
+
+void
+defer_cancel_conn(uint16_t conn_handle)
+{
+    if (conn_handle == DEFER_CONN_NONE)
+    {
+        return;
+    }
+
+    portENTER_CRITICAL(&defer_lock);
+    for (uint8_t i = 0; i < DEFER_MAX_JOBS; i++)
+    {
+        if (defer_jobs[i].fn == NULL || defer_jobs[i].conn_handle != conn_handle)
+        {
+            continue;
+        }
+        if (defer_jobs[i].slot == DEFER_NIL)
+        {
+            /* Already due; the task skips it and returns it to the pool */
+            defer_jobs[i].fn = NULL;
+        }
+        else
+        {
+            defer_unlink(i);
+        }
+    }
+    portEXIT_CRITICAL(&defer_lock);
+}
@@ -0,0 +1,47 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef DEFER_H
+#define DEFER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Jobs not bound to a connection, e.g. re-advertising */
+#define DEFER_CONN_NONE                 0xFFFF
+
+/* Resolution of the timer wheel */
+#define DEFER_TICK_MS                   10
+
+/**
+ * Deferred job.  Runs on the deferred-work task, never on the NimBLE host
+ * task, so it may call host APIs but should not block for long.
+ */
+typedef void (*defer_fn_t)(uint16_t conn_handle, void *arg);
+
+esp_err_t defer_init(void);
+
+/**
+ * Schedules fn to run after delay_ms (rounded up to DEFER_TICK_MS).  Jobs
+ * bound to a connection are dropped by defer_cancel_conn().
+ *
+ * @return ESP_OK, or ESP_ERR_NO_MEM when the job pool is exhausted.
+ */
+esp_err_t defer_submit(uint16_t conn_handle, uint32_t delay_ms,
+                       defer_fn_t fn, void *arg);
+
+/* Cancels every pending job bound to conn_handle. */
+void defer_cancel_conn(uint16_t conn_handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,477 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "host/ble_hs.h"
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "conn_ctx.h"
+#include "blog.h"
+#include "mem_acct.h"
+#include "fanout.h"
+
+/*
+ * Chunks are numbered by a free-running sequence; chunk seq lives in
+ * fanout_win[seq % FANOUT_WINDOW] while fanout_tail <= seq < fanout_head.
+ * A subscriber is owed every chunk from its next up to the head.  The tail
+ * advances past a chunk once no subscriber is owed it, so nothing is
+ * reference counted: a connection that unsubscribes or drops simply stops
+ * holding the tail back.
+ *
+ * The cursors live here rather than in the connection context.  The host
+ * task adds and removes subscribers from its hooks while the bridge task
+ * sends, and a context can be released and handed to the next connection
+ * in the middle of a send.  fanout_mutex covers the table, the window and
+ * the stats; the bridge task holds it across a whole submit or pump, and
+ * the hooks wait for it, so a cursor never outlives its connection.
+ * NimBLE calls GAP event handlers without its host lock held, so sending
+ * with the mutex held cannot deadlock against a hook.
+ *
+ * NimBLE mbufs carry no reference count and the notify call consumes the
+ * chain it is given, so sharing means one os_mbuf_dup() per send.  Handing
+ * the source to the last owner saves that copy, but a failed send frees the
+ * source with no way to retry, so it is only done while the pool has
+ * FANOUT_HANDOVER_RESERVE blocks spare.
+ */
+#define FANOUT_BACKOFF_MIN_MS       5
+#define FANOUT_BACKOFF_MAX_MS       160
+#define FANOUT_HANDOVER_RESERVE     4
+#define FANOUT_SUBS_MAX             CONN_CTX_MAX
+
+typedef struct
+{
+    struct os_mbuf *om;         /* Source chain, NULL once handed over */
+    uint16_t len;
+    uint8_t subs;               /* Subscribers at submit, for cost stats */
+} fanout_chunk_t;
+
+/* One connection's place in the fan-out, from subscribe to disconnect */
+typedef struct
+{
+    uint16_t conn_handle;       /* BLE_HS_CONN_HANDLE_NONE when free */
+    bool joined;                /* Subscribed; next is valid */
+    uint8_t attempts;           /* Failed sends of the current chunk */
+    uint16_t backoff_ms;
+    uint32_t next;              /* Sequence of the next chunk owed */
+    TickType_t retry_at;        /* Tick count of the next retry */
+    fanout_conn_stats_t stats;
+} fanout_sub_t;
+
+static fanout_chunk_t fanout_win[FANOUT_WINDOW];
+static uint32_t fanout_head;
+static uint32_t fanout_tail;
+static fanout_sub_t fanout_subs[FANOUT_SUBS_MAX];
+static SemaphoreHandle_t fanout_mutex;
+static const uint16_t *fanout_attr_handle;
+static fanout_stats_t fanout_stats;
+
+static TickType_t
+fanout_ms_to_ticks(uint32_t ms)
+{
+    TickType_t ticks = pdMS_TO_TICKS(ms);
+    return ticks ? ticks : 1;
+}
+
+static inline fanout_chunk_t *
+fanout_chunk(uint32_t seq)
+{
+    return &fanout_win[seq % FANOUT_WINDOW];
+}
+
+static inline bool
+fanout_owes(const fanout_sub_t *sub, uint32_t seq)
+{
+    return (int32_t)(seq - sub->next) >= 0;
+}
+
+/* Entry for conn_handle, or a free one if conn_handle is NONE.  Mutex held. */
+static fanout_sub_t *
+fanout_sub_find(uint16_t conn_handle)
+{
+    for (int i = 0; i < FANOUT_SUBS_MAX; i++)
+    {
+        if (fanout_subs[i].conn_handle == conn_handle)
+        {
+            return &fanout_subs[i];
+        }
+    }
+    return NULL;
+}
+
+/* The subscribers taking part in the fan-out.  Mutex held. */
+static int
+fanout_subscribers(fanout_sub_t **subs)
+{
+    int k = 0;
+
+    for (int i = 0; i < FANOUT_SUBS_MAX; i++)
+    {
+        if (fanout_subs[i].joined)
+        {
+            subs[k++] = &fanout_subs[i];
+        }
+    }
+    return k;
+}
+
+static void
+fanout_skip(fanout_sub_t *sub, const fanout_chunk_t *chunk, int rc)
+{
+    sub->stats.dropped_bytes += chunk->len;
+    sub->next++;
+    sub->attempts = 0;
+    sub->backoff_ms = 0;
+    BLOG(BRIDGE_DROP, chunk->len, sub->conn_handle, rc);
+}
+
+/* Frees chunks at the tail that no subscriber is owed any more */
+static void
+fanout_release(fanout_sub_t **subs, int n)
+{
+    while (fanout_tail != fanout_head)
+    {
+        fanout_chunk_t *chunk = fanout_chunk(fanout_tail);
+
+        for (int i = 0; i < n; i++)
+        {
+            if (fanout_owes(subs[i], fanout_tail))
+            {
+                return;
+            }
+        }
+        if (chunk->om != NULL)
+        {
+            os_mbuf_free_chain(chunk->om);
+            chunk->om = NULL;
+        }
+        fanout_tail++;
+    }
+}
+
+/*
+ * True if a new chunk can be taken: the window has a free slot or, when
+ * slow subscribers are dropped, one that still holds the oldest chunk is
+ * behind another.  If every subscriber owes it, the shortage is one they
+ * share, usually the msys pool, and dropping would only lose data.  Mutex
+ * held.
+ */
+static bool
+fanout_room(fanout_sub_t **subs, int n)
+{
+    if (fanout_head - fanout_tail < FANOUT_WINDOW)
+    {
+        return true;
+    }
+#if CONFIG_LOCK_FANOUT_SLOW_DROP
+    for (int i = 0; i < n; i++)
+    {
+        if (!fanout_owes(subs[i], fanout_tail))
+        {
+            return true;
+        }
+    }
+#endif
+    return false;
+}
+
+/* Builds the mbuf to send chunk seq to subs[me] */
+static struct os_mbuf *
+fanout_take(fanout_chunk_t *chunk, uint32_t seq, fanout_sub_t **subs, int n, int me)
+{
+    struct os_mbuf *om;
+
+    for (int i = 0; i < n; i++)
+    {
+        if (i != me && fanout_owes(subs[i], seq))
+        {
+            goto dup;
+        }
+    }
+    if (os_msys_num_free() >= FANOUT_HANDOVER_RESERVE)
+    {
+        om = chunk->om;
+        chunk->om = NULL;
+        return om;
+    }
+
+dup:
+    om = os_mbuf_dup(chunk->om);
+    if (om != NULL)
+    {
+        fanout_stats.by_subs[chunk->subs - 1].copies++;
+    }
+    return om;
+}
+
+/* Sends what subs[me] is owed until it is caught up or has to back off */
+static void
+fanout_send(fanout_sub_t **subs, int n, int me, TickType_t now)
+{
+    fanout_sub_t *sub = subs[me];
+
+    while (fanout_owes(sub, fanout_head - 1))
+    {
+        uint32_t seq = sub->next;
+        fanout_chunk_t *chunk = fanout_chunk(seq);
+        fanout_cost_t *cost = &fanout_stats.by_subs[chunk->subs - 1];
+        int64_t start = lock_hal_now_us();
+        struct os_mbuf *om;
+        int rc;
+
+        if (chunk->om == NULL)
+        {
+            /* Handed over to a subscriber that has since been dropped */
+            fanout_skip(sub, chunk, BLE_HS_ENOENT);
+            continue;
+        }
+        om = fanout_take(chunk, seq, subs, n, me);
+        rc = om != NULL ?
+             lock_hal_notify_mbuf(sub->conn_handle, *fanout_attr_handle, om) : BLE_HS_ENOMEM;
+        cost->cpu_us += lock_hal_now_us() - start;
+
+        if (rc == 0)
+        {
+            cost->sends++;
+            sub->stats.tx_bytes += chunk->len;
+            sub->stats.tx_chunks++;
+            sub->next++;
+            sub->attempts = 0;
+            sub->backoff_ms = 0;
+        }
+        else if (rc == BLE_HS_ENOMEM && chunk->om != NULL &&
+                 ++sub->attempts <= CONFIG_LOCK_BRIDGE_MAX_RETRIES)
+        {
+            sub->stats.retries++;
+            sub->backoff_ms = sub->backoff_ms ? sub->backoff_ms * 2 : FANOUT_BACKOFF_MIN_MS;
+            if (sub->backoff_ms > FANOUT_BACKOFF_MAX_MS)
+            {
+                sub->backoff_ms = FANOUT_BACKOFF_MAX_MS;
+            }
+            sub->retry_at = now + fanout_ms_to_ticks(sub->backoff_ms);
+            return;
+        }
+        else
+        {
+            fanout_skip(sub, chunk, rc);
+        }
+    }
+}
+
+TickType_t
+fanout_pump(void)
+{
+    fanout_sub_t *subs[FANOUT_SUBS_MAX];
+    TickType_t now = xTaskGetTickCount();
+    TickType_t wait = portMAX_DELAY;
+    int n;
+
+    xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+    n = fanout_subscribers(subs);
+    for (int i = 0; i < n; i++)
+    {
+        fanout_sub_t *sub = subs[i];
+
+        if (sub->attempts == 0 || (int32_t)(sub->retry_at - now) <= 0)
+        {
+            fanout_send(subs, n, i, now);
+        }
+        if (sub->attempts != 0)
+        {
+            int32_t due = sub->retry_at - now;
+            TickType_t ticks = due > 0 ? due : 1;
+
+            if (ticks < wait)
+            {
+                wait = ticks;
+            }
+        }
+    }
+    fanout_release(subs, n);
+    xSemaphoreGive(fanout_mutex);
+    return wait;
+}
+
+bool
+fanout_has_room(void)
+{
+    fanout_sub_t *subs[FANOUT_SUBS_MAX];
+    bool room;
+
+    xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+    room = fanout_room(subs, fanout_subscribers(subs));
+    xSemaphoreGive(fanout_mutex);
+    return room;
+}
+
+esp_err_t
+fanout_submit(const void *a, uint16_t alen, const void *b, uint16_t blen)
+{
+    fanout_sub_t *subs[FANOUT_SUBS_MAX];
+    int64_t start = lock_hal_now_us();
+    esp_err_t ret = ESP_OK;
+    fanout_chunk_t *chunk;
+    struct os_mbuf *om;
+    uint32_t held;
+    int n;
+
+    xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+    n = fanout_subscribers(subs);
+    if (n == 0)
+    {
+        goto out;
+    }
+
+    fanout_release(subs, n);
+    if (!fanout_room(subs, n))
+    {
+        fanout_stats.refused_full++;
+        ret = ESP_ERR_TIMEOUT;
+        goto out;
+    }
+#if CONFIG_LOCK_FANOUT_SLOW_DROP
+    if (fanout_head - fanout_tail == FANOUT_WINDOW)
+    {
+        /* Whoever still holds the oldest chunk is a window behind */
+        for (int i = 0; i < n; i++)
+        {
+            if (fanout_owes(subs[i], fanout_tail))
+            {
+                fanout_stats.slow_skips++;
+                fanout_skip(subs[i], fanout_chunk(fanout_tail), BLE_HS_EBUSY);
+            }
+        }
+        fanout_release(subs, n);
+    }
+#endif
+
+    om = ble_hs_mbuf_from_flat(a, alen);
+    if (om != NULL && blen != 0 && os_mbuf_append(om, b, blen) != 0)
+    {
+        os_mbuf_free_chain(om);
+        om = NULL;
+    }
+    if (om == NULL)
+    {
+        MEM_COUNT(MEM_CNT_MSYS_FAIL);
+        fanout_stats.refused_nomem++;
+        ret = ESP_ERR_NO_MEM;
+        goto out;
+    }
+
+    chunk = fanout_chunk(fanout_head);
+    chunk->om = om;
+    chunk->len = alen + blen;
+    chunk->subs = n;
+    fanout_head++;
+
+    held = fanout_head - fanout_tail;
+    if (held > fanout_stats.held_max)
+    {
+        fanout_stats.held_max = held;
+    }
+    fanout_stats.by_subs[n - 1].chunks++;
+    fanout_stats.by_subs[n - 1].cpu_us += lock_hal_now_us() - start;
+
+out:
+    xSemaphoreGive(fanout_mutex);
+    return ret;
+}
+
+static void
+fanout_on_subscribe(conn_ctx_t *ctx)
+{
+    fanout_sub_t *sub;
+
+    xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+    sub = fanout_sub_find(ctx->conn_handle);
+    if (sub == NULL)
+    {
+        sub = fanout_sub_find(BLE_HS_CONN_HANDLE_NONE);
+        if (sub == NULL)
+        {
+            /* One entry per context, so this cannot happen */
+            xSemaphoreGive(fanout_mutex);
+            return;
+        }
+        memset(sub, 0, sizeof *sub);
+        sub->conn_handle = ctx->conn_handle;
+    }
+    /* A new subscriber only receives chunks submitted after it joined */
+    sub->joined = ctx->subscribed;
+    sub->next = fanout_head;
+    sub->attempts = 0;
+    sub->backoff_ms = 0;
+    xSemaphoreGive(fanout_mutex);
+}
+
+static void
+fanout_on_disconnect(conn_ctx_t *ctx, int reason)
+{
+    fanout_sub_t *sub;
+
+    xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+    sub = fanout_sub_find(ctx->conn_handle);
+    if (sub != NULL)
+    {
+        MODLOG_DFLT(INFO, "fanout conn_handle=%d tx_bytes=%u chunks=%u retries=%u dropped=%u\n",
+                    sub->conn_handle, (unsigned)sub->stats.tx_bytes,
+                    (unsigned)sub->stats.tx_chunks, (unsigned)sub->stats.retries,
+                    (unsigned)sub->stats.dropped_bytes);
+        sub->conn_handle = BLE_HS_CONN_HANDLE_NONE;
+        sub->joined = false;
+    }
+    xSemaphoreGive(fanout_mutex);
+}
+
+static const conn_ctx_hooks_t fanout_hooks = {
+    .on_subscribe = fanout_on_subscribe,
+    .on_disconnect = fanout_on_disconnect,
+};
+
+esp_err_t
+fanout_init(const uint16_t *attr_handle)
+{
+    fanout_mutex = xSemaphoreCreateMutex();
+    if (fanout_mutex == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < FANOUT_SUBS_MAX; i++)
+    {
+        fanout_subs[i].conn_handle = BLE_HS_CONN_HANDLE_NONE;
+    }
+    fanout_attr_handle = attr_handle;
+    return conn_ctx_register_hooks(&fanout_hooks);
+}
+
+void
+fanout_get_conn_stats(uint16_t conn_handle, fanout_conn_stats_t *out)
+{
+    fanout_sub_t *sub;
+
+    xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+    sub = fanout_sub_find(conn_handle);
+    if (sub == NULL)
+    {
+        memset(out, 0, sizeof *out);
+    }
+    else
+    {
+        *out = sub->stats;
+    }
+    xSemaphoreGive(fanout_mutex);
+}
+
+void
+fanout_get_stats(fanout_stats_t *out)
+{
+    xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+    *out = fanout_stats;
+    xSemaphoreGive(fanout_mutex);
+}
@@ -0,0 +1,97 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FANOUT_WINDOW               CONFIG_LOCK_FANOUT_WINDOW
+
+/* Per-connection counters */
+typedef struct
+{
+    uint32_t tx_bytes;          /* Payload bytes notified */
+    uint32_t tx_chunks;         /* Notifications sent */
+    uint32_t retries;           /* Sends retried after mbuf exhaustion */
+    uint32_t dropped_bytes;     /* Bytes given up on, or skipped while too slow */
+} fanout_conn_stats_t;
+
+/* Cost of broadcasting, bucketed by the number of subscribers at submit */
+typedef struct
+{
+    uint32_t chunks;
+    uint32_t sends;             /* Notifications handed to the stack */
+    uint32_t copies;            /* ... of which were duplicated from the source */
+    uint32_t cpu_us;            /* Time spent building and sending */
+} fanout_cost_t;
+
+typedef struct
+{
+    uint32_t refused_full;      /* Submissions refused: window full */
+    uint32_t refused_nomem;     /* Submissions refused: msys exhausted */
+    uint32_t slow_skips;        /* Chunks skipped for a subscriber a window behind */
+    uint32_t held_max;          /* Most chunks held at once */
+    fanout_cost_t by_subs[CONFIG_BT_NIMBLE_MAX_CONNECTIONS];
+} fanout_stats_t;
+
+/**
+ * Broadcasts notifications to every subscriber of one characteristic.
+ *
+ * Each chunk is copied into an mbuf chain once and kept in a window of
+ * FANOUT_WINDOW chunks.  Every subscriber has its own cursor into the
+ * window and its own retry backoff, so a subscriber that is short of
+ * buffers does not delay the others.  Each send is an os_mbuf_dup() of the
+ * source, except that the last subscriber still owed a chunk is handed the
+ * source itself while the msys pool has headroom.
+ *
+ * A subscriber that falls a whole window behind either loses its oldest
+ * chunk (CONFIG_LOCK_FANOUT_SLOW_DROP) or makes fanout_submit() refuse new
+ * data until it catches up (CONFIG_LOCK_FANOUT_SLOW_THROTTLE).  When every
+ * subscriber is that far behind, as when the msys pool is dry, nobody is
+ * being held back and fanout_submit() refuses in either mode.
+ *
+ * The per-subscriber cursors are kept here, not in the connection context,
+ * and every entry point takes the fan-out's mutex, so the connection hooks
+ * on the host task never race a send on the bridge task.
+ */
+esp_err_t fanout_init(const uint16_t *attr_handle);
+
+/**
+ * Queues one chunk, given as up to two segments, to every current
+ * subscriber.  Nothing is sent until the next fanout_pump().
+ *
+ * @return ESP_OK; ESP_ERR_TIMEOUT if the window is full; ESP_ERR_NO_MEM if
+ *         no mbuf was available.  In both error cases retry later.
+ */
+esp_err_t fanout_submit(const void *a, uint16_t alen, const void *b, uint16_t blen);
+
+/**
+ * Sends every chunk that is due and releases chunks all subscribers have
+ * had.
+ *
+ * @return ticks until the next retry is due, or portMAX_DELAY.
+ */
+TickType_t fanout_pump(void);
+
+/* True if fanout_submit() would have room for another chunk */
+bool fanout_has_room(void);
+
+void fanout_get_conn_stats(uint16_t conn_handle, fanout_conn_stats_t *out);
+void fanout_get_stats(fanout_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,252 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <string.h>
+#include "os/os_mbuf.h"
+#include "frame_parser.h"
+
+enum
+{
+    FRAME_STATE_IDLE = 0,
+    FRAME_STATE_TEXT,
+    FRAME_STATE_TEXT_DISCARD,
+    FRAME_STATE_BIN_HDR,
+    FRAME_STATE_BIN_BODY,
+    FRAME_STATE_BIN_DISCARD,
+};
+
+void
+frame_parser_reset(frame_parser_t *p)
+{
+    p->state = FRAME_STATE_IDLE;
+    p->hdr_got = 0;
+    p->need = 0;
+    p->len = 0;
+}
+
+bool
+frame_parser_begin_write(frame_parser_t *p, uint32_t now_ms)
+{
+    bool stale = p->state != FRAME_STATE_IDLE && now_ms - p->last_ms > FRAME_GAP_MS;
+
+    /* The rest of that frame is not coming; what follows is a new one */
+    if (stale)
+    {
+        p->stale++;
+        frame_parser_reset(p);
+    }
+    p->last_ms = now_ms;
+    return stale;
+}
+
+static void
+frame_emit_text(frame_parser_t *p, const uint8_t *data, uint16_t len,
+                frame_cb_t cb, void *arg)
+{
+    if (len > 0 && data[len - 1] == '\r')
+    {
+        len--;
+    }
+    if (len > FRAME_MAX)
+    {
+        p->overflows++;
+        return;
+    }
+    p->frames++;
+    cb(arg, FRAME_TYPE_TEXT, data, len);
+}
+
+/* Appends to the frame buffer; returns false if the frame no longer fits */
+static bool
+frame_append(frame_parser_t *p, const uint8_t *data, size_t len, size_t max)
+{
+    if (len > max - p->len)
+    {
+        return false;
+    }
+    memcpy(&p->buf[p->len], data, len);
+    p->len += len;
+    return true;
+}
+
+void
+frame_parser_feed(frame_parser_t *p, const uint8_t *data, size_t len,
+                  bool end_of_write, frame_cb_t cb, void *arg)
+{
+    while (len > 0)
+    {
+        switch (p->state)
+        {
+        case FRAME_STATE_IDLE:
+            if (*data == '\r' || *data == '\n')
+            {
+                /* Empty line */
+                data++;
+                len--;
+                continue;
+            }
+            if (*data == FRAME_BIN_MAGIC)
+            {
+                p->state = FRAME_STATE_BIN_HDR;
+                p->hdr_got = 0;
+                p->need = 0;
+                data++;
+                len--;
+                continue;
+            }
+            p->state = FRAME_STATE_TEXT;
+            /* fall through */
+
+        case FRAME_STATE_TEXT:
+        case FRAME_STATE_TEXT_DISCARD:
+        {
+            const uint8_t *nl = memchr(data, '\n', len);
+            size_t n = nl ? (size_t)(nl - data) : len;
+
+            if (p->state == FRAME_STATE_TEXT)
+            {
+                /* A line may carry a '\r' past FRAME_MAX; it is stripped */
+                if ((nl != NULL || end_of_write) && p->len == 0 && n <= FRAME_MAX + 1)
+                {
+                    /* Whole frame in this segment; no copy */
+                    frame_emit_text(p, data, n, cb, arg);
+                    if (nl == NULL)
+                    {
+                        frame_parser_reset(p);
+                        return;
+                    }
+                }
+                else if (!frame_append(p, data, n, FRAME_MAX + 1))
+                {
+                    p->overflows++;
+                    p->state = FRAME_STATE_TEXT_DISCARD;
+                }
+                else if (nl != NULL)
+                {
+                    frame_emit_text(p, p->buf, p->len, cb, arg);
+                }
+            }
+
+            if (nl == NULL)
+            {
+                data += n;
+                len = 0;
+                break;
+            }
+            frame_parser_reset(p);
+            data += n + 1;
+            len -= n + 1;
+            break;
+        }
+
+        case FRAME_STATE_BIN_HDR:
+            p->need |= (uint16_t)*data << (8 * p->hdr_got);
+            data++;
+            len--;
+            if (++p->hdr_got < 2)
+            {
+                break;
+            }
+            if (p->need > FRAME_MAX)
+            {
+                p->overflows++;
+                p->state = FRAME_STATE_BIN_DISCARD;
+            }
+            else if (p->need == 0)
+            {
+                p->frames++;
+                cb(arg, FRAME_TYPE_BINARY, data, 0);
+                frame_parser_reset(p);
+            }
+            else
+            {
+                p->state = FRAME_STATE_BIN_BODY;
+            }
+            break;
+
+        case FRAME_STATE_BIN_BODY:
+        {
+            size_t take = p->need - p->len;
+
+            if (take > len)
+            {
+                take = len;
+            }
+            if (p->len == 0 && take == p->need)
+            {
+                /* Whole payload in this segment; no copy */
+                p->frames++;
+                cb(arg, FRAME_TYPE_BINARY, data, take);
+                frame_parser_reset(p);
+            }
+            else
+            {
+                frame_append(p, data, take, FRAME_MAX);
+                if (p->len == p->need)
+                {
+                    p->frames++;
+                    cb(arg, FRAME_TYPE_BINARY, p->buf, p->len);
+                    frame_parser_reset(p);
+                }
+            }
+            data += take;
+            len -= take;
+            break;
+        }
+
+        case FRAME_STATE_BIN_DISCARD:
+        {
+            /* p->len counts skipped bytes here */
+            size_t skip = p->need - p->len;
+
+            if (skip > len)
+            {
+                skip = len;
+            }
+            p->len += skip;
+            data += skip;
+            len -= skip;
+            if (p->len == p->need)
+            {
+                frame_parser_reset(p);
+            }
+            break;
+        }
+
+        default:
+            frame_parser_reset(p);
+            break;
+        }
+    }
+
+    if (!end_of_write)
+    {
+        return;
+    }
+    if (p->state == FRAME_STATE_TEXT)
+    {
+        frame_emit_text(p, p->buf, p->len, cb, arg);
+        frame_parser_reset(p);
+    }
+    else if (p->state == FRAME_STATE_TEXT_DISCARD)
+    {
+        frame_parser_reset(p);
+    }
+}
+
+void
+frame_parser_feed_mbuf(frame_parser_t *p, const struct os_mbuf *om,
+                       bool end_of_write, frame_cb_t cb, void *arg)
+{
+    while (om != NULL)
+    {
+        const struct os_mbuf *next = SLIST_NEXT(om, om_next);
+
+        frame_parser_feed(p, om->om_data, om->om_len,
+                          end_of_write && next == NULL, cb, arg);
+        om = next;
+    }
+}
@@ -0,0 +1,92 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef FRAME_PARSER_H
+#define FRAME_PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Incremental parser for data written to the SPP characteristic.  Two frame
+ * kinds share the stream:
+ *
+ *   text    UTF-8 up to '\n' (a trailing '\r' is stripped).  With
+ *           CONFIG_LOCK_FRAME_SHORT_WRITE_ENDS a write that does not fill a
+ *           whole ATT payload also ends the current text frame, so clients
+ *           that send a bare PIN keep working.
+ *   binary  FRAME_BIN_MAGIC, 16-bit little-endian payload length, payload.
+ *           The magic byte is a UTF-8 continuation byte, so it can never
+ *           start a text frame.
+ *
+ * A frame that lies entirely within one input segment is handed to the
+ * callback in place; only frames split across segments or writes are
+ * copied into the per-connection buffer.  Frames longer than
+ * CONFIG_LOCK_FRAME_MAX are discarded and counted, and so are frames still
+ * incomplete when a write comes after a pause of more than
+ * CONFIG_LOCK_FRAME_GAP_MS.
+ */
+#define FRAME_BIN_MAGIC             0xA5
+#define FRAME_MAX                   CONFIG_LOCK_FRAME_MAX
+#define FRAME_GAP_MS                CONFIG_LOCK_FRAME_GAP_MS
+
+typedef enum
+{
+    FRAME_TYPE_TEXT = 0,
+    FRAME_TYPE_BINARY,
+} frame_type_t;
+
+typedef void (*frame_cb_t)(void *arg, frame_type_t type,
+                           const uint8_t *data, uint16_t len);
+
+typedef struct
+{
+    uint8_t state;
+    uint8_t hdr_got;
+    uint16_t need;              /* Binary payload length */
+    uint16_t len;               /* Bytes accumulated in buf */
+    uint32_t frames;
+    uint32_t overflows;
+    uint32_t stale;             /* Incomplete frames dropped after a pause */
+    uint32_t last_ms;           /* Time of the last write */
+    uint8_t buf[FRAME_MAX + 1]; /* + the '\r' of a full-length CRLF line */
+} frame_parser_t;
+
+void frame_parser_reset(frame_parser_t *p);
+
+/**
+ * Starts a write at now_ms (any monotonic millisecond clock; wrap-around
+ * is handled).  Call before feeding it.
+ *
+ * @return true if a frame left incomplete more than FRAME_GAP_MS ago was
+ *         dropped.
+ */
+bool frame_parser_begin_write(frame_parser_t *p, uint32_t now_ms);
+
+/**
+ * Feeds one contiguous segment.  Set end_of_write on the last segment of a
+ * write that should terminate a pending text frame.
+ */
+void frame_parser_feed(frame_parser_t *p, const uint8_t *data, size_t len,
+                       bool end_of_write, frame_cb_t cb, void *arg);
+
+struct os_mbuf;
+
+/* Walks an mbuf chain without flattening it and feeds every segment. */
+void frame_parser_feed_mbuf(frame_parser_t *p, const struct os_mbuf *om,
+                            bool end_of_write, frame_cb_t cb, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,258 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_LOCK_DIAG
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "host/ble_hs.h"
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "conn_ctx.h"
+#include "frame_parser.h"
+#include "lock_diag.h"
+
+/*
+ * Recording is a few plain increments with no lock.  Most histograms have
+ * a single writer (the NimBLE host task, or the actuator tasks for the
+ * unlock and servo spans); where tasks do race, a lost count is cheaper
+ * than a critical section on every probe.  The notify FIFOs are the
+ * exception: a mismatched pair would corrupt every later sample, so they
+ * sit behind a spinlock.
+ */
+#define DIAG_CALIBRATE_ROUNDS       64
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t max_us;
+    uint32_t bucket[DIAG_BUCKETS];
+} diag_hist_data_t;
+
+static diag_hist_data_t diag_hist[DIAG_HIST_COUNT];
+static uint32_t diag_cnt[DIAG_CNT_COUNT];
+static uint16_t diag_probe_cycles;
+static portMUX_TYPE diag_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Per door: write time of the unlock its actuator is about to take, 0 if
+ * none, and the start of the current servo move */
+static volatile uint32_t diag_unlock_us[CONFIG_LOCK_DOOR_COUNT];
+static uint32_t diag_servo_us[CONFIG_LOCK_DOOR_COUNT];
+
+void
+lock_diag_record(diag_hist_t hist, uint32_t us)
+{
+    diag_hist_data_t *h = &diag_hist[hist];
+    int b = us < 2 ? 0 : 31 - __builtin_clz(us);
+
+    h->bucket[b < DIAG_BUCKETS ? b : DIAG_BUCKETS - 1]++;
+    h->count++;
+    if (us > h->max_us)
+    {
+        h->max_us = us;
+    }
+}
+
+void
+lock_diag_count(diag_cnt_t cnt)
+{
+    diag_cnt[cnt]++;
+}
+
+void
+lock_diag_notify_submit(uint16_t conn_handle)
+{
+    uint32_t now = lock_hal_now_us();
+    conn_ctx_t *ctx = conn_ctx_find(conn_handle);
+
+    portENTER_CRITICAL(&diag_lock);
+    diag_cnt[DIAG_CNT_NOTIFY_SUBMIT]++;
+    if (ctx != NULL)
+    {
+        /* When full the oldest entry is overwritten */
+        ctx->diag_tx_us[ctx->diag_tx_head++ % CONN_CTX_DIAG_TX_DEPTH] = now;
+        if ((uint8_t)(ctx->diag_tx_head - ctx->diag_tx_tail) > CONN_CTX_DIAG_TX_DEPTH)
+        {
+            ctx->diag_tx_tail++;
+        }
+    }
+    portEXIT_CRITICAL(&diag_lock);
+}
+
+void
+lock_diag_notify_tx(uint16_t conn_handle, int status)
+{
+    uint32_t now = lock_hal_now_us();
+    conn_ctx_t *ctx = conn_ctx_find(conn_handle);
+    uint32_t sent = 0;
+    bool matched = false;
+
+    portENTER_CRITICAL(&diag_lock);
+    diag_cnt[status == 0 ? DIAG_CNT_NOTIFY_TX : DIAG_CNT_NOTIFY_TX_ERR]++;
+    if (ctx != NULL && ctx->diag_tx_head != ctx->diag_tx_tail)
+    {
+        sent = ctx->diag_tx_us[ctx->diag_tx_tail++ % CONN_CTX_DIAG_TX_DEPTH];
+        matched = true;
+    }
+    else
+    {
+        diag_cnt[DIAG_CNT_NOTIFY_UNMATCHED]++;
+    }
+    portEXIT_CRITICAL(&diag_lock);
+
+    if (matched && status == 0)
+    {
+        lock_diag_record(DIAG_HIST_NOTIFY, now - sent);
+    }
+}
+
+void
+lock_diag_unlock_requested(uint8_t door, uint32_t write_us)
+{
+    /* 0 means "nothing pending" */
+    diag_unlock_us[door] = write_us | 1;
+}
+
+void
+lock_diag_unlock_served(uint8_t door)
+{
+    uint32_t write_us = diag_unlock_us[door];
+    uint32_t us;
+
+    if (write_us != 0)
+    {
+        diag_unlock_us[door] = 0;
+        us = (uint32_t)lock_hal_now_us() - write_us;
+        lock_diag_record(DIAG_HIST_UNLOCK, us);
+        if (us > CONFIG_LOCK_DIAG_UNLOCK_BUDGET_MS * 1000)
+        {
+            /* Typically a wake from light sleep or a clock still ramping */
+            diag_cnt[DIAG_CNT_UNLOCK_LATE]++;
+            MODLOG_DFLT(WARN, "door %d unlock took %ums, budget %ums\n", door,
+                        (unsigned)(us / 1000), CONFIG_LOCK_DIAG_UNLOCK_BUDGET_MS);
+        }
+    }
+}
+
+void
+lock_diag_servo_start(uint8_t door)
+{
+    diag_servo_us[door] = lock_hal_now_us();
+}
+
+void
+lock_diag_servo_stop(uint8_t door)
+{
+    lock_diag_record(DIAG_HIST_SERVO, (uint32_t)lock_hal_now_us() - diag_servo_us[door]);
+}
+
+static uint8_t *
+diag_put_u16(uint8_t *p, uint32_t v)
+{
+    if (v > 0xFFFF)
+    {
+        v = 0xFFFF;
+    }
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static uint8_t *
+diag_put_u32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        *p++ = v >> (8 * i);
+    }
+    return p;
+}
+
+int
+lock_diag_dump(uint8_t *buf, int cap)
+{
+    uint8_t *p = buf;
+
+    if (cap < DIAG_DUMP_SIZE)
+    {
+        return 0;
+    }
+    *p++ = DIAG_VERSION;
+    *p++ = DIAG_HIST_COUNT;
+    *p++ = DIAG_BUCKETS;
+    *p++ = DIAG_CNT_COUNT;
+    p = diag_put_u16(p, diag_probe_cycles);
+    p = diag_put_u16(p, 0);
+    for (int i = 0; i < DIAG_CNT_COUNT; i++)
+    {
+        p = diag_put_u32(p, diag_cnt[i]);
+    }
+    for (int i = 0; i < DIAG_HIST_COUNT; i++)
+    {
+        p = diag_put_u32(p, diag_hist[i].count);
+        p = diag_put_u32(p, diag_hist[i].max_us);
+        for (int b = 0; b < DIAG_BUCKETS; b++)
+        {
+            p = diag_put_u16(p, diag_hist[i].bucket[b]);
+        }
+    }
+    return p - buf;
+}
+
+void
+lock_diag_uart_dump(void)
+{
+    uint8_t frame[3 + DIAG_DUMP_SIZE];
+    int len = lock_diag_dump(frame + 3, DIAG_DUMP_SIZE);
+
+    frame[0] = FRAME_BIN_MAGIC;
+    frame[1] = len & 0xFF;
+    frame[2] = len >> 8;
+    lock_hal_uart_write(frame, 3 + len);
+}
+
+int
+lock_diag_access(uint16_t conn_handle, uint16_t attr_handle,
+                 struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    uint8_t buf[DIAG_DUMP_SIZE];
+    int len;
+
+    if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR)
+    {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    /* Longer than one ATT payload; the host serves read-blob offsets from
+     * a fresh dump each time, so a long read may mix two snapshots */
+    len = lock_diag_dump(buf, sizeof buf);
+    return os_mbuf_append(ctxt->om, buf, len) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+esp_err_t
+lock_diag_init(void)
+{
+    uint32_t start;
+
+    /* Measure what a probe pair plus a record costs on this part */
+    start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < DIAG_CALIBRATE_ROUNDS; i++)
+    {
+        DIAG_SPAN_BEGIN(t);
+        DIAG_SPAN_END(DIAG_HIST_GAP_EVENT, t);
+    }
+    diag_probe_cycles = (esp_cpu_get_cycle_count() - start) / DIAG_CALIBRATE_ROUNDS;
+    memset(&diag_hist[DIAG_HIST_GAP_EVENT], 0, sizeof diag_hist[0]);
+
+    MODLOG_DFLT(INFO, "diag: probe costs %u cycles (%u MHz)\n",
+                diag_probe_cycles, (unsigned)esp_rom_get_cpu_ticks_per_us());
+    return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef LOCK_DIAG_H
+#define LOCK_DIAG_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#if CONFIG_LOCK_DIAG
+#include "esp_timer.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Latency probes.  Each histogram has DIAG_BUCKETS power-of-two buckets:
+ * bucket 0 counts spans under 2us and bucket i spans in [2^i, 2^(i+1)) us,
+ * the last one being open-ended.
+ *
+ * Every span is timed with the microsecond timer.  The CPU cycle counter
+ * would be cheaper, but with CONFIG_LOCK_PM the CPU clock is scaled at run
+ * time and cycles no longer convert to a fixed time.  With
+ * CONFIG_LOCK_DIAG off every probe compiles to nothing.
+ *
+ * Dump layout (version 1, little-endian):
+ *   u8 version, u8 histograms, u8 buckets, u8 counters, u16 probe_cycles,
+ *   u16 reserved, u32 counter[counters],
+ *   { u32 count, u32 max_us, u16 bucket[buckets] } [histograms]
+ * Bucket counts saturate at 0xFFFF.  probe_cycles is the measured cost of
+ * one probe pair in CPU cycles at the boot clock.
+ */
+#define DIAG_VERSION                1
+#define DIAG_BUCKETS                16
+
+typedef enum
+{
+    DIAG_HIST_GAP_EVENT = 0,    /* GAP event handler, entry to exit */
+    DIAG_HIST_GATT_WRITE,       /* SPP write handler, receipt to return */
+    DIAG_HIST_VERIFY,           /* PIN and TOTP check */
+    DIAG_HIST_NOTIFY,           /* Notify submit to BLE_GAP_EVENT_NOTIFY_TX */
+    DIAG_HIST_UNLOCK,           /* Write receipt to the actuator acting on it */
+    DIAG_HIST_SERVO,            /* Servo start to end of travel */
+    DIAG_HIST_COUNT
+} diag_hist_t;
+
+typedef enum
+{
+    DIAG_CNT_GAP_EVENTS = 0,
+    DIAG_CNT_WRITES,
+    DIAG_CNT_NOTIFY_SUBMIT,
+    DIAG_CNT_NOTIFY_TX,
+    DIAG_CNT_NOTIFY_TX_ERR,
+    DIAG_CNT_NOTIFY_UNMATCHED,  /* Completion with no recorded submit */
+    DIAG_CNT_UNLOCK_LATE,       /* Unlocks over CONFIG_LOCK_DIAG_UNLOCK_BUDGET_MS */
+    DIAG_CNT_COUNT
+} diag_cnt_t;
+
+#define DIAG_DUMP_SIZE \
+    (8 + 4 * DIAG_CNT_COUNT + DIAG_HIST_COUNT * (8 + 2 * DIAG_BUCKETS))
+
+#if CONFIG_LOCK_DIAG
+
+struct ble_gatt_access_ctxt;
+
+esp_err_t lock_diag_init(void);
+
+void lock_diag_record(diag_hist_t hist, uint32_t us);
+void lock_diag_count(diag_cnt_t cnt);
+
+/* Notify submit and completion, paired per connection in FIFO order */
+void lock_diag_notify_submit(uint16_t conn_handle);
+void lock_diag_notify_tx(uint16_t conn_handle, int status);
+
+/* An accepted write asks for a door; that door's actuator taking the
+ * command (starting the servo, or extending the hold) closes the span */
+void lock_diag_unlock_requested(uint8_t door, uint32_t write_us);
+void lock_diag_unlock_served(uint8_t door);
+
+/* Servo travel, from the door's actuator task */
+void lock_diag_servo_start(uint8_t door);
+void lock_diag_servo_stop(uint8_t door);
+
+/* Writes the dump described above.  Returns its length. */
+int lock_diag_dump(uint8_t *buf, int cap);
+
+/* Sends the dump on the bridge UART as a binary frame */
+void lock_diag_uart_dump(void);
+
+int lock_diag_access(uint16_t conn_handle, uint16_t attr_handle,
+                     struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+static inline uint32_t
+lock_diag_now(void)
+{
+    return (uint32_t)esp_timer_get_time();
+}
+
+#define DIAG_SPAN_BEGIN(t)          uint32_t t = lock_diag_now()
+#define DIAG_SPAN_END(hist, t)      lock_diag_record(hist, lock_diag_now() - (t))
+#define DIAG_COUNT(cnt)             lock_diag_count(cnt)
+#define DIAG_CALL(call)             call
+
+#else
+
+#define DIAG_SPAN_BEGIN(t)          do { } while (0)
+#define DIAG_SPAN_END(hist, t)      do { } while (0)
+#define DIAG_COUNT(cnt)             do { } while (0)
+#define DIAG_CALL(call)             do { } while (0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
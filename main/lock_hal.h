@@ -0,0 +1,146 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef LOCK_HAL_H
+#define LOCK_HAL_H
+
+/*
+ * Thin hardware abstraction used by the lock logic.  lock_hal_esp.c is the
+ * only translation unit that talks to the BLE notify path, LEDC, UART and
+ * NVS drivers directly; an off-target build links its own implementation of
+ * these functions instead.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Monotonic time in microseconds since boot */
+int64_t lock_hal_now_us(void);
+
+/* Wall-clock time in Unix seconds; whatever was last set, counted from 0
+ * at boot if never set. */
+int64_t lock_hal_wall_time(void);
+void lock_hal_set_wall_time(int64_t unix_s);
+
+/* Wall-clock times before this are taken to be uptime, not a set clock */
+#define LOCK_HAL_CLOCK_VALID    1700000000
+
+/* Application version string from the image header, e.g. "1.2.0" */
+const char *lock_hal_fw_version(void);
+
+/* Initializes NVS, erasing it if the layout is stale. */
+esp_err_t lock_hal_nvs_init(void);
+
+/**
+ * Sends a notification carrying a copy of data.
+ *
+ * @return 0 on success, BLE_HS_ENOMEM if no mbuf could be allocated, or the
+ *         NimBLE error from the notify call.
+ */
+int lock_hal_notify(uint16_t conn_handle, uint16_t attr_handle,
+                    const void *data, uint16_t len);
+
+struct os_mbuf;
+
+/* Sends a notification carrying om, which is consumed whatever the result. */
+int lock_hal_notify_mbuf(uint16_t conn_handle, uint16_t attr_handle,
+                         struct os_mbuf *om);
+
+/* Servo PWM timing; duties are in LEDC ticks of LOCK_HAL_SERVO_RES_BITS */
+#define LOCK_HAL_SERVO_FREQ_HZ  50
+#define LOCK_HAL_SERVO_RES_BITS 14
+
+/* Fade-end callback.  Runs in interrupt context; returns true if it woke a
+ * higher-priority task. */
+typedef bool (*lock_hal_fade_cb_t)(void *arg);
+
+/**
+ * Configures the servo PWM output of a door (0 .. CONFIG_LOCK_DOOR_COUNT-1)
+ * and the hardware fade engine.  Every door has its own LEDC channel on a
+ * shared timer.  The output stays at 0% duty.  fade_done is called at the
+ * end of every fade on that door.
+ */
+void lock_hal_servo_init(uint8_t door, lock_hal_fade_cb_t fade_done, void *arg);
+
+/* Applies a new servo PWM duty at once. */
+void lock_hal_servo_set_duty(uint8_t door, uint32_t duty);
+
+/* Starts a linear hardware fade to duty over ms and returns immediately. */
+void lock_hal_servo_fade(uint8_t door, uint32_t duty, uint32_t ms);
+
+/**
+ * Servo power gating, with CONFIG_LOCK_PM.  Off stops the door's PWM output
+ * at a low level and, once every door is off, drives the servo supply GPIO
+ * low; on switches the supply back on.  The output restarts at the next
+ * lock_hal_servo_set_duty().  Without CONFIG_LOCK_PM it does nothing and
+ * the PWM runs all the time.
+ */
+void lock_hal_servo_power(uint8_t door, bool on);
+
+/* Installs the bridge UART driver and returns its event queue. */
+esp_err_t lock_hal_uart_init(QueueHandle_t *event_queue);
+
+/* Reads up to len bytes from the bridge UART. */
+int lock_hal_uart_read(void *buf, uint32_t len, TickType_t ticks_to_wait);
+
+/* Queues len bytes for transmission on the bridge UART. */
+int lock_hal_uart_write(const void *buf, size_t len);
+
+/* Number of received bytes waiting in the UART driver buffer */
+size_t lock_hal_uart_buffered(void);
+
+/* Discards everything in the UART receive path. */
+void lock_hal_uart_flush(void);
+
+/* Forgets the line ends recorded by pattern detection.  The driver raises
+ * UART_PATTERN_DET once per received '\n'. */
+void lock_hal_uart_pattern_flush(void);
+
+/* Raw data partitions; erase granularity is LOCK_HAL_SECTOR_SIZE. */
+#define LOCK_HAL_SECTOR_SIZE    4096
+
+typedef const void *lock_hal_part_t;
+
+/* Finds a data partition by label and returns its size in bytes. */
+esp_err_t lock_hal_part_find(const char *label, lock_hal_part_t *part, size_t *size);
+esp_err_t lock_hal_part_read(lock_hal_part_t part, size_t off, void *buf, size_t len);
+esp_err_t lock_hal_part_write(lock_hal_part_t part, size_t off, const void *buf, size_t len);
+esp_err_t lock_hal_part_erase(lock_hal_part_t part, size_t off, size_t len);
+
+/* Small NVS blobs.  *len is the buffer size in and the blob size out. */
+esp_err_t lock_hal_nvs_get(const char *ns, const char *key, void *buf, size_t *len);
+esp_err_t lock_hal_nvs_set(const char *ns, const char *key, const void *buf, size_t len);
+esp_err_t lock_hal_nvs_erase(const char *ns, const char *key);
+
+/* Fills buf from the hardware RNG. */
+void lock_hal_random(void *buf, size_t len);
+
+/*
+ * Firmware update into the next OTA slot.  One update at a time, written
+ * in order; flash is erased a sector ahead of the data.
+ */
+esp_err_t lock_hal_ota_begin(uint32_t size);
+esp_err_t lock_hal_ota_write(const void *buf, size_t len);
+
+/* Checks the image and makes it the one the next boot starts. */
+esp_err_t lock_hal_ota_end(void);
+void lock_hal_ota_abort(void);
+
+void lock_hal_restart(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,492 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <sys/time.h>
+#include "esp_app_desc.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+#include "esp_random.h"
+#include "nvs_flash.h"
+#include "esp_sleep.h"
+#include "driver/gpio.h"
+#include "driver/ledc.h"
+#include "driver/uart.h"
+#include "host/ble_hs.h"
+#include "lock_hal.h"
+#include "lock_diag.h"
+#include "mem_acct.h"
+
+#define LEDC_TIMER              LEDC_TIMER_0
+#define LEDC_MODE               LEDC_LOW_SPEED_MODE
+#define LEDC_CHANNEL(door)      ((ledc_channel_t)(LEDC_CHANNEL_0 + (door)))
+#define LEDC_DUTY_RES           LOCK_HAL_SERVO_RES_BITS // Set duty resolution to 14 bits
+#define LEDC_FREQUENCY          LOCK_HAL_SERVO_FREQ_HZ // Frequency in Hertz. Set frequency at 50 Hz
+
+#define LOCK_HAL_UART           UART_NUM_0
+
+/* Line ends recorded between two UART_PATTERN_DET events */
+#define LOCK_HAL_UART_PATTERN_DEPTH 16
+
+/* RX edges that wake the chip from light sleep; those bytes are lost */
+#define LOCK_HAL_UART_WAKE_EDGES    3
+
+_Static_assert(CONFIG_LOCK_DOOR_COUNT <= SOC_LEDC_CHANNEL_NUM, "more doors than LEDC channels");
+
+/* Servo output GPIO of each door */
+static const uint8_t ledc_output_io[CONFIG_LOCK_DOOR_COUNT] = {
+    CONFIG_LOCK_DOOR0_GPIO,
+#if CONFIG_LOCK_DOOR_COUNT > 1
+    CONFIG_LOCK_DOOR1_GPIO,
+#endif
+#if CONFIG_LOCK_DOOR_COUNT > 2
+    CONFIG_LOCK_DOOR2_GPIO,
+#endif
+#if CONFIG_LOCK_DOOR_COUNT > 3
+    CONFIG_LOCK_DOOR3_GPIO,
+#endif
+#if CONFIG_LOCK_DOOR_COUNT > 4
+    CONFIG_LOCK_DOOR4_GPIO,
+#endif
+#if CONFIG_LOCK_DOOR_COUNT > 5
+    CONFIG_LOCK_DOOR5_GPIO,
+#endif
+#if CONFIG_LOCK_DOOR_COUNT > 6
+    CONFIG_LOCK_DOOR6_GPIO,
+#endif
+#if CONFIG_LOCK_DOOR_COUNT > 7
+    CONFIG_LOCK_DOOR7_GPIO,
+#endif
+};
+
+int64_t
+lock_hal_now_us(void)
+{
+    return esp_timer_get_time();
+}
+
+int64_t
+lock_hal_wall_time(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec;
+}
+
+void
+lock_hal_set_wall_time(int64_t unix_s)
+{
+    struct timeval tv = {
+        .tv_sec = unix_s,
+    };
+
+    settimeofday(&tv, NULL);
+}
+
+const char *
+lock_hal_fw_version(void)
+{
+    return esp_app_get_description()->version;
+}
+
+esp_err_t
+lock_hal_nvs_init(void)
+{
+    esp_err_t ret = nvs_flash_init();
+
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    return ret;
+}
+
+int
+lock_hal_notify(uint16_t conn_handle, uint16_t attr_handle,
+                const void *data, uint16_t len)
+{
+    struct os_mbuf *txom;
+
+    txom = ble_hs_mbuf_from_flat(data, len);
+    if (txom == NULL)
+    {
+        MEM_COUNT(MEM_CNT_MSYS_FAIL);
+        return BLE_HS_ENOMEM;
+    }
+    return lock_hal_notify_mbuf(conn_handle, attr_handle, txom);
+}
+
+int
+lock_hal_notify_mbuf(uint16_t conn_handle, uint16_t attr_handle,
+                     struct os_mbuf *om)
+{
+    int rc;
+
+    /* BLE_GAP_EVENT_NOTIFY_TX can fire before the call returns */
+    DIAG_CALL(lock_diag_notify_submit(conn_handle));
+    /* Consumes om on both success and failure */
+    rc = ble_gatts_notify_custom(conn_handle, attr_handle, om);
+    if (rc == BLE_HS_ENOMEM)
+    {
+        MEM_COUNT(MEM_CNT_NOTIFY_ENOMEM);
+    }
+    return rc;
+}
+
+static struct
+{
+    lock_hal_fade_cb_t cb;
+    void *arg;
+} servo_fade[CONFIG_LOCK_DOOR_COUNT];
+static bool servo_timer_ready;
+#if CONFIG_LOCK_PM
+static uint32_t servo_powered;              /* Doors with the output on */
+static portMUX_TYPE servo_power_lock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+/* The registered user argument is the door number */
+static bool
+lock_hal_fade_isr(const ledc_cb_param_t *param, void *arg)
+{
+    uintptr_t door = (uintptr_t)arg;
+
+    if (param->event != LEDC_FADE_END_EVT || servo_fade[door].cb == NULL)
+    {
+        return false;
+    }
+    return servo_fade[door].cb(servo_fade[door].arg);
+}
+
+void
+lock_hal_servo_init(uint8_t door, lock_hal_fade_cb_t fade_done, void *arg)
+{
+    ledc_cbs_t cbs = {
+        .fade_cb = lock_hal_fade_isr,
+    };
+
+    if (!servo_timer_ready)
+    {
+        // Prepare and then apply the LEDC PWM timer configuration, shared by all doors
+        ledc_timer_config_t ledc_timer = {
+            .speed_mode       = LEDC_MODE,
+            .duty_resolution  = LEDC_DUTY_RES,
+            .timer_num        = LEDC_TIMER,
+            .freq_hz          = LEDC_FREQUENCY,
+            .clk_cfg          = LEDC_AUTO_CLK
+        };
+        ESP_ERROR_CHECK(ledc_timer_config(&ledc_timer));
+        ESP_ERROR_CHECK(ledc_fade_func_install(0));
+#if CONFIG_LOCK_PM && CONFIG_LOCK_SERVO_POWER_GPIO >= 0
+        gpio_config_t io = {
+            .pin_bit_mask = 1ULL << CONFIG_LOCK_SERVO_POWER_GPIO,
+            .mode = GPIO_MODE_OUTPUT,
+        };
+        ESP_ERROR_CHECK(gpio_set_level(CONFIG_LOCK_SERVO_POWER_GPIO, 0));
+        ESP_ERROR_CHECK(gpio_config(&io));
+#endif
+        servo_timer_ready = true;
+    }
+
+    // Prepare and then apply the LEDC PWM channel configuration
+    ledc_channel_config_t ledc_channel = {
+        .speed_mode     = LEDC_MODE,
+        .channel        = LEDC_CHANNEL(door),
+        .timer_sel      = LEDC_TIMER,
+        .intr_type      = LEDC_INTR_DISABLE,
+        .gpio_num       = ledc_output_io[door],
+        .duty           = 0, // Set duty to 0%
+        .hpoint         = 0
+    };
+    ESP_ERROR_CHECK(ledc_channel_config(&ledc_channel));
+
+    servo_fade[door].cb = fade_done;
+    servo_fade[door].arg = arg;
+    ESP_ERROR_CHECK(ledc_cb_register(LEDC_MODE, LEDC_CHANNEL(door), &cbs,
+                                     (void *)(uintptr_t)door));
+}
+
+void
+lock_hal_servo_set_duty(uint8_t door, uint32_t duty)
+{
+    // Set the duty cycle for the LEDC channel
+    ESP_ERROR_CHECK(ledc_set_duty(LEDC_MODE, LEDC_CHANNEL(door), duty));
+    // Update the LEDC channel with the new duty cycle
+    ESP_ERROR_CHECK(ledc_update_duty(LEDC_MODE, LEDC_CHANNEL(door)));
+}
+
+void
+lock_hal_servo_fade(uint8_t door, uint32_t duty, uint32_t ms)
+{
+    ESP_ERROR_CHECK(ledc_set_fade_with_time(LEDC_MODE, LEDC_CHANNEL(door), duty, ms));
+    ESP_ERROR_CHECK(ledc_fade_start(LEDC_MODE, LEDC_CHANNEL(door), LEDC_FADE_NO_WAIT));
+}
+
+void
+lock_hal_servo_power(uint8_t door, bool on)
+{
+#if CONFIG_LOCK_PM
+    uint32_t was;
+
+    if (!on)
+    {
+        ESP_ERROR_CHECK(ledc_stop(LEDC_MODE, LEDC_CHANNEL(door), 0));
+    }
+    /* The supply is shared; it stays on while any door is powered */
+    portENTER_CRITICAL(&servo_power_lock);
+    was = servo_powered;
+    servo_powered = on ? was | 1u << door : was & ~(1u << door);
+#if CONFIG_LOCK_SERVO_POWER_GPIO >= 0
+    if ((was == 0) != (servo_powered == 0))
+    {
+        gpio_set_level(CONFIG_LOCK_SERVO_POWER_GPIO, servo_powered != 0);
+    }
+#endif
+    portEXIT_CRITICAL(&servo_power_lock);
+#endif
+}
+
+esp_err_t
+lock_hal_uart_init(QueueHandle_t *event_queue)
+{
+    uart_config_t uart_config = {
+        .baud_rate = 115200,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_RTS,
+        .rx_flow_ctrl_thresh = 122,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+    esp_err_t ret;
+
+    // Install UART driver, and get the queue.
+    ret = uart_driver_install(LOCK_HAL_UART, 4096, 8192, 10, event_queue, 0);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    // Set UART parameters
+    ret = uart_param_config(LOCK_HAL_UART, &uart_config);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    // Set UART pins
+    ret = uart_set_pin(LOCK_HAL_UART, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE,
+                       UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    if (ret == ESP_OK)
+    {
+        /* Wake the reader at each line end rather than at the RX timeout */
+        ret = uart_enable_pattern_det_baud_intr(LOCK_HAL_UART, '\n', 1, 9, 0, 0);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = uart_pattern_queue_reset(LOCK_HAL_UART, LOCK_HAL_UART_PATTERN_DEPTH);
+    }
+#if CONFIG_LOCK_PM
+    if (ret == ESP_OK)
+    {
+        /* Incoming data wakes the chip; the bridge then holds the clocks */
+        ret = uart_set_wakeup_threshold(LOCK_HAL_UART, LOCK_HAL_UART_WAKE_EDGES);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = esp_sleep_enable_uart_wakeup(LOCK_HAL_UART);
+    }
+#endif
+    return ret;
+}
+
+int
+lock_hal_uart_read(void *buf, uint32_t len, TickType_t ticks_to_wait)
+{
+    return uart_read_bytes(LOCK_HAL_UART, buf, len, ticks_to_wait);
+}
+
+int
+lock_hal_uart_write(const void *buf, size_t len)
+{
+    return uart_write_bytes(LOCK_HAL_UART, buf, len);
+}
+
+size_t
+lock_hal_uart_buffered(void)
+{
+    size_t len = 0;
+
+    uart_get_buffered_data_len(LOCK_HAL_UART, &len);
+    return len;
+}
+
+void
+lock_hal_uart_flush(void)
+{
+    uart_flush_input(LOCK_HAL_UART);
+}
+
+void
+lock_hal_uart_pattern_flush(void)
+{
+    while (uart_pattern_pop_pos(LOCK_HAL_UART) != -1)
+    {
+    }
+}
+
+esp_err_t
+lock_hal_part_find(const char *label, lock_hal_part_t *part, size_t *size)
+{
+    const esp_partition_t *p;
+
+    p = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (p == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *part = p;
+    *size = p->size;
+    return ESP_OK;
+}
+
+esp_err_t
+lock_hal_part_read(lock_hal_part_t part, size_t off, void *buf, size_t len)
+{
+    return esp_partition_read(part, off, buf, len);
+}
+
+esp_err_t
+lock_hal_part_write(lock_hal_part_t part, size_t off, const void *buf, size_t len)
+{
+    return esp_partition_write(part, off, buf, len);
+}
+
+esp_err_t
+lock_hal_part_erase(lock_hal_part_t part, size_t off, size_t len)
+{
+    return esp_partition_erase_range(part, off, len);
+}
+
+esp_err_t
+lock_hal_nvs_get(const char *ns, const char *key, void *buf, size_t *len)
+{
+    nvs_handle_t h;
+    esp_err_t ret = nvs_open(ns, NVS_READONLY, &h);
+
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    ret = nvs_get_blob(h, key, buf, len);
+    nvs_close(h);
+    return ret;
+}
+
+esp_err_t
+lock_hal_nvs_set(const char *ns, const char *key, const void *buf, size_t len)
+{
+    nvs_handle_t h;
+    esp_err_t ret = nvs_open(ns, NVS_READWRITE, &h);
+
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    ret = nvs_set_blob(h, key, buf, len);
+    if (ret == ESP_OK)
+    {
+        ret = nvs_commit(h);
+    }
+    nvs_close(h);
+    return ret;
+}
+
+esp_err_t
+lock_hal_nvs_erase(const char *ns, const char *key)
+{
+    nvs_handle_t h;
+    esp_err_t ret = nvs_open(ns, NVS_READWRITE, &h);
+
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    ret = nvs_erase_key(h, key);
+    if (ret == ESP_OK)
+    {
+        ret = nvs_commit(h);
+    }
+    nvs_close(h);
+    return ret;
+}
+
+void
+lock_hal_random(void *buf, size_t len)
+{
+    esp_fill_random(buf, len);
+}
+
+static esp_ota_handle_t ota_handle;
+static const esp_partition_t *ota_part;
+
+esp_err_t
+lock_hal_ota_begin(uint32_t size)
+{
+    esp_err_t ret;
+
+    ota_part = esp_ota_get_next_update_partition(NULL);
+    if (ota_part == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (size > ota_part->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    /* Erasing as the data comes keeps begin from stalling for seconds */
+    ret = esp_ota_begin(ota_part, OTA_WITH_SEQUENTIAL_WRITES, &ota_handle);
+    if (ret != ESP_OK)
+    {
+        ota_handle = 0;
+    }
+    return ret;
+}
+
+esp_err_t
+lock_hal_ota_write(const void *buf, size_t len)
+{
+    return esp_ota_write(ota_handle, buf, len);
+}
+
+esp_err_t
+lock_hal_ota_end(void)
+{
+    esp_err_t ret = esp_ota_end(ota_handle);
+
+    ota_handle = 0;
+    if (ret == ESP_OK)
+    {
+        ret = esp_ota_set_boot_partition(ota_part);
+    }
+    return ret;
+}
+
+void
+lock_hal_ota_abort(void)
+{
+    if (ota_handle != 0)
+    {
+        esp_ota_abort(ota_handle);
+        ota_handle = 0;
+    }
+}
+
+void
+lock_hal_restart(void)
+{
+    esp_restart();
+}
@@ -0,0 +1,178 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_LOCK_PM
+
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "defer.h"
+#include "lock_pm.h"
+
+typedef struct
+{
+    esp_pm_lock_handle_t lock;
+    int64_t since_us;           /* Start of the current window */
+    lock_pm_stats_t stats;
+} lock_pm_path_data_t;
+
+static const struct
+{
+    esp_pm_lock_type_t type;
+    const char *name;
+} pm_path_def[LOCK_PM_PATHS] = {
+    [LOCK_PM_BLE]      = { ESP_PM_CPU_FREQ_MAX, "ble" },
+    [LOCK_PM_UART]     = { ESP_PM_APB_FREQ_MAX, "uart" },
+    [LOCK_PM_ACTUATOR] = { ESP_PM_APB_FREQ_MAX, "actuator" },
+};
+
+static lock_pm_path_data_t pm_path[LOCK_PM_PATHS];
+static portMUX_TYPE pm_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void
+lock_pm_acquire(lock_pm_path_t path)
+{
+    lock_pm_path_data_t *p = &pm_path[path];
+    int64_t now = lock_hal_now_us();
+
+    /* esp_pm locks count too; this only keeps the statistics */
+    portENTER_CRITICAL(&pm_lock);
+    if (p->stats.held++ == 0)
+    {
+        p->since_us = now;
+        p->stats.acquires++;
+    }
+    portEXIT_CRITICAL(&pm_lock);
+    esp_pm_lock_acquire(p->lock);
+}
+
+void
+lock_pm_release(lock_pm_path_t path)
+{
+    lock_pm_path_data_t *p = &pm_path[path];
+    int64_t now = lock_hal_now_us();
+    uint32_t us;
+
+    esp_pm_lock_release(p->lock);
+    portENTER_CRITICAL(&pm_lock);
+    if (p->stats.held != 0 && --p->stats.held == 0)
+    {
+        us = now - p->since_us;
+        p->stats.total_us += us;
+        if (us > p->stats.max_us)
+        {
+            p->stats.max_us = us;
+        }
+    }
+    portEXIT_CRITICAL(&pm_lock);
+}
+
+void
+lock_pm_get_stats(lock_pm_path_t path, lock_pm_stats_t *out)
+{
+    int64_t now = lock_hal_now_us();
+
+    portENTER_CRITICAL(&pm_lock);
+    *out = pm_path[path].stats;
+    if (out->held != 0)
+    {
+        /* Count the window in progress */
+        out->total_us += now - pm_path[path].since_us;
+    }
+    portEXIT_CRITICAL(&pm_lock);
+}
+
+void
+lock_pm_report(void)
+{
+    uint64_t up_ms = lock_hal_now_us() / 1000;
+    lock_pm_stats_t st;
+
+    for (int i = 0; i < LOCK_PM_PATHS; i++)
+    {
+        lock_pm_get_stats(i, &st);
+        MODLOG_DFLT(INFO, "pm %-8s %u windows, held %llums (%u.%u%%), longest %ums%s\n",
+                    pm_path_def[i].name, (unsigned)st.acquires,
+                    (unsigned long long)(st.total_us / 1000),
+                    (unsigned)(st.total_us / 10 / (up_ms ? up_ms : 1)),
+                    (unsigned)(st.total_us / (up_ms ? up_ms : 1) % 10),
+                    (unsigned)(st.max_us / 1000), st.held ? ", held now" : "");
+    }
+#if CONFIG_PM_PROFILING
+    /* Per-mode times: light sleep, APB_MIN, APB_MAX and CPU_MAX */
+    esp_pm_dump_locks(stdout);
+#endif
+}
+
+#if CONFIG_LOCK_PM_PROFILE
+/* Logging is too heavy for the esp_timer task */
+static void
+pm_report_job(uint16_t conn_handle, void *arg)
+{
+    lock_pm_report();
+}
+
+static void
+pm_report_timer_cb(void *arg)
+{
+    defer_submit(DEFER_CONN_NONE, 0, pm_report_job, NULL);
+}
+#endif
+
+esp_err_t
+lock_pm_init(void)
+{
+    esp_pm_config_t cfg = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_LOCK_PM_MIN_FREQ_MHZ,
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        .light_sleep_enable = true,
+#endif
+    };
+    esp_err_t ret;
+
+    for (int i = 0; i < LOCK_PM_PATHS; i++)
+    {
+        ret = esp_pm_lock_create(pm_path_def[i].type, 0, pm_path_def[i].name,
+                                 &pm_path[i].lock);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+
+    ret = esp_pm_configure(&cfg);
+    if (ret != ESP_OK)
+    {
+        MODLOG_DFLT(ERROR, "pm: configure failed; rc=%d\n", ret);
+        return ret;
+    }
+    MODLOG_DFLT(INFO, "pm: %d-%d MHz, light sleep %s\n", cfg.min_freq_mhz,
+                cfg.max_freq_mhz, cfg.light_sleep_enable ? "on" : "off");
+
+#if CONFIG_LOCK_PM_PROFILE
+    const esp_timer_create_args_t timer_args = {
+        .callback = pm_report_timer_cb,
+        .name = "pm_report",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_handle_t timer;
+
+    ret = esp_timer_create(&timer_args, &timer);
+    if (ret == ESP_OK)
+    {
+        ret = esp_timer_start_periodic(timer, CONFIG_LOCK_PM_REPORT_S * 1000000ULL);
+    }
+#endif
+    return ret;
+}
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef LOCK_PM_H
+#define LOCK_PM_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Power management.
+ *
+ * With CONFIG_LOCK_PM the CPU and APB clocks scale down and the chip
+ * light-sleeps whenever no task is runnable (tickless idle).  Each path
+ * that cannot tolerate that holds its lock only for its active window:
+ *
+ *   BLE        CPU at full speed while any link is at the FAST
+ *              connection-parameter level, i.e. the client is talking
+ *   UART       APB at full speed while any phone is subscribed to the
+ *              bridge, and otherwise while the bridge holds data and for
+ *              CONFIG_LOCK_PM_UART_IDLE_MS after the last byte
+ *   ACTUATOR   APB at full speed, so the servo PWM keeps its frequency,
+ *              from the start of a move until the servo has settled back
+ *              at the locked position
+ *
+ * Paths count nested acquires, so every door or connection can take and
+ * drop the path lock on its own.  Without CONFIG_LOCK_PM all of this
+ * compiles to nothing.
+ */
+typedef enum
+{
+    LOCK_PM_BLE = 0,
+    LOCK_PM_UART,
+    LOCK_PM_ACTUATOR,
+    LOCK_PM_PATHS,
+} lock_pm_path_t;
+
+typedef struct
+{
+    uint32_t acquires;          /* Active windows opened */
+    uint32_t held;              /* Holders right now */
+    uint64_t total_us;          /* Time with at least one holder */
+    uint32_t max_us;            /* Longest window */
+} lock_pm_stats_t;
+
+#if CONFIG_LOCK_PM
+
+/* Configures DFS and automatic light sleep and creates the path locks.
+ * Call before anything that acquires one. */
+esp_err_t lock_pm_init(void);
+
+void lock_pm_acquire(lock_pm_path_t path);
+void lock_pm_release(lock_pm_path_t path);
+
+void lock_pm_get_stats(lock_pm_path_t path, lock_pm_stats_t *out);
+
+/* Logs the path statistics and, with CONFIG_PM_PROFILING, the time spent
+ * in each power mode. */
+void lock_pm_report(void);
+
+#else
+
+static inline esp_err_t lock_pm_init(void) { return ESP_OK; }
+static inline void lock_pm_acquire(lock_pm_path_t path) { }
+static inline void lock_pm_release(lock_pm_path_t path) { }
+static inline void lock_pm_report(void) { }
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
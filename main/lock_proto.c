@@ -0,0 +1,136 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <string.h>
+#include "frame_parser.h"
+#include "lock_proto.h"
+
+/* Frame header: magic and 16-bit payload length */
+#define LOCK_FRAME_HDR_LEN          3
+
+esp_err_t
+lock_proto_decode(const uint8_t *data, uint16_t len, lock_msg_t *msg)
+{
+    uint16_t off;
+
+    if (len < LOCK_PROTO_HDR_LEN)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    msg->op = data[0];
+    msg->seq = data[1];
+    msg->tlv = data + LOCK_PROTO_HDR_LEN;
+    msg->tlv_len = len - LOCK_PROTO_HDR_LEN;
+
+    for (off = 0; off + 2 <= msg->tlv_len; off += 2 + msg->tlv[off + 1])
+    {
+    }
+    return off == msg->tlv_len ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+bool
+lock_proto_find(const lock_msg_t *msg, uint8_t type, const uint8_t **val, uint8_t *len)
+{
+    /* decode() has checked that the TLVs tile the area */
+    for (uint16_t off = 0; off < msg->tlv_len; off += 2 + msg->tlv[off + 1])
+    {
+        if (msg->tlv[off] == type)
+        {
+            *val = &msg->tlv[off + 2];
+            *len = msg->tlv[off + 1];
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+lock_proto_get_u8(const lock_msg_t *msg, uint8_t type, uint8_t *out)
+{
+    const uint8_t *val;
+    uint8_t len;
+
+    if (!lock_proto_find(msg, type, &val, &len) || len != 1)
+    {
+        return false;
+    }
+    *out = val[0];
+    return true;
+}
+
+bool
+lock_proto_get_u16(const lock_msg_t *msg, uint8_t type, uint16_t *out)
+{
+    const uint8_t *val;
+    uint8_t len;
+
+    if (!lock_proto_find(msg, type, &val, &len) || len != 2)
+    {
+        return false;
+    }
+    *out = val[0] | val[1] << 8;
+    return true;
+}
+
+void
+lock_proto_begin(lock_writer_t *w, uint8_t *buf, uint16_t cap,
+                 uint8_t op, uint8_t seq, lock_result_t result)
+{
+    w->buf = buf;
+    w->cap = cap;
+    w->len = LOCK_FRAME_HDR_LEN + LOCK_PROTO_HDR_LEN;
+    w->overflow = cap < w->len;
+    if (!w->overflow)
+    {
+        buf[0] = FRAME_BIN_MAGIC;
+        buf[3] = op | LOCK_OP_REPLY;
+        buf[4] = seq;
+    }
+    lock_proto_put_u8(w, LOCK_TLV_RESULT, result);
+}
+
+void
+lock_proto_put(lock_writer_t *w, uint8_t type, const void *val, uint8_t len)
+{
+    if (w->overflow || w->cap - w->len < 2 + len)
+    {
+        w->overflow = true;
+        return;
+    }
+    w->buf[w->len] = type;
+    w->buf[w->len + 1] = len;
+    memcpy(&w->buf[w->len + 2], val, len);
+    w->len += 2 + len;
+}
+
+void
+lock_proto_put_u8(lock_writer_t *w, uint8_t type, uint8_t val)
+{
+    lock_proto_put(w, type, &val, 1);
+}
+
+void
+lock_proto_put_u16(lock_writer_t *w, uint8_t type, uint16_t val)
+{
+    uint8_t le[2] = {val & 0xFF, val >> 8};
+
+    lock_proto_put(w, type, le, sizeof le);
+}
+
+int
+lock_proto_end(lock_writer_t *w)
+{
+    uint16_t payload;
+
+    if (w->overflow)
+    {
+        return -1;
+    }
+    payload = w->len - LOCK_FRAME_HDR_LEN;
+    w->buf[1] = payload & 0xFF;
+    w->buf[2] = payload >> 8;
+    return w->len;
+}
@@ -0,0 +1,143 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef LOCK_PROTO_H
+#define LOCK_PROTO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary command protocol carried in FRAME_BIN_MAGIC frames on the SPP
+ * characteristic (see frame_parser.h).  A frame payload is
+ *
+ *   opcode (1)  seq (1)  { type (1)  length (1)  value (length) } ...
+ *
+ * Replies carry the request opcode with LOCK_OP_REPLY set, the request's
+ * sequence number and a LOCK_TLV_RESULT first.  Multi-byte values are
+ * little-endian.  Unknown TLV types are ignored so either side can add
+ * fields; unknown opcodes get LOCK_RES_UNSUPPORTED.
+ *
+ * A 6-digit unlock is a 13-byte write answered by one 12-byte notification.
+ * HELLO replies with the mask of doors this controller drives, and with
+ * USER when a bonded peer's session has been resumed (see bond_cache.h);
+ * UNLOCK may then leave out CODE.
+ *
+ * POLICY_SET gives a PIN user an access policy (see access_policy.h):
+ * WINDOWS holds up to 8 triplets of weekday mask (Monday = bit 0), start
+ * hour and end hour, FROM and UNTIL are local day numbers and FLAGS bit 0
+ * makes the PIN one-time.  Leaving them all out clears the policy.  A PIN
+ * refused by its policy gets the same DENIED as a wrong one.
+ */
+#define LOCK_PROTO_VERSION          1
+#define LOCK_PROTO_HDR_LEN          2
+#define LOCK_PROTO_REPLY_MAX        48      /* Largest reply frame we build */
+
+typedef enum
+{
+    LOCK_OP_HELLO = 0x01,       /* Switch the connection to binary mode */
+    LOCK_OP_UNLOCK = 0x02,      /* CODE [DOOR] -> USER; CODE optional if resumed */
+    LOCK_OP_LOCK = 0x03,        /* [DOOR]; needs a session unlocked for it */
+    LOCK_OP_STATUS = 0x04,      /* [DOOR] -> STATE, COUNT */
+    LOCK_OP_CRED_ADD = 0x10,    /* CODE [DOORS] -> USER; admin only */
+    LOCK_OP_CRED_REVOKE = 0x11, /* USER; admin only */
+    LOCK_OP_POLICY_SET = 0x12,  /* USER [WINDOWS] [FROM] [UNTIL] [FLAGS]; admin only */
+    LOCK_OP_POLICY_GET = 0x13,  /* USER -> HOURS FROM UNTIL FLAGS if set; admin only */
+} lock_op_t;
+
+#define LOCK_OP_REPLY               0x80
+
+typedef enum
+{
+    LOCK_TLV_RESULT = 0x01,     /* u8 lock_result_t */
+    LOCK_TLV_VERSION = 0x02,    /* u8 */
+    LOCK_TLV_CODE = 0x03,       /* PIN or TOTP digits, ASCII */
+    LOCK_TLV_USER = 0x04,       /* u16 */
+    LOCK_TLV_STATE = 0x05,      /* u8 actuator_state_t */
+    LOCK_TLV_COUNT = 0x06,      /* u16 live credentials */
+    LOCK_TLV_MTU = 0x07,        /* u16 ATT MTU */
+    LOCK_TLV_DOOR = 0x08,       /* u8 door number; door 0 when absent */
+    LOCK_TLV_DOORS = 0x09,      /* u8 door mask, bit n for door n */
+    LOCK_TLV_WINDOWS = 0x0A,    /* n x (u8 days, u8 start hour, u8 end hour) */
+    LOCK_TLV_FROM = 0x0B,       /* u16 first valid day, days since 1970-01-01 */
+    LOCK_TLV_UNTIL = 0x0C,      /* u16 last valid day; 0xFFFF for none */
+    LOCK_TLV_FLAGS = 0x0D,      /* u8 policy flags, bit 0 one-time */
+    LOCK_TLV_HOURS = 0x0E,      /* 21 bytes, bit day * 24 + hour of the week */
+} lock_tlv_t;
+
+typedef enum
+{
+    LOCK_RES_OK = 0,
+    LOCK_RES_DENIED,            /* Wrong code, or unknown user */
+    LOCK_RES_LOCKED_OUT,        /* Too many wrong codes; try later */
+    LOCK_RES_BAD_REQUEST,       /* Malformed frame or missing TLV */
+    LOCK_RES_UNSUPPORTED,       /* Unknown opcode */
+    LOCK_RES_NOT_PERMITTED,     /* Needs encryption or an admin session */
+    LOCK_RES_BUSY,              /* Actuator queue full, or a credential change pending */
+    LOCK_RES_FAILED,            /* Storage error or duplicate credential */
+} lock_result_t;
+
+/* A decoded request; tlv points into the caller's buffer */
+typedef struct
+{
+    uint8_t op;
+    uint8_t seq;
+    const uint8_t *tlv;
+    uint16_t tlv_len;
+} lock_msg_t;
+
+/* Reply under construction: a complete binary frame, header included */
+typedef struct
+{
+    uint8_t *buf;
+    uint16_t cap;
+    uint16_t len;
+    bool overflow;
+} lock_writer_t;
+
+/**
+ * Splits a frame payload into header and TLV area and checks that the TLVs
+ * tile it exactly.
+ *
+ * @return ESP_OK; ESP_ERR_INVALID_SIZE if there is no header (msg is left
+ *         untouched); ESP_ERR_INVALID_ARG if the TLVs are malformed (op and
+ *         seq are still filled in so the request can be answered).
+ */
+esp_err_t lock_proto_decode(const uint8_t *data, uint16_t len, lock_msg_t *msg);
+
+/* Finds the first TLV of the given type.  Returns false if absent. */
+bool lock_proto_find(const lock_msg_t *msg, uint8_t type,
+                     const uint8_t **val, uint8_t *len);
+
+/* Read a TLV that must be exactly one or two bytes long. */
+bool lock_proto_get_u8(const lock_msg_t *msg, uint8_t type, uint8_t *out);
+bool lock_proto_get_u16(const lock_msg_t *msg, uint8_t type, uint16_t *out);
+
+/* Starts a reply frame to op/seq in buf, including its RESULT TLV. */
+void lock_proto_begin(lock_writer_t *w, uint8_t *buf, uint16_t cap,
+                      uint8_t op, uint8_t seq, lock_result_t result);
+
+void lock_proto_put(lock_writer_t *w, uint8_t type, const void *val, uint8_t len);
+void lock_proto_put_u8(lock_writer_t *w, uint8_t type, uint8_t val);
+void lock_proto_put_u16(lock_writer_t *w, uint8_t type, uint16_t val);
+
+/**
+ * Patches the frame length.
+ *
+ * @return the number of bytes to send, or -1 if the reply did not fit.
+ */
+int lock_proto_end(lock_writer_t *w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
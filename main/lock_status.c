@@ -0,0 +1,235 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "actuator.h"
+#include "conn_ctx.h"
+#include "defer.h"
+#include "rate_limit.h"
+#include "lock_status.h"
+
+/* Writers are the actuator tasks and the NimBLE host task; readers are the
+ * host task and the notify job on the deferred-work task */
+static lock_status_t status_snap;
+static lock_status_t status_sent;           /* What subscribers last got */
+static bool status_scheduled;
+static uint16_t status_subs[CONN_CTX_MAX];
+static uint8_t status_nsubs;
+static const uint16_t *status_val_handle;
+static void (*status_listener)(const lock_status_t *snap);
+static portMUX_TYPE status_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void status_notify_job(uint16_t conn_handle, void *arg);
+
+/* Marks the snapshot changed.  Lock held.  Returns true if the caller must
+ * start the coalescing window with status_schedule() once unlocked. */
+static bool
+status_touch_locked(void)
+{
+    status_snap.changes++;
+    if (status_scheduled)
+    {
+        return false;
+    }
+    status_scheduled = true;
+    return true;
+}
+
+static void
+status_schedule(bool start)
+{
+    if (start && defer_submit(DEFER_CONN_NONE, CONFIG_LOCK_STATUS_COALESCE_MS,
+                              status_notify_job, NULL) != ESP_OK)
+    {
+        /* The next change tries again */
+        status_scheduled = false;
+    }
+}
+
+static void
+status_notify_job(uint16_t conn_handle, void *arg)
+{
+    lock_status_t snap;
+    lock_status_t cmp;
+    uint16_t subs[CONN_CTX_MAX];
+    int nsubs;
+
+    portENTER_CRITICAL(&status_lock);
+    status_scheduled = false;
+    snap = status_snap;
+    nsubs = status_nsubs;
+    memcpy(subs, status_subs, nsubs * sizeof subs[0]);
+    portEXIT_CRITICAL(&status_lock);
+
+    /* If only the change count moved, something flipped and flipped back
+     * within the window; that is not worth a notification */
+    cmp = snap;
+    cmp.changes = status_sent.changes;
+    if (memcmp(&cmp, &status_sent, sizeof cmp) == 0)
+    {
+        return;
+    }
+    status_sent = snap;
+    if (status_listener != NULL)
+    {
+        status_listener(&snap);
+    }
+    for (int i = 0; i < nsubs; i++)
+    {
+        int rc = lock_hal_notify(subs[i], *status_val_handle, &snap, sizeof snap);
+
+        if (rc != 0)
+        {
+            MODLOG_DFLT(DEBUG, "status notify to %d failed, rc=%d\n", subs[i], rc);
+        }
+    }
+}
+
+static void
+status_actuator_cb(uint8_t door, actuator_state_t state, void *arg)
+{
+    int64_t now = lock_hal_wall_time();
+    bool start;
+
+    portENTER_CRITICAL(&status_lock);
+    status_snap.states = (status_snap.states & ~(3u << (2 * door))) | (uint16_t)state << (2 * door);
+    if (state == ACTUATOR_STATE_OPENING)
+    {
+        status_snap.last_door = door;
+        if (now >= LOCK_HAL_CLOCK_VALID)
+        {
+            status_snap.last_actuation = now;
+            status_snap.flags |= LOCK_STATUS_F_WALL_CLOCK;
+        }
+        else
+        {
+            status_snap.last_actuation = lock_hal_now_us() / 1000000;
+            status_snap.flags &= ~LOCK_STATUS_F_WALL_CLOCK;
+        }
+    }
+    start = status_touch_locked();
+    portEXIT_CRITICAL(&status_lock);
+    status_schedule(start);
+}
+
+void
+lock_status_attempt(bool granted)
+{
+    rate_limit_stats_t rs;
+    bool start;
+
+    if (granted)
+    {
+        /* Shows up through the actuator instead */
+        return;
+    }
+    rate_limit_get_stats(&rs);
+
+    portENTER_CRITICAL(&status_lock);
+    if (status_snap.denied != UINT16_MAX)
+    {
+        status_snap.denied++;
+    }
+    status_snap.lockouts = rs.lockouts < UINT16_MAX ? rs.lockouts : UINT16_MAX;
+    start = status_touch_locked();
+    portEXIT_CRITICAL(&status_lock);
+    status_schedule(start);
+}
+
+void
+lock_status_get(lock_status_t *out)
+{
+    portENTER_CRITICAL(&status_lock);
+    memcpy(out, &status_snap, sizeof *out);
+    portEXIT_CRITICAL(&status_lock);
+}
+
+void
+lock_status_set_listener(void (*cb)(const lock_status_t *snap))
+{
+    status_listener = cb;
+}
+
+void
+lock_status_subscribe(uint16_t conn_handle, bool subscribed)
+{
+    portENTER_CRITICAL(&status_lock);
+    for (int i = 0; i < status_nsubs; i++)
+    {
+        if (status_subs[i] == conn_handle)
+        {
+            status_subs[i] = status_subs[--status_nsubs];
+            break;
+        }
+    }
+    if (subscribed && status_nsubs < CONN_CTX_MAX)
+    {
+        status_subs[status_nsubs++] = conn_handle;
+    }
+    portEXIT_CRITICAL(&status_lock);
+}
+
+static void
+status_on_disconnect(conn_ctx_t *ctx, int reason)
+{
+    lock_status_subscribe(ctx->conn_handle, false);
+}
+
+static const conn_ctx_hooks_t status_hooks = {
+    .on_disconnect = status_on_disconnect,
+};
+
+int
+lock_status_access(uint16_t conn_handle, uint16_t attr_handle,
+                   struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    lock_status_t snap;
+
+    if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR)
+    {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    lock_status_get(&snap);
+    return os_mbuf_append(ctxt->om, &snap, sizeof snap) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+esp_err_t
+lock_status_init(const uint16_t *val_handle)
+{
+    const char *v = lock_hal_fw_version();
+    char *end;
+
+    status_val_handle = val_handle;
+    status_snap.version = LOCK_STATUS_VERSION;
+    status_snap.doors = ACTUATOR_DOORS;
+    status_snap.last_door = 0xFF;
+    /* "1.2.3", "v1.2.3-4-gabcdef" and the like */
+    if (*v == 'v')
+    {
+        v++;
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        status_snap.fw[i] = strtoul(v, &end, 10);
+        if (*end != '.')
+        {
+            break;
+        }
+        v = end + 1;
+    }
+    for (int door = 0; door < ACTUATOR_DOORS; door++)
+    {
+        status_snap.states |= (uint16_t)actuator_get_state(door) << (2 * door);
+    }
+    status_sent = status_snap;
+
+    ESP_ERROR_CHECK(conn_ctx_register_hooks(&status_hooks));
+    return actuator_register_cb(status_actuator_cb, NULL);
+}
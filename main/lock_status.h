@@ -0,0 +1,79 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef LOCK_STATUS_H
+#define LOCK_STATUS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "host/ble_hs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Lock status snapshot, served by the status characteristic (0xABF4).
+ *
+ * The snapshot is kept packed and up to date as things change, so a read
+ * is one copy under a spinlock.  Changes are batched for
+ * CONFIG_LOCK_STATUS_COALESCE_MS and then notified to subscribers, but only
+ * if the snapshot differs from the one they were last sent.
+ *
+ * Layout (version 1, little-endian, 20 bytes so it fits the default MTU):
+ *   u8 version, u8 doors present, u8 flags, u8 door of the last actuation,
+ *   u16 door states (2 bits per door, actuator_state_t), u16 change count,
+ *   u32 time of the last actuation (Unix s if LOCK_STATUS_F_WALL_CLOCK,
+ *   else uptime s), u16 denied attempts, u16 lockouts since boot,
+ *   u8 firmware major, minor, patch, u8 reserved
+ */
+#define LOCK_STATUS_VERSION         1
+#define LOCK_STATUS_F_WALL_CLOCK    0x01
+
+typedef struct __attribute__((packed))
+{
+    uint8_t version;
+    uint8_t doors;
+    uint8_t flags;
+    uint8_t last_door;
+    uint16_t states;
+    uint16_t changes;
+    uint32_t last_actuation;
+    uint16_t denied;
+    uint16_t lockouts;
+    uint8_t fw[3];
+    uint8_t reserved;
+} lock_status_t;
+
+_Static_assert(sizeof(lock_status_t) == 20, "status snapshot must fit one default-MTU notification");
+
+/* Builds the first snapshot and starts following the actuators.
+ * val_handle is the status characteristic's value handle, filled in when
+ * the GATT table is registered. */
+esp_err_t lock_status_init(const uint16_t *val_handle);
+
+/* Records the outcome of an unlock attempt; call after rate_limit_result(). */
+void lock_status_attempt(bool granted);
+
+void lock_status_get(lock_status_t *out);
+
+/* Called from the deferred-work task with every snapshot that is sent to
+ * subscribers, whether or not there are any. */
+void lock_status_set_listener(void (*cb)(const lock_status_t *snap));
+
+/* Subscription changes for the status characteristic, from the GAP handler */
+void lock_status_subscribe(uint16_t conn_handle, bool subscribed);
+
+/* GATT access callback for the status characteristic */
+int lock_status_access(uint16_t conn_handle, uint16_t attr_handle,
+                       struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -5,7 +5,6 @@
  */
 
 #include "esp_log.h"
-#include "nvs_flash.h"
 /* BLE */
 #include "nimble/nimble_port.h"
 #include "nimble/nimble_port_freertos.h"
@@ -15,148 +14,72 @@
 #include "services/gap/ble_svc_gap.h"
 #include "services/gatt/ble_svc_gatt.h"
 #include "main.h"
-#include "driver/uart.h"
-#include "driver/ledc.h"
-
-#define LEDC_TIMER              LEDC_TIMER_0
-#define LEDC_MODE               LEDC_LOW_SPEED_MODE
-#define LEDC_OUTPUT_IO          (2) // Define the output GPIO
-#define LEDC_CHANNEL            LEDC_CHANNEL_0
-#define LEDC_DUTY_RES           LEDC_TIMER_14_BIT // Set duty resolution to 14 bits
-#define LEDC_DUTY               (1229) // Set duty to 50%. (2 ** 14) * 50% = 8192
-#define LEDC_FREQUENCY          (50) // Frequency in Hertz. Set frequency at 50 Hz
+#include "lock_hal.h"
+#include "actuator.h"
+#include "defer.h"
+#include "uart_bridge.h"
+#include "conn_ctx.h"
+#include "conn_policy.h"
+#include "frame_parser.h"
+#include "cred_store.h"
+#include "access_policy.h"
+#include "totp.h"
+#include "rate_limit.h"
+#include "blog.h"
+#include "audit_log.h"
+#include "lock_proto.h"
+#include "lock_diag.h"
+#include "lock_status.h"
+#include "adv_sched.h"
+#include "lock_pm.h"
+#include "admin_console.h"
+#include "ota_svc.h"
+#include "bond_cache.h"
+#include "mem_acct.h"
+#include "reply.h"
 
 static int ble_spp_server_gap_event(struct ble_gap_event *event, void *arg);
 static uint8_t own_addr_type;
 int gatt_svr_register(void);
-QueueHandle_t spp_common_uart_queue = NULL;
-static bool conn_handle_subs[CONFIG_BT_NIMBLE_MAX_CONNECTIONS + 1];
 static uint16_t ble_spp_svc_gatt_read_val_handle;
-static void send_welcome_message(uint16_t conn_handle);// Flag to indicate if the door is locked or not
+static uint16_t ble_svc_status_val_handle;
+#if CONFIG_LOCK_OTA
+static uint16_t ble_svc_ota_ctrl_val_handle;
+#endif
+/* Longest a returning bond's banner waits for encryption to settle */
+#define WELCOME_BOND_WAIT_MS    1000
+/* What a resumed session sends in the text dialogue to open door 0 */
+#define RESUME_TEXT_CMD         "开门"
+
+static void send_welcome_message(conn_ctx_t *ctx);
+static void welcome_job(uint16_t conn_handle, void *arg);
+static void welcome_send(uint16_t conn_handle);
+static void welcome_cancel(uint16_t conn_handle);
+static void cred_op_cancel(uint16_t conn_handle);
+static void send_resume_message(conn_ctx_t *ctx);
+/* Banners due, queued by welcome_job() for the host task to send */
+static struct ble_npl_event welcome_ev;
+static uint16_t welcome_due[CONN_CTX_MAX];
+static int welcome_due_count;
+static portMUX_TYPE welcome_lock = portMUX_INITIALIZER_UNLOCKED;
+/* Time from link establishment to the welcome notification */
+static int64_t ttfn_total_us;
+static int64_t ttfn_max_us;
+static uint32_t ttfn_count;
 void ble_store_config_init(void);
-static void local_ledc_init(void)
-{
-    // Prepare and then apply the LEDC PWM timer configuration
-    ledc_timer_config_t ledc_timer = {
-        .speed_mode       = LEDC_MODE,
-        .duty_resolution  = LEDC_DUTY_RES,
-        .timer_num        = LEDC_TIMER,
-        .freq_hz          = LEDC_FREQUENCY,  // Set output frequency at 4 kHz
-        .clk_cfg          = LEDC_AUTO_CLK
-    };
-    ESP_ERROR_CHECK(ledc_timer_config(&ledc_timer));
-
-    // Prepare and then apply the LEDC PWM channel configuration
-    ledc_channel_config_t ledc_channel = {
-        .speed_mode     = LEDC_MODE,
-        .channel        = LEDC_CHANNEL,
-        .timer_sel      = LEDC_TIMER,
-        .intr_type      = LEDC_INTR_DISABLE,
-        .gpio_num       = LEDC_OUTPUT_IO,
-        .duty           = 0, // Set duty to 0%
-        .hpoint         = 0
-    };
-    ESP_ERROR_CHECK(ledc_channel_config(&ledc_channel));
-}
-static void local_ledc_set_duty(uint32_t duty)
-{
-    // Set the duty cycle for the LEDC channel
-    ESP_ERROR_CHECK(ledc_set_duty(LEDC_MODE, LEDC_CHANNEL, duty));
-    // Update the LEDC channel with the new duty cycle
-    ESP_ERROR_CHECK(ledc_update_duty(LEDC_MODE, LEDC_CHANNEL));
-}
 /**
  * Logs information about a connection to the console.
  */
 static void
 ble_spp_server_print_conn_desc(struct ble_gap_conn_desc *desc)
 {
-    MODLOG_DFLT(INFO, "handle=%d our_ota_addr_type=%d our_ota_addr=",
-                desc->conn_handle, desc->our_ota_addr.type);
-    print_addr(desc->our_ota_addr.val);
-    MODLOG_DFLT(INFO, " our_id_addr_type=%d our_id_addr=",
-                desc->our_id_addr.type);
-    print_addr(desc->our_id_addr.val);
-    MODLOG_DFLT(INFO, " peer_ota_addr_type=%d peer_ota_addr=",
-                desc->peer_ota_addr.type);
-    print_addr(desc->peer_ota_addr.val);
-    MODLOG_DFLT(INFO, " peer_id_addr_type=%d peer_id_addr=",
-                desc->peer_id_addr.type);
-    print_addr(desc->peer_id_addr.val);
-    MODLOG_DFLT(INFO, " conn_itvl=%d conn_latency=%d supervision_timeout=%d "
-                      "encrypted=%d authenticated=%d bonded=%d\n",
-                desc->conn_itvl, desc->conn_latency,
-                desc->supervision_timeout,
-                desc->sec_state.encrypted,
-                desc->sec_state.authenticated,
-                desc->sec_state.bonded);
-}
-
-/**
- * Enables advertising with the following parameters:
- *     o General discoverable mode.
- *     o Undirected connectable mode.
- */
-static void
-ble_spp_server_advertise(void)
-{
-    struct ble_gap_adv_params adv_params;
-    struct ble_hs_adv_fields fields;
-    const char *name;
-    int rc;
-
-    /**
-     *  Set the advertisement data included in our advertisements:
-     *     o Flags (indicates advertisement type and other general info).
-     *     o Advertising tx power.
-     *     o Device name.
-     *     o 16-bit service UUIDs (alert notifications).
-     */
-
-    memset(&fields, 0, sizeof fields);
-
-    /* Advertise two flags:
-     *     o Discoverability in forthcoming advertisement (general)
-     *     o BLE-only (BR/EDR unsupported).
-     */
-    fields.flags = BLE_HS_ADV_F_DISC_GEN |
-                   BLE_HS_ADV_F_BREDR_UNSUP;
-
-    /* Indicate that the TX power level field should be included; have the
-     * stack fill this value automatically.  This is done by assigning the
-     * special value BLE_HS_ADV_TX_PWR_LVL_AUTO.
-     */
-    fields.tx_pwr_lvl_is_present = 1;
-    fields.tx_pwr_lvl = BLE_HS_ADV_TX_PWR_LVL_AUTO;
-
-    name = ble_svc_gap_device_name();
-    fields.name = (uint8_t *)name;
-    fields.name_len = strlen(name);
-    fields.name_is_complete = 1;
-
-    fields.uuids16 = (ble_uuid16_t[]){
-        BLE_UUID16_INIT(BLE_SVC_SPP_UUID16)};
-    fields.num_uuids16 = 1;
-    fields.uuids16_is_complete = 1;
-
-    rc = ble_gap_adv_set_fields(&fields);
-    if (rc != 0)
-    {
-        MODLOG_DFLT(ERROR, "error setting advertisement data; rc=%d\n", rc);
-        return;
-    }
-
-    /* Begin advertising. */
-    memset(&adv_params, 0, sizeof adv_params);
-    adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
-    adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
-    rc = ble_gap_adv_start(own_addr_type, NULL, BLE_HS_FOREVER,
-                           &adv_params, ble_spp_server_gap_event, NULL);
-    if (rc != 0)
-    {
-        MODLOG_DFLT(ERROR, "error enabling advertisement; rc=%d\n", rc);
-        return;
-    }
+    /* Our own addresses are printed once at sync and left out here */
+    BLOG(CONN_DESC, desc->conn_handle, desc->peer_ota_addr.type,
+         BLOG_ADDR(desc->peer_ota_addr.val), BLOG_ADDR(desc->peer_id_addr.val));
+    BLOG(CONN_PARAMS, desc->conn_handle, desc->conn_itvl, desc->conn_latency,
+         desc->supervision_timeout,
+         desc->sec_state.encrypted | desc->sec_state.authenticated << 1 |
+         desc->sec_state.bonded << 2);
 }
 
 /**
@@ -175,87 +98,149 @@ ble_spp_server_advertise(void)
  *                                  particular GAP event being signalled.
  */
 static int
-ble_spp_server_gap_event(struct ble_gap_event *event, void *arg)
+ble_spp_server_gap_dispatch(struct ble_gap_event *event, void *arg)
 {
     struct ble_gap_conn_desc desc;
+    conn_ctx_t *ctx;
     int rc;
 
     switch (event->type)
     {
     case BLE_GAP_EVENT_LINK_ESTAB:
         /* A new connection was established or a connection attempt failed. */
-        MODLOG_DFLT(INFO, "connection %s; status=%d ",
-                    event->link_estab.status == 0 ? "established" : "failed",
-                    event->link_estab.status);
         if (event->link_estab.status == 0)
         {
+            BLOG(CONN_ESTAB, event->link_estab.conn_handle);
             rc = ble_gap_conn_find(event->link_estab.conn_handle, &desc);
             assert(rc == 0);
             ble_spp_server_print_conn_desc(&desc);
-
-            /* Send welcome message when connection is established */
-            vTaskDelay(pdMS_TO_TICKS(100)); // Small delay to ensure connection is ready
-            send_welcome_message(event->link_estab.conn_handle);
+            ctx = conn_ctx_link_established(&desc);
+
+            /* Send welcome message once the connection is ready, without
+             * holding up the host task.  A bond that may get its session
+             * back hears at encryption instead, or after a timeout. */
+            defer_submit(event->link_estab.conn_handle,
+                         ctx != NULL && ctx->bond_wait ? WELCOME_BOND_WAIT_MS :
+                         CONFIG_LOCK_WELCOME_DELAY_MS, welcome_job, NULL);
+            adv_sched_event(ADV_SCHED_EV_CONNECT);
+        }
+        else
+        {
+            BLOG(CONN_FAILED, event->link_estab.status);
         }
-        MODLOG_DFLT(INFO, "\n");
         if (event->link_estab.status != 0 || CONFIG_BT_NIMBLE_MAX_CONNECTIONS > 1)
         {
             /* Connection failed or if multiple connection allowed; resume advertising. */
-            ble_spp_server_advertise();
+            adv_sched_event(ADV_SCHED_EV_RESUME);
         }
         return 0;
 
     case BLE_GAP_EVENT_DISCONNECT:
-        MODLOG_DFLT(INFO, "disconnect; reason=%d ", event->disconnect.reason);
+        BLOG(DISCONNECT, event->disconnect.conn.conn_handle, event->disconnect.reason);
         ble_spp_server_print_conn_desc(&event->disconnect.conn);
-        MODLOG_DFLT(INFO, "\n");
 
-        conn_handle_subs[event->disconnect.conn.conn_handle] = false;
+        defer_cancel_conn(event->disconnect.conn.conn_handle);
+        welcome_cancel(event->disconnect.conn.conn_handle);
+        reply_cancel(event->disconnect.conn.conn_handle);
+        cred_op_cancel(event->disconnect.conn.conn_handle);
+        conn_ctx_disconnect(event->disconnect.conn.conn_handle, event->disconnect.reason);
 
-        /* Connection terminated; resume advertising. */
-        ble_spp_server_advertise();
+        /* Connection terminated; advertise fast for a while, and to
+         * bonds first if this was one. */
+        adv_sched_event(event->disconnect.conn.sec_state.bonded ?
+                        ADV_SCHED_EV_BOND_LOST : ADV_SCHED_EV_DISCONNECT);
         return 0;
 
+    case BLE_GAP_EVENT_ENC_CHANGE:
+        /* Encryption has been enabled or disabled for this connection. */
+        MODLOG_DFLT(INFO, "encryption change event; conn_handle=%d status=%d\n",
+                    event->enc_change.conn_handle, event->enc_change.status);
+        ctx = conn_ctx_find(event->enc_change.conn_handle);
+        if (ctx == NULL)
+        {
+            return 0;
+        }
+        bond_cache_enc_change(ctx, event->enc_change.status);
+        if (ctx->bond_wait)
+        {
+            ctx->bond_wait = false;
+            if (ctx->resumed)
+            {
+                send_resume_message(ctx);
+            }
+            else
+            {
+                welcome_send(ctx->conn_handle);
+            }
+        }
+        return 0;
+
+    case BLE_GAP_EVENT_REPEAT_PAIRING:
+        /* The peer lost its keys and pairs again; drop the old bond, and
+         * the session that came with it, and let pairing go ahead. */
+        rc = ble_gap_conn_find(event->repeat_pairing.conn_handle, &desc);
+        assert(rc == 0);
+        bond_cache_forget(&desc.peer_id_addr);
+        ble_store_util_delete_peer(&desc.peer_id_addr);
+        return BLE_GAP_REPEAT_PAIRING_RETRY;
+
     case BLE_GAP_EVENT_CONN_UPDATE:
         /* The central has updated the connection parameters. */
-        MODLOG_DFLT(INFO, "connection updated; status=%d ",
-                    event->conn_update.status);
+        BLOG(CONN_UPDATE, event->conn_update.conn_handle, event->conn_update.status);
         rc = ble_gap_conn_find(event->conn_update.conn_handle, &desc);
         assert(rc == 0);
         ble_spp_server_print_conn_desc(&desc);
-        MODLOG_DFLT(INFO, "\n");
+        conn_policy_conn_update(event->conn_update.conn_handle,
+                                event->conn_update.status, desc.conn_itvl);
         return 0;
 
     case BLE_GAP_EVENT_ADV_COMPLETE:
-        MODLOG_DFLT(INFO, "advertise complete; reason=%d",
-                    event->adv_complete.reason);
-        ble_spp_server_advertise();
+        BLOG(ADV_COMPLETE, event->adv_complete.reason);
+        if (event->adv_complete.reason == BLE_HS_ETIMEOUT)
+        {
+            /* The fast burst ran its course */
+            adv_sched_event(ADV_SCHED_EV_BURST_END);
+        }
+        else if (event->adv_complete.reason != 0)
+        {
+            /* 0 is a connection, handled at LINK_ESTAB */
+            adv_sched_event(ADV_SCHED_EV_RESUME);
+        }
         return 0;
 
     case BLE_GAP_EVENT_MTU:
-        MODLOG_DFLT(INFO, "mtu update event; conn_handle=%d cid=%d mtu=%d\n",
-                    event->mtu.conn_handle,
-                    event->mtu.channel_id,
-                    event->mtu.value);
+        BLOG(MTU, event->mtu.conn_handle, event->mtu.channel_id, event->mtu.value);
+        conn_ctx_mtu(event->mtu.conn_handle, event->mtu.value);
+        return 0;
+
+    case BLE_GAP_EVENT_NOTIFY_TX:
+        DIAG_CALL(lock_diag_notify_tx(event->notify_tx.conn_handle,
+                                      event->notify_tx.status));
         return 0;
 
     case BLE_GAP_EVENT_SUBSCRIBE:
-        MODLOG_DFLT(INFO, "subscribe event; conn_handle=%d attr_handle=%d "
-                          "reason=%d prevn=%d curn=%d previ=%d curi=%d\n",
-                    event->subscribe.conn_handle,
-                    event->subscribe.attr_handle,
-                    event->subscribe.reason,
-                    event->subscribe.prev_notify,
-                    event->subscribe.cur_notify,
-                    event->subscribe.prev_indicate,
-                    event->subscribe.cur_indicate);
-        conn_handle_subs[event->subscribe.conn_handle] = true;
-
-        /* Send welcome message when client subscribes to notifications */
-        if (event->subscribe.cur_notify)
-        {
-            vTaskDelay(pdMS_TO_TICKS(50)); // Small delay
-            send_welcome_message(event->subscribe.conn_handle);
+        BLOG(SUBSCRIBE, event->subscribe.conn_handle, event->subscribe.attr_handle,
+             event->subscribe.reason, event->subscribe.prev_notify,
+             event->subscribe.cur_notify, event->subscribe.cur_indicate);
+        if (event->subscribe.attr_handle == ble_svc_status_val_handle)
+        {
+            lock_status_subscribe(event->subscribe.conn_handle, event->subscribe.cur_notify);
+            return 0;
+        }
+        if (event->subscribe.attr_handle != ble_spp_svc_gatt_read_val_handle)
+        {
+            return 0;
+        }
+        conn_ctx_subscribe(event->subscribe.conn_handle, event->subscribe.cur_notify);
+
+        /* Send welcome message when client subscribes to notifications,
+         * unless it already went out on link establishment. */
+        ctx = conn_ctx_find(event->subscribe.conn_handle);
+        if (event->subscribe.cur_notify && ctx != NULL && !ctx->welcome_sent &&
+            !ctx->bond_wait)
+        {
+            defer_submit(event->subscribe.conn_handle, CONFIG_LOCK_SUBSCRIBE_DELAY_MS,
+                         welcome_job, NULL);
         }
         return 0;
 
@@ -264,6 +249,19 @@ ble_spp_server_gap_event(struct ble_gap_event *event, void *arg)
     }
 }
 
+/* GAP entry point; times every event for the diagnostics histograms */
+static int
+ble_spp_server_gap_event(struct ble_gap_event *event, void *arg)
+{
+    int rc;
+
+    DIAG_SPAN_BEGIN(t);
+    DIAG_COUNT(DIAG_CNT_GAP_EVENTS);
+    rc = ble_spp_server_gap_dispatch(event, arg);
+    DIAG_SPAN_END(DIAG_HIST_GAP_EVENT, t);
+    return rc;
+}
+
 static void
 ble_spp_server_on_reset(int reason)
 {
@@ -294,11 +292,11 @@ ble_spp_server_on_sync(void)
     print_addr(addr_val);
     MODLOG_DFLT(INFO, "\n");
     /* Begin advertising. */
-    ble_spp_server_advertise();
+    adv_sched_start(own_addr_type, ble_spp_server_gap_event);
 }
 
 /* Function to send welcome message to client */
-static void send_welcome_message(uint16_t conn_handle)
+static void send_welcome_message(conn_ctx_t *ctx)
 {
     const char *welcome_msg =
         "◈═════◈═════◈\n"
@@ -308,13 +306,22 @@ static void send_welcome_message(uint16_t conn_handle)
         "◈═════◈═════◈\n"
         "> ";
 
-    struct os_mbuf *txom;
-    txom = ble_hs_mbuf_from_flat((const uint8_t *)welcome_msg, strlen(welcome_msg));
-
-    int rc = ble_gatts_notify_custom(conn_handle, ble_spp_svc_gatt_read_val_handle, txom);
+    uint16_t conn_handle = ctx->conn_handle;
+    int rc = reply_send(conn_handle, ble_spp_svc_gatt_read_val_handle,
+                        welcome_msg, strlen(welcome_msg));
     if (rc == 0)
     {
-        MODLOG_DFLT(INFO, "Welcome message sent successfully to conn_handle=%d", conn_handle);
+        int64_t ttfn = lock_hal_now_us() - ctx->connect_us;
+
+        ctx->welcome_sent = true;
+        ttfn_count++;
+        ttfn_total_us += ttfn;
+        if (ttfn > ttfn_max_us)
+        {
+            ttfn_max_us = ttfn;
+        }
+        BLOG(WELCOME, conn_handle, (uint32_t)ttfn,
+             (uint32_t)(ttfn_total_us / ttfn_count), (uint32_t)ttfn_max_us);
     }
     else
     {
@@ -322,32 +329,232 @@ static void send_welcome_message(uint16_t conn_handle)
     }
 }
 
+/* Instead of the banner, for a bond whose session came back */
+static void send_resume_message(conn_ctx_t *ctx)
+{
+    const char *msg =
+        "◈═════◈═════◈\n"
+        "派蒙认得你！旅行者～\n"
+        "说「" RESUME_TEXT_CMD "」就让你进去！\n"
+        "◈═════◈═════◈\n"
+        "> ";
+    int rc;
+
+    /* An app that said hello needs no prompt */
+    if (ctx->welcome_sent)
+    {
+        return;
+    }
+    rc = reply_send(ctx->conn_handle, ble_spp_svc_gatt_read_val_handle,
+                    msg, strlen(msg));
+    if (rc == 0)
+    {
+        ctx->welcome_sent = true;
+    }
+}
+
+/* Sends the banner unless this connection already got it.  Host task. */
+static void welcome_send(uint16_t conn_handle)
+{
+    conn_ctx_t *ctx = conn_ctx_find(conn_handle);
+
+    if (ctx != NULL && !ctx->welcome_sent)
+    {
+        /* A returning bond that has not encrypted by now gets the banner */
+        ctx->bond_wait = false;
+        send_welcome_message(ctx);
+    }
+}
+
+/* Host task event: sends the banners welcome_job() queued */
+static void welcome_event(struct ble_npl_event *ev)
+{
+    uint16_t due[CONN_CTX_MAX];
+    int n;
+
+    portENTER_CRITICAL(&welcome_lock);
+    n = welcome_due_count;
+    memcpy(due, welcome_due, n * sizeof due[0]);
+    welcome_due_count = 0;
+    portEXIT_CRITICAL(&welcome_lock);
+
+    for (int i = 0; i < n; i++)
+    {
+        welcome_send(due[i]);
+    }
+}
+
+/*
+ * Deferred job.  Contexts belong to the host task, and the encryption
+ * handler there may be answering the same connection with the resume
+ * prompt, so the banner is handed back to the host task rather than sent
+ * from here.
+ */
+static void welcome_job(uint16_t conn_handle, void *arg)
+{
+    int i;
+
+    portENTER_CRITICAL(&welcome_lock);
+    for (i = 0; i < welcome_due_count && welcome_due[i] != conn_handle; i++)
+    {
+    }
+    if (i == welcome_due_count && i < CONN_CTX_MAX)
+    {
+        welcome_due[welcome_due_count++] = conn_handle;
+    }
+    portEXIT_CRITICAL(&welcome_lock);
+
+    /* Already queued is fine; the event runs once for every handle */
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &welcome_ev);
+}
+
+/* Drops a banner still queued for a connection that went away */
+static void welcome_cancel(uint16_t conn_handle)
+{
+    portENTER_CRITICAL(&welcome_lock);
+    for (int i = 0; i < welcome_due_count; i++)
+    {
+        if (welcome_due[i] == conn_handle)
+        {
+            welcome_due[i] = welcome_due[--welcome_due_count];
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&welcome_lock);
+}
+
 void ble_spp_server_host_task(void *param)
 {
     MODLOG_DFLT(INFO, "BLE Host Task Started");
+    mem_acct_track_task(NULL, CONFIG_BT_NIMBLE_HOST_TASK_STACK_SIZE);
     /* This function will return only when nimble_port_stop() is executed */
     nimble_port_run();
 
     nimble_port_freertos_deinit();
 }
 
-static void open_door(void)
+static void open_door(uint8_t door)
 {
-    MODLOG_DFLT(INFO, "Opening door...");
-    local_ledc_set_duty(1229-400);
-    //Servo Angle 1
-    vTaskDelay(pdMS_TO_TICKS(1000)); // Simulate door opening delay
-    //Servo Angle 0
-    local_ledc_set_duty(1229);
-    MODLOG_DFLT(INFO, "Door opened successfully!");
-    // Here you can add code to control the door lock mechanism
+    /* Hand the move off to the door's actuator task; the host task must not sleep */
+    if (actuator_request(door, ACTUATOR_CMD_UNLOCK) != ESP_OK)
+    {
+        MODLOG_DFLT(ERROR, "Door %d actuator queue full, unlock dropped", door);
+    }
 }
-static int password_check(uint16_t conn_handle, const char *received_password)
+
+/**
+ * Checks a PIN or TOTP code, records the attempt in the audit log and opens
+ * the door on success.  A valid code outside its door mask or its access
+ * policy counts as wrong; only the audit log tells the two apart.  Shared
+ * by the text and binary dialogues.
+ */
+static bool unlock_attempt(conn_ctx_t *ctx, uint8_t door, const char *code,
+                           uint16_t len, uint16_t *user_out)
 {
-    const char *correct_password = "200296"; // 正确的密码
+    uint16_t user_id = CRED_USER_NONE;
+    audit_method_t method = AUDIT_METHOD_PIN;
+    access_verdict_t verdict = ACCESS_ALLOW;
+    uint8_t doors = 0;
+    uint8_t totp_user;
+    bool ok;
+
+    DIAG_SPAN_BEGIN(t);
+    ok = cred_store_verify(code, len, &user_id, &doors) == ESP_OK;
+    if (!ok && totp_verify(code, len, &totp_user) == ESP_OK)
+    {
+        /* TOTP secrets carry no door mask */
+        user_id = totp_user;
+        doors = CRED_DOORS_ALL;
+        method = AUDIT_METHOD_TOTP;
+        ok = true;
+    }
+    DIAG_SPAN_END(DIAG_HIST_VERIFY, t);
+    if (method == AUDIT_METHOD_TOTP)
+    {
+        MODLOG_DFLT(INFO, "TOTP code accepted; user=%d", totp_user);
+    }
+    if (ok && !(doors & (1u << door)))
+    {
+        MODLOG_DFLT(INFO, "user=%d may not open door %d", user_id, door);
+        ok = false;
+    }
+    if (ok && method == AUDIT_METHOD_PIN)
+    {
+        /* Last, so a one-time PIN is only spent on a door it may open */
+        verdict = access_policy_check(user_id);
+        if (ACCESS_DENIED(verdict))
+        {
+            MODLOG_DFLT(INFO, "user=%d refused: %s", user_id, access_verdict_str(verdict));
+            ok = false;
+        }
+    }
+    audit_log_append(&ctx->peer_id_addr, user_id, door, method,
+                     ok ? AUDIT_RESULT_GRANTED :
+                     ACCESS_DENIED(verdict) ? AUDIT_RESULT_SCHEDULE : AUDIT_RESULT_DENIED);
+
+    if (ok)
+    {
+        ctx->authed = true;
+        ctx->auth_user = user_id;
+        ctx->auth_method = method;
+        ctx->auth_doors = doors;
+        ctx->resumed = false;
+        DIAG_CALL(lock_diag_unlock_requested(door, ctx->diag_write_us));
+        /* A one-time PIN leaves no session behind */
+        bond_cache_unlocked(ctx, method == AUDIT_METHOD_PIN && verdict == ACCESS_ALLOW);
+        open_door(door);
+    }
+    *user_out = user_id;
+    return ok;
+}
+
+/**
+ * Opens a door on a session resumed from the bond cache, with no code.
+ * Only the doors of the PIN that started the session, and only within its
+ * access policy.
+ */
+static bool resumed_unlock(conn_ctx_t *ctx, uint8_t door, uint16_t *user_out)
+{
+    access_verdict_t verdict = ACCESS_ALLOW;
+    bool ok = ctx->resumed && (ctx->auth_doors & (1u << door));
+
+    if (ok)
+    {
+        verdict = access_policy_check(ctx->auth_user);
+        ok = !ACCESS_DENIED(verdict);
+    }
+    audit_log_append(&ctx->peer_id_addr, ctx->auth_user, door, AUDIT_METHOD_BOND,
+                     ok ? AUDIT_RESULT_GRANTED :
+                     ACCESS_DENIED(verdict) ? AUDIT_RESULT_SCHEDULE : AUDIT_RESULT_DENIED);
+    if (ok)
+    {
+        DIAG_CALL(lock_diag_unlock_requested(door, ctx->diag_write_us));
+        bond_cache_unlocked(ctx, false);
+        open_door(door);
+    }
+    *user_out = ctx->auth_user;
+    return ok;
+}
+
+static int password_check(conn_ctx_t *ctx, const char *received_password, uint16_t len)
+{
+    uint16_t conn_handle = ctx->conn_handle;
     const char *response;
+    uint16_t user_id;
+    bool ok;
+
+    /* The text dialogue always addresses door 0 */
+    if (ctx->resumed && len == strlen(RESUME_TEXT_CMD) &&
+        memcmp(received_password, RESUME_TEXT_CMD, len) == 0)
+    {
+        ok = resumed_unlock(ctx, 0, &user_id);
+    }
+    else
+    {
+        ok = unlock_attempt(ctx, 0, received_password, len, &user_id);
+    }
 
-    if (strcmp(received_password, correct_password) == 0)
+    if (ok)
     {
         response =
             "\n"
@@ -357,8 +564,7 @@ static int password_check(uint16_t conn_handle, const char *received_password)
             "正在开门...应急食品已就位！\n"
             "◈═════◈═════◈\n";
 
-        MODLOG_DFLT(INFO, "Password correct");
-        open_door();
+        MODLOG_DFLT(INFO, "Password correct; user=%d", user_id);
     }
     else
     {
@@ -373,15 +579,474 @@ static int password_check(uint16_t conn_handle, const char *received_password)
     }
 
     // 将结果通过 BLE 通知客户端
-    struct os_mbuf *txom;
-    txom = ble_hs_mbuf_from_flat((const uint8_t *)response, strlen(response));
-    int rc = ble_gatts_notify_custom(conn_handle, ble_spp_svc_gatt_read_val_handle, txom);
+    int rc = reply_send(conn_handle, ble_spp_svc_gatt_read_val_handle,
+                        response, strlen(response));
     if (rc != 0)
     {
         MODLOG_DFLT(ERROR, "Failed to send response, rc=%d", rc);
     }
 
-    return strcmp(received_password, correct_password) == 0;
+    return ok;
+}
+
+/* Credential management needs an encrypted link and an admin session
+ * opened with the PIN of user 0.  TOTP ids also start at 0 and a resumed
+ * session proved nothing on this link, so neither counts. */
+static bool
+spp_command_admin(const conn_ctx_t *ctx)
+{
+    struct ble_gap_conn_desc desc;
+
+    return ctx->authed && ctx->auth_user == 0 && ctx->auth_method == AUDIT_METHOD_PIN &&
+           ble_gap_conn_find(ctx->conn_handle, &desc) == 0 &&
+           desc.sec_state.encrypted;
+}
+
+/* Builds a rule from the optional WINDOWS, FROM, UNTIL and FLAGS TLVs;
+ * none of them means any time.  Ranges are checked when it is compiled. */
+static bool
+policy_rule_decode(const lock_msg_t *msg, access_rule_t *rule)
+{
+    const uint8_t *win;
+    uint8_t win_len;
+    uint8_t flags = 0;
+
+    memset(rule, 0, sizeof *rule);
+    rule->until_day = ACCESS_DAY_NONE;
+    if (lock_proto_find(msg, LOCK_TLV_WINDOWS, &win, &win_len))
+    {
+        if (win_len == 0 || win_len % 3 != 0 || win_len / 3 > ACCESS_MAX_WINDOWS)
+        {
+            return false;
+        }
+        rule->nwindows = win_len / 3;
+        for (int i = 0; i < rule->nwindows; i++)
+        {
+            rule->windows[i].days = win[3 * i];
+            rule->windows[i].start_hour = win[3 * i + 1];
+            rule->windows[i].end_hour = win[3 * i + 2];
+        }
+    }
+    lock_proto_get_u16(msg, LOCK_TLV_FROM, &rule->from_day);
+    lock_proto_get_u16(msg, LOCK_TLV_UNTIL, &rule->until_day);
+    lock_proto_get_u8(msg, LOCK_TLV_FLAGS, &flags);
+    rule->once = flags & ACCESS_F_ONCE;
+    return true;
+}
+
+/*
+ * Adding or revoking a credential may compact a sector of the store, a copy
+ * and an erase, so it runs as a deferred job rather than on the host task.
+ * Each connection has at most one in flight; the job hands its result back
+ * to the host task, which sends the reply.
+ */
+typedef struct
+{
+    uint16_t conn_handle;           /* BLE_HS_CONN_HANDLE_NONE once it left */
+    bool busy;
+    bool done;
+    uint8_t op;
+    uint8_t seq;
+    uint8_t doors;
+    uint8_t code_len;
+    char code[CRED_PIN_MAX];
+    uint16_t user_id;
+    lock_result_t result;
+} cred_op_t;
+
+static cred_op_t cred_ops[CONN_CTX_MAX];
+static portMUX_TYPE cred_op_lock = portMUX_INITIALIZER_UNLOCKED;
+static struct ble_npl_event cred_op_ev;
+
+/* Deferred job */
+static void cred_op_job(uint16_t conn_handle, void *arg)
+{
+    cred_op_t *op = arg;
+    esp_err_t err;
+
+    if (op->op == LOCK_OP_CRED_ADD)
+    {
+        err = cred_store_add(op->code, op->code_len, op->doors, &op->user_id);
+        if (err == ESP_OK)
+        {
+            /* The id may be a revoked user's, with a policy left over */
+            access_policy_clear(op->user_id);
+        }
+        op->result = err == ESP_OK ? LOCK_RES_OK :
+                     err == ESP_ERR_INVALID_ARG ? LOCK_RES_BAD_REQUEST : LOCK_RES_FAILED;
+        memset(op->code, 0, sizeof op->code);
+    }
+    else
+    {
+        err = cred_store_revoke(op->user_id);
+        if (err == ESP_OK)
+        {
+            access_policy_clear(op->user_id);
+        }
+        op->result = err == ESP_OK ? LOCK_RES_OK :
+                     err == ESP_ERR_NOT_FOUND ? LOCK_RES_DENIED : LOCK_RES_FAILED;
+    }
+
+    portENTER_CRITICAL(&cred_op_lock);
+    op->done = true;
+    portEXIT_CRITICAL(&cred_op_lock);
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &cred_op_ev);
+}
+
+/* Host task event: replies for the jobs that finished */
+static void cred_op_event(struct ble_npl_event *ev)
+{
+    uint8_t buf[LOCK_PROTO_REPLY_MAX];
+    lock_writer_t w;
+    cred_op_t op;
+    bool take;
+    int n;
+
+    for (int i = 0; i < CONN_CTX_MAX; i++)
+    {
+        portENTER_CRITICAL(&cred_op_lock);
+        take = cred_ops[i].busy && cred_ops[i].done;
+        if (take)
+        {
+            op = cred_ops[i];
+            cred_ops[i].busy = false;
+            cred_ops[i].done = false;
+        }
+        portEXIT_CRITICAL(&cred_op_lock);
+        if (!take || op.conn_handle == BLE_HS_CONN_HANDLE_NONE)
+        {
+            continue;
+        }
+
+        lock_proto_begin(&w, buf, sizeof buf, op.op, op.seq, op.result);
+        if (op.result == LOCK_RES_OK && op.op == LOCK_OP_CRED_ADD)
+        {
+            lock_proto_put_u16(&w, LOCK_TLV_USER, op.user_id);
+        }
+        n = lock_proto_end(&w);
+        if (n > 0)
+        {
+            n = reply_send(op.conn_handle, ble_spp_svc_gatt_read_val_handle, buf, n);
+        }
+        if (n != 0)
+        {
+            MODLOG_DFLT(ERROR, "Failed to send reply, rc=%d", n);
+        }
+    }
+}
+
+/*
+ * Queues a credential change for the connection.  Returns LOCK_RES_OK if
+ * the job will reply, or the result to reply with now.
+ */
+static lock_result_t cred_op_submit(const conn_ctx_t *ctx, const lock_msg_t *msg,
+                                    const uint8_t *code, uint8_t code_len,
+                                    uint8_t doors, uint16_t user_id)
+{
+    cred_op_t *op = NULL;
+    bool pending = false;
+
+    if (code_len > CRED_PIN_MAX)
+    {
+        return LOCK_RES_BAD_REQUEST;
+    }
+
+    portENTER_CRITICAL(&cred_op_lock);
+    for (int i = 0; i < CONN_CTX_MAX; i++)
+    {
+        if (!cred_ops[i].busy)
+        {
+            op = op == NULL ? &cred_ops[i] : op;
+        }
+        else if (cred_ops[i].conn_handle == ctx->conn_handle)
+        {
+            pending = true;
+        }
+    }
+    if (op != NULL && !pending)
+    {
+        op->busy = true;
+        op->done = false;
+        op->conn_handle = ctx->conn_handle;
+    }
+    portEXIT_CRITICAL(&cred_op_lock);
+    if (op == NULL || pending)
+    {
+        return LOCK_RES_BUSY;
+    }
+
+    op->op = msg->op;
+    op->seq = msg->seq;
+    op->doors = doors;
+    op->code_len = code_len;
+    if (code_len > 0)
+    {
+        memcpy(op->code, code, code_len);
+    }
+    op->user_id = user_id;
+    /* Bound to no connection: a change under way finishes if the admin leaves */
+    if (defer_submit(DEFER_CONN_NONE, 0, cred_op_job, op) != ESP_OK)
+    {
+        portENTER_CRITICAL(&cred_op_lock);
+        op->busy = false;
+        portEXIT_CRITICAL(&cred_op_lock);
+        return LOCK_RES_BUSY;
+    }
+    return LOCK_RES_OK;
+}
+
+/* Drops the reply to a change still running for a connection that went away */
+static void cred_op_cancel(uint16_t conn_handle)
+{
+    portENTER_CRITICAL(&cred_op_lock);
+    for (int i = 0; i < CONN_CTX_MAX; i++)
+    {
+        if (cred_ops[i].busy && cred_ops[i].conn_handle == conn_handle)
+        {
+            cred_ops[i].conn_handle = BLE_HS_CONN_HANDLE_NONE;
+        }
+    }
+    portEXIT_CRITICAL(&cred_op_lock);
+}
+
+/* Handles one binary command frame and sends its reply; see lock_proto.h */
+static void spp_command(conn_ctx_t *ctx, const uint8_t *data, uint16_t len)
+{
+    uint8_t buf[LOCK_PROTO_REPLY_MAX];
+    lock_result_t result = LOCK_RES_OK;
+    uint16_t user_id = CRED_USER_NONE;
+    const uint8_t *code;
+    uint8_t code_len;
+    uint8_t door = 0;
+    uint8_t doors = CRED_DOORS_ALL;
+    access_policy_t policy;
+    access_rule_t rule;
+    lock_writer_t w;
+    lock_msg_t msg;
+    esp_err_t err;
+    int n;
+
+    err = lock_proto_decode(data, len, &msg);
+    if (err == ESP_ERR_INVALID_SIZE)
+    {
+        MODLOG_DFLT(WARN, "runt command frame (%d bytes)\n", len);
+        return;
+    }
+    if (err != ESP_OK)
+    {
+        result = LOCK_RES_BAD_REQUEST;
+        goto reply;
+    }
+    /* Optional on every request; absent means door 0 */
+    lock_proto_get_u8(&msg, LOCK_TLV_DOOR, &door);
+    if (door >= ACTUATOR_DOORS)
+    {
+        result = LOCK_RES_BAD_REQUEST;
+        goto reply;
+    }
+
+    switch (msg.op)
+    {
+    case LOCK_OP_HELLO:
+        /* The banner is for humans; an app that says hello never gets it */
+        ctx->binary = true;
+        ctx->welcome_sent = true;
+        break;
+
+    case LOCK_OP_UNLOCK:
+        if (!lock_proto_find(&msg, LOCK_TLV_CODE, &code, &code_len))
+        {
+            if (!ctx->resumed)
+            {
+                result = LOCK_RES_BAD_REQUEST;
+            }
+            else
+            {
+                bool ok = resumed_unlock(ctx, door, &user_id);
+
+                lock_status_attempt(ok);
+                result = ok ? LOCK_RES_OK : LOCK_RES_NOT_PERMITTED;
+            }
+        }
+        else if (rate_limit_locked(&ctx->peer_id_addr))
+        {
+            result = LOCK_RES_LOCKED_OUT;
+        }
+        else
+        {
+            bool ok = unlock_attempt(ctx, door, (const char *)code, code_len, &user_id);
+
+            rate_limit_result(&ctx->peer_id_addr, ok);
+            lock_status_attempt(ok);
+            result = ok ? LOCK_RES_OK : LOCK_RES_DENIED;
+        }
+        break;
+
+    case LOCK_OP_LOCK:
+        if (!ctx->authed || !(ctx->auth_doors & (1u << door)))
+        {
+            result = LOCK_RES_NOT_PERMITTED;
+        }
+        else if (actuator_request(door, ACTUATOR_CMD_LOCK) != ESP_OK)
+        {
+            result = LOCK_RES_BUSY;
+        }
+        break;
+
+    case LOCK_OP_STATUS:
+        break;
+
+    case LOCK_OP_CRED_ADD:
+        if (!spp_command_admin(ctx))
+        {
+            result = LOCK_RES_NOT_PERMITTED;
+        }
+        else if (!lock_proto_find(&msg, LOCK_TLV_CODE, &code, &code_len))
+        {
+            result = LOCK_RES_BAD_REQUEST;
+        }
+        else
+        {
+            lock_proto_get_u8(&msg, LOCK_TLV_DOORS, &doors);
+            result = cred_op_submit(ctx, &msg, code, code_len, doors, user_id);
+            if (result == LOCK_RES_OK)
+            {
+                /* The job replies */
+                return;
+            }
+        }
+        break;
+
+    case LOCK_OP_CRED_REVOKE:
+        if (!spp_command_admin(ctx))
+        {
+            result = LOCK_RES_NOT_PERMITTED;
+        }
+        else if (!lock_proto_get_u16(&msg, LOCK_TLV_USER, &user_id))
+        {
+            result = LOCK_RES_BAD_REQUEST;
+        }
+        else
+        {
+            result = cred_op_submit(ctx, &msg, NULL, 0, doors, user_id);
+            if (result == LOCK_RES_OK)
+            {
+                return;
+            }
+        }
+        break;
+
+    case LOCK_OP_POLICY_SET:
+        if (!spp_command_admin(ctx))
+        {
+            result = LOCK_RES_NOT_PERMITTED;
+        }
+        else if (!lock_proto_get_u16(&msg, LOCK_TLV_USER, &user_id) ||
+                 !policy_rule_decode(&msg, &rule))
+        {
+            result = LOCK_RES_BAD_REQUEST;
+        }
+        else
+        {
+            err = access_policy_set(user_id, &rule);
+            result = err == ESP_OK ? LOCK_RES_OK :
+                     err == ESP_ERR_INVALID_ARG ? LOCK_RES_BAD_REQUEST :
+                     err == ESP_ERR_NOT_FOUND ? LOCK_RES_DENIED : LOCK_RES_FAILED;
+        }
+        break;
+
+    case LOCK_OP_POLICY_GET:
+        if (!spp_command_admin(ctx))
+        {
+            result = LOCK_RES_NOT_PERMITTED;
+        }
+        else if (!lock_proto_get_u16(&msg, LOCK_TLV_USER, &user_id))
+        {
+            result = LOCK_RES_BAD_REQUEST;
+        }
+        break;
+
+    default:
+        result = LOCK_RES_UNSUPPORTED;
+        break;
+    }
+
+reply:
+    lock_proto_begin(&w, buf, sizeof buf, msg.op, msg.seq, result);
+    if (result == LOCK_RES_OK)
+    {
+        switch (msg.op)
+        {
+        case LOCK_OP_HELLO:
+            lock_proto_put_u8(&w, LOCK_TLV_VERSION, LOCK_PROTO_VERSION);
+            lock_proto_put_u16(&w, LOCK_TLV_MTU, ctx->mtu);
+            lock_proto_put_u8(&w, LOCK_TLV_DOORS, ACTUATOR_DOORS_ALL);
+            if (ctx->resumed)
+            {
+                lock_proto_put_u16(&w, LOCK_TLV_USER, ctx->auth_user);
+            }
+            break;
+
+        case LOCK_OP_UNLOCK:
+            lock_proto_put_u16(&w, LOCK_TLV_USER, user_id);
+            break;
+
+        case LOCK_OP_POLICY_GET:
+            /* Nothing past RESULT for an unrestricted user */
+            if (access_policy_get(user_id, &policy))
+            {
+                lock_proto_put(&w, LOCK_TLV_HOURS, policy.hours, sizeof policy.hours);
+                lock_proto_put_u16(&w, LOCK_TLV_FROM, policy.from_day);
+                lock_proto_put_u16(&w, LOCK_TLV_UNTIL, policy.until_day);
+                lock_proto_put_u8(&w, LOCK_TLV_FLAGS, policy.flags & ACCESS_F_ONCE);
+            }
+            break;
+
+        case LOCK_OP_STATUS:
+            lock_proto_put_u8(&w, LOCK_TLV_DOOR, door);
+            lock_proto_put_u8(&w, LOCK_TLV_STATE, actuator_get_state(door));
+            lock_proto_put_u16(&w, LOCK_TLV_COUNT, cred_store_count());
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    n = lock_proto_end(&w);
+    if (n < 0)
+    {
+        MODLOG_DFLT(ERROR, "reply to op 0x%02x does not fit\n", msg.op);
+        return;
+    }
+    n = reply_send(ctx->conn_handle, ble_spp_svc_gatt_read_val_handle, buf, n);
+    if (n != 0)
+    {
+        MODLOG_DFLT(ERROR, "Failed to send reply, rc=%d", n);
+    }
+}
+
+/* Called by the frame parser for every complete frame written by a client */
+static void spp_frame_cb(void *arg, frame_type_t type, const uint8_t *data, uint16_t len)
+{
+    conn_ctx_t *ctx = arg;
+    bool ok;
+
+    if (type == FRAME_TYPE_TEXT)
+    {
+        /* One write may carry several lines; stop at the lockout */
+        if (rate_limit_locked(&ctx->peer_id_addr))
+        {
+            return;
+        }
+        ok = password_check(ctx, (const char *)data, len);
+        rate_limit_result(&ctx->peer_id_addr, ok);
+        lock_status_attempt(ok);
+    }
+    else
+    {
+        spp_command(ctx, data, len);
+    }
 }
 
 /* Callback function for custom service */
@@ -390,26 +1055,46 @@ static int ble_svc_gatt_handler(uint16_t conn_handle, uint16_t attr_handle, stru
     switch (ctxt->op)
     {
     case BLE_GATT_ACCESS_OP_READ_CHR:
-        MODLOG_DFLT(INFO, "Callback for read");
-        break;
+        /* Same snapshot as the status characteristic */
+        return lock_status_access(conn_handle, attr_handle, ctxt, arg);
 
     case BLE_GATT_ACCESS_OP_WRITE_CHR:
-        MODLOG_DFLT(INFO, "Data received in write event,conn_handle = %x,attr_handle = %x", conn_handle, attr_handle);
-        // Echo received data back to client for now
-        if (ctxt->om->om_len > 0)
-        {
-            // struct os_mbuf *txom;
-            // txom = ble_hs_mbuf_from_flat(ctxt->om->om_data, ctxt->om->om_len);
-            ble_hs_mbuf_from_flat(ctxt->om->om_data, ctxt->om->om_len);
-            // ble_gatts_notify_custom(conn_handle, ble_spp_svc_gatt_read_val_handle, txom);
-            // 将接收到的密码打印到终端
-            // MODLOG_DFLT(INFO, "Received data: %.*s", ctxt->om->om_len, (char *)ctxt->om->om_data);
-            // check if the password is correct
-            char received_password[20] = {0};
-            memcpy(received_password, ctxt->om->om_data, ctxt->om->om_len);
-            password_check(conn_handle, received_password);
+    {
+        conn_ctx_t *ctx = conn_ctx_find(conn_handle);
+        bool end_of_write;
+
+        DIAG_SPAN_BEGIN(t);
+        if (ctx == NULL)
+        {
+            return BLE_ATT_ERR_UNLIKELY;
+        }
+        DIAG_COUNT(DIAG_CNT_WRITES);
+        DIAG_CALL(ctx->diag_write_us = lock_hal_now_us());
+        /* Refuse floods before doing any work on them */
+        if (!rate_limit_admit(&ctx->peer_id_addr))
+        {
+            return BLE_ATT_ERR_INSUFFICIENT_RES;
+        }
+        BLOG(GATT_WRITE, conn_handle, attr_handle, OS_MBUF_PKTLEN(ctxt->om));
+        /* Whatever this write is, the reply should go out fast */
+        conn_policy_activity(ctx);
+
+        /* Long and prepared writes arrive as an mbuf chain; the parser walks
+         * it in place.  A write shorter than a full ATT payload is the end of
+         * what the client had to say. */
+#if CONFIG_LOCK_FRAME_SHORT_WRITE_ENDS
+        end_of_write = OS_MBUF_PKTLEN(ctxt->om) != ctx->mtu - 3;
+#else
+        end_of_write = false;
+#endif
+        if (frame_parser_begin_write(&ctx->rx, (uint32_t)(lock_hal_now_us() / 1000)))
+        {
+            MODLOG_DFLT(WARN, "conn_handle=%d dropped a frame left incomplete\n", conn_handle);
         }
+        frame_parser_feed_mbuf(&ctx->rx, ctxt->om, end_of_write, spp_frame_cb, ctx);
+        DIAG_SPAN_END(DIAG_HIST_GATT_WRITE, t);
         break;
+    }
 
     default:
         MODLOG_DFLT(INFO, "\nDefault Callback");
@@ -431,10 +1116,57 @@ static const struct ble_gatt_svc_def new_ble_svc_gatt_defs[] = {
                                                            .val_handle = &ble_spp_svc_gatt_read_val_handle,
                                                            .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_NOTIFY,
                                                        },
+                                                       {
+                                                           /* Audit log readout; needs an encrypted link */
+                                                           .uuid = BLE_UUID16_DECLARE(BLE_SVC_AUDIT_CHR_UUID16),
+                                                           .access_cb = audit_log_access,
+                                                           .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_READ_ENC |
+                                                                    BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_ENC,
+                                                       },
+                                                       {
+                                                           /* Packed lock status, see lock_status.h */
+                                                           .uuid = BLE_UUID16_DECLARE(BLE_SVC_STATUS_CHR_UUID16),
+                                                           .access_cb = lock_status_access,
+                                                           .val_handle = &ble_svc_status_val_handle,
+                                                           .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+                                                       },
+#if CONFIG_LOCK_DIAG
+                                                       {
+                                                           /* Latency histograms, see lock_diag.h */
+                                                           .uuid = BLE_UUID16_DECLARE(BLE_SVC_DIAG_CHR_UUID16),
+                                                           .access_cb = lock_diag_access,
+                                                           .flags = BLE_GATT_CHR_F_READ,
+                                                       },
+#endif
                                                        {
                                                            0, /* No more characteristics */
                                                        }},
     },
+#if CONFIG_LOCK_OTA
+    {
+        /*** Service: firmware update, see ota_svc.h */
+        .type = BLE_GATT_SVC_TYPE_PRIMARY,
+        .uuid = BLE_UUID16_DECLARE(BLE_SVC_OTA_UUID16),
+        .characteristics = (struct ble_gatt_chr_def[]){{
+                                                           .uuid = BLE_UUID16_DECLARE(BLE_SVC_OTA_CTRL_CHR_UUID16),
+                                                           .access_cb = ota_svc_ctrl_access,
+                                                           .val_handle = &ble_svc_ota_ctrl_val_handle,
+                                                           .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_READ_ENC |
+                                                                    BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_ENC |
+                                                                    BLE_GATT_CHR_F_NOTIFY,
+                                                       },
+                                                       {
+                                                           /* Image chunks; no response, so the client can
+                                                            * keep several in flight per connection event */
+                                                           .uuid = BLE_UUID16_DECLARE(BLE_SVC_OTA_DATA_CHR_UUID16),
+                                                           .access_cb = ota_svc_data_access,
+                                                           .flags = BLE_GATT_CHR_F_WRITE_NO_RSP | BLE_GATT_CHR_F_WRITE_ENC,
+                                                       },
+                                                       {
+                                                           0, /* No more characteristics */
+                                                       }},
+    },
+#endif
     {
         0, /* No more services. */
     },
@@ -495,91 +1227,24 @@ int gatt_svr_init(void)
     return 0;
 }
 
-void ble_server_uart_task(void *pvParameters)
-{
-    MODLOG_DFLT(INFO, "BLE server UART_task started\n");
-    uart_event_t event;
-    int rc = 0;
-    for (;;)
-    {
-        // Waiting for UART event.
-        if (xQueueReceive(spp_common_uart_queue, (void *)&event, (TickType_t)portMAX_DELAY))
-        {
-            switch (event.type)
-            {
-            // Event of UART receiving data
-            case UART_DATA:
-                if (event.size)
-                {
-                    uint8_t *ntf;
-                    ntf = (uint8_t *)malloc(sizeof(uint8_t) * event.size);
-                    memset(ntf, 0x00, event.size);
-                    uart_read_bytes(UART_NUM_0, ntf, event.size, portMAX_DELAY);
-
-                    for (int i = 0; i <= CONFIG_BT_NIMBLE_MAX_CONNECTIONS; i++)
-                    {
-                        /* Check if client has subscribed to notifications */
-                        if (conn_handle_subs[i])
-                        {
-                            struct os_mbuf *txom;
-                            txom = ble_hs_mbuf_from_flat(ntf, event.size);
-                            rc = ble_gatts_notify_custom(i, ble_spp_svc_gatt_read_val_handle,
-                                                         txom);
-                            if (rc == 0)
-                            {
-                                MODLOG_DFLT(INFO, "Notification sent successfully");
-                            }
-                            else
-                            {
-                                MODLOG_DFLT(INFO, "Error in sending notification rc = %d", rc);
-                            }
-                        }
-                    }
-
-                    free(ntf);
-                }
-                break;
-            default:
-                break;
-            }
-        }
-    }
-    vTaskDelete(NULL);
-}
-static void ble_spp_uart_init(void)
-{
-    uart_config_t uart_config = {
-        .baud_rate = 115200,
-        .data_bits = UART_DATA_8_BITS,
-        .parity = UART_PARITY_DISABLE,
-        .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_RTS,
-        .rx_flow_ctrl_thresh = 122,
-        .source_clk = UART_SCLK_DEFAULT,
-    };
-    // Install UART driver, and get the queue.
-    uart_driver_install(UART_NUM_0, 4096, 8192, 10, &spp_common_uart_queue, 0);
-    // Set UART parameters
-    uart_param_config(UART_NUM_0, &uart_config);
-    // Set UART pins
-    uart_set_pin(UART_NUM_0, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
-    xTaskCreate(ble_server_uart_task, "uTask", 4096, (void *)UART_NUM_0, 8, NULL);
-}
-
 void app_main(void)
 {
     int rc;
 
     /* Initialize NVS — it is used to store PHY calibration data */
-    esp_err_t ret = nvs_flash_init();
-    local_ledc_init();
-    local_ledc_set_duty(1229);
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
-    {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        ret = nvs_flash_init();
-    }
+    esp_err_t ret = lock_hal_nvs_init();
+    /* Before anything takes a PM lock */
+    ESP_ERROR_CHECK(lock_pm_init());
+    ESP_ERROR_CHECK(actuator_init());
     ESP_ERROR_CHECK(ret);
+    ESP_ERROR_CHECK(blog_init());
+#if CONFIG_LOCK_DIAG
+    ESP_ERROR_CHECK(lock_diag_init());
+#endif
+    ESP_ERROR_CHECK(cred_store_init());
+    ESP_ERROR_CHECK(access_policy_init());
+    ESP_ERROR_CHECK(totp_init());
+    ESP_ERROR_CHECK(audit_log_init());
 
     ret = nimble_port_init();
     if (ret != ESP_OK)
@@ -588,14 +1253,27 @@ void app_main(void)
         return;
     }
 
-    /* Initialize connection_handle array */
-    for (int i = 0; i <= CONFIG_BT_NIMBLE_MAX_CONNECTIONS; i++)
-    {
-        conn_handle_subs[i] = false;
-    }
+    /* After the controller task exists, so it can be tracked */
+    ESP_ERROR_CHECK(mem_acct_init());
+    ble_npl_event_init(&welcome_ev, welcome_event, NULL);
+    ble_npl_event_init(&cred_op_ev, cred_op_event, NULL);
+    reply_init();
+    conn_ctx_init();
+    ESP_ERROR_CHECK(conn_policy_init());
+    ESP_ERROR_CHECK(bond_cache_init());
+    rate_limit_init();
+    ESP_ERROR_CHECK(defer_init());
+    ESP_ERROR_CHECK(lock_status_init(&ble_svc_status_val_handle));
+#if CONFIG_LOCK_OTA
+    ESP_ERROR_CHECK(ota_svc_init(&ble_svc_ota_ctrl_val_handle));
+#endif
 
-    /* Initialize uart driver and start uart task */
-    ble_spp_uart_init();
+#if CONFIG_LOCK_CONSOLE
+    /* Before the bridge, which hands it command lines */
+    ESP_ERROR_CHECK(admin_console_init());
+#endif
+    /* Initialize uart driver and start the UART -> BLE bridge task */
+    ESP_ERROR_CHECK(uart_bridge_init(&ble_spp_svc_gatt_read_val_handle));
 
     /* Initialize the NimBLE host configuration. */
     ble_hs_cfg.reset_cb = ble_spp_server_on_reset;
@@ -22,6 +22,20 @@ extern "C" {
 /* 16 Bit SPP Service Characteristic UUID */
 #define BLE_SVC_SPP_CHR_UUID16                              0xABF1
 
+/* 16 Bit audit log Characteristic UUID */
+#define BLE_SVC_AUDIT_CHR_UUID16                            0xABF2
+
+/* 16 Bit diagnostics Characteristic UUID */
+#define BLE_SVC_DIAG_CHR_UUID16                             0xABF3
+
+/* 16 Bit lock status Characteristic UUID */
+#define BLE_SVC_STATUS_CHR_UUID16                           0xABF4
+
+/* 16 Bit firmware update Service and Characteristic UUIDs */
+#define BLE_SVC_OTA_UUID16                                  0xABF8
+#define BLE_SVC_OTA_CTRL_CHR_UUID16                         0xABF9
+#define BLE_SVC_OTA_DATA_CHR_UUID16                         0xABFA
+
 struct ble_hs_cfg;
 struct ble_gatt_register_ctxt;
 
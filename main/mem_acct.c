@@ -0,0 +1,169 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_LOCK_MEM_ACCT
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "os/os_mempool.h"
+#include "modlog/modlog.h"
+#include "mem_acct.h"
+
+/*
+ * Counters are plain increments, as in lock_diag.c: a count lost to a race
+ * costs less than a lock on the paths that fail for lack of memory.  The
+ * heap hooks run inside the allocator, possibly from an ISR or with the
+ * cache off, so they only do an atomic add.
+ */
+typedef struct
+{
+    TaskHandle_t task;
+    uint32_t stack;
+} mem_task_t;
+
+static mem_task_t mem_tasks[MEM_ACCT_TASKS_MAX];
+static int mem_task_count;
+static uint32_t mem_cnt[MEM_CNT_COUNT];
+static uint32_t mem_fail_size;
+static portMUX_TYPE mem_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#if CONFIG_LOCK_MEM_HEAP_COUNT
+static uint32_t mem_heap_allocs;
+static uint32_t mem_heap_frees;
+
+/* Called by the heap for every allocation and free (CONFIG_HEAP_USE_HOOKS) */
+void IRAM_ATTR
+esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    __atomic_fetch_add(&mem_heap_allocs, 1, __ATOMIC_RELAXED);
+}
+
+void IRAM_ATTR
+esp_heap_trace_free_hook(void *ptr)
+{
+    __atomic_fetch_add(&mem_heap_frees, 1, __ATOMIC_RELAXED);
+}
+#endif
+
+static void
+mem_alloc_failed(size_t size, uint32_t caps, const char *function_name)
+{
+    mem_cnt[MEM_CNT_HEAP_FAIL]++;
+    mem_fail_size = size;
+}
+
+void
+mem_acct_track_task(TaskHandle_t task, uint32_t stack)
+{
+    if (task == NULL)
+    {
+        task = xTaskGetCurrentTaskHandle();
+    }
+    portENTER_CRITICAL(&mem_lock);
+    if (mem_task_count < MEM_ACCT_TASKS_MAX)
+    {
+        mem_tasks[mem_task_count].task = task;
+        mem_tasks[mem_task_count++].stack = stack;
+    }
+    portEXIT_CRITICAL(&mem_lock);
+}
+
+void
+mem_acct_count(mem_cnt_t cnt)
+{
+    mem_cnt[cnt]++;
+}
+
+void
+mem_acct_get_stats(mem_acct_stats_t *out)
+{
+    memset(out, 0, sizeof *out);
+    out->heap_free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    out->heap_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    out->heap_largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+#if CONFIG_LOCK_MEM_HEAP_COUNT
+    out->heap_allocs = __atomic_load_n(&mem_heap_allocs, __ATOMIC_RELAXED);
+    out->heap_frees = __atomic_load_n(&mem_heap_frees, __ATOMIC_RELAXED);
+#endif
+    out->heap_fail_size = mem_fail_size;
+    memcpy(out->cnt, mem_cnt, sizeof out->cnt);
+}
+
+int
+mem_acct_tasks(mem_task_info_t *out, int max)
+{
+    int n = 0;
+
+    /* Tasks are registered once and never deleted */
+    for (int i = 0; i < mem_task_count && n < max; i++)
+    {
+        out[n].name = pcTaskGetName(mem_tasks[i].task);
+        out[n].stack = mem_tasks[i].stack;
+        out[n].min_free = uxTaskGetStackHighWaterMark(mem_tasks[i].task);
+        n++;
+    }
+    return n;
+}
+
+int
+mem_acct_pools(mem_pool_info_t *out, int max)
+{
+    struct os_mempool_info omi;
+    struct os_mempool *mp = NULL;
+    int n = 0;
+
+    /* Every pool NimBLE created: msys_1/msys_2 and the host's own */
+    while (n < max && (mp = os_mempool_info_get_next(mp, &omi)) != NULL)
+    {
+        /* Pool names can run to 31 bytes; ours and NimBLE's fit in 15 */
+        snprintf(out[n].name, sizeof out[n].name, "%.*s",
+                 (int)sizeof out[n].name - 1, omi.omi_name);
+        out[n].block_size = omi.omi_block_size;
+        out[n].blocks = omi.omi_num_blocks;
+        out[n].free = omi.omi_num_free;
+        out[n].min_free = omi.omi_min_free;
+        n++;
+    }
+    return n;
+}
+
+/* System tasks that run our callbacks; looked up by name */
+static void
+mem_track_named(const char *name, uint32_t stack)
+{
+    TaskHandle_t task = xTaskGetHandle(name);
+
+    if (task != NULL)
+    {
+        mem_acct_track_task(task, stack);
+    }
+}
+
+esp_err_t
+mem_acct_init(void)
+{
+    esp_err_t ret = heap_caps_register_failed_alloc_callback(mem_alloc_failed);
+
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    mem_track_named("esp_timer", CONFIG_ESP_TIMER_TASK_STACK_SIZE);
+    mem_track_named("btController", 0);
+
+    MODLOG_DFLT(INFO, "mem: heap %u free, %u largest block\n",
+                (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT),
+                (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    return ESP_OK;
+}
+
+#endif
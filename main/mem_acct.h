@@ -0,0 +1,103 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef MEM_ACCT_H
+#define MEM_ACCT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Memory accounting against the fixed budgets the firmware runs on: the
+ * stack high-water mark of every task that registered, the heap low-water
+ * mark and largest free block, NimBLE mempool (msys and host pools)
+ * occupancy peaks, and counts of allocations that failed.
+ *
+ * The data paths (unlock, notify, UART bridge) allocate nothing from the
+ * heap; buffers are static or come from the msys pools.  With
+ * CONFIG_LOCK_MEM_HEAP_COUNT every heap allocation and free is counted as
+ * well, so reading the counters before and after an unlock or a burst of
+ * bridged bytes shows whether that still holds.
+ */
+#define MEM_ACCT_TASKS_MAX          16
+
+typedef enum
+{
+    MEM_CNT_MSYS_FAIL = 0,      /* No mbuf for an outgoing payload */
+    MEM_CNT_NOTIFY_ENOMEM,      /* Host refused a notify for lack of buffers */
+    MEM_CNT_HEAP_FAIL,          /* Any heap allocation that failed */
+    MEM_CNT_REPLY_LOST,         /* Reply given up after retrying, see reply.h */
+    MEM_CNT_COUNT
+} mem_cnt_t;
+
+typedef struct
+{
+    const char *name;
+    uint32_t stack;             /* Bytes; 0 if not known */
+    uint32_t min_free;          /* Least stack ever left, bytes */
+} mem_task_info_t;
+
+typedef struct
+{
+    char name[16];
+    uint16_t block_size;
+    uint16_t blocks;
+    uint16_t free;
+    uint16_t min_free;          /* Peak occupancy is blocks - min_free */
+} mem_pool_info_t;
+
+typedef struct
+{
+    uint32_t heap_free;
+    uint32_t heap_min_free;     /* Low-water mark since boot */
+    uint32_t heap_largest;      /* Largest block that can be allocated now */
+    uint32_t heap_allocs;       /* With CONFIG_LOCK_MEM_HEAP_COUNT, else 0 */
+    uint32_t heap_frees;
+    uint32_t heap_fail_size;    /* Size of the last failed allocation */
+    uint32_t cnt[MEM_CNT_COUNT];
+} mem_acct_stats_t;
+
+#if CONFIG_LOCK_MEM_ACCT
+
+/* Hooks the heap's failed-allocation callback and looks up the system
+ * tasks that run our code (esp_timer, the BLE controller). */
+esp_err_t mem_acct_init(void);
+
+/* Registers a task for stack reporting; NULL for the calling task */
+void mem_acct_track_task(TaskHandle_t task, uint32_t stack);
+
+void mem_acct_count(mem_cnt_t cnt);
+
+void mem_acct_get_stats(mem_acct_stats_t *out);
+
+/* Fill up to max entries; return the number filled */
+int mem_acct_tasks(mem_task_info_t *out, int max);
+int mem_acct_pools(mem_pool_info_t *out, int max);
+
+#define MEM_COUNT(cnt)              mem_acct_count(cnt)
+
+#else
+
+static inline esp_err_t mem_acct_init(void) { return ESP_OK; }
+static inline void mem_acct_track_task(TaskHandle_t task, uint32_t stack) { }
+
+#define MEM_COUNT(cnt)              do { } while (0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <string.h>
+#include "ota_pipe.h"
+
+void
+ota_pipe_init(ota_pipe_t *p, uint8_t *buf0, uint8_t *buf1, uint32_t cap, uint32_t size)
+{
+    memset(p, 0, sizeof *p);
+    p->buf[0] = buf0;
+    p->buf[1] = buf1;
+    p->cap = cap;
+    p->size = size;
+}
+
+uint32_t
+ota_pipe_window_end(const ota_pipe_t *p)
+{
+    uint32_t end = p->committed + OTA_PIPE_BUFS * p->cap;
+
+    return end < p->size ? end : p->size;
+}
+
+ota_pipe_rx_t
+ota_pipe_rx(ota_pipe_t *p, uint32_t off, const uint8_t *data, uint32_t len, uint8_t *ready)
+{
+    uint32_t n;
+
+    *ready = 0;
+    if (off != p->received)
+    {
+        return off < p->received ? OTA_PIPE_STALE : OTA_PIPE_GAP;
+    }
+    if (len > p->cap || len > ota_pipe_window_end(p) - off)
+    {
+        return OTA_PIPE_OVERRUN;
+    }
+
+    while (len > 0)
+    {
+        /* The window keeps the buffer being filled clear of the writer */
+        n = p->cap - p->len[p->fill];
+        if (n > len)
+        {
+            n = len;
+        }
+        memcpy(p->buf[p->fill] + p->len[p->fill], data, n);
+        p->len[p->fill] += n;
+        p->received += n;
+        data += n;
+        len -= n;
+
+        if (p->len[p->fill] == p->cap || p->received == p->size)
+        {
+            *ready |= 1u << p->fill;
+            p->busy |= 1u << p->fill;
+            p->fill = (p->fill + 1) % OTA_PIPE_BUFS;
+        }
+    }
+    return OTA_PIPE_OK;
+}
+
+int
+ota_pipe_next_ready(const ota_pipe_t *p, uint8_t *ready)
+{
+    /* Blocks fill in turn, so the oldest is the first one after fill */
+    for (int i = 0; i < OTA_PIPE_BUFS; i++)
+    {
+        int idx = (p->fill + i) % OTA_PIPE_BUFS;
+
+        if (*ready & (1u << idx))
+        {
+            *ready &= ~(1u << idx);
+            return idx;
+        }
+    }
+    return -1;
+}
+
+void
+ota_pipe_written(ota_pipe_t *p, uint8_t idx)
+{
+    p->committed += p->len[idx];
+    p->len[idx] = 0;
+    p->busy &= ~(1u << idx);
+}
@@ -0,0 +1,87 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef OTA_PIPE_H
+#define OTA_PIPE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Receive side of a firmware update: orders incoming chunks into two
+ * staging buffers so one can be written to flash while the other fills.
+ *
+ * The image is cut into buffer-sized blocks.  A full block (or the short
+ * last one) is handed to the writer, and the client may only send below
+ * ota_pipe_window_end(): two blocks past what has been written.  So a
+ * well-behaved client never finds both buffers busy, and an ack after each
+ * block is the only flow control needed.  Chunks must arrive in order;
+ * anything else is reported, not stored.
+ *
+ * Pure state; ota_svc.c drives it from the NimBLE host task and the flash
+ * writer task under one lock.  It can be run on a host against a file.
+ */
+#define OTA_PIPE_BUFS               2
+
+typedef enum
+{
+    OTA_PIPE_OK = 0,
+    OTA_PIPE_STALE,             /* Already received; dropped */
+    OTA_PIPE_GAP,               /* Ahead of what was expected; dropped */
+    OTA_PIPE_OVERRUN,           /* Past the window or the image; dropped */
+} ota_pipe_rx_t;
+
+typedef struct
+{
+    uint8_t *buf[OTA_PIPE_BUFS];
+    uint32_t cap;               /* Bytes per buffer */
+    uint32_t size;              /* Image size */
+    uint32_t received;          /* Next offset expected */
+    uint32_t committed;         /* Bytes the writer has finished with */
+    uint32_t len[OTA_PIPE_BUFS];
+    uint8_t fill;               /* Buffer being filled */
+    uint8_t busy;               /* Buffers handed to the writer, bit each */
+} ota_pipe_t;
+
+void ota_pipe_init(ota_pipe_t *p, uint8_t *buf0, uint8_t *buf1, uint32_t cap, uint32_t size);
+
+/**
+ * Takes the chunk at image offset off.  A chunk may not be longer than a
+ * buffer.  It usually completes at most one, but one that crosses a block
+ * boundary and ends the image completes two.
+ *
+ * @param ready     Set to the buffers that are now full and must go to the
+ *                  writer, bit each, 0 if none.  Hand them over in the
+ *                  order ota_pipe_next_ready() gives.
+ */
+ota_pipe_rx_t ota_pipe_rx(ota_pipe_t *p, uint32_t off, const uint8_t *data, uint32_t len,
+                          uint8_t *ready);
+
+/* Takes the oldest buffer out of a ready mask from ota_pipe_rx() and
+ * returns it, or -1 once the mask is empty */
+int ota_pipe_next_ready(const ota_pipe_t *p, uint8_t *ready);
+
+/* The writer is done with buffer idx. */
+void ota_pipe_written(ota_pipe_t *p, uint8_t idx);
+
+/* The client may send data below this offset */
+uint32_t ota_pipe_window_end(const ota_pipe_t *p);
+
+static inline bool
+ota_pipe_complete(const ota_pipe_t *p)
+{
+    return p->committed == p->size;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
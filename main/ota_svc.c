@@ -0,0 +1,615 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_LOCK_OTA
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "mbedtls/sha256.h"
+#include "host/ble_hs.h"
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "actuator.h"
+#include "conn_ctx.h"
+#include "defer.h"
+#include "mem_acct.h"
+#include "ota_pipe.h"
+#include "ota_svc.h"
+
+#define OTA_TASK_STACK          4096
+#define OTA_TASK_PRIO           5
+#define OTA_QUEUE_LEN           (OTA_PIPE_BUFS + 2)
+#define OTA_HDR_LEN             4
+#define OTA_CHUNK_MAX           (CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU - 3 - OTA_HDR_LEN)
+#define OTA_BEGIN_LEN           (1 + 4 + 32)
+#define OTA_APPLY_DELAY_MS      500
+
+_Static_assert(CONFIG_LOCK_OTA_BUF_SIZE >= OTA_CHUNK_MAX, "OTA buffer smaller than a chunk");
+
+/* Work for the flash writer task, in order */
+typedef enum
+{
+    OTA_JOB_BEGIN = 0,
+    OTA_JOB_WRITE,
+    OTA_JOB_ABORT,
+    OTA_JOB_APPLY,
+} ota_job_type_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t idx;                /* Buffer, for OTA_JOB_WRITE */
+    uint16_t session;
+} ota_job_t;
+
+/*
+ * Session state.  The host task and the writer share it under ota_lock;
+ * the staging buffers themselves are handed over through the pipe's busy
+ * mask, and the hash context is the writer's alone.
+ */
+static struct
+{
+    uint8_t state;              /* ota_state_t */
+    uint16_t session;           /* Bumped on every BEGIN and abort */
+    uint16_t conn_handle;       /* Owner, or BLE_HS_CONN_HANDLE_NONE while detached */
+    uint8_t detach_gen;         /* Identifies the live resume timer */
+    bool gap_reported;
+    uint8_t sha[32];
+    int64_t start_us;
+    ota_pipe_t pipe;
+} ota;
+
+static uint8_t ota_buf[OTA_PIPE_BUFS][CONFIG_LOCK_OTA_BUF_SIZE];
+static mbedtls_sha256_context ota_sha;
+static QueueHandle_t ota_queue;
+static const uint16_t *ota_ctrl_handle;
+static portMUX_TYPE ota_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void
+ota_notify(uint16_t conn_handle, uint8_t evt, uint8_t status, uint32_t a, uint32_t b)
+{
+    uint8_t msg[10];
+
+    if (conn_handle == BLE_HS_CONN_HANDLE_NONE)
+    {
+        return;
+    }
+    msg[0] = evt;
+    msg[1] = status;
+    put_le32(&msg[2], a);
+    put_le32(&msg[6], b);
+    lock_hal_notify(conn_handle, *ota_ctrl_handle,
+                    msg, evt == OTA_EVT_DONE ? 2 : evt == OTA_EVT_NACK ? 6 : 10);
+}
+
+static void
+ota_post(uint8_t type, uint8_t idx, uint16_t session)
+{
+    ota_job_t job = {
+        .type = type,
+        .idx = idx,
+        .session = session,
+    };
+
+    /* Sized for every buffer plus a control op, so this only fails if the
+     * client floods control writes */
+    if (xQueueSend(ota_queue, &job, 0) != pdTRUE)
+    {
+        MODLOG_DFLT(WARN, "ota: writer queue full\n");
+    }
+}
+
+/* Ends the session; the caller posts OTA_JOB_ABORT if the slot is open */
+static void
+ota_reset_locked(void)
+{
+    ota.state = OTA_STATE_IDLE;
+    ota.session++;
+}
+
+/*
+ * Writer task side
+ */
+static void
+ota_do_begin(uint16_t session)
+{
+    esp_err_t ret;
+    uint16_t conn_handle;
+    uint32_t size;
+    uint32_t window = 0;
+    bool live;
+
+    portENTER_CRITICAL(&ota_lock);
+    live = ota.session == session;
+    size = ota.pipe.size;
+    portEXIT_CRITICAL(&ota_lock);
+    if (!live)
+    {
+        return;
+    }
+
+    ret = lock_hal_ota_begin(size);
+    if (ret == ESP_OK)
+    {
+        mbedtls_sha256_init(&ota_sha);
+        mbedtls_sha256_starts(&ota_sha, 0);
+    }
+
+    portENTER_CRITICAL(&ota_lock);
+    conn_handle = ota.conn_handle;
+    if (ota.session != session)
+    {
+        /* Aborted meanwhile; the abort job closes the slot */
+    }
+    else if (ret == ESP_OK)
+    {
+        ota.state = OTA_STATE_RECEIVING;
+        ota.start_us = lock_hal_now_us();
+        window = ota_pipe_window_end(&ota.pipe);
+    }
+    else
+    {
+        ota_reset_locked();
+    }
+    portEXIT_CRITICAL(&ota_lock);
+
+    if (ret != ESP_OK)
+    {
+        MODLOG_DFLT(ERROR, "ota: cannot open the update slot; rc=%d\n", ret);
+    }
+    ota_notify(conn_handle, OTA_EVT_BEGIN,
+               ret == ESP_OK ? OTA_STATUS_OK :
+               ret == ESP_ERR_INVALID_SIZE ? OTA_STATUS_SIZE : OTA_STATUS_FLASH,
+               0, window);
+}
+
+/* All data is written; checks it and selects it for the next boot */
+static void
+ota_do_finish(uint16_t session)
+{
+    uint8_t sha[32];
+    uint16_t conn_handle;
+    ota_status_t status = OTA_STATUS_OK;
+    uint32_t ms = (lock_hal_now_us() - ota.start_us) / 1000;
+    esp_err_t ret;
+
+    mbedtls_sha256_finish(&ota_sha, sha);
+    mbedtls_sha256_free(&ota_sha);
+    if (memcmp(sha, ota.sha, sizeof sha) != 0)
+    {
+        status = OTA_STATUS_HASH;
+        lock_hal_ota_abort();
+    }
+    else if ((ret = lock_hal_ota_end()) != ESP_OK)
+    {
+        MODLOG_DFLT(ERROR, "ota: image rejected; rc=%d\n", ret);
+        status = OTA_STATUS_IMAGE;
+    }
+
+    portENTER_CRITICAL(&ota_lock);
+    conn_handle = ota.conn_handle;
+    if (ota.session == session)
+    {
+        if (status == OTA_STATUS_OK)
+        {
+            ota.state = OTA_STATE_DONE;
+        }
+        else
+        {
+            ota_reset_locked();
+        }
+    }
+    portEXIT_CRITICAL(&ota_lock);
+
+    MODLOG_DFLT(INFO, "ota: %u bytes in %ums (%u KB/s), status %d\n",
+                (unsigned)ota.pipe.size, (unsigned)ms,
+                (unsigned)(ms ? ota.pipe.size / ms : 0), status);
+    ota_notify(conn_handle, OTA_EVT_DONE, status, 0, 0);
+}
+
+static void
+ota_do_write(uint8_t idx, uint16_t session)
+{
+    uint16_t conn_handle;
+    uint32_t committed = 0;
+    uint32_t window = 0;
+    bool complete = false;
+    bool live;
+    esp_err_t ret;
+
+    portENTER_CRITICAL(&ota_lock);
+    live = ota.session == session;
+    portEXIT_CRITICAL(&ota_lock);
+    if (!live)
+    {
+        return;
+    }
+
+    /* The host task is filling the other buffer meanwhile */
+    mbedtls_sha256_update(&ota_sha, ota_buf[idx], ota.pipe.len[idx]);
+    ret = lock_hal_ota_write(ota_buf[idx], ota.pipe.len[idx]);
+
+    portENTER_CRITICAL(&ota_lock);
+    conn_handle = ota.conn_handle;
+    if (ota.session != session)
+    {
+        live = false;
+    }
+    else if (ret == ESP_OK)
+    {
+        ota_pipe_written(&ota.pipe, idx);
+        committed = ota.pipe.committed;
+        window = ota_pipe_window_end(&ota.pipe);
+        complete = ota_pipe_complete(&ota.pipe);
+    }
+    else
+    {
+        ota_reset_locked();
+    }
+    portEXIT_CRITICAL(&ota_lock);
+
+    if (!live)
+    {
+        return;
+    }
+    if (ret != ESP_OK)
+    {
+        MODLOG_DFLT(ERROR, "ota: flash write failed; rc=%d\n", ret);
+        lock_hal_ota_abort();
+        mbedtls_sha256_free(&ota_sha);
+        ota_notify(conn_handle, OTA_EVT_DONE, OTA_STATUS_FLASH, 0, 0);
+        return;
+    }
+    ota_notify(conn_handle, OTA_EVT_ACK, OTA_STATUS_OK, committed, window);
+    if (complete)
+    {
+        ota_do_finish(session);
+    }
+}
+
+static void
+ota_task(void *param)
+{
+    ota_job_t job;
+
+    mem_acct_track_task(NULL, OTA_TASK_STACK);
+    for (;;)
+    {
+        if (xQueueReceive(ota_queue, &job, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+
+        switch (job.type)
+        {
+        case OTA_JOB_BEGIN:
+            ota_do_begin(job.session);
+            break;
+
+        case OTA_JOB_WRITE:
+            ota_do_write(job.idx, job.session);
+            break;
+
+        case OTA_JOB_ABORT:
+            lock_hal_ota_abort();
+            break;
+
+        case OTA_JOB_APPLY:
+            MODLOG_DFLT(INFO, "ota: restarting into the new image\n");
+            /* Let the write response and the log get out */
+            vTaskDelay(pdMS_TO_TICKS(OTA_APPLY_DELAY_MS));
+            lock_hal_restart();
+            break;
+        }
+    }
+}
+
+/*
+ * Host task side
+ */
+static void
+ota_expire_job(uint16_t conn_handle, void *arg)
+{
+    bool expired = false;
+    uint16_t session = 0;
+
+    portENTER_CRITICAL(&ota_lock);
+    if (ota.conn_handle == BLE_HS_CONN_HANDLE_NONE &&
+        ota.detach_gen == (uint8_t)(uintptr_t)arg && ota.state != OTA_STATE_IDLE)
+    {
+        ota_reset_locked();
+        session = ota.session;
+        expired = true;
+    }
+    portEXIT_CRITICAL(&ota_lock);
+
+    if (expired)
+    {
+        MODLOG_DFLT(INFO, "ota: not resumed; update abandoned\n");
+        ota_post(OTA_JOB_ABORT, 0, session);
+    }
+}
+
+/* The update is as powerful as a code that opens every door, entered on
+ * this connection rather than resumed from a bond */
+static bool
+ota_authorized(const conn_ctx_t *ctx)
+{
+    return ctx->authed && !ctx->resumed &&
+           (ctx->auth_doors & ACTUATOR_DOORS_ALL) == ACTUATOR_DOORS_ALL;
+}
+
+static void
+ota_begin(conn_ctx_t *ctx, uint32_t size, const uint8_t *sha)
+{
+    uint16_t conn_handle = ctx->conn_handle;
+    uint32_t resume_at = 0;
+    uint32_t window = 0;
+    uint16_t session;
+    bool was_open;
+
+    if (size == 0)
+    {
+        ota_notify(conn_handle, OTA_EVT_BEGIN, OTA_STATUS_SIZE, 0, 0);
+        return;
+    }
+
+    portENTER_CRITICAL(&ota_lock);
+    if (ota.conn_handle != BLE_HS_CONN_HANDLE_NONE && ota.conn_handle != conn_handle &&
+        ota.state != OTA_STATE_IDLE)
+    {
+        portEXIT_CRITICAL(&ota_lock);
+        ota_notify(conn_handle, OTA_EVT_BEGIN, OTA_STATUS_BUSY, 0, 0);
+        return;
+    }
+    if (ota.state == OTA_STATE_RECEIVING && ota.pipe.size == size &&
+        memcmp(ota.sha, sha, sizeof ota.sha) == 0)
+    {
+        /* Same image: carry on from the last byte received */
+        ota.conn_handle = conn_handle;
+        ota.detach_gen++;
+        ota.gap_reported = false;
+        resume_at = ota.pipe.received;
+        window = ota_pipe_window_end(&ota.pipe);
+        portEXIT_CRITICAL(&ota_lock);
+        MODLOG_DFLT(INFO, "ota: resuming at %u of %u\n", (unsigned)resume_at, (unsigned)size);
+        ota_notify(conn_handle, OTA_EVT_BEGIN, OTA_STATUS_OK, resume_at, window);
+        return;
+    }
+    /* Anything else starts over; a half-written buffer of the old session
+     * is dropped by the writer once it sees the new session number */
+    was_open = ota.state == OTA_STATE_STARTING || ota.state == OTA_STATE_RECEIVING;
+    ota_reset_locked();
+    session = ota.session;
+    ota.state = OTA_STATE_STARTING;
+    ota.conn_handle = conn_handle;
+    ota.detach_gen++;
+    ota.gap_reported = false;
+    memcpy(ota.sha, sha, sizeof ota.sha);
+    ota_pipe_init(&ota.pipe, ota_buf[0], ota_buf[1], sizeof ota_buf[0], size);
+    portEXIT_CRITICAL(&ota_lock);
+
+    MODLOG_DFLT(INFO, "ota: receiving %u bytes\n", (unsigned)size);
+    if (was_open)
+    {
+        ota_post(OTA_JOB_ABORT, 0, session);
+    }
+    ota_post(OTA_JOB_BEGIN, 0, session);
+}
+
+int
+ota_svc_ctrl_access(uint16_t conn_handle, uint16_t attr_handle,
+                    struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    conn_ctx_t *ctx = conn_ctx_find(conn_handle);
+    uint8_t req[OTA_BEGIN_LEN];
+    uint8_t rsp[13];
+    uint16_t session;
+    uint16_t len;
+    bool owner;
+    uint8_t state;
+
+    if (ctx == NULL)
+    {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+
+    switch (ctxt->op)
+    {
+    case BLE_GATT_ACCESS_OP_READ_CHR:
+        portENTER_CRITICAL(&ota_lock);
+        rsp[0] = ota.state;
+        put_le32(&rsp[1], ota.pipe.size);
+        put_le32(&rsp[5], ota.pipe.received);
+        put_le32(&rsp[9], ota.pipe.committed);
+        portEXIT_CRITICAL(&ota_lock);
+        return os_mbuf_append(ctxt->om, rsp, sizeof rsp) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+
+    case BLE_GATT_ACCESS_OP_WRITE_CHR:
+        break;
+
+    default:
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+
+    if (!ota_authorized(ctx))
+    {
+        return BLE_ATT_ERR_INSUFFICIENT_AUTHOR;
+    }
+    if (ble_hs_mbuf_to_flat(ctxt->om, req, sizeof req, &len) != 0 || len == 0)
+    {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+
+    switch (req[0])
+    {
+    case OTA_OP_BEGIN:
+        if (len != OTA_BEGIN_LEN)
+        {
+            return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        }
+        ota_begin(ctx, get_le32(&req[1]), &req[5]);
+        return 0;
+
+    case OTA_OP_ABORT:
+    case OTA_OP_APPLY:
+        portENTER_CRITICAL(&ota_lock);
+        /* A detached session is anyone's to finish */
+        owner = ota.conn_handle == conn_handle || ota.conn_handle == BLE_HS_CONN_HANDLE_NONE;
+        state = ota.state;
+        if (owner && req[0] == OTA_OP_ABORT)
+        {
+            ota_reset_locked();
+        }
+        session = ota.session;
+        portEXIT_CRITICAL(&ota_lock);
+
+        if (!owner)
+        {
+            return BLE_ATT_ERR_INSUFFICIENT_AUTHOR;
+        }
+        if (req[0] == OTA_OP_ABORT)
+        {
+            MODLOG_DFLT(INFO, "ota: aborted by the client\n");
+            ota_post(OTA_JOB_ABORT, 0, session);
+        }
+        else if (state == OTA_STATE_DONE)
+        {
+            ota_post(OTA_JOB_APPLY, 0, session);
+        }
+        else
+        {
+            ota_notify(conn_handle, OTA_EVT_DONE, OTA_STATUS_STATE, 0, 0);
+        }
+        return 0;
+
+    default:
+        return BLE_ATT_ERR_REQ_NOT_SUPPORTED;
+    }
+}
+
+int
+ota_svc_data_access(uint16_t conn_handle, uint16_t attr_handle,
+                    struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    uint8_t chunk[OTA_HDR_LEN + OTA_CHUNK_MAX];
+    conn_ctx_t *ctx;
+    ota_pipe_rx_t rx;
+    uint32_t expected;
+    uint16_t session;
+    uint16_t len;
+    bool nack = false;
+    uint8_t full[OTA_PIPE_BUFS];
+    int nfull = 0;
+    uint8_t ready;
+    int idx;
+
+    if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR)
+    {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    if (ble_hs_mbuf_to_flat(ctxt->om, chunk, sizeof chunk, &len) != 0 || len <= OTA_HDR_LEN)
+    {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+
+    portENTER_CRITICAL(&ota_lock);
+    if (ota.conn_handle != conn_handle || ota.state != OTA_STATE_RECEIVING)
+    {
+        portEXIT_CRITICAL(&ota_lock);
+        return BLE_ATT_ERR_INSUFFICIENT_AUTHOR;
+    }
+    rx = ota_pipe_rx(&ota.pipe, get_le32(chunk), chunk + OTA_HDR_LEN, len - OTA_HDR_LEN,
+                     &ready);
+    expected = ota.pipe.received;
+    session = ota.session;
+    if (rx == OTA_PIPE_OK)
+    {
+        ota.gap_reported = false;
+    }
+    else if (rx != OTA_PIPE_STALE && !ota.gap_reported)
+    {
+        /* Everything after a lost chunk is out of order too; say so once */
+        ota.gap_reported = true;
+        nack = true;
+    }
+    while ((idx = ota_pipe_next_ready(&ota.pipe, &ready)) >= 0)
+    {
+        full[nfull++] = idx;
+    }
+    portEXIT_CRITICAL(&ota_lock);
+
+    /* Only this task queues writes, so they keep their order */
+    for (int i = 0; i < nfull; i++)
+    {
+        ota_post(OTA_JOB_WRITE, full[i], session);
+    }
+    if (nack)
+    {
+        ota_notify(conn_handle, OTA_EVT_NACK, OTA_STATUS_GAP, expected, 0);
+    }
+
+    /* Keep the link at its fastest for the whole transfer */
+    ctx = conn_ctx_find(conn_handle);
+    if (ctx != NULL)
+    {
+        conn_policy_activity(ctx);
+    }
+    return 0;
+}
+
+static void
+ota_on_disconnect(conn_ctx_t *ctx, int reason)
+{
+    bool paused = false;
+    uint8_t gen = 0;
+
+    portENTER_CRITICAL(&ota_lock);
+    if (ota.conn_handle == ctx->conn_handle)
+    {
+        ota.conn_handle = BLE_HS_CONN_HANDLE_NONE;
+        gen = ++ota.detach_gen;
+        paused = ota.state == OTA_STATE_STARTING || ota.state == OTA_STATE_RECEIVING;
+    }
+    portEXIT_CRITICAL(&ota_lock);
+
+    if (paused)
+    {
+        MODLOG_DFLT(INFO, "ota: paused at %u; resumable for %ds\n",
+                    (unsigned)ota.pipe.received, CONFIG_LOCK_OTA_RESUME_S);
+        defer_submit(DEFER_CONN_NONE, CONFIG_LOCK_OTA_RESUME_S * 1000,
+                     ota_expire_job, (void *)(uintptr_t)gen);
+    }
+}
+
+static const conn_ctx_hooks_t ota_hooks = {
+    .on_disconnect = ota_on_disconnect,
+};
+
+esp_err_t
+ota_svc_init(const uint16_t *ctrl_val_handle)
+{
+    ota_ctrl_handle = ctrl_val_handle;
+    ota.conn_handle = BLE_HS_CONN_HANDLE_NONE;
+
+    ota_queue = xQueueCreate(OTA_QUEUE_LEN, sizeof(ota_job_t));
+    if (ota_queue == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(ota_task, "otaTask", OTA_TASK_STACK, NULL,
+                    OTA_TASK_PRIO, NULL) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return conn_ctx_register_hooks(&ota_hooks);
+}
+
+#endif
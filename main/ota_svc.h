@@ -0,0 +1,84 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef OTA_SVC_H
+#define OTA_SVC_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "host/ble_hs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Firmware update over BLE.  Both characteristics need an encrypted link,
+ * and writes are only taken from a connection whose accepted code opens
+ * every door.
+ *
+ * Control characteristic (0xABF9), little-endian:
+ *   write  BEGIN  01 | u32 size | sha256[32]
+ *          ABORT  02
+ *          APPLY  03                   restart into the verified image
+ *   notify BEGIN  81 | status | u32 offset to send from | u32 window end
+ *          ACK    82 | status | u32 bytes written | u32 window end
+ *          NACK   83 | status | u32 offset expected
+ *          DONE   84 | status
+ *   read          state | u32 size | u32 received | u32 written
+ *
+ * Data characteristic (0xABFA), write without response:
+ *          u32 offset | payload, at most MTU - 7 bytes
+ *
+ * The client sends in order and never at or past the window end, which
+ * each ACK moves forward by one staging buffer.  A NACK is sent once per
+ * gap; the client goes back to the offset it gives.  The session survives
+ * a disconnect for CONFIG_LOCK_OTA_RESUME_S: a BEGIN with the same size
+ * and hash then resumes from where it stopped.  DONE follows the last ACK
+ * once the SHA-256 of the image and the image itself have been checked.
+ */
+#define OTA_OP_BEGIN                0x01
+#define OTA_OP_ABORT                0x02
+#define OTA_OP_APPLY                0x03
+#define OTA_EVT_BEGIN               0x81
+#define OTA_EVT_ACK                 0x82
+#define OTA_EVT_NACK                0x83
+#define OTA_EVT_DONE                0x84
+
+typedef enum
+{
+    OTA_STATUS_OK = 0,
+    OTA_STATUS_BUSY,            /* Another connection is updating */
+    OTA_STATUS_SIZE,            /* Empty, or larger than the OTA slot */
+    OTA_STATUS_FLASH,           /* Flash write failed */
+    OTA_STATUS_HASH,            /* SHA-256 mismatch */
+    OTA_STATUS_IMAGE,           /* Not a valid app image */
+    OTA_STATUS_STATE,           /* Nothing to apply */
+    OTA_STATUS_GAP,             /* Data out of order (NACK) */
+} ota_status_t;
+
+typedef enum
+{
+    OTA_STATE_IDLE = 0,
+    OTA_STATE_STARTING,         /* Slot being opened */
+    OTA_STATE_RECEIVING,
+    OTA_STATE_DONE,             /* Verified; waiting for APPLY */
+} ota_state_t;
+
+/* Starts the flash writer task.  *ctrl_val_handle is the control
+ * characteristic's value handle, filled in at GATT registration. */
+esp_err_t ota_svc_init(const uint16_t *ctrl_val_handle);
+
+int ota_svc_ctrl_access(uint16_t conn_handle, uint16_t attr_handle,
+                        struct ble_gatt_access_ctxt *ctxt, void *arg);
+int ota_svc_data_access(uint16_t conn_handle, uint16_t attr_handle,
+                        struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
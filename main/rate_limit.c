@@ -0,0 +1,166 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <string.h>
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "rate_limit.h"
+
+/*
+ * Token bucket per peer.  The bucket level is kept as microseconds of
+ * refill time, so refilling is one addition and a write costs
+ * RATE_PERIOD_US.  After CONFIG_LOCK_LOCKOUT_FAILS consecutive wrong codes
+ * the peer is locked out, for twice as long after every further failure.
+ *
+ * The table is small enough that a linear scan costs less than hashing a
+ * 7-byte address; the least recently seen peer is evicted when it is full.
+ * A peer that rotates its private address gets a fresh entry, but each
+ * connection is still held to the per-peer rate.
+ */
+#define RATE_PEERS              CONFIG_LOCK_RATE_PEERS
+#define RATE_PERIOD_US          (1000000LL / CONFIG_LOCK_RATE_PER_S)
+#define RATE_CAPACITY_US        (RATE_PERIOD_US * CONFIG_LOCK_RATE_BURST)
+#define RATE_LOCKOUT_BASE_US    (CONFIG_LOCK_LOCKOUT_BASE_MS * 1000LL)
+#define RATE_LOCKOUT_MAX_US     (CONFIG_LOCK_LOCKOUT_MAX_S * 1000000LL)
+
+typedef struct
+{
+    ble_addr_t addr;
+    bool in_use;
+    uint8_t fails;              /* Consecutive failed attempts */
+    int64_t level_us;
+    int64_t refill_us;          /* Time of the last refill */
+    int64_t locked_until_us;
+    uint32_t seen;              /* LRU stamp */
+} rate_peer_t;
+
+static rate_peer_t rate_peers[RATE_PEERS];
+static uint32_t rate_clock;
+static rate_limit_stats_t rate_stats;
+
+static rate_peer_t *
+rate_lookup(const ble_addr_t *peer)
+{
+    rate_peer_t *victim = &rate_peers[0];
+
+    for (int i = 0; i < RATE_PEERS; i++)
+    {
+        rate_peer_t *p = &rate_peers[i];
+
+        if (p->in_use && ble_addr_cmp(&p->addr, peer) == 0)
+        {
+            p->seen = ++rate_clock;
+            return p;
+        }
+        if (!p->in_use)
+        {
+            victim = p;
+        }
+        else if (victim->in_use && p->seen < victim->seen)
+        {
+            victim = p;
+        }
+    }
+
+    if (victim->in_use)
+    {
+        rate_stats.evictions++;
+    }
+    memset(victim, 0, sizeof *victim);
+    victim->addr = *peer;
+    victim->in_use = true;
+    victim->level_us = RATE_CAPACITY_US;
+    victim->refill_us = lock_hal_now_us();
+    victim->seen = ++rate_clock;
+    return victim;
+}
+
+void
+rate_limit_init(void)
+{
+    memset(rate_peers, 0, sizeof rate_peers);
+    memset(&rate_stats, 0, sizeof rate_stats);
+}
+
+bool
+rate_limit_admit(const ble_addr_t *peer)
+{
+    rate_peer_t *p = rate_lookup(peer);
+    int64_t now = lock_hal_now_us();
+
+    if (now < p->locked_until_us)
+    {
+        rate_stats.rejected_lockout++;
+        return false;
+    }
+
+    p->level_us += now - p->refill_us;
+    p->refill_us = now;
+    if (p->level_us > RATE_CAPACITY_US)
+    {
+        p->level_us = RATE_CAPACITY_US;
+    }
+    if (p->level_us < RATE_PERIOD_US)
+    {
+        rate_stats.rejected_rate++;
+        return false;
+    }
+    p->level_us -= RATE_PERIOD_US;
+    rate_stats.admitted++;
+    return true;
+}
+
+bool
+rate_limit_locked(const ble_addr_t *peer)
+{
+    rate_peer_t *p = rate_lookup(peer);
+
+    if (lock_hal_now_us() < p->locked_until_us)
+    {
+        rate_stats.rejected_lockout++;
+        return true;
+    }
+    return false;
+}
+
+void
+rate_limit_result(const ble_addr_t *peer, bool success)
+{
+    rate_peer_t *p = rate_lookup(peer);
+    int64_t lockout;
+    int shift;
+
+    if (success)
+    {
+        p->fails = 0;
+        return;
+    }
+    if (p->fails < UINT8_MAX)
+    {
+        p->fails++;
+    }
+    if (p->fails < CONFIG_LOCK_LOCKOUT_FAILS)
+    {
+        return;
+    }
+
+    shift = p->fails - CONFIG_LOCK_LOCKOUT_FAILS;
+    lockout = shift < 20 ? RATE_LOCKOUT_BASE_US << shift : RATE_LOCKOUT_MAX_US;
+    if (lockout > RATE_LOCKOUT_MAX_US)
+    {
+        lockout = RATE_LOCKOUT_MAX_US;
+    }
+    p->locked_until_us = lock_hal_now_us() + lockout;
+    rate_stats.lockouts++;
+    MODLOG_DFLT(WARN, "peer locked out for %lldms after %d failed attempts\n",
+                (long long)(lockout / 1000), p->fails);
+}
+
+void
+rate_limit_get_stats(rate_limit_stats_t *out)
+{
+    *out = rate_stats;
+}
@@ -0,0 +1,50 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "host/ble_hs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+    uint32_t admitted;          /* Writes let through */
+    uint32_t rejected_rate;     /* Writes refused for lack of tokens */
+    uint32_t rejected_lockout;  /* Writes or attempts refused while locked out */
+    uint32_t lockouts;          /* Lockouts started */
+    uint32_t evictions;         /* Peers dropped from the table */
+} rate_limit_stats_t;
+
+/**
+ * Per-peer write limiter.  Peers are tracked by identity address in a
+ * small table that outlives their connections, so reconnecting does not
+ * refill the bucket or clear a lockout.  All calls come from the NimBLE
+ * host task.
+ */
+void rate_limit_init(void);
+
+/* Takes one token for a write.  Returns false if the write must be refused. */
+bool rate_limit_admit(const ble_addr_t *peer);
+
+/* True while the peer is serving a lockout */
+bool rate_limit_locked(const ble_addr_t *peer);
+
+/* Records the outcome of an unlock attempt. */
+void rate_limit_result(const ble_addr_t *peer, bool success);
+
+void rate_limit_get_stats(rate_limit_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
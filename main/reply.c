@@ -0,0 +1,221 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "nimble/nimble_port.h"
+#include "host/ble_hs.h"
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "conn_ctx.h"
+#include "defer.h"
+#include "mem_acct.h"
+#include "reply.h"
+
+#define REPLY_BACKOFF_MS            10
+#define REPLY_HDR                   4       /* u16 attribute, u16 length */
+
+/* Replies waiting for one connection, length-prefixed in order */
+typedef struct
+{
+    uint16_t conn_handle;           /* BLE_HS_CONN_HANDLE_NONE when free */
+    uint16_t len;                   /* Bytes used in buf */
+    uint16_t backoff_ms;
+    uint8_t attempts;               /* Failed sends of the first reply */
+    uint8_t buf[REPLY_BUF_SIZE];
+} reply_slot_t;
+
+static reply_slot_t reply_slots[CONN_CTX_MAX];
+
+/* Connections whose retry came due, handed from the defer task */
+static struct ble_npl_event reply_ev;
+static uint16_t reply_due[CONN_CTX_MAX];
+static int reply_due_count;
+static portMUX_TYPE reply_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static reply_slot_t *
+reply_slot(uint16_t conn_handle)
+{
+    for (int i = 0; i < CONN_CTX_MAX; i++)
+    {
+        if (reply_slots[i].conn_handle == conn_handle)
+        {
+            return &reply_slots[i];
+        }
+    }
+    return NULL;
+}
+
+/* Deferred job: asks the host task to try again */
+static void
+reply_job(uint16_t conn_handle, void *arg)
+{
+    int i;
+
+    portENTER_CRITICAL(&reply_lock);
+    for (i = 0; i < reply_due_count && reply_due[i] != conn_handle; i++)
+    {
+    }
+    if (i == reply_due_count && i < CONN_CTX_MAX)
+    {
+        reply_due[reply_due_count++] = conn_handle;
+    }
+    portEXIT_CRITICAL(&reply_lock);
+
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &reply_ev);
+}
+
+static void
+reply_schedule(reply_slot_t *slot)
+{
+    if (defer_submit(slot->conn_handle, slot->backoff_ms, reply_job, NULL) != ESP_OK)
+    {
+        /* No timer to spare; come round again straight away */
+        reply_job(slot->conn_handle, NULL);
+    }
+}
+
+static void
+reply_release(reply_slot_t *slot)
+{
+    slot->conn_handle = BLE_HS_CONN_HANDLE_NONE;
+    slot->len = 0;
+}
+
+/* Sends queued replies in order until one is refused again */
+static void
+reply_flush(reply_slot_t *slot)
+{
+    uint16_t attr;
+    uint16_t len;
+    int rc;
+
+    while (slot->len > 0)
+    {
+        attr = slot->buf[0] | slot->buf[1] << 8;
+        len = slot->buf[2] | slot->buf[3] << 8;
+        rc = lock_hal_notify(slot->conn_handle, attr, &slot->buf[REPLY_HDR], len);
+        if (rc == BLE_HS_ENOMEM)
+        {
+            if (++slot->attempts > REPLY_MAX_RETRIES)
+            {
+                MODLOG_DFLT(ERROR, "conn %d: %u bytes of replies lost\n",
+                            slot->conn_handle, slot->len);
+                MEM_COUNT(MEM_CNT_REPLY_LOST);
+                reply_release(slot);
+                return;
+            }
+            slot->backoff_ms *= 2;
+            reply_schedule(slot);
+            return;
+        }
+        if (rc != 0)
+        {
+            MODLOG_DFLT(ERROR, "conn %d: reply dropped, rc=%d\n", slot->conn_handle, rc);
+        }
+        slot->len -= REPLY_HDR + len;
+        memmove(slot->buf, &slot->buf[REPLY_HDR + len], slot->len);
+        slot->attempts = 0;
+        slot->backoff_ms = REPLY_BACKOFF_MS;
+    }
+    reply_release(slot);
+}
+
+/* Host task event: retries the connections reply_job() queued */
+static void
+reply_event(struct ble_npl_event *ev)
+{
+    uint16_t due[CONN_CTX_MAX];
+    reply_slot_t *slot;
+    int n;
+
+    portENTER_CRITICAL(&reply_lock);
+    n = reply_due_count;
+    memcpy(due, reply_due, n * sizeof due[0]);
+    reply_due_count = 0;
+    portEXIT_CRITICAL(&reply_lock);
+
+    for (int i = 0; i < n; i++)
+    {
+        slot = reply_slot(due[i]);
+        if (slot != NULL)
+        {
+            reply_flush(slot);
+        }
+    }
+}
+
+void
+reply_init(void)
+{
+    for (int i = 0; i < CONN_CTX_MAX; i++)
+    {
+        reply_release(&reply_slots[i]);
+    }
+    ble_npl_event_init(&reply_ev, reply_event, NULL);
+}
+
+int
+reply_send(uint16_t conn_handle, uint16_t attr_handle,
+           const void *data, uint16_t len)
+{
+    reply_slot_t *slot = reply_slot(conn_handle);
+    int rc;
+
+    if (slot == NULL)
+    {
+        rc = lock_hal_notify(conn_handle, attr_handle, data, len);
+        if (rc != BLE_HS_ENOMEM)
+        {
+            return rc;
+        }
+        slot = reply_slot(BLE_HS_CONN_HANDLE_NONE);
+        if (slot == NULL || len > sizeof slot->buf - REPLY_HDR)
+        {
+            MEM_COUNT(MEM_CNT_REPLY_LOST);
+            return BLE_HS_ENOMEM;
+        }
+        slot->conn_handle = conn_handle;
+        slot->attempts = 1;
+        slot->backoff_ms = REPLY_BACKOFF_MS;
+        reply_schedule(slot);
+    }
+    else if (len > sizeof slot->buf - REPLY_HDR - slot->len)
+    {
+        /* Behind a reply that has not gone yet, and no room to wait */
+        MEM_COUNT(MEM_CNT_REPLY_LOST);
+        return BLE_HS_ENOMEM;
+    }
+
+    slot->buf[slot->len] = attr_handle & 0xff;
+    slot->buf[slot->len + 1] = attr_handle >> 8;
+    slot->buf[slot->len + 2] = len & 0xff;
+    slot->buf[slot->len + 3] = len >> 8;
+    memcpy(&slot->buf[slot->len + REPLY_HDR], data, len);
+    slot->len += REPLY_HDR + len;
+    return 0;
+}
+
+void
+reply_cancel(uint16_t conn_handle)
+{
+    reply_slot_t *slot = reply_slot(conn_handle);
+
+    if (slot != NULL)
+    {
+        reply_release(slot);
+    }
+    portENTER_CRITICAL(&reply_lock);
+    for (int i = 0; i < reply_due_count; i++)
+    {
+        if (reply_due[i] == conn_handle)
+        {
+            reply_due[i] = reply_due[--reply_due_count];
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&reply_lock);
+}
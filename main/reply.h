@@ -0,0 +1,48 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef REPLY_H
+#define REPLY_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bytes of replies a connection may have waiting for buffers */
+#define REPLY_BUF_SIZE              512
+/* Attempts on one reply before it is given up, backing off 10..320 ms */
+#define REPLY_MAX_RETRIES           6
+
+/*
+ * Single replies to one connection: banners, the PIN verdict and command
+ * responses.  A reply the host cannot take for lack of mbufs is kept and
+ * sent again from the host task with backoff, and every later reply to
+ * that connection queues behind it so the dialogue stays in order.
+ *
+ * Everything here runs on the NimBLE host task.
+ */
+void reply_init(void);
+
+/**
+ * Sends data as a notification of attr_handle to conn_handle, or queues it
+ * if the host is out of buffers.
+ *
+ * @return 0 if sent or queued, BLE_HS_ENOMEM if there was no room to queue
+ *         it either, or the NimBLE error from the notify call.
+ */
+int reply_send(uint16_t conn_handle, uint16_t attr_handle,
+               const void *data, uint16_t len);
+
+/* Drops whatever is queued for a connection that went away */
+void reply_cancel(uint16_t conn_handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
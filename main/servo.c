@@ -0,0 +1,168 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include "lock_hal.h"
+#include "servo.h"
+
+_Static_assert(CONFIG_LOCK_SERVO_RANGE_DEG <= SERVO_LUT_DEG, "servo range larger than the table");
+_Static_assert(SERVO_DUTY(CONFIG_LOCK_SERVO_RANGE_DEG) <= SERVO_DUTY_MAX, "servo pulse longer than the PWM period");
+_Static_assert(CONFIG_LOCK_SERVO_OPEN_DEG <= CONFIG_LOCK_SERVO_RANGE_DEG &&
+               CONFIG_LOCK_SERVO_LOCKED_DEG <= CONFIG_LOCK_SERVO_RANGE_DEG, "door angle out of range");
+
+/* One entry per degree; angles past the servo's range hold its end stop */
+#define SERVO_CLAMP(d)      ((d) < CONFIG_LOCK_SERVO_RANGE_DEG ? (d) : CONFIG_LOCK_SERVO_RANGE_DEG)
+#define SERVO_LUT1(d)       SERVO_DUTY(SERVO_CLAMP(d)),
+#define SERVO_LUT10(d)      SERVO_LUT1(d) SERVO_LUT1(d + 1) SERVO_LUT1(d + 2) SERVO_LUT1(d + 3) \
+                            SERVO_LUT1(d + 4) SERVO_LUT1(d + 5) SERVO_LUT1(d + 6) SERVO_LUT1(d + 7) \
+                            SERVO_LUT1(d + 8) SERVO_LUT1(d + 9)
+#define SERVO_LUT60(d)      SERVO_LUT10(d) SERVO_LUT10(d + 10) SERVO_LUT10(d + 20) \
+                            SERVO_LUT10(d + 30) SERVO_LUT10(d + 40) SERVO_LUT10(d + 50)
+
+static const uint16_t servo_lut[SERVO_LUT_DEG + 1] = {
+    SERVO_LUT60(0) SERVO_LUT60(60) SERVO_LUT60(120) SERVO_LUT1(180)
+};
+
+/*
+ * Position profiles sampled at t = k / SERVO_SEGMENTS, in thousandths of
+ * the move, rounded to nearest:
+ *   linear     s = t
+ *   trapezoid  constant acceleration for the first and last quarter,
+ *              constant speed between: s = 8/3 t^2, 4/3 t - 1/6,
+ *              1 - 8/3 (1 - t)^2
+ *   S-curve    s = 10 t^3 - 15 t^4 + 6 t^5, zero speed and acceleration
+ *              at both ends
+ */
+#define N                   SERVO_SEGMENTS
+#define SERVO_LINEAR(k)     ((1000 * (k) + N / 2) / N)
+#define SERVO_TRAP(k) \
+    (4 * (k) <= N ? (8000 * (k) * (k) + 3 * N * N / 2) / (3 * N * N) : \
+     4 * (k) <= 3 * N ? (1000 * (8 * (k) - N) + 3 * N) / (6 * N) : \
+     1000 - (8000 * (N - (k)) * (N - (k)) + 3 * N * N / 2) / (3 * N * N))
+#define SERVO_SCURVE(k) \
+    ((1000LL * (10LL * (k) * (k) * (k) * N * N - 15LL * (k) * (k) * (k) * (k) * N + \
+                6LL * (k) * (k) * (k) * (k) * (k)) + (long long)N * N * N * N * N / 2) / \
+     ((long long)N * N * N * N * N))
+
+#if CONFIG_LOCK_SERVO_PROFILE_LINEAR
+#define SERVO_POINT(k)      SERVO_LINEAR(k)
+#elif CONFIG_LOCK_SERVO_PROFILE_TRAPEZOID
+#define SERVO_POINT(k)      SERVO_TRAP(k)
+#else
+#define SERVO_POINT(k)      SERVO_SCURVE(k)
+#endif
+
+_Static_assert(SERVO_SEGMENTS == 8, "profile table below assumes 8 segments");
+
+static const uint16_t servo_profile[SERVO_SEGMENTS + 1] = {
+    SERVO_POINT(0), SERVO_POINT(1), SERVO_POINT(2), SERVO_POINT(3), SERVO_POINT(4),
+    SERVO_POINT(5), SERVO_POINT(6), SERVO_POINT(7), SERVO_POINT(8),
+};
+#undef N
+
+uint32_t
+servo_angle_to_duty(int deg)
+{
+    if (deg < 0)
+    {
+        deg = 0;
+    }
+    return servo_lut[deg < SERVO_LUT_DEG ? deg : SERVO_LUT_DEG];
+}
+
+uint16_t
+servo_profile_point(int k)
+{
+    return servo_profile[k];
+}
+
+void
+servo_park(servo_t *s, uint8_t door, int deg)
+{
+    s->door = door;
+    s->duty = servo_angle_to_duty(deg);
+    s->seg = SERVO_SEGMENTS + 1;
+    s->moving = false;
+    s->pending = false;
+    lock_hal_servo_set_duty(s->door, s->duty);
+}
+
+void
+servo_power(servo_t *s, bool on)
+{
+    lock_hal_servo_power(s->door, on);
+    if (on)
+    {
+        lock_hal_servo_set_duty(s->door, s->duty);
+    }
+}
+
+/* Starts the next segment that changes the duty.  Returns false when the
+ * move has no segments left. */
+static bool
+servo_next(servo_t *s)
+{
+    int32_t span = (int32_t)s->to - (int32_t)s->from;
+    uint32_t ms = 0;
+
+    while (s->seg <= SERVO_SEGMENTS)
+    {
+        uint32_t target = s->from + span * servo_profile[s->seg] / 1000;
+
+        s->seg++;
+        ms += s->seg_ms;
+        if (target == s->duty)
+        {
+            /* Nothing to fade; fold this segment's time into the next */
+            continue;
+        }
+        s->duty = target;
+        s->moving = true;
+        lock_hal_servo_fade(s->door, target, ms);
+        return true;
+    }
+    s->moving = false;
+    return false;
+}
+
+static bool
+servo_start(servo_t *s, int deg, uint32_t ms)
+{
+    s->from = s->duty;
+    s->to = servo_angle_to_duty(deg);
+    s->seg = 1;
+    s->seg_ms = ms / SERVO_SEGMENTS;
+    if (s->seg_ms < SERVO_PERIOD_US / 1000)
+    {
+        /* The servo only sees one pulse per PWM period */
+        s->seg_ms = SERVO_PERIOD_US / 1000;
+    }
+    return !servo_next(s);
+}
+
+bool
+servo_move(servo_t *s, int deg, uint32_t ms)
+{
+    if (s->moving)
+    {
+        s->pending = true;
+        s->pending_deg = deg;
+        s->pending_ms = ms;
+        return false;
+    }
+    return servo_start(s, deg, ms);
+}
+
+bool
+servo_fade_done(servo_t *s)
+{
+    s->moving = false;
+    if (s->pending)
+    {
+        s->pending = false;
+        return servo_start(s, s->pending_deg, s->pending_ms);
+    }
+    return !servo_next(s);
+}
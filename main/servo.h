@@ -0,0 +1,95 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef SERVO_H
+#define SERVO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "lock_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Servo angle -> LEDC duty, and motion profiles.
+ *
+ * A pulse of CONFIG_LOCK_SERVO_MIN_PULSE_US is 0 degrees and one of
+ * CONFIG_LOCK_SERVO_MAX_PULSE_US is CONFIG_LOCK_SERVO_RANGE_DEG.  The duty
+ * for every whole degree is computed by the compiler from the LEDC timer
+ * resolution and frequency in lock_hal.h.
+ *
+ * A move is split into SERVO_SEGMENTS equal-time segments that follow the
+ * configured position profile.  Each segment is one linear LEDC hardware
+ * fade, so the CPU only wakes once per segment, from the fade-end
+ * interrupt, to queue the next one.
+ */
+#define SERVO_SEGMENTS              8
+#define SERVO_LUT_DEG               180
+
+#define SERVO_PERIOD_US             (1000000 / LOCK_HAL_SERVO_FREQ_HZ)
+#define SERVO_DUTY_MAX              ((1u << LOCK_HAL_SERVO_RES_BITS) - 1)
+
+/* Pulse width for deg, in us times RANGE_DEG to stay exact */
+#define SERVO_PULSE_SCALED(deg) \
+    ((uint64_t)CONFIG_LOCK_SERVO_MIN_PULSE_US * CONFIG_LOCK_SERVO_RANGE_DEG + \
+     (uint64_t)(deg) * (CONFIG_LOCK_SERVO_MAX_PULSE_US - CONFIG_LOCK_SERVO_MIN_PULSE_US))
+
+/* Duty in LEDC ticks for a whole number of degrees, rounded to nearest */
+#define SERVO_DUTY(deg) \
+    ((uint32_t)(((SERVO_PULSE_SCALED(deg) << (LOCK_HAL_SERVO_RES_BITS + 1)) / \
+                 ((uint64_t)CONFIG_LOCK_SERVO_RANGE_DEG * SERVO_PERIOD_US) + 1) / 2))
+
+typedef struct
+{
+    uint32_t duty;              /* Duty now, or at the end of the fade in flight */
+    uint32_t from;              /* Move start and end duties */
+    uint32_t to;
+    uint32_t seg_ms;
+    uint8_t seg;                /* Next profile point */
+    bool moving;                /* A fade is in flight */
+    bool pending;               /* A new move waits for the current segment */
+    uint16_t pending_deg;
+    uint32_t pending_ms;
+    uint8_t door;               /* LEDC output, see lock_hal_servo_init() */
+} servo_t;
+
+/* Duty for an angle, clamped to the configured range */
+uint32_t servo_angle_to_duty(int deg);
+
+/* Position after segment k of SERVO_SEGMENTS, in thousandths of the move */
+uint16_t servo_profile_point(int k);
+
+/* Binds s to a door's output and sets it at once, with no profile.  Only
+ * while not moving. */
+void servo_park(servo_t *s, uint8_t door, int deg);
+
+/* Gates the servo's power and PWM (see lock_hal_servo_power()).  Powering
+ * on resumes the pulse at the current position.  Only while not moving. */
+void servo_power(servo_t *s, bool on);
+
+/**
+ * Starts a profiled move to deg taking about ms.  A move requested while
+ * another is in flight starts from wherever the current segment ends.
+ *
+ * @return true if there was nothing to do (already there); false if a fade
+ *         has been started and servo_fade_done() will report the end.
+ */
+bool servo_move(servo_t *s, int deg, uint32_t ms);
+
+/**
+ * Call from task context after each fade-end interrupt.
+ *
+ * @return true when the whole move has finished.
+ */
+bool servo_fade_done(servo_t *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
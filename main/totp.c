@@ -0,0 +1,364 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "mbedtls/sha1.h"
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "totp.h"
+
+/*
+ * TOTP verification.
+ *
+ * Every user's codes for the steps within +-CONFIG_LOCK_TOTP_WINDOW of now
+ * are kept in a ring; a timer at each step boundary computes the one new
+ * code per user and rebuilds a small code -> (user, step) hash table.  A
+ * BLE write therefore costs a table probe, not 2N+1 HMACs.  Verification
+ * reads one of two tables while the timer fills the other, then flips.
+ */
+#define TOTP_NVS_NS             "totp"
+#define TOTP_MAX_USERS          CONFIG_LOCK_TOTP_MAX_USERS
+#define TOTP_WINDOW             CONFIG_LOCK_TOTP_WINDOW
+#define TOTP_SPAN               (2 * TOTP_WINDOW + 1)
+#define TOTP_STEP_S             CONFIG_LOCK_TOTP_STEP_S
+#define TOTP_DIGITS             CONFIG_LOCK_TOTP_DIGITS
+/* Codes are refused while the clock still reads earlier than this */
+#define TOTP_CLOCK_VALID        1700000000
+
+/* Table of at least twice the entries, rounded up to a power of two */
+#define TOTP_SMEAR(v)           ((v) | (v) >> 1 | (v) >> 2 | (v) >> 4 | (v) >> 8)
+#define TOTP_TABLE_SIZE         (TOTP_SMEAR(2 * TOTP_MAX_USERS * TOTP_SPAN - 1) + 1)
+#define TOTP_TABLE_MASK         (TOTP_TABLE_SIZE - 1)
+
+_Static_assert(TOTP_MAX_USERS * TOTP_SPAN < 0x8000, "TOTP table too large");
+
+typedef struct
+{
+    uint32_t code;
+    uint8_t user;
+    uint8_t pos;                /* Index into the window, 0 = oldest step */
+    bool valid;
+} totp_entry_t;
+
+typedef struct
+{
+    uint8_t key[TOTP_SECRET_MAX];
+    uint8_t len;                /* 0 = no secret */
+    bool dirty;                 /* Ring must be recomputed */
+} totp_user_t;
+
+static totp_user_t totp_users[TOTP_MAX_USERS];
+static uint32_t totp_ring[TOTP_MAX_USERS][TOTP_SPAN];
+static int64_t totp_ring_step = -1;                 /* Step at ring centre */
+static SemaphoreHandle_t totp_mutex;
+static esp_timer_handle_t totp_timer;
+
+static totp_entry_t totp_table[2][TOTP_TABLE_SIZE];
+static int64_t totp_table_step[2] = {-1, -1};
+static uint8_t totp_active;
+static int64_t totp_last_step[TOTP_MAX_USERS];     /* Replay guard */
+static portMUX_TYPE totp_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* HMAC-SHA1 with its state on the stack; mbedtls_md_hmac() would set up a
+ * heap context on every call, i.e. per user every step.  Keys are never
+ * longer than a block. */
+static void
+totp_hmac(const uint8_t *key, size_t len, const uint8_t *msg, size_t msg_len,
+          uint8_t mac[20])
+{
+    mbedtls_sha1_context sha;
+    uint8_t pad[64];
+
+    for (int i = 0; i < (int)sizeof pad; i++)
+    {
+        pad[i] = (i < (int)len ? key[i] : 0) ^ 0x36;
+    }
+    mbedtls_sha1_init(&sha);
+    mbedtls_sha1_starts(&sha);
+    mbedtls_sha1_update(&sha, pad, sizeof pad);
+    mbedtls_sha1_update(&sha, msg, msg_len);
+    mbedtls_sha1_finish(&sha, mac);
+
+    for (int i = 0; i < (int)sizeof pad; i++)
+    {
+        pad[i] ^= 0x36 ^ 0x5C;
+    }
+    mbedtls_sha1_starts(&sha);
+    mbedtls_sha1_update(&sha, pad, sizeof pad);
+    mbedtls_sha1_update(&sha, mac, 20);
+    mbedtls_sha1_finish(&sha, mac);
+    mbedtls_sha1_free(&sha);
+    memset(pad, 0, sizeof pad);
+}
+
+static uint32_t
+totp_code(const uint8_t *key, size_t len, int64_t step)
+{
+    static const uint32_t mod[] = {1000000, 10000000, 100000000};
+    uint8_t msg[8];
+    uint8_t mac[20];
+    uint32_t bin;
+    int off;
+
+    for (int i = 7; i >= 0; i--)
+    {
+        msg[i] = step & 0xFF;
+        step >>= 8;
+    }
+    totp_hmac(key, len, msg, sizeof msg, mac);
+
+    /* RFC 4226 dynamic truncation */
+    off = mac[19] & 0x0F;
+    bin = (uint32_t)(mac[off] & 0x7F) << 24 | (uint32_t)mac[off + 1] << 16 |
+          (uint32_t)mac[off + 2] << 8 | mac[off + 3];
+    return bin % mod[TOTP_DIGITS - 6];
+}
+
+static inline uint32_t
+totp_home(uint32_t code)
+{
+    return (code * 2654435769u) >> 16 & TOTP_TABLE_MASK;
+}
+
+/* Brings every ring up to step and fills the inactive table.  Mutex held. */
+static void
+totp_build(int64_t step)
+{
+    uint8_t spare = totp_active ^ 1;
+    totp_entry_t *table = totp_table[spare];
+    bool shift = totp_ring_step >= 0 && step == totp_ring_step + 1;
+
+    for (int u = 0; u < TOTP_MAX_USERS; u++)
+    {
+        totp_user_t *user = &totp_users[u];
+
+        if (user->len == 0)
+        {
+            continue;
+        }
+        if (shift && !user->dirty)
+        {
+            memmove(&totp_ring[u][0], &totp_ring[u][1],
+                    (TOTP_SPAN - 1) * sizeof totp_ring[u][0]);
+            totp_ring[u][TOTP_SPAN - 1] = totp_code(user->key, user->len, step + TOTP_WINDOW);
+        }
+        else
+        {
+            for (int i = 0; i < TOTP_SPAN; i++)
+            {
+                totp_ring[u][i] = totp_code(user->key, user->len, step - TOTP_WINDOW + i);
+            }
+        }
+        user->dirty = false;
+    }
+    totp_ring_step = step;
+
+    memset(table, 0, sizeof totp_table[spare]);
+    for (int u = 0; u < TOTP_MAX_USERS; u++)
+    {
+        if (totp_users[u].len == 0)
+        {
+            continue;
+        }
+        for (int i = 0; i < TOTP_SPAN; i++)
+        {
+            uint32_t b = totp_home(totp_ring[u][i]);
+
+            while (table[b].valid)
+            {
+                b = (b + 1) & TOTP_TABLE_MASK;
+            }
+            table[b].code = totp_ring[u][i];
+            table[b].user = u;
+            table[b].pos = i;
+            table[b].valid = true;
+        }
+    }
+
+    portENTER_CRITICAL(&totp_lock);
+    totp_table_step[spare] = step;
+    totp_active = spare;
+    portEXIT_CRITICAL(&totp_lock);
+}
+
+static void
+totp_refresh(void)
+{
+    int64_t now = lock_hal_wall_time();
+    int64_t step = now / TOTP_STEP_S;
+
+    if (now < TOTP_CLOCK_VALID)
+    {
+        /* Nothing to precompute until the clock is set, and a table
+         * built under an earlier setting must not be used either */
+        portENTER_CRITICAL(&totp_lock);
+        totp_table_step[totp_active] = -1;
+        portEXIT_CRITICAL(&totp_lock);
+        esp_timer_stop(totp_timer);
+        return;
+    }
+
+    xSemaphoreTake(totp_mutex, portMAX_DELAY);
+    totp_build(step);
+    xSemaphoreGive(totp_mutex);
+
+    esp_timer_stop(totp_timer);
+    esp_timer_start_once(totp_timer, ((step + 1) * TOTP_STEP_S - now) * 1000000LL);
+}
+
+static void
+totp_timer_cb(void *arg)
+{
+    totp_refresh();
+}
+
+static void
+totp_key_name(uint8_t user, char *key, size_t len)
+{
+    snprintf(key, len, "k%u", user);
+}
+
+esp_err_t
+totp_init(void)
+{
+    const esp_timer_create_args_t timer_args = {
+        .callback = totp_timer_cb,
+        .name = "totp",
+    };
+    int n = 0;
+
+    totp_mutex = xSemaphoreCreateMutex();
+    if (totp_mutex == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &totp_timer));
+
+    for (int u = 0; u < TOTP_MAX_USERS; u++)
+    {
+        char key[8];
+        size_t len = TOTP_SECRET_MAX;
+
+        totp_key_name(u, key, sizeof key);
+        if (lock_hal_nvs_get(TOTP_NVS_NS, key, totp_users[u].key, &len) == ESP_OK)
+        {
+            totp_users[u].len = len;
+            totp_users[u].dirty = true;
+            n++;
+        }
+        totp_last_step[u] = -1;
+    }
+    MODLOG_DFLT(INFO, "TOTP: %d users, %d-step window\n", n, TOTP_SPAN);
+
+    totp_refresh();
+    return ESP_OK;
+}
+
+esp_err_t
+totp_set_secret(uint8_t user, const uint8_t *secret, size_t len)
+{
+    char key[8];
+    esp_err_t ret;
+
+    if (user >= TOTP_MAX_USERS || len == 0 || len > TOTP_SECRET_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    totp_key_name(user, key, sizeof key);
+    ret = lock_hal_nvs_set(TOTP_NVS_NS, key, secret, len);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    xSemaphoreTake(totp_mutex, portMAX_DELAY);
+    memcpy(totp_users[user].key, secret, len);
+    totp_users[user].len = len;
+    totp_users[user].dirty = true;
+    xSemaphoreGive(totp_mutex);
+
+    totp_refresh();
+    return ESP_OK;
+}
+
+esp_err_t
+totp_remove(uint8_t user)
+{
+    char key[8];
+    esp_err_t ret;
+
+    if (user >= TOTP_MAX_USERS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    totp_key_name(user, key, sizeof key);
+    ret = lock_hal_nvs_erase(TOTP_NVS_NS, key);
+
+    xSemaphoreTake(totp_mutex, portMAX_DELAY);
+    memset(&totp_users[user], 0, sizeof totp_users[user]);
+    xSemaphoreGive(totp_mutex);
+
+    totp_refresh();
+    return ret;
+}
+
+void
+totp_clock_changed(void)
+{
+    xSemaphoreTake(totp_mutex, portMAX_DELAY);
+    totp_ring_step = -1;
+    xSemaphoreGive(totp_mutex);
+
+    totp_refresh();
+}
+
+esp_err_t
+totp_verify(const char *code, size_t len, uint8_t *user)
+{
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    uint32_t value = 0;
+
+    if (len != TOTP_DIGITS)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        if (code[i] < '0' || code[i] > '9')
+        {
+            return ESP_ERR_NOT_FOUND;
+        }
+        value = value * 10 + (code[i] - '0');
+    }
+
+    portENTER_CRITICAL(&totp_lock);
+    const totp_entry_t *table = totp_table[totp_active];
+    int64_t base = totp_table_step[totp_active] - TOTP_WINDOW;
+
+    if (totp_table_step[totp_active] >= 0)
+    {
+        for (uint32_t b = totp_home(value); table[b].valid; b = (b + 1) & TOTP_TABLE_MASK)
+        {
+            int64_t step = base + table[b].pos;
+
+            if (table[b].code == value && step > totp_last_step[table[b].user])
+            {
+                totp_last_step[table[b].user] = step;
+                *user = table[b].user;
+                ret = ESP_OK;
+                break;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&totp_lock);
+
+    return ret;
+}
@@ -0,0 +1,46 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef TOTP_H
+#define TOTP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TOTP_SECRET_MAX             32
+
+/**
+ * RFC 6238 time-based codes (HMAC-SHA1).  Codes are only accepted once the
+ * wall clock has been set; call totp_clock_changed() after setting it.
+ */
+esp_err_t totp_init(void);
+
+/* Stores a user's shared secret (raw bytes, not base32) in NVS. */
+esp_err_t totp_set_secret(uint8_t user, const uint8_t *secret, size_t len);
+esp_err_t totp_remove(uint8_t user);
+
+/* Recomputes the code window after the wall clock was set or stepped. */
+void totp_clock_changed(void);
+
+/**
+ * Checks a code against the precomputed window.  Each code is accepted at
+ * most once, and never one from a step older than the user's last
+ * accepted code.
+ *
+ * @return ESP_OK and the matching user in *user, or ESP_ERR_NOT_FOUND.
+ */
+esp_err_t totp_verify(const char *code, size_t len, uint8_t *user);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
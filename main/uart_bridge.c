@@ -0,0 +1,473 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "driver/uart.h"
+#include "host/ble_hs.h"
+#include "modlog/modlog.h"
+#include "lock_hal.h"
+#include "conn_ctx.h"
+#include "fanout.h"
+#include "lock_pm.h"
+#include "admin_console.h"
+#include "mem_acct.h"
+#include "uart_bridge.h"
+
+/*
+ * UART -> BLE streaming bridge.
+ *
+ * Bytes are read straight from the UART driver into a preallocated ring.
+ * Once enough data for a full notification is buffered, or the coalescing
+ * window expires, one chunk sized to the smallest ATT MTU among subscribers
+ * is handed to the fan-out engine, which sends it to every subscriber and
+ * retries per connection.  While the fan-out window is full or the msys
+ * pool is dry the ring keeps filling and, once full, RTS flow control holds
+ * off the sender.  Nothing on this path touches the heap.
+ */
+#define BRIDGE_RING_SIZE        CONFIG_LOCK_BRIDGE_RING_SIZE
+#define BRIDGE_RING_MASK        (BRIDGE_RING_SIZE - 1)
+#define BRIDGE_MAX_PAYLOAD      (CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU - 3)
+#define BRIDGE_BACKOFF_MIN_MS   5
+#define BRIDGE_BACKOFF_MAX_MS   160
+#define BRIDGE_TASK_STACK       4096
+#define BRIDGE_TASK_PRIO        8
+
+_Static_assert((BRIDGE_RING_SIZE & BRIDGE_RING_MASK) == 0,
+               "bridge ring size must be a power of two");
+
+static uint8_t bridge_ring[BRIDGE_RING_SIZE];
+static uint32_t bridge_head;
+static uint32_t bridge_tail;
+static TickType_t bridge_window_start;
+static TickType_t bridge_retry_at;          /* Next submit after mbuf exhaustion */
+static uint32_t bridge_backoff_ms;
+static TickType_t bridge_fanout_at;         /* Next fan-out retry */
+static bool bridge_fanout_pending;
+static bool bridge_held;                    /* Fan-out window is full */
+
+#if CONFIG_LOCK_PM
+static TickType_t bridge_rx_at;             /* Last byte received */
+static bool bridge_pm_held;
+#endif
+
+#if CONFIG_LOCK_CONSOLE
+static bool bridge_line_start = true;
+static bool bridge_in_console;              /* The current line is a command */
+static bool bridge_skip_lf;
+#endif
+
+static uart_bridge_stats_t bridge_stats;
+static QueueHandle_t bridge_uart_queue;
+
+static TickType_t
+bridge_ms_to_ticks(uint32_t ms)
+{
+    TickType_t ticks = pdMS_TO_TICKS(ms);
+    return ticks ? ticks : 1;
+}
+
+static inline uint32_t
+bridge_ring_used(void)
+{
+    return bridge_head - bridge_tail;
+}
+
+#if CONFIG_LOCK_CONSOLE
+/*
+ * Takes admin console lines out of n bytes just read into the ring,
+ * compacting the rest in place, and returns how many are left to bridge.
+ * A line belongs to the console if its first byte is ADMIN_CONSOLE_PREFIX.
+ * Plain bridged data is scanned once and not moved.
+ */
+static int
+bridge_demux(uint8_t *data, int n)
+{
+    int keep = 0;
+    int i = 0;
+
+    while (i < n)
+    {
+        int end = i;
+        bool eol;
+
+        if (bridge_skip_lf)
+        {
+            /* The '\n' of a console line's "\r\n" */
+            bridge_skip_lf = false;
+            if (data[i] == '\n')
+            {
+                i++;
+                continue;
+            }
+        }
+        if (bridge_line_start)
+        {
+            bridge_in_console = data[i] == ADMIN_CONSOLE_PREFIX;
+        }
+        while (end < n && data[end] != '\n' && data[end] != '\r')
+        {
+            end++;
+        }
+        eol = end < n;
+        if (eol)
+        {
+            end++;
+        }
+        if (bridge_in_console)
+        {
+            admin_console_feed(&data[i], end - i);
+            bridge_skip_lf = eol && data[end - 1] == '\r';
+        }
+        else
+        {
+            if (keep != i)
+            {
+                memmove(&data[keep], &data[i], end - i);
+            }
+            keep += end - i;
+        }
+        bridge_line_start = eol;
+        i = end;
+    }
+    return keep;
+}
+#endif
+
+/* Moves as much buffered UART data into the ring as fits */
+static void
+bridge_fill(void)
+{
+    /* Two passes cover a wrap of the ring */
+    for (int pass = 0; pass < 2;)
+    {
+        uint32_t used = bridge_ring_used();
+        uint32_t off = bridge_head & BRIDGE_RING_MASK;
+        uint32_t room = BRIDGE_RING_SIZE - used;
+        size_t avail = lock_hal_uart_buffered();
+        int n;
+
+        if (room > BRIDGE_RING_SIZE - off)
+        {
+            room = BRIDGE_RING_SIZE - off;
+        }
+        if (avail == 0 || room == 0)
+        {
+            return;
+        }
+        n = lock_hal_uart_read(&bridge_ring[off], avail < room ? avail : room, 0);
+        if (n <= 0)
+        {
+            return;
+        }
+        bridge_stats.rx_bytes += n;
+#if CONFIG_LOCK_PM
+        bridge_rx_at = xTaskGetTickCount();
+#endif
+#if CONFIG_LOCK_CONSOLE
+        n = bridge_demux(&bridge_ring[off], n);
+        if (n == 0)
+        {
+            /* All console; the ring has not moved */
+            continue;
+        }
+#endif
+        if (used == 0)
+        {
+            bridge_window_start = xTaskGetTickCount();
+        }
+        bridge_head += n;
+        pass++;
+    }
+}
+
+/* Largest payload every current subscriber can take, or 0 if none */
+static uint16_t
+bridge_payload_size(void)
+{
+    uint16_t handles[CONN_CTX_MAX];
+    int n = conn_ctx_subscribers(handles, CONN_CTX_MAX);
+    uint16_t payload = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        conn_ctx_t *ctx = conn_ctx_find(handles[i]);
+        if (ctx != NULL && (payload == 0 || ctx->mtu - 3 < payload))
+        {
+            payload = ctx->mtu - 3;
+        }
+    }
+
+    return payload > BRIDGE_MAX_PAYLOAD ? BRIDGE_MAX_PAYLOAD : payload;
+}
+
+/* Runs the fan-out and remembers when it next needs attention */
+static void
+bridge_fanout_pump(void)
+{
+    TickType_t wait = fanout_pump();
+
+    bridge_fanout_pending = wait != portMAX_DELAY;
+    bridge_fanout_at = xTaskGetTickCount() + wait;
+}
+
+/* Hands one chunk from the ring to the fan-out.  Returns false if it has
+ * to wait: the window is full or the msys pool is empty. */
+static bool
+bridge_submit(uint16_t len)
+{
+    uint32_t off = bridge_tail & BRIDGE_RING_MASK;
+    uint32_t first = BRIDGE_RING_SIZE - off;
+    esp_err_t ret;
+
+    if (first > len)
+    {
+        first = len;
+    }
+    /* Copied straight from the ring into the one source mbuf */
+    ret = fanout_submit(&bridge_ring[off], first, bridge_ring, len - first);
+    if (ret == ESP_ERR_NO_MEM)
+    {
+        bridge_backoff_ms = bridge_backoff_ms ?
+                            bridge_backoff_ms * 2 : BRIDGE_BACKOFF_MIN_MS;
+        if (bridge_backoff_ms > BRIDGE_BACKOFF_MAX_MS)
+        {
+            bridge_backoff_ms = BRIDGE_BACKOFF_MAX_MS;
+        }
+        bridge_retry_at = xTaskGetTickCount() + bridge_ms_to_ticks(bridge_backoff_ms);
+    }
+    if (ret != ESP_OK)
+    {
+        return false;
+    }
+    bridge_tail += len;
+    bridge_backoff_ms = 0;
+    return true;
+}
+
+static void
+bridge_pump(void)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    bridge_fanout_pump();
+    if (bridge_backoff_ms != 0 && (int32_t)(now - bridge_retry_at) < 0)
+    {
+        return;
+    }
+
+    for (;;)
+    {
+        uint32_t used = bridge_ring_used();
+        uint16_t payload;
+
+        if (used == 0)
+        {
+            return;
+        }
+        payload = bridge_payload_size();
+        if (payload == 0)
+        {
+            /* Nobody subscribed; nothing to bridge to */
+            bridge_tail = bridge_head;
+            return;
+        }
+        if (used < payload &&
+            now - bridge_window_start < bridge_ms_to_ticks(CONFIG_LOCK_BRIDGE_COALESCE_MS))
+        {
+            /* Wait for the burst to fill a whole notification */
+            return;
+        }
+        bridge_held = !fanout_has_room();
+        if (bridge_held || !bridge_submit(used < payload ? used : payload))
+        {
+            /* A slow subscriber or the msys pool holds us up; the ring
+             * keeps filling and RTS stops the sender when it is full */
+            return;
+        }
+        bridge_fill();
+        bridge_fanout_pump();
+    }
+}
+
+#if CONFIG_LOCK_PM
+/*
+ * Every subscriber holds the UART path for as long as it is subscribed:
+ * the bytes that wake the chip from light sleep are lost, and a phone
+ * that is listening expects all of them.  Host task.
+ */
+static void
+bridge_pm_subscribe(conn_ctx_t *ctx)
+{
+    if (ctx->subscribed != ctx->bridge_pm)
+    {
+        ctx->bridge_pm = ctx->subscribed;
+        if (ctx->bridge_pm)
+        {
+            lock_pm_acquire(LOCK_PM_UART);
+        }
+        else
+        {
+            lock_pm_release(LOCK_PM_UART);
+        }
+    }
+}
+
+static void
+bridge_pm_disconnect(conn_ctx_t *ctx, int reason)
+{
+    if (ctx->bridge_pm)
+    {
+        ctx->bridge_pm = false;
+        lock_pm_release(LOCK_PM_UART);
+    }
+}
+
+static const conn_ctx_hooks_t bridge_pm_hooks = {
+    .on_subscribe = bridge_pm_subscribe,
+    .on_disconnect = bridge_pm_disconnect,
+};
+
+/* With nobody subscribed, holds the clocks while there is work, and for a
+ * while after the last byte so the rest of a console line is not lost */
+static void
+bridge_pm_update(void)
+{
+    bool busy = bridge_ring_used() != 0 || bridge_fanout_pending || bridge_backoff_ms != 0 ||
+                xTaskGetTickCount() - bridge_rx_at < bridge_ms_to_ticks(CONFIG_LOCK_PM_UART_IDLE_MS);
+
+    if (busy != bridge_pm_held)
+    {
+        bridge_pm_held = busy;
+        if (busy)
+        {
+            lock_pm_acquire(LOCK_PM_UART);
+        }
+        else
+        {
+            lock_pm_release(LOCK_PM_UART);
+        }
+    }
+}
+#endif
+
+static TickType_t
+bridge_next_wait(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    TickType_t deadline;
+    bool due = false;
+
+    if (bridge_backoff_ms != 0)
+    {
+        deadline = bridge_retry_at;
+        due = true;
+    }
+    else if (bridge_ring_used() != 0 && !bridge_held)
+    {
+        /* While held, only a fan-out retry can free the window */
+        deadline = bridge_window_start + bridge_ms_to_ticks(CONFIG_LOCK_BRIDGE_COALESCE_MS);
+        due = true;
+    }
+    if (bridge_fanout_pending && (!due || (int32_t)(bridge_fanout_at - deadline) < 0))
+    {
+        deadline = bridge_fanout_at;
+        due = true;
+    }
+#if CONFIG_LOCK_PM
+    if (bridge_pm_held && !due)
+    {
+        /* Wake once more to let go of the PM lock */
+        deadline = bridge_rx_at + bridge_ms_to_ticks(CONFIG_LOCK_PM_UART_IDLE_MS);
+        due = true;
+    }
+#endif
+    if (!due)
+    {
+        return portMAX_DELAY;
+    }
+    return (int32_t)(deadline - now) > 0 ? deadline - now : 1;
+}
+
+static void
+ble_server_uart_task(void *pvParameters)
+{
+    MODLOG_DFLT(INFO, "BLE server UART_task started\n");
+    uart_event_t event;
+
+    mem_acct_track_task(NULL, BRIDGE_TASK_STACK);
+    for (;;)
+    {
+        // Waiting for UART event, or for a coalescing/retry deadline.
+        if (xQueueReceive(bridge_uart_queue, (void *)&event, bridge_next_wait()))
+        {
+            switch (event.type)
+            {
+            case UART_PATTERN_DET:
+                /* A line ended; bridge_demux() finds where as it reads,
+                 * so the recorded positions are only let go of */
+                lock_hal_uart_pattern_flush();
+                break;
+            case UART_FIFO_OVF:
+            case UART_BUFFER_FULL:
+                MODLOG_DFLT(WARN, "UART overflow; flushing input\n");
+                bridge_stats.rx_overflows++;
+                lock_hal_uart_flush();
+                xQueueReset(bridge_uart_queue);
+                break;
+            default:
+                /* UART_DATA and friends only signal that data may be
+                 * waiting; bridge_fill() reads what is buffered. */
+                break;
+            }
+        }
+        bridge_fill();
+        bridge_pump();
+#if CONFIG_LOCK_PM
+        bridge_pm_update();
+#endif
+    }
+    vTaskDelete(NULL);
+}
+
+esp_err_t
+uart_bridge_init(const uint16_t *attr_handle)
+{
+    esp_err_t ret;
+
+    ret = fanout_init(attr_handle);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+#if CONFIG_LOCK_PM
+    ret = conn_ctx_register_hooks(&bridge_pm_hooks);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+#endif
+
+    ret = lock_hal_uart_init(&bridge_uart_queue);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    if (xTaskCreate(ble_server_uart_task, "uTask", BRIDGE_TASK_STACK, NULL,
+                    BRIDGE_TASK_PRIO, NULL) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void
+uart_bridge_get_stats(uart_bridge_stats_t *out)
+{
+    *out = bridge_stats;
+}
@@ -0,0 +1,39 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#ifndef UART_BRIDGE_H
+#define UART_BRIDGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+    uint32_t rx_bytes;          /* Bytes taken from the UART */
+    uint32_t rx_overflows;      /* UART FIFO/buffer overflow events */
+} uart_bridge_stats_t;
+
+/**
+ * Installs the UART driver and starts the bridge task.  Data is broadcast
+ * through the fan-out engine on the characteristic whose value handle is
+ * stored at *attr_handle; the handle is read at send time, after GATT
+ * registration has filled it in.  Per-connection counters are available
+ * from fanout_get_conn_stats().
+ */
+esp_err_t uart_bridge_init(const uint16_t *attr_handle);
+
+void uart_bridge_get_stats(uart_bridge_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
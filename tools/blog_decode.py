@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+# SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+#
+# SPDX-License-Identifier: Unlicense OR CC0-1.0
+"""
+Decodes binary log records captured from the console.
+
+Build with CONFIG_LOCK_BLOG_RAW=y, capture the monitor output, then run
+
+    tools/blog_decode.py capture.txt
+
+Lines of the form "#B <hex>" are decoded using the event list in
+main/blog_events.h; every other line is passed through unchanged.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+RECORD = struct.Struct('<IHBB6I')
+EVENT_RE = re.compile(r'^BLOG_EVENT\(\s*(\w+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)', re.M)
+
+
+def load_events(path):
+    with open(path, encoding='utf-8') as f:
+        return [(name, fmt.encode().decode('unicode_escape'))
+                for name, fmt in EVENT_RE.findall(f.read())]
+
+
+def c_format(fmt, args):
+    # Formats only use 32-bit conversions; %d needs the sign restored
+    it = iter(args)
+
+    def conv(m):
+        spec = m.group(0)
+        if spec == '%%':
+            return '%'
+        value = next(it)
+        if spec[-1] in 'di' and value & 0x80000000:
+            value -= 1 << 32
+        return ('%' + spec[1:-1] + ('d' if spec[-1] in 'di' else spec[-1])) % value
+
+    return re.sub(r'%%|%[-+ #0]*\d*[diuxX]', conv, fmt)
+
+
+def decode(line, events):
+    raw = bytes.fromhex(line[3:].strip())
+    ts, ev, nargs, core, *args = RECORD.unpack(raw[:RECORD.size])
+    if ev >= len(events):
+        return '[%u.%06u] <unknown event %d> %s' % (ts // 1000000, ts % 1000000, ev, args[:nargs])
+    name, fmt = events[ev]
+    return '[%u.%06u] cpu%d %s: %s' % (ts // 1000000, ts % 1000000, core, name,
+                                      c_format(fmt, args))
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument('capture', nargs='?', help='captured console output (default: stdin)')
+    parser.add_argument('--events', default=os.path.join(here, '..', 'main', 'blog_events.h'),
+                        help='path to blog_events.h')
+    args = parser.parse_args()
+
+    events = load_events(args.events)
+    src = open(args.capture, encoding='utf-8', errors='replace') if args.capture else sys.stdin
+    with src:
+        for line in src:
+            line = line.rstrip('\n')
+            if line.startswith('#B '):
+                try:
+                    line = decode(line, events)
+                except (ValueError, struct.error):
+                    pass
+            print(line)
+
+
+if __name__ == '__main__':
+    main()
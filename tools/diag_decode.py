@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+# SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+#
+# SPDX-License-Identifier: Unlicense OR CC0-1.0
+"""
+Prints a latency diagnostics dump (see main/lock_diag.h).
+
+The dump is what a read of the diagnostics characteristic (0xABF3) returns,
+or the payload of the binary frame the lock writes to the bridge UART after
+the line "!diag".  Pass it as a hex string or a file:
+
+    tools/diag_decode.py 01060f06...
+    tools/diag_decode.py --file dump.bin
+
+A leading 0xA5 frame header is skipped.
+"""
+
+import argparse
+import struct
+import sys
+
+HISTS = ['gap_event', 'gatt_write', 'verify', 'notify', 'unlock', 'servo']
+COUNTERS = ['gap_events', 'writes', 'notify_submit', 'notify_tx',
+            'notify_tx_err', 'notify_unmatched', 'unlock_late']
+
+
+def name(names, i):
+    return names[i] if i < len(names) else '#%d' % i
+
+
+def bucket_label(b, nbuckets):
+    if b == 0:
+        return '<2us'
+    if b == nbuckets - 1:
+        return '>=%dus' % (1 << b)
+    return '%d-%dus' % (1 << b, (2 << b) - 1)
+
+
+def percentile(buckets, count, q):
+    # Upper bound of the bucket holding the q-th sample
+    want, seen = count * q, 0
+    for b, n in enumerate(buckets):
+        seen += n
+        if seen >= want:
+            return 2 << b
+    return 2 << (len(buckets) - 1)
+
+
+def decode(raw):
+    if raw[0] == 0xA5:
+        raw = raw[3:]
+    version, nhist, nbuckets, ncnt, probe = struct.unpack_from('<BBBBH', raw)
+    if version != 1:
+        sys.exit('unsupported dump version %d' % version)
+    off = 8
+    counters = struct.unpack_from('<%dI' % ncnt, raw, off)
+    off += 4 * ncnt
+
+    print('probe cost: %d cycles' % probe)
+    for i, value in enumerate(counters):
+        print('%-18s %u' % (name(COUNTERS, i), value))
+
+    for h in range(nhist):
+        count, max_us = struct.unpack_from('<II', raw, off)
+        buckets = struct.unpack_from('<%dH' % nbuckets, raw, off + 8)
+        off += 8 + 2 * nbuckets
+        print('\n%s: %u samples, max %uus' % (name(HISTS, h), count, max_us))
+        if count == 0:
+            continue
+        print('  p50 <%dus  p99 <%dus' % (percentile(buckets, count, 0.5),
+                                         percentile(buckets, count, 0.99)))
+        for b, n in enumerate(buckets):
+            if n:
+                print('  %-14s %u%s' % (bucket_label(b, nbuckets), n,
+                                        '+' if n == 0xFFFF else ''))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument('hex', nargs='?', help='dump as a hex string')
+    parser.add_argument('--file', help='binary file holding the dump')
+    args = parser.parse_args()
+
+    if args.file:
+        with open(args.file, 'rb') as f:
+            raw = f.read()
+    elif args.hex:
+        raw = bytes.fromhex(args.hex)
+    else:
+        parser.error('give a hex string or --file')
+    decode(raw)
+
+
+if __name__ == '__main__':
+    main()